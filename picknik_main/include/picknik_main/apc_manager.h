@@ -284,6 +284,19 @@ public:
    */
   bool liftFromGoalBin(JointModelGroup* arm_jmg);
 
+  /**
+   * \brief Generate, rank and filter the grasps of a work order's product
+   * \return false if no grasp is valid
+   */
+  bool chooseGrasp(const WorkOrder& work_order, JointModelGroup* arm_jmg,
+                   std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates, bool verbose);
+
+  /**
+   * \brief Add the outcome of the grasp used for a work order to the grasp statistics
+   */
+  void recordGraspOutcome(const WorkOrder& work_order,
+                          moveit_grasps::GraspCandidatePtr grasp_candidate, bool success);
+
   /**
    * \brief Move both arms to their start location
    * \param optionally specify which arm to use
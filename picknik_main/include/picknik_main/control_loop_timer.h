@@ -0,0 +1,91 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Fixed period timing for control loops that run on their own thread
+*/
+
+#ifndef PICKNIK_MAIN__CONTROL_LOOP_TIMER
+#define PICKNIK_MAIN__CONTROL_LOOP_TIMER
+
+// C++
+#include <vector>
+#include <ostream>
+#include <cstddef>
+#include <time.h>
+
+namespace picknik_main
+{
+/** \brief Timing of a finished control loop */
+struct ControlLoopStats
+{
+  ControlLoopStats();
+
+  void reset();
+
+  /** \brief Fill in the mean and max from the recorded jitter */
+  void summarize();
+
+  /** \brief One line summary, for use after the loop is done */
+  void print(std::ostream& out) const;
+
+  double period_;                // seconds
+  std::size_t steps_;            // number of completed steps
+  std::size_t overruns_;         // steps whose work took longer than the period
+  std::vector<double> jitter_;   // seconds each step woke after its deadline
+  double mean_jitter_;
+  double max_jitter_;
+  bool realtime_priority_;       // whether the loop thread got a real-time scheduler
+};
+
+/**
+ * \brief Sleeps to absolute deadlines on the monotonic clock so error does not accumulate like it
+ *        does with relative sleeps. Records jitter and overruns without allocating or logging,
+ *        so it is safe to use on a real-time thread
+ */
+class ControlLoopTimer
+{
+public:
+  /**
+   * \brief Constructor
+   * \param period - seconds between steps
+   * \param expected_steps - number of steps to reserve memory for, recording stops after this
+   */
+  ControlLoopTimer(double period, std::size_t expected_steps);
+
+  /**
+   * \brief Try to run the calling thread with the SCHED_FIFO scheduler
+   * \param priority - 1 to 99, or 0 to leave the thread alone
+   * \return true if the thread is now real-time. Usually fails without root or rtprio limits
+   */
+  bool setRealtimePriority(int priority);
+
+  /** \brief Set the first deadline one period from now */
+  void start();
+
+  /**
+   * \brief Sleep until the next deadline. If the deadline already passed the step is counted as an
+   *        overrun and missed deadlines are skipped instead of being run back to back
+   * \return false on overrun
+   */
+  bool waitForNextStep();
+
+  ControlLoopStats& getStats() { return stats_; }
+private:
+  void advanceDeadline();
+
+  long period_ns_;
+  timespec deadline_;
+  ControlLoopStats stats_;
+};
+
+}  // end namespace
+
+#endif
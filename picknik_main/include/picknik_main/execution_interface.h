@@ -100,6 +100,12 @@ public:
    */
   bool waitForExecution();
 
+  /**
+   * \brief Halt the trajectory currently being executed
+   * \return true on success
+   */
+  bool stopExecution();
+
   /**
    * \brief Ensure that execution manager has been loaded
    * \return true on success
@@ -0,0 +1,93 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Split experience database training across several processes on one machine
+*/
+
+#ifndef PICKNIK_MAIN__EXPERIENCE_TRAINING
+#define PICKNIK_MAIN__EXPERIENCE_TRAINING
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+// C++
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/** \brief Which training queries one worker is responsible for */
+struct TrainingPartition
+{
+  TrainingPartition() : worker_id_(-1), num_workers_(1) {}
+
+  TrainingPartition(int worker_id, int num_workers)
+    : worker_id_(worker_id), num_workers_(num_workers)
+  {
+  }
+
+  /** \brief False when training in a single process */
+  bool isWorker() const { return worker_id_ >= 0; }
+
+  /** \brief Queries are dealt out round robin so every worker gets a spread of the shelf */
+  bool owns(std::size_t query) const
+  {
+    return !isWorker() || int(query % num_workers_) == worker_id_;
+  }
+
+  int worker_id_;
+  int num_workers_;
+};
+
+/** \brief Database file a worker saves its partial experience graph to, next to the main one
+    e.g. thunder.db becomes thunder_worker2.db */
+std::string getWorkerDatabasePath(const std::string& database_path, int worker_id);
+
+/**
+ * \brief Starts copies of this executable as training workers and waits for them. Each worker
+ *        runs in its own ROS namespace with a copy of this node's parameters, so that planners and
+ *        databases are not shared between processes
+ */
+class ExperienceTrainingCoordinator
+{
+public:
+  /**
+   * \brief Constructor
+   * \param nh - private node handle whose parameters are copied to the workers
+   */
+  ExperienceTrainingCoordinator(ros::NodeHandle nh);
+
+  /**
+   * \brief Run num_workers workers to completion
+   * \param worker_args - command line for every worker, --worker_id and --num_workers are added
+   * \return false if a worker could not be started or did not exit cleanly
+   */
+  bool runWorkers(int num_workers, const std::vector<std::string>& worker_args);
+
+private:
+  /** \brief Copy this node's private parameters into the worker's private namespace */
+  bool copyParameters(const std::string& worker_namespace);
+
+  // A shared node handle
+  ros::NodeHandle nh_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ExperienceTrainingCoordinator> ExperienceTrainingCoordinatorPtr;
+typedef boost::shared_ptr<const ExperienceTrainingCoordinator>
+    ExperienceTrainingCoordinatorConstPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,124 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Persistent record of grasp attempts used to try the grasps that worked before first
+*/
+
+#ifndef PICKNIK_MAIN__GRASP_STATISTICS
+#define PICKNIK_MAIN__GRASP_STATISTICS
+
+// ROS
+#include <ros/ros.h>
+
+// Grasping
+#include <moveit_grasps/grasp_filter.h>
+
+// Eigen
+#include <Eigen/Geometry>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// C++
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/** \brief One grasp that was executed and whether the product made it out of the bin */
+struct GraspAttempt
+{
+  std::string product_;
+  std::string bin_;
+  Eigen::Affine3d product_to_grasp_;
+  bool success_;
+};
+
+/**
+ * \brief Attempts are appended to a text file, one per line, and replayed on load. Attempts are
+ *        grouped by product, approach side and grasp position on a coarse grid in the product
+ *        frame, so a grasp is scored by how similar grasps went. A group's score is its success
+ *        rate with one prior success and one prior failure, so untried groups score 0.5 and rank
+ *        between what is known to work and what is known to fail
+ */
+class GraspStatistics
+{
+public:
+  /**
+   * \brief Constructor
+   * \param position_resolution - meters, size of the grid grasps are grouped on
+   * \param min_bin_attempts - attempts in a group before its bin specific rate is used over the
+   *        rate of the product in every bin
+   */
+  GraspStatistics(double position_resolution = 0.02, std::size_t min_bin_attempts = 3);
+
+  /**
+   * \brief Replay the attempts recorded in a file and append new attempts to it
+   * \return false if the file can not be opened, previous attempts are kept if it is missing
+   */
+  bool load(const std::string& file_path);
+
+  /** \brief Count an attempt and append it to the file */
+  void record(const GraspAttempt& attempt);
+
+  /** \brief Estimated probability a grasp at product_to_grasp succeeds */
+  double getSuccessScore(const std::string& product, const std::string& bin,
+                         const Eigen::Affine3d& product_to_grasp) const;
+
+  /**
+   * \brief Order candidates by getSuccessScore(), best first, keeping the generator's order
+   *        between equal scores
+   * \param world_to_product - pose of the product the candidates are for
+   */
+  void rankGrasps(const std::string& product, const std::string& bin,
+                  const Eigen::Affine3d& world_to_product,
+                  std::vector<moveit_grasps::GraspCandidatePtr>& candidates) const;
+
+  /** \brief The product face the end effector approaches from, e.g. "-x" for the front */
+  static std::string getApproachType(const Eigen::Affine3d& product_to_grasp);
+
+  std::size_t getAttemptCount() const { return attempts_; }
+
+private:
+  struct Counts
+  {
+    Counts() : attempts_(0), successes_(0) {}
+    std::size_t attempts_;
+    std::size_t successes_;
+  };
+  typedef std::map<std::string, Counts> CountsMap;
+
+  /** \brief Group of a grasp, bin is left out for the product wide group */
+  std::string getKey(const std::string& product, const std::string& bin,
+                     const Eigen::Affine3d& product_to_grasp) const;
+
+  void count(const GraspAttempt& attempt);
+
+  double position_resolution_;
+  std::size_t min_bin_attempts_;
+
+  // Guards the counts and file, recording may happen while another thread ranks
+  mutable boost::mutex mutex_;
+  CountsMap counts_;
+  std::size_t attempts_;
+  std::ofstream file_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<GraspStatistics> GraspStatisticsPtr;
+typedef boost::shared_ptr<const GraspStatistics> GraspStatisticsConstPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,137 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Record tactile samples, tool poses and insertion decisions to a compact binary log
+*/
+
+#ifndef PICKNIK_MAIN__INSERTION_RECORDER
+#define PICKNIK_MAIN__INSERTION_RECORDER
+
+// PickNik
+#include <picknik_main/tactile_filter.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+// Eigen
+#include <Eigen/Geometry>
+
+// C++
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+static const char INSERTION_LOG_MAGIC[8] = {'P', 'K', 'I', 'N', 'S', 'L', 'O', 'G'};
+static const uint32_t INSERTION_LOG_VERSION = 1;
+static const std::size_t INSERTION_RECORD_MAX_VALUES = 20;
+
+enum InsertionRecordType
+{
+  RECORD_TACTILE = 1,  // raw data then filtered force, torque, force rate, torque rate, theta,
+                       // contact, slip
+  RECORD_COMMANDED_POSE,  // x, y, z, qx, qy, qz, qw of the tool in world frame
+  RECORD_ACTUAL_POSE,     // same layout as commanded
+  RECORD_DECISION         // corrected, steps left holding, slipping
+};
+
+/**
+ * \brief One entry in the log. On disk only the first count_ values are written, after a 16 byte
+ *        header of type_, count_, step_ and stamp_
+ */
+struct InsertionRecord
+{
+  uint16_t type_;
+  uint16_t count_;
+  uint32_t step_;  // insertion loop step, 0 when not from the loop
+  double stamp_;   // seconds
+  double values_[INSERTION_RECORD_MAX_VALUES];
+};
+
+/**
+ * \brief Producers on any thread hand records to a background writer that owns the file, so the
+ *        sensor callback and insertion loop never touch the disk. Recording is off until start()
+ */
+class InsertionRecorder
+{
+public:
+  // Returns the current tool pose in world frame, false if unavailable
+  typedef std::function<bool(Eigen::Affine3d&)> PoseSource;
+
+  InsertionRecorder();
+
+  ~InsertionRecorder();
+
+  /**
+   * \brief Open a new log and begin accepting records
+   * \return false if the file could not be opened
+   */
+  bool start(const std::string& file_path);
+
+  /** \brief Write everything still queued and close the log */
+  void stop();
+
+  bool isRecording() const { return recording_; }
+
+  /** \brief Sample the actual tool pose from the writer thread while recording
+      \param rate - hz */
+  void setActualPoseSource(PoseSource source, double rate);
+
+  void recordTactile(const TactileSample& sample);
+
+  void recordCommandedPose(std::size_t step, const Eigen::Affine3d& pose);
+
+  void recordDecision(std::size_t step, bool corrected, std::size_t hold_steps, bool slipping);
+
+  /** \brief Check the magic and version at the start of a log */
+  static bool readHeader(std::istream& in);
+
+  /** \brief Read the next record of a log, false at the end */
+  static bool readRecord(std::istream& in, InsertionRecord& record);
+
+private:
+  /** \brief Queue a record, drops it if the writer has fallen too far behind */
+  void push(const InsertionRecord& record);
+
+  void writerThread();
+
+  void write(const InsertionRecord& record);
+
+  std::atomic<bool> recording_;
+
+  // Records waiting for the writer, swapped out in one go so producers hold the lock briefly
+  boost::mutex queue_mutex_;
+  boost::condition_variable queue_condition_;
+  std::vector<InsertionRecord> queue_;
+  bool stop_requested_;
+  std::size_t dropped_;
+
+  // Only used by the writer thread
+  boost::thread writer_thread_;
+  std::ofstream file_;
+  std::size_t written_;
+
+  PoseSource actual_pose_source_;
+  double actual_pose_period_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<InsertionRecorder> InsertionRecorderPtr;
+typedef boost::shared_ptr<const InsertionRecorder> InsertionRecorderConstPtr;
+
+}  // end namespace
+
+#endif
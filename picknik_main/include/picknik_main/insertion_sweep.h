@@ -0,0 +1,128 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Search over insertion parameters by running trials back to back and scoring them
+*/
+
+#ifndef PICKNIK_MAIN__INSERTION_SWEEP
+#define PICKNIK_MAIN__INSERTION_SWEEP
+
+// ROS
+#include <ros/ros.h>
+
+// PickNik
+#include <picknik_main/manipulation_data.h>
+
+// C++
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/** \brief Outcome of one insertion attempt */
+struct InsertionTrialResult
+{
+  InsertionTrialResult()
+    : success_(false), time_to_insert_(0.0), depth_(0.0), peak_force_(0.0), corrections_(0)
+  {
+  }
+
+  bool success_;
+  double time_to_insert_;  // seconds from first contact until the actual tool pose seated
+  double depth_;           // meters the actual tool pose moved along the insertion axis
+  double peak_force_;      // largest filtered sheer force
+  std::size_t corrections_;
+};
+
+/** \brief Score of one configuration over all of its repeats */
+struct InsertionSweepScore
+{
+  std::size_t config_id_;
+  std::vector<double> values_;  // in the order of the swept parameters
+  std::size_t successes_;
+  std::size_t trials_;
+  double mean_time_;  // of the successful trials only
+
+  double getSuccessRate() const { return trials_ ? successes_ / double(trials_) : 0.0; }
+
+  /** \brief Higher success rate first, then faster insertion */
+  bool operator<(const InsertionSweepScore& other) const;
+};
+
+/**
+ * \brief Sets the swept keys directly on the shared ManipulationData before each trial, so the
+ *        insertion code runs unchanged, and restores the original values when done.
+ *        Settings are read from the insertion_sweep namespace, see config/insertion_sweep.yaml
+ */
+class InsertionSweep
+{
+public:
+  // Run one attempt with the current config, false to abort the sweep
+  typedef std::function<bool(InsertionTrialResult&)> TrialFunction;
+
+  InsertionSweep(ManipulationDataPtr config, ros::NodeHandle nh);
+
+  /**
+   * \brief Read the search settings and the values to try
+   * \return false if the settings are missing or name an unknown parameter
+   */
+  bool load();
+
+  /**
+   * \brief Run every configuration, then write <output_directory>/insertion_sweep_<time>.csv with
+   *        one row per trial and <output_directory>/insertion_sweep_<time>_best.yaml
+   * \return false if aborted or nothing succeeded
+   */
+  bool run(TrialFunction trial);
+
+  /** \brief Seconds to wait between trials for the part and sensor to settle */
+  double getResetPause() const { return reset_pause_; }
+
+private:
+  /** \brief Insertion keys of ManipulationData that may be swept */
+  void bindParameters();
+
+  /** \brief Every combination of the grid values, or trials uniform samples of the ranges */
+  void generateConfigurations(std::vector<std::vector<double> >& configurations) const;
+
+  void applyConfiguration(const std::vector<double>& values);
+
+  bool writeBestConfig(const std::string& file_path, const InsertionSweepScore& best) const;
+
+  // A shared node handle
+  ros::NodeHandle nh_;
+
+  ManipulationDataPtr config_;
+
+  // Search settings
+  bool random_search_;
+  int random_trials_;
+  int seed_;  // of the random search
+  int repeats_;
+  double reset_pause_;
+  std::string output_directory_;
+
+  // Swept keys and, per key, the grid values or the [min, max] range
+  std::vector<std::string> names_;
+  std::vector<std::vector<double> > values_;
+
+  std::map<std::string, double*> bound_parameters_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<InsertionSweep> InsertionSweepPtr;
+typedef boost::shared_ptr<const InsertionSweep> InsertionSweepConstPtr;
+
+}  // end namespace
+
+#endif
@@ -44,6 +44,7 @@
 
 // MoveIt
 #include <picknik_main/manipulation_pipeline.h>
+#include <picknik_main/experience_training.h>
 
 namespace picknik_main
 {
@@ -60,6 +61,17 @@ struct BinExperienceData
 
 typedef std::map<const std::string, BinExperienceData> BinExperienceDataMap;
 
+// Grasps of one bin, filtered independently of the other bins
+struct BinGraspJob
+{
+  std::string bin_name_;
+  std::vector<moveit_msgs::Grasp> possible_grasps_;
+  std::vector<moveit_grasps::GraspSolution> filtered_grasps_;
+  std::size_t valid_ik_grasps_;
+  double ik_time_;         // seconds
+  double collision_time_;  // seconds
+};
+
 class LearningPipeline : private ManipulationPipeline
 {
 public:
@@ -90,7 +102,8 @@ public:
   bool visualizePose(Eigen::Affine3d grasp_pose, const moveit::core::JointModelGroup *arm_jmg);
 
   /**
-   * \brief Determine which grasps have IK solutions
+   * \brief Determine which grasps have IK solutions. Bins are filtered in parallel, one worker per
+   *        core
    * \return true on success
    */
   bool analyzeGrasps(const moveit::core::JointModelGroup *arm_jmg);
@@ -101,6 +114,11 @@ public:
    */
   bool planToGrasps(const moveit::core::JointModelGroup *arm_jmg);
 
+  /**
+   * \brief Only plan to this worker's share of the grasps, see ExperienceTrainingCoordinator
+   */
+  void setTrainingPartition(const TrainingPartition &partition) { partition_ = partition; }
+
   /**
    * \brief Show all grasps in Rviz
    * \return true on success
@@ -114,11 +132,41 @@ public:
   bool testSingleGraspIK();
 
 private:
+  /**
+   * \brief Convert the training poses of one bin to grasp msgs
+   */
+  void createGrasps(const BinExperienceData &data, const moveit::core::JointModelGroup *arm_jmg,
+                    std::vector<moveit_msgs::Grasp> &possible_grasps);
+
+  /**
+   * \brief Take bins from jobs until none are left, running the collision filter on the IK
+   *        solutions of each. Every worker has its own robot state and planning scene
+   * \param next_job - index of the next bin nobody has taken, guarded by job_mutex
+   * \param start_state - current state with the end effector open
+   * \param scene - snapshot of the planning scene, only read through a per-worker diff
+   */
+  void filterCollisionsWorker(std::vector<BinGraspJob> *jobs, std::size_t *next_job,
+                              boost::mutex *job_mutex, const moveit::core::JointModelGroup *arm_jmg,
+                              moveit::core::RobotStateConstPtr start_state,
+                              planning_scene::PlanningSceneConstPtr scene);
+
+  /**
+   * \brief Remove solutions whose grasp or pre-grasp state collides in scene, checking the
+   *        whole robot including the end effector
+   */
+  void filterGraspsInCollision(std::vector<moveit_grasps::GraspSolution> &grasps,
+                               const planning_scene::PlanningScene &scene,
+                               moveit::core::RobotState &robot_state,
+                               const moveit::core::JointModelGroup *arm_jmg);
+
   BinExperienceDataMap bin_experience_data_;
 
   // Save all IK and collision-valid grasps
   std::vector<moveit_grasps::GraspSolution> filtered_grasps_;
 
+  // Which grasps this process plans to when training in parallel
+  TrainingPartition partition_;
+
 };  // end class
 
 // Create boost pointers for this class
@@ -23,6 +23,9 @@
 #include <picknik_main/remote_control.h>
 #include <picknik_main/execution_interface.h>
 #include <picknik_main/tactile_feedback.h>
+#include <picknik_main/control_loop_timer.h>
+#include <picknik_main/reachability_map.h>
+#include <picknik_main/grasp_statistics.h>
 
 // ROS
 #include <ros/ros.h>
@@ -74,14 +77,25 @@ public:
                TactileFeedbackPtr tactile_feedback);
 
   /**
-   * \brief Choose the grasp for the object
+   * \brief Destructor - stops the teleoperation thread
+   */
+  ~Manipulation();
+
+  /**
+   * \brief Choose the grasp for the object. Generated grasps are ranked by the grasp statistics
+   *        and checked for IK and collisions grasp_filter_max_candidates at a time, best first,
+   *        until a batch has a valid grasp
+   * \param world_to_product - pose of the product cuboid
+   * \param product, bin - names the grasp statistics are kept under
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
+   * \param grasp_candidates - the valid grasps, best first
    * \return true on success
    */
-  // bool chooseGrasp(WorkOrder work_order, JointModelGroup* arm_jmg,
-  //                  std::vector<moveit_grasps::GraspCandidatePtr> &qgrasp_candidates,
-  //                  bool verbose, moveit::core::RobotStatePtr seed_state =
-  //                  moveit::core::RobotStatePtr());
+  bool chooseGrasp(const Eigen::Affine3d& world_to_product, double depth, double width,
+                   double height, const std::string& product, const std::string& bin,
+                   JointModelGroup* arm_jmg,
+                   std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates, bool verbose,
+                   moveit::core::RobotStatePtr seed_state = moveit::core::RobotStatePtr());
 
   /**
    * \brief Plan entire cartesian manipulation sequence
@@ -107,6 +121,18 @@ public:
    */
   bool moveCartesianWaypointPath(JointModelGroup* arm_jmg, EigenSTL::vector_Affine3d waypoints);
 
+  /**
+   * \brief Follow a search pattern of tool poses as one continuous trajectory. All waypoints are
+   *        solved with IK and time parameterized up front, then sent to the controller at once
+   * \param tool_waypoints - poses of the finger tips in world frame
+   * \param stop_on_contact - halt the arm as soon as the tactile sensor reports contact
+   * \param contact_found - true if the trajectory was stopped because of contact
+   * \return true on success
+   */
+  bool executeSearchPath(JointModelGroup* arm_jmg, const EigenSTL::vector_Affine3d& tool_waypoints,
+                         double velocity_scaling_factor, bool stop_on_contact,
+                         bool& contact_found);
+
   /**
    * \brief Move to any pose as defined in the SRDF
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
@@ -302,11 +328,42 @@ public:
    * \param desired_distance
    * \param direction_pose
    * \param direction_in
+   * \param achieved_depth - false if insertion_force_rejection is set and the sheer force passed
+   *        sheer_force_rejection_max, or the settled tool pose ended short of desired_distance by
+   *        more than insertion_depth_tolerance
    */
   bool executeInsertionClosedLoop(JointModelGroup* arm_jmg, double desired_distance,
                                   Eigen::Affine3d& desired_pose, bool direction_in,
                                   bool& achieved_depth);
 
+  /**
+   * \brief Log commanded and actual tool poses and loop decisions of insertions
+   * \param arm_jmg - arm whose tool pose is sampled as the actual pose
+   * \param actual_pose_rate - hz
+   */
+  void setRecorder(InsertionRecorderPtr recorder, JointModelGroup* arm_jmg,
+                   double actual_pose_rate);
+
+  /**
+   * \brief Tool pose from the latest robot state, without touching the shared current state so
+   *        that it can be called from any thread
+   * \return false if the arm has no grasp data
+   */
+  bool getActualToolPose(JointModelGroup* arm_jmg, Eigen::Affine3d& world_to_tool);
+
+  /** \brief Timing of the most recent closed loop insertion */
+  const ControlLoopStats& getInsertionLoopStats() const { return insertion_loop_stats_; }
+
+  /** \brief Tactile corrections made during the most recent closed loop insertion */
+  std::size_t getInsertionCorrections() const { return insertion_corrections_; }
+
+  /** \brief Largest filtered sheer force seen during the most recent closed loop insertion */
+  double getInsertionPeakForce() const { return insertion_peak_force_; }
+
+  /** \brief Distance the actual tool pose moved along the insertion axis in the most recent
+   *         closed loop insertion */
+  double getInsertionDepth() const { return insertion_depth_; }
+
   /** \brief Insertion by stream cartesian waypoints */
   bool executeInsertionOpenLoopNew(JointModelGroup* arm_jmg, double desired_distance,
                                    double duration, Eigen::Affine3d& desired_world_to_tool,
@@ -368,7 +425,8 @@ public:
   JointModelGroup* chooseArm(const Eigen::Affine3d& ee_pose);
 
   /**
-   * \brief Get the robot state that accomplished a desired end effector pose
+   * \brief Get the robot state that accomplished a desired end effector pose. Poses the
+   *        reachability map marks unreachable fail without calling IK
    * \return true on success
    */
   bool getRobotStateFromPose(const Eigen::Affine3d& ee_pose,
@@ -492,6 +550,57 @@ public:
    */
   bool displayExperienceDatabase(JointModelGroup* arm_jmg);
 
+  /**
+   * \brief Save experiences to this file instead of the planner's default database, e.g. for a
+   *        training worker. Empty to use the default again
+   */
+  void setExperienceDatabasePath(const std::string& path) { experience_database_path_ = path; }
+
+  /**
+   * \brief Add the paths and graph edges of partial databases to the experience database and
+   *        save it. Exact duplicates are skipped, near duplicate thunder vertices are merged by the
+   *        sparse roadmap when inserted
+   * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
+   * \param partial_paths - database files written by training workers
+   * \return true on success
+   */
+  bool mergeExperienceDatabases(JointModelGroup* arm_jmg,
+                                const std::vector<std::string>& partial_paths);
+
+  /**
+   * \brief Rewrite a database keeping only what is still valid in the current planning scene, e.g.
+   *        after the shelf was recalibrated. Invalid paths and edges and exact duplicates are
+   *        dropped, lightning paths are also shortcut and smoothed. Sizes, and the time to recall
+   *        the same queries from each database, are printed before and after
+   * \param input_path - database to compact, left unchanged
+   * \param output_path - compacted database, overwritten
+   * \return true on success
+   */
+  bool compactExperienceDatabase(JointModelGroup* arm_jmg, const std::string& input_path,
+                                 const std::string& output_path);
+
+  /**
+   * \brief Sample IK over the region in the reachability_map namespace and save the result to
+   *        reachability_map_file, which is loaded on the next start
+   * \param nh - node handle holding the reachability_map settings
+   * \return true on success
+   */
+  bool buildReachabilityMap(JointModelGroup* arm_jmg, ros::NodeHandle nh);
+
+  /** \brief NULL if no map was loaded */
+  ReachabilityMapConstPtr getReachabilityMap() const { return reachability_map_; }
+
+  /** \brief Outcomes of past grasps, always valid but only saved if grasp_statistics_file is set */
+  GraspStatisticsPtr getGraspStatistics() { return grasp_statistics_; }
+
+  /**
+   * \brief Add the outcome of a grasp chosen by chooseGrasp() to the grasp statistics
+   * \param world_to_product - same product pose as given to chooseGrasp()
+   */
+  void recordGraspOutcome(const std::string& product, const std::string& bin,
+                          const Eigen::Affine3d& world_to_product,
+                          const moveit_grasps::GraspCandidatePtr& grasp_candidate, bool success);
+
   /**
    * \brief Visulization function
    * \param input - description
@@ -571,16 +680,43 @@ public:
    */
   bool showJointLimits(JointModelGroup* jmg);
 
-  /** \brief Quickly response to pose requests. Uses IK on dev computer, not embedded */
+  /** \brief Quickly response to pose requests. Only the newest pose is kept, the teleoperation
+             thread solves IK and commands the arm. Safe to call from any thread
+      \param ee_pose - in world frame
+      \param move - false to only visualize the IK solution
+      \return false if the teleoperation thread is not running for this arm */
   bool teleoperation(const Eigen::Affine3d& ee_pose, bool move, JointModelGroup* arm_jmg);
 
+  /** \brief Start the thread that sends the newest teleoperation pose every
+             teleoperation_command_period */
+  void startTeleoperation(JointModelGroup* arm_jmg);
+
+  void stopTeleoperation();
+
   /** \brief Respond to touch sensors on hand */
   bool beginTouchControl();
 
   /** \brief Adjust the teleop tool pose to tactile feedback
+      \param visualize - print and publish markers, must be false on the insertion loop thread
       \return true if pose was adjusted, false if remained same
    */
-  bool adjustPoseFromTactile();
+  bool adjustPoseFromTactile(bool visualize = true);
+
+  /** \brief Body of executeInsertionClosedLoop(), run on its own thread at a fixed period.
+             Returns early if the robot is stopped, with step set to where it left off, or when
+             inserting with insertion_force_rejection set and the sheer force passes
+             sheer_force_rejection_max, with rejected set */
+  void insertionLoop(JointModelGroup* arm_jmg, const Eigen::Vector3d& rotated_direction,
+                     double step_distance, std::size_t num_steps, std::size_t hold_steps,
+                     const Eigen::Affine3d& base_to_world, bool direction_in,
+                     ControlLoopTimer& timer, std::size_t& step, std::size_t& corrections,
+                     bool& rejected);
+
+  /** \brief Body of the teleoperation thread started by startTeleoperation() */
+  void teleoperationLoop(JointModelGroup* arm_jmg, const Eigen::Affine3d& base_to_world);
+
+  /** \brief Block until the current trajectory is done, then set finished */
+  void waitForExecutionThread(std::atomic<bool>& finished);
 
   /** \brief Help display which way the EE is moving */
   void showDirectionArrow(double torque, bool show);
@@ -588,6 +724,9 @@ public:
   /** \brief Callback whenever new gelsight data recieved */
   void updateTouchControl(JointModelGroup* arm_jmg);
 
+  /** \brief Callback whenever tactile contact or slip begins or ends */
+  void tactileEventCallback(TactileEventType event, const TactileSample& sample);
+
   /** \brief Setup robot state for teleop */
   bool enableTeleoperation();
 
@@ -638,16 +777,41 @@ protected:
 
   // End effector sheer force teleoperation
   TactileFeedbackPtr tactile_feedback_;
+  std::atomic<bool> tactile_slipping_;
   Eigen::Vector3d teleop_direction_;
   Eigen::Vector3d teleop_rotated_direction_;
   Eigen::Affine3d teleop_world_to_tool_;
   Eigen::Affine3d teleop_world_to_ee_;
   Eigen::Affine3d teleop_base_to_ee_;
 
+  // Newest teleoperation request, older ones are overwritten before they are acted on
+  boost::mutex teleop_target_mutex_;
+  Eigen::Affine3d teleop_target_;
+  bool teleop_target_move_;
+  std::size_t teleop_target_sequence_;
+  boost::thread teleop_thread_;
+  JointModelGroup* teleop_arm_jmg_;
+  std::atomic<bool> teleop_running_;
+  ControlLoopStats insertion_loop_stats_;
+  std::size_t insertion_corrections_;
+  double insertion_peak_force_;  // only written by the insertion loop thread
+  double insertion_depth_;
+
+  // Optional experiment log
+  InsertionRecorderPtr recorder_;
+
   // Experience-based planning
   bool use_experience_;
   bool use_loggaing_;
   std::ofstream logging_file_;
+  std::string experience_database_path_;
+
+  // Offline IK results to reject poses without solving, empty if not loaded
+  ReachabilityMapPtr reachability_map_;
+  std::atomic<std::size_t> reachability_rejections_;  // also counted by the teleoperation thread
+
+  // Record of which grasps worked
+  GraspStatisticsPtr grasp_statistics_;
 
   // Grasp generator
   moveit_grasps::GraspGeneratorPtr grasp_generator_;
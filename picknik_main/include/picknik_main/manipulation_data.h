@@ -129,10 +129,24 @@ public:
   // Tactile Sensor Data
   double sheer_force_threshold_;
   double sheer_force_rejection_max_;
+  bool insertion_force_rejection_;
   double touch_teleop_max_translation_step_;
+  double tactile_visualization_rate_;
+  std::string tactile_filter_;
+  double tactile_filter_cutoff_;
+  double tactile_kalman_process_noise_;
+  double tactile_kalman_measurement_noise_;
+  double tactile_contact_force_on_;
+  double tactile_contact_force_off_;
+  double tactile_slip_force_rate_;
+  double tactile_slip_torque_rate_;
+  double tactile_event_debounce_;
   double insertion_steps_per_meter_;
   double insertion_duration_;
+  double insertion_step_period_;
+  int insertion_loop_priority_;
   double insertion_distance_;
+  double insertion_depth_tolerance_;
   double insertion_updown_pause_;
   double insertion_alter_pause_;
   double insertion_touch_translation_step_;
@@ -143,6 +157,17 @@ public:
   double insertion_attempt_distance_;
   double insertion_attempt_distance_scale_;
   double insertion_spiral_distance_;
+  std::string insertion_search_pattern_;
+  double insertion_search_width_;
+  double insertion_search_velocity_scaling_;
+
+  // Insertion experiment logging
+  std::string insertion_log_directory_;
+  double insertion_log_pose_rate_;
+
+  // Trajectory recording downsampling
+  double trajectory_record_min_period_;
+  double trajectory_record_min_change_;
 
   // Automated insertion test
   double automated_insertion_distance_;
@@ -169,7 +194,25 @@ public:
 
   std::string joint_state_topic_;
 
+  // Planning scene diffs with the octomap of unmodelled objects, empty to disable
+  std::string clutter_map_topic_;
+
   Eigen::Affine3d teleoperation_offset_;
+  double teleoperation_command_period_;
+  bool teleoperation_check_ik_;
+
+  // Experience database training
+  std::string experience_training_database_;
+  int experience_training_queries_;
+  std::string experience_compaction_input_;
+  std::string experience_compaction_output_;
+
+  // Offline IK results loaded at startup, empty to disable
+  std::string reachability_map_file_;
+
+  // Grasp attempts for ranking candidates, empty to not keep them between runs
+  std::string grasp_statistics_file_;
+  int grasp_filter_max_candidates_;
 
 private:
   // A shared node handle
@@ -45,6 +45,12 @@
 #include <actionlib/client/terminal_state.h>
 #include <tf/transform_listener.h>
 
+// Boost
+#include <boost/thread/mutex.hpp>
+
+// C++
+#include <map>
+
 // Picknik
 #include <picknik_main/namespaces.h>
 #include <picknik_main/visuals.h>
@@ -62,6 +68,16 @@ static const double PRODUCT_POSE_WITHIN_BIN_TOLERANCE =
     0.2;  // throw an error if pose is beyond this amount
 static const std::string PERCEPTION_TOPIC = "perception/recognize_objects";
 
+/**
+ * \brief Last whole-bin perception result, kept until something in the bin is disturbed
+ */
+struct BinPerception
+{
+  picknik_msgs::FindObjectsGoal goal_;  // region the found poses are relative to
+  picknik_msgs::FindObjectsResult result_;
+  ros::Time stamp_;
+};
+
 class PerceptionInterface
 {
 public:
@@ -90,7 +106,71 @@ public:
   bool getTFTransform(Eigen::Affine3d& world_to_frame, ros::Time& time_stamp,
                       const std::string& parent_frame_id, const std::string& frame_id);
 
+  /**
+   * \brief Ask the perception server to segment and label every expected product in a bin
+   * \param goal - the bin region and the names of all products expected in it
+   * \return true on success
+   */
+  bool startPerception(const picknik_msgs::FindObjectsGoal& goal);
+
+  /**
+   * \brief Tell the server the camera is done moving and wait for its result. A successful
+   *        result is cached for the requested bin
+   * \param result - all products found in the bin
+   * \param timeout - seconds to wait for the server
+   * \return true on success
+   */
+  bool endPerception(picknik_msgs::FindObjectsResult& result, double timeout = 60);
+
+  /**
+   * \brief Get the cached perception of a bin, if it is still valid
+   * \param result - copy of the cached result
+   * \return true if a valid result was found
+   */
+  bool getCachedPerception(const std::string& bin_name, picknik_msgs::FindObjectsResult& result);
+
+  /**
+   * \brief Get the world pose of a product from the cached perception of its bin
+   * \return false if the bin is not cached or the product was not found in it
+   */
+  bool getProductPose(const std::string& bin_name, const std::string& product_name,
+                      Eigen::Affine3d& world_to_product);
+
+  /**
+   * \brief Add every product of the cached perception of a bin to the planning scene, at the
+   *        pose it was perceived at
+   * \return false if the bin is not cached
+   */
+  bool applyCachedPerception(const std::string& bin_name);
+
+  /**
+   * \brief Forget the cached perception of a bin, e.g. after something in it was picked or touched
+   */
+  void invalidateBin(const std::string& bin_name);
+
+  /**
+   * \brief Forget the cached perception of every bin whose region contains the point
+   */
+  void invalidateBinsAt(const Eigen::Vector3d& world_point);
+
+  /**
+   * \brief Forget every cached perception result
+   */
+  void invalidateAllBins();
+
 private:
+  /**
+   * \brief Corner of the bin region that the server reports product poses relative to
+   */
+  Eigen::Affine3d getWorldToBinCorner(const picknik_msgs::FindObjectsGoal& goal) const;
+
+  /**
+   * \brief Remove the cached bin if it is older than perception_cache_max_age.
+   *        Caller must hold bin_perception_cache_mutex_
+   * \return true if the bin was expired
+   */
+  bool expireBin(std::map<std::string, BinPerception>::iterator bin);
+
   /**
    * \brief Display a visualization of a camera view frame
    * \return true on success
@@ -122,6 +202,16 @@ private:
   // Perception processing has started
   bool is_processing_perception_;
 
+  // Request currently being processed
+  picknik_msgs::FindObjectsGoal processing_goal_;
+
+  // Whole-bin results by bin name, reused across requests until the bin is disturbed
+  std::map<std::string, BinPerception> bin_perception_cache_;
+  boost::mutex bin_perception_cache_mutex_;
+
+  // Cached results older than this many seconds are ignored, 0 to never expire
+  double perception_cache_max_age_;
+
   // Camera intrinsics
   double camera_fx_;
   double camera_fy_;
@@ -25,6 +25,8 @@
 #include <picknik_main/perception_interface.h>
 #include <picknik_main/remote_control.h>
 #include <picknik_main/tactile_feedback.h>
+#include <picknik_main/insertion_sweep.h>
+#include <picknik_main/experience_training.h>
 
 // Picknik Msgs
 #include <picknik_msgs/FindObjectsAction.h>
@@ -219,12 +221,55 @@ public:
   void drawSpiral();
 
   /** \brief Generate a large number of poses in a spiral starting from the input center_pose */
-  void getSpiralPoses(std::vector<Eigen::Affine3d>& poses, const Eigen::Affine3d& center_pose,
+  void getSpiralPoses(EigenSTL::vector_Affine3d& poses, const Eigen::Affine3d& center_pose,
                       double distance);
 
+  /** \brief Poses every chord meters along a smooth spiral of the given radius around center_pose */
+  void getArchimedeanSpiralPoses(EigenSTL::vector_Affine3d& poses,
+                                 const Eigen::Affine3d& center_pose, double coils, double radius,
+                                 double chord);
+
+  /** \brief Back and forth rows covering a square of the given width around center_pose */
+  void getRasterPoses(EigenSTL::vector_Affine3d& poses, const Eigen::Affine3d& center_pose,
+                      double width, double distance);
+
   /** \brief Demo of tactile insertion */
   void automatedInsertionTest();
 
+  /** \brief Tune the closed loop insertion by repeating it over the settings in
+      insertion_sweep.yaml */
+  void insertionParameterSweep();
+
+  /** \brief Fill the experience database with random queries planned by parallel worker
+      processes, then merge their databases into experience_training_database */
+  bool trainExperienceDatabase();
+
+  /** \brief Sample IK over the region in reachability_map.yaml and save it for the next start */
+  bool buildReachabilityMap();
+
+  /** \brief Drop stale and duplicate experiences, see Manipulation::compactExperienceDatabase() */
+  bool compactExperienceDatabase();
+
+  /** \brief Perceive every product in each bin in turn, as configured in perception_bins.yaml,
+      and add them to the planning scene. A bin with a valid cached result is not perceived again
+      \param bin_names - comma separated, a bin may be listed more than once */
+  bool perceiveBins(const std::string& bin_names);
+
+  /** \brief Perceive one bin, or reuse its cached result, and place its products in the scene */
+  bool perceiveBin(const std::string& bin_name);
+
+  /** \brief Pick the first perceived product out of each bin in turn and record in the grasp
+      statistics whether the grasp held
+      \param bin_names - comma separated, a bin may be listed more than once */
+  bool pickProducts(const std::string& bin_names);
+
+  /** \brief Perceive a bin, then grasp, lift and retreat with its first product */
+  bool pickProduct(const std::string& bin_name);
+
+  /** \brief Start logging to a new timestamped file in insertion_log_directory, if set
+      \param name - prefix of the file name */
+  void startInsertionRecording(const std::string& name);
+
   VisualsPtr getVisuals() { return visuals_; }
   planning_scene_monitor::PlanningSceneMonitorPtr getPlanningSceneMonitor() const
   {
@@ -232,6 +277,23 @@ public:
   }
 
 private:
+  /** \brief Steps of automatedInsertionTest(), may return early */
+  void runAutomatedInsertionTest();
+
+  /** \brief One closed loop insertion from start_world_to_tool, then back out to it again
+      \return false if the arm could not be moved */
+  bool runInsertionTrial(JointModelGroup* arm_jmg, const Eigen::Affine3d& start_world_to_tool,
+                         InsertionTrialResult& result);
+
+  /** \brief Sample contact and the actual tool depth while runInsertionTrial() inserts, keeping
+      the first time each was seen. Samples once more after done is set, then returns */
+  void watchInsertionTrial(JointModelGroup* arm_jmg, const Eigen::Affine3d& start_world_to_tool,
+                           double seated_depth, const std::atomic<bool>& done,
+                           ros::WallTime& contact_time, ros::WallTime& seated_time);
+
+  /** \brief Plan this worker's share of the training queries into its own database */
+  bool runExperienceTrainingWorker(JointModelGroup* arm_jmg, const TrainingPartition& partition);
+
   // A shared node handle
   ros::NodeHandle nh_private_;
   ros::NodeHandle nh_root_;
@@ -271,6 +333,9 @@ private:
   // Line tracking interface
   TactileFeedbackPtr tactile_feedback_;
 
+  // Log of insertion experiments
+  InsertionRecorderPtr insertion_recorder_;
+
   // Helper classes
   // LearningPipelinePtr learning_;
 
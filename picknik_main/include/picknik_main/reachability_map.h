@@ -0,0 +1,135 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Offline grid of which end effector poses in front of the shelf the arm can reach
+*/
+
+#ifndef PICKNIK_MAIN__REACHABILITY_MAP
+#define PICKNIK_MAIN__REACHABILITY_MAP
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+
+// Eigen
+#include <Eigen/Geometry>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+// C++
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/**
+ * \brief Box of cells over the shelf face, each sampled with every approach orientation. A cell
+ *        records how many distinct IK solutions reach its center, the gantry height of the most
+ *        manipulable one and its manipulability. Poses outside the box, or further than
+ *        orientation_tolerance from every approach, are not covered by the map.
+ *        Settings are read from the reachability_map namespace, see config/reachability_map.yaml
+ */
+class ReachabilityMap
+{
+public:
+  ReachabilityMap();
+
+  /**
+   * \brief Read the region and sampling settings used by build()
+   * \return false if a setting is missing or invalid
+   */
+  bool loadParameters(ros::NodeHandle nh);
+
+  /**
+   * \brief Sample every cell. Slow, run offline with --mode 14 and save() the result
+   * \param robot_state - scratch state, other groups are left where they are
+   * \param ik_tip_link - link whose pose the cells describe
+   * \param validity_fn - rejects colliding IK solutions
+   * \param gantry_joint - NULL if the robot has no gantry
+   */
+  bool build(moveit::core::RobotState& robot_state, const moveit::core::JointModelGroup* arm_jmg,
+             const moveit::core::LinkModel* ik_tip_link,
+             const moveit::core::GroupStateValidityCallbackFn& validity_fn,
+             const moveit::core::JointModel* gantry_joint);
+
+  bool save(const std::string& file_path) const;
+  bool load(const std::string& file_path);
+
+  bool isLoaded() const { return !solutions_.empty(); }
+
+  /** \brief Group the map was built for */
+  const std::string& getGroupName() const { return group_name_; }
+
+  /**
+   * \brief Check a pose against the map without solving IK
+   * \param world_to_tip - pose of the ik tip link in the model frame
+   * \return true only if the pose is covered by the map and neither its cell nor any of the 26
+   *         cells around it, with the same approach, had an IK solution
+   */
+  bool isUnreachable(const Eigen::Affine3d& world_to_tip) const;
+
+  /**
+   * \brief Look up the cell of a pose
+   * \return false if the pose is not covered by the map or its cell is unreachable
+   */
+  bool getCell(const Eigen::Affine3d& world_to_tip, std::size_t& solutions, double& gantry_height,
+               double& manipulability) const;
+
+private:
+  /** \brief Index into the cell arrays, false if the pose is not covered */
+  bool getCellIndex(const Eigen::Affine3d& world_to_tip, std::size_t& index) const;
+
+  /** \brief Nearest cell and approach of a pose, false if the pose is not covered */
+  bool getCellCoordinates(const Eigen::Affine3d& world_to_tip, std::size_t cell[3],
+                          std::size_t& approach) const;
+
+  std::size_t getIndex(std::size_t x, std::size_t y, std::size_t z, std::size_t approach) const
+  {
+    return ((x * dims_[1] + y) * dims_[2] + z) * approaches_.size() + approach;
+  }
+
+  /** \brief Center of a cell with one of the approach orientations, in the model frame */
+  Eigen::Affine3d getCellPose(std::size_t x, std::size_t y, std::size_t z,
+                              std::size_t orientation) const;
+
+  std::size_t getNumCells() const { return dims_[0] * dims_[1] * dims_[2] * approaches_.size(); }
+
+  // Region, cells start at the origin and extend along its +x (into the shelf), +y and +z axes
+  std::string group_name_;
+  Eigen::Affine3d world_to_face_;
+  double resolution_;
+  std::size_t dims_[3];
+  EigenSTL::vector_Affine3d approaches_;  // rotations relative to world_to_face
+  double orientation_tolerance_;          // radians
+
+  // Sampling
+  int ik_seeds_;
+  double ik_timeout_;
+  double distinct_solution_distance_;
+
+  // Per cell, x slowest and orientation fastest
+  std::vector<uint8_t> solutions_;
+  std::vector<float> gantry_heights_;
+  std::vector<float> manipulabilities_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ReachabilityMap> ReachabilityMapPtr;
+typedef boost::shared_ptr<const ReachabilityMap> ReachabilityMapConstPtr;
+
+}  // end namespace
+
+#endif
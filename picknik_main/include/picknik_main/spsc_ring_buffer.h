@@ -0,0 +1,168 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Fixed size single-producer ring buffer with lock-free, never-torn readers
+*/
+
+#ifndef PICKNIK_MAIN__SPSC_RING_BUFFER
+#define PICKNIK_MAIN__SPSC_RING_BUFFER
+
+// C++
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+namespace picknik_main
+{
+/**
+ * \brief Ring buffer written by exactly one thread and read by any number of threads.
+ *
+ *        Readers never remove samples - they copy the latest one or a window of recent ones.
+ *        Every slot carries a sequence number that is odd while the producer is writing it and
+ *        otherwise encodes which lap of the ring the slot holds, so a reader that raced with
+ *        the producer detects it and retries instead of returning a torn value. Neither side
+ *        ever blocks or allocates.
+ *
+ *        T should be plain old data (fixed layout, no pointers to owned memory)
+ */
+template <typename T, std::size_t Capacity>
+class SpscRingBuffer
+{
+public:
+  SpscRingBuffer() : head_(0)
+  {
+    for (std::size_t i = 0; i < Capacity; ++i)
+      slots_[i].sequence_.store(0, std::memory_order_relaxed);
+  }
+
+  /** \brief Add a sample, overwriting the oldest one when full. Only call from the producer */
+  void push(const T& value)
+  {
+    const uint64_t index = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[index % Capacity];
+    const uint64_t lap = index / Capacity;
+
+    // Mark slot as being written
+    slot.sequence_.store(2 * lap + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.value_ = value;
+
+    // Mark slot as holding this lap, then make it visible
+    slot.sequence_.store(2 * lap + 2, std::memory_order_release);
+    head_.store(index + 1, std::memory_order_release);
+  }
+
+  /** \brief Total number of samples ever pushed */
+  uint64_t getTotalPushed() const { return head_.load(std::memory_order_acquire); }
+
+  /** \brief Number of samples currently readable */
+  std::size_t size() const
+  {
+    const uint64_t pushed = getTotalPushed();
+    return pushed < Capacity ? pushed : Capacity;
+  }
+
+  bool empty() const { return getTotalPushed() == 0; }
+
+  /**
+   * \brief Copy the newest sample
+   * \return false if nothing has been pushed yet
+   */
+  bool readLatest(T& value) const
+  {
+    while (true)
+    {
+      const uint64_t pushed = getTotalPushed();
+      if (pushed == 0)
+        return false;
+      if (read(pushed - 1, value))
+        return true;
+      // The producer lapped us mid-copy, try again with the new head
+    }
+  }
+
+  /**
+   * \brief Copy up to count of the newest samples, oldest first
+   * \return number of samples copied
+   */
+  std::size_t readWindow(std::size_t count, std::vector<T>& values) const
+  {
+    values.clear();
+
+    const uint64_t pushed = getTotalPushed();
+    if (count > Capacity)
+      count = Capacity;
+    if (count > pushed)
+      count = pushed;
+
+    values.reserve(count);
+    T value;
+    for (uint64_t index = pushed - count; index < pushed; ++index)
+    {
+      // Samples overwritten while copying are left out of the window
+      if (read(index, value))
+        values.push_back(value);
+    }
+    return values.size();
+  }
+
+  static std::size_t capacity() { return Capacity; }
+
+private:
+  /**
+   * \brief Copy the sample with the given absolute index
+   * \return false if it has already been overwritten
+   */
+  bool read(uint64_t index, T& value) const
+  {
+    const Slot& slot = slots_[index % Capacity];
+    const uint64_t expected = 2 * (index / Capacity) + 2;
+
+    while (true)
+    {
+      const uint64_t before = slot.sequence_.load(std::memory_order_acquire);
+      if (before > expected)
+        return false;  // overwritten by a later lap
+      if (before != expected)
+        continue;  // currently being written
+
+      value = slot.value_;
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t after = slot.sequence_.load(std::memory_order_relaxed);
+      if (after == before)
+        return true;
+      if (after > expected)
+        return false;
+    }
+  }
+
+  struct Slot
+  {
+    std::atomic<uint64_t> sequence_;
+    T value_;
+  };
+
+  Slot slots_[Capacity];
+
+  // Absolute index of the next sample to be written
+  std::atomic<uint64_t> head_;
+
+  // Non-copyable
+  SpscRingBuffer(const SpscRingBuffer&);
+  SpscRingBuffer& operator=(const SpscRingBuffer&);
+};  // end class
+
+}  // end namespace
+
+#endif
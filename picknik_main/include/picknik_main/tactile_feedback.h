@@ -22,6 +22,12 @@
 // PickNik
 #include <picknik_main/namespaces.h>
 #include <picknik_main/manipulation_data.h>
+#include <picknik_main/spsc_ring_buffer.h>
+#include <picknik_main/tactile_filter.h>
+#include <picknik_main/insertion_recorder.h>
+
+// Boost
+#include <boost/thread.hpp>
 
 // Visual Tools
 #include <rviz_visual_tools/rviz_visual_tools.h>
@@ -30,25 +36,9 @@ namespace picknik_main
 {
 static const std::string ATTACH_FRAME = "finger_sensor_pad";
 
-/** \brief Names of data sent from Gelsight to rest of BLUE
-           NOTE: this is copied from
-           gelsight/include/gelsight/image_processing.hpp
- */
-enum EndEffectorData
-{
-  SHEER_FORCE = 0,
-  LINE_CENTER_X,
-  LINE_CENTER_Y,
-  LINE_EIGEN_VEC_X,
-  LINE_EIGEN_VEC_Y,
-  LINE_EIGEN_VAL,
-  SHEER_DISPLACEMENT_X,
-  SHEER_DISPLACEMENT_Y,
-  SHEER_TORQUE,
-  IMAGE_HEIGHT,
-  IMAGE_WIDTH,
-  ALWAYS_AT_END  // for counting array size
-};
+// Roughly 5 seconds of sensor data at 100hz
+static const std::size_t TACTILE_BUFFER_SIZE = 512;
+typedef SpscRingBuffer<TactileSample, TACTILE_BUFFER_SIZE> TactileSampleBuffer;
 
 class TactileFeedback
 {
@@ -58,23 +48,68 @@ public:
    */
   TactileFeedback(ManipulationDataPtr config);
 
+  /**
+   * \brief Destructor - stops the visualization thread
+   */
+  ~TactileFeedback();
+
   /** \brief Send command to remote sensor to reset itself */
   void recalibrateTactileSensor();
 
-  double getSheerTheta() { return sheer_theta_; };
-  double getSheerForce() { return end_effector_data_cached_[SHEER_FORCE]; };
-  double getSheerTorque() { return end_effector_data_cached_[SHEER_TORQUE]; };
+  double getSheerTheta() { return getLatestSample().sheer_theta_; };
+  double getSheerForce() { return getLatestSample().data_[SHEER_FORCE]; };
+  double getSheerTorque() { return getLatestSample().data_[SHEER_TORQUE]; };
+  double getFilteredSheerForce() { return getLatestSample().filtered_force_; };
+  double getFilteredSheerTorque() { return getLatestSample().filtered_torque_; };
+
+  /**
+   * \brief Copy of the newest sensor reading, or all zeros if none has arrived yet.
+   *        Lock-free and safe to call from any thread
+   */
+  TactileSample getLatestSample() const;
+
+  /**
+   * \brief Copy up to count of the newest sensor readings, oldest first
+   * \return number of samples copied
+   */
+  std::size_t getSamples(std::size_t count, std::vector<TactileSample>& samples) const;
+
+  /**
+   * \brief Copy the sensor readings received within the last duration, oldest first
+   * \return number of samples copied
+   */
+  std::size_t getSamples(const ros::Duration& duration, std::vector<TactileSample>& samples) const;
   void setEndEffectorDataCallback(std::function<void()> function)
   {
+    boost::mutex::scoped_lock lock(callbacks_mutex_);
     end_effector_data_callback_ = function;
   };
 
+  /** \brief Log every sample while the recorder is recording. Safe to call while data arrives */
+  void setRecorder(InsertionRecorderPtr recorder)
+  {
+    boost::mutex::scoped_lock lock(callbacks_mutex_);
+    recorder_ = recorder;
+  };
+
+  /** \brief Called from the sensor callback whenever contact or slip begins or ends.
+             Keep it short, it runs at sensor rate */
+  void setTactileEventCallback(
+      std::function<void(TactileEventType, const TactileSample&)> function)
+  {
+    boost::mutex::scoped_lock lock(callbacks_mutex_);
+    tactile_event_callback_ = function;
+  };
+
 private:
   void dataCallback(const std_msgs::Float64MultiArray::ConstPtr& msg);
 
-  void displayLineDirection();
+  /** \brief Publish markers of the latest sample at a low rate, away from the sensor callback */
+  void visualizationThread(double rate);
+
+  void displayLineDirection(const TactileSample& sample);
 
-  void displaySheerForce();
+  void displaySheerForce(const TactileSample& sample);
 
   void publishUpdatedLine(geometry_msgs::Point& pt1, geometry_msgs::Point& pt2);
 
@@ -89,11 +124,25 @@ private:
   // Publish commands to re-calibrate sensor
   ros::Publisher tactile_calibration_pub_;
 
-  double sheer_theta_;
-  std::vector<double> end_effector_data_cached_;
+  // Written only by the subscriber callback
+  TactileSampleBuffer samples_;
 
-  // Allow a callback to be added whenever new end effector data is recieved
+  // Markers are published from here so the callback never waits on rviz
+  boost::thread visualization_thread_;
+  std::atomic<bool> visualization_running_;
+
+  // Smooths each reading and detects contact and slip, only used by the subscriber callback
+  TactileFilter filter_;
+  std::atomic<bool> filter_reset_requested_;
+
+  // Allow a callback to be added whenever new end effector data is recieved. The subscriber
+  // already runs when these are set, so they and recorder_ are guarded by callbacks_mutex_
+  boost::mutex callbacks_mutex_;
   std::function<void()> end_effector_data_callback_;
+  std::function<void(TactileEventType, const TactileSample&)> tactile_event_callback_;
+
+  // Optional experiment log
+  InsertionRecorderPtr recorder_;
 
   // Show data
   rviz_visual_tools::RvizVisualToolsPtr visual_tools_;
@@ -0,0 +1,188 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Filter tactile sensor signals, estimate their rates and detect contact and slip
+*/
+
+#ifndef PICKNIK_MAIN__TACTILE_FILTER
+#define PICKNIK_MAIN__TACTILE_FILTER
+
+// ROS
+#include <ros/time.h>
+
+// C++
+#include <string>
+
+namespace picknik_main
+{
+/** \brief Names of data sent from Gelsight to rest of BLUE
+           NOTE: this is copied from
+           gelsight/include/gelsight/image_processing.hpp
+ */
+enum EndEffectorData
+{
+  SHEER_FORCE = 0,
+  LINE_CENTER_X,
+  LINE_CENTER_Y,
+  LINE_EIGEN_VEC_X,
+  LINE_EIGEN_VEC_Y,
+  LINE_EIGEN_VAL,
+  SHEER_DISPLACEMENT_X,
+  SHEER_DISPLACEMENT_Y,
+  SHEER_TORQUE,
+  IMAGE_HEIGHT,
+  IMAGE_WIDTH,
+  ALWAYS_AT_END  // for counting array size
+};
+
+/** \brief One fixed-layout reading from the tactile sensor, safe to copy between threads */
+struct TactileSample
+{
+  ros::Time stamp_;
+  double data_[ALWAYS_AT_END];  // raw values from the sensor
+
+  // Filled in by TactileFilter
+  double filtered_force_;
+  double filtered_torque_;
+  double filtered_displacement_x_;
+  double filtered_displacement_y_;
+  double force_rate_;   // per second
+  double torque_rate_;  // per second
+  double sheer_theta_;  // direction of filtered sheer displacement, radians
+  bool in_contact_;
+  bool slipping_;
+};
+
+enum TactileFilterMode
+{
+  TACTILE_FILTER_NONE = 0,  // pass raw values through, finite difference rates
+  TACTILE_FILTER_LOW_PASS,  // first order low pass
+  TACTILE_FILTER_KALMAN     // constant velocity kalman filter
+};
+
+/** \brief Convert "none", "low_pass" or "kalman" to a mode
+    \return false if unknown */
+bool parseTactileFilterMode(const std::string& name, TactileFilterMode& mode);
+
+enum TactileEventType
+{
+  TACTILE_CONTACT_BEGIN = 0,
+  TACTILE_CONTACT_END,
+  TACTILE_SLIP_BEGIN,
+  TACTILE_SLIP_END
+};
+
+struct TactileFilterSettings
+{
+  TactileFilterSettings();
+
+  TactileFilterMode mode_;
+  double low_pass_cutoff_;           // hz
+  double kalman_process_noise_;      // variance of the signal's acceleration
+  double kalman_measurement_noise_;  // variance of one reading
+
+  // Contact begins above the on force and ends below the off force
+  double contact_force_on_;
+  double contact_force_off_;
+
+  // While in contact, slip is a filtered force or torque changing faster than these
+  double slip_force_rate_;
+  double slip_torque_rate_;
+
+  // A contact or slip state must hold this long before an event is raised, seconds
+  double event_debounce_;
+};
+
+/** \brief Filter one scalar signal and estimate its rate of change */
+class SignalFilter
+{
+public:
+  SignalFilter();
+
+  void configure(const TactileFilterSettings& settings);
+
+  void reset();
+
+  /** \brief Add a measurement taken dt seconds after the previous one */
+  void update(double measurement, double dt);
+
+  double getValue() const { return value_; }
+  double getRate() const { return rate_; }
+private:
+  TactileFilterSettings settings_;
+  bool initialized_;
+  double value_;
+  double rate_;
+
+  // Kalman covariance of (value, rate)
+  double p00_, p01_, p10_, p11_;
+};
+
+/** \brief Boolean state that only changes after its condition has held for a minimum time */
+class DebouncedState
+{
+public:
+  DebouncedState();
+
+  void reset();
+
+  /** \brief \return true if the state changed */
+  bool update(bool condition, const ros::Time& stamp, double debounce);
+
+  bool getState() const { return state_; }
+private:
+  bool state_;
+  bool pending_;
+  ros::Time pending_since_;
+};
+
+/**
+ * \brief Runs at sensor rate: filters force, torque and displacement of each sample, estimates
+ *        their rates and raises debounced contact and slip events. Does not allocate
+ */
+class TactileFilter
+{
+public:
+  static const std::size_t MAX_EVENTS = 2;
+
+  TactileFilter();
+
+  void configure(const TactileFilterSettings& settings);
+
+  /** \brief Forget all history, e.g. after the sensor is recalibrated */
+  void reset();
+
+  /**
+   * \brief Fill in the filtered fields of a sample
+   * \param sample - raw data and stamp must be set
+   * \param events - array of at least MAX_EVENTS
+   * \return number of events raised by this sample
+   */
+  std::size_t update(TactileSample& sample, TactileEventType* events);
+
+private:
+  TactileFilterSettings settings_;
+
+  SignalFilter force_;
+  SignalFilter torque_;
+  SignalFilter displacement_x_;
+  SignalFilter displacement_y_;
+
+  DebouncedState contact_;
+  DebouncedState slip_;
+
+  bool has_previous_;
+  ros::Time previous_stamp_;
+};
+
+}  // end namespace
+
+#endif
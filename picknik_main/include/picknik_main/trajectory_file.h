@@ -0,0 +1,152 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Binary trajectory files that are read in place through a memory map
+*/
+
+#ifndef PICKNIK_MAIN__TRAJECTORY_FILE
+#define PICKNIK_MAIN__TRAJECTORY_FILE
+
+// Boost
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+// C++
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+static const char TRAJECTORY_FILE_MAGIC[8] = {'P', 'K', 'T', 'R', 'A', 'J', 'C', 'T'};
+static const uint32_t TRAJECTORY_FILE_VERSION = 1;
+
+// Binary files sit next to the csv they replace with this extension
+static const char* const TRAJECTORY_FILE_EXTENSION = ".traj";
+
+enum TrajectoryFileFlags
+{
+  TRAJECTORY_HAS_TIMES = 1,  // every point starts with its time in seconds
+  TRAJECTORY_POSES = 2       // points are row major 4x4 pose matrices rather than joint positions
+};
+
+/**
+ * \brief Path of the binary file for a csv trajectory, e.g. trajectories/calibration.traj for
+ *        trajectories/calibration.csv
+ */
+std::string getBinaryTrajectoryPath(const std::string& csv_path);
+
+/**
+ * \brief Writes points as they come and fills in the point count on close(). On disk the file is
+ *        the magic, then version, flags, variable count and name count as uint32, the point count
+ *        as uint64, each name as a uint32 length and its characters, zero padding to 8 bytes, and
+ *        finally the points as packed doubles. Numbers are in the byte order of the writing
+ *        machine, the reader recognises a byte swapped version and rejects the file
+ */
+class TrajectoryFileWriter : private boost::noncopyable
+{
+public:
+  TrajectoryFileWriter();
+
+  ~TrajectoryFileWriter();
+
+  /**
+   * \brief Create the file and write its header
+   * \param names - one per variable, or empty to leave the variables unnamed
+   * \param num_variables - values in each point, not counting the time
+   * \return false if the file could not be created
+   */
+  bool open(const std::string& file_path, const std::vector<std::string>& names,
+            std::size_t num_variables, uint32_t flags);
+
+  /** \brief Add a point of num_variables values, time is ignored without TRAJECTORY_HAS_TIMES */
+  void append(const double* values, double time = 0.0);
+
+  /**
+   * \brief Record the point count and close the file
+   * \return false if any write failed
+   */
+  bool close();
+
+  bool isOpen() const { return file_.is_open(); }
+
+  std::size_t getPointCount() const { return num_points_; }
+
+private:
+  std::ofstream file_;
+  std::string file_path_;
+  uint32_t flags_;
+  std::size_t num_variables_;
+  uint64_t num_points_;
+};  // end class
+
+/**
+ * \brief Maps a whole trajectory file into memory so points are used where they lie, without
+ *        parsing or copying. The pointers returned stay valid until close()
+ */
+class TrajectoryFileReader : private boost::noncopyable
+{
+public:
+  TrajectoryFileReader();
+
+  ~TrajectoryFileReader();
+
+  /** \brief Whether a file exists and starts like a trajectory file, without mapping it */
+  static bool isTrajectoryFile(const std::string& file_path);
+
+  /**
+   * \brief Map the file and check its header. A file with a point count of 0, e.g. from a
+   *        recording that was cut short, is read up to its last complete point
+   * \return false if the file is missing, of another version or byte order, or truncated
+   */
+  bool open(const std::string& file_path);
+
+  void close();
+
+  const std::vector<std::string>& getVariableNames() const { return names_; }
+
+  std::size_t getVariableCount() const { return num_variables_; }
+
+  std::size_t getPointCount() const { return num_points_; }
+
+  bool hasTimes() const { return flags_ & TRAJECTORY_HAS_TIMES; }
+
+  bool isPoses() const { return flags_ & TRAJECTORY_POSES; }
+
+  /** \brief getVariableCount() values of point i */
+  const double* getValues(std::size_t i) const
+  {
+    return points_ + i * stride_ + (hasTimes() ? 1 : 0);
+  }
+
+  /** \brief Seconds, 0 if the file has no times */
+  double getTime(std::size_t i) const { return hasTimes() ? points_[i * stride_] : 0.0; }
+
+private:
+  void* data_;
+  std::size_t size_;
+
+  uint32_t flags_;
+  std::vector<std::string> names_;
+  std::size_t num_variables_;
+  std::size_t num_points_;
+  std::size_t stride_;  // doubles per point
+  const double* points_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TrajectoryFileReader> TrajectoryFileReaderPtr;
+typedef boost::shared_ptr<const TrajectoryFileReader> TrajectoryFileReaderConstPtr;
+
+}  // end namespace
+
+#endif
@@ -42,6 +42,8 @@
 // PickNik
 #include <picknik_main/manipulation.h>
 #include <picknik_main/namespaces.h>
+#include <picknik_main/trajectory_file.h>
+#include <picknik_main/trajectory_recorder.h>
 
 namespace picknik_main
 {
@@ -55,7 +57,8 @@ public:
                ManipulationPtr manipulation);
 
   /**
-   * \brief Read a joint trajectory from CSV and execute on robot
+   * \brief Read a joint trajectory from CSV, or the binary file converted from it, and execute
+   *        on robot
    * \param file_name - location of file
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
    * \param velocity_scaling_factor - the percent of max speed all joints should be allowed to
@@ -66,7 +69,8 @@ public:
                                   double velocity_scaling_factor);
 
   /**
-   * \brief Read a waypoint trajectory from CSV and execute on robot
+   * \brief Read a waypoint trajectory from CSV, or the binary file converted from it, and
+   *        execute on robot
    * \param file_name - location of file
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
    * \param velocity_scaling_factor - the percent of max speed all joints should be allowed to
@@ -88,7 +92,8 @@ public:
                                              double velocity_scaling_factor);
 
   /**
-   * \brief Record the entire state of a robot to file
+   * \brief Record the entire state of a robot from the joint states until the stop button, into
+   *        the binary version of file_name
    * \param file_name - location of file
    * \return true on success
    */
@@ -110,6 +115,24 @@ public:
   bool getFilePath(std::string& file_path, const std::string& file_name) const;
 
 private:
+  /**
+   * \brief Read joint states from the binary version of file_name if there is one, else from the
+   *        CSV itself
+   * \param seed_state - values of variables the file does not have
+   * \param has_times - set when the file was recorded with times, which become the durations
+   * \return true if at least one state was loaded
+   */
+  bool loadJointTrajectory(const std::string& file_name,
+                           const moveit::core::RobotStatePtr& seed_state,
+                           robot_trajectory::RobotTrajectoryPtr robot_traj, bool& has_times);
+
+  /**
+   * \brief Read 4x4 pose matrices from the binary version of file_name if there is one, else from
+   *        the CSV itself
+   * \return true if at least one pose was loaded
+   */
+  bool loadPoses(const std::string& file_name, EigenSTL::vector_Affine3d& poses);
+
   // A shared node handle
   ros::NodeHandle nh_;
 
@@ -0,0 +1,121 @@
+/*********************************************************************
+  * Software License Agreement (BSD License)
+  *
+  *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+  *  All rights reserved.
+  *
+  * Unauthorized copying of this file, via any medium is strictly prohibited
+  * Proprietary and confidential
+  *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Record demonstrations at the rate of the joint state stream
+*/
+
+#ifndef PICKNIK_MAIN__TRAJECTORY_RECORDER
+#define PICKNIK_MAIN__TRAJECTORY_RECORDER
+
+// PickNik
+#include <picknik_main/trajectory_file.h>
+
+// ROS
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+// C++
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/**
+ * \brief Subscribes to the joint states while recording and keeps every message, or those the
+ *        downsampling settings let through. Messages only update the variables they name, so
+ *        every point has all variables even when joints are published separately. Points are
+ *        handed to a writer thread in batches so the callback never touches the disk
+ */
+class TrajectoryRecorder
+{
+public:
+  /**
+   * \brief Constructor
+   * \param variable_names - every variable of the robot, in the order they are written
+   * \param joint_state_topic - topic to record
+   */
+  TrajectoryRecorder(ros::NodeHandle nh, const std::vector<std::string>& variable_names,
+                     const std::string& joint_state_topic);
+
+  ~TrajectoryRecorder();
+
+  /**
+   * \brief Only keep points at least min_period seconds and min_change radians or meters, on
+   *        any variable, from the last point kept. Zero keeps everything. Set before start()
+   */
+  void setDownsampling(double min_period, double min_change);
+
+  /**
+   * \brief Open a binary trajectory file and start recording into it
+   * \param initial_positions - values of variables until a message names them
+   * \return false if the file could not be opened
+   */
+  bool start(const std::string& file_path, const std::vector<double>& initial_positions);
+
+  /**
+   * \brief Write everything still queued and close the file
+   * \return false if writing the file failed, true if it succeeded or nothing was recording
+   */
+  bool stop();
+
+  bool isRecording() const { return recording_; }
+
+private:
+  void jointStateCallback(const sensor_msgs::JointState::ConstPtr& msg);
+
+  void writerThread();
+
+  // A shared node handle
+  ros::NodeHandle nh_;
+  ros::Subscriber joint_state_sub_;
+  std::string joint_state_topic_;
+
+  std::vector<std::string> variable_names_;
+
+  // Downsampling
+  double min_period_;
+  double min_change_;
+
+  std::atomic<bool> recording_;
+
+  // Only used by the subscriber callback
+  std::vector<std::string> msg_names_;   // names of the last message, to reuse the lookup
+  std::vector<std::size_t> msg_indices_;  // variable of each name in the message
+  std::vector<double> positions_;
+  std::vector<double> last_kept_;
+  ros::Time first_stamp_;
+  ros::Time last_kept_stamp_;
+  bool has_kept_;
+
+  // Points waiting for the writer as time then positions, swapped out in one go
+  boost::mutex queue_mutex_;
+  boost::condition_variable queue_condition_;
+  std::vector<double> queue_;
+  bool stop_requested_;
+  std::size_t dropped_;
+
+  // Only used by the writer thread
+  boost::thread writer_thread_;
+  TrajectoryFileWriter writer_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TrajectoryRecorder> TrajectoryRecorderPtr;
+typedef boost::shared_ptr<const TrajectoryRecorder> TrajectoryRecorderConstPtr;
+
+}  // end namespace
+
+#endif
@@ -23,6 +23,9 @@
 #include <moveit/robot_state/conversions.h>
 #include <moveit/macros/console_colors.h>
 
+// ROS
+#include <eigen_conversions/eigen_msg.h>
+
 // Boost
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
@@ -391,8 +394,8 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         // Allow fingers to touch object
         manipulation_->allowFingerTouch(work_order.product_->getCollisionName(), arm_jmg);
 
-        // Generate and chose grasp
-        if (!manipulation_->chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose))
+        // Generate and chose grasp, best ranked first
+        if (!chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose))
         {
           ROS_ERROR_STREAM_NAMED("apc_manager", "No grasps found");
 
@@ -551,6 +554,7 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
                                                       moveit_grasps::LIFT))
         {
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to execute lift path after grasping");
+          recordGraspOutcome(work_order, grasp_candidates.front(), false);
           return false;
         }
 
@@ -584,6 +588,7 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
                                                       moveit_grasps::RETREAT))
         {
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to execute retreaval path");
+          recordGraspOutcome(work_order, grasp_candidates.front(), false);
           return false;
         }
 
@@ -604,6 +609,7 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         if (!placeObjectInGoalBin(arm_jmg))
         {
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to move object to goal bin");
+          recordGraspOutcome(work_order, grasp_candidates.front(), false);
           return false;
         }
 
@@ -619,12 +625,14 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         if (!manipulation_->openEE(true, arm_jmg))
         {
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to close end effector");
+          recordGraspOutcome(work_order, grasp_candidates.front(), false);
           return false;
         }
 
         if (!liftFromGoalBin(arm_jmg))
         {
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to lift up from goal bin");
+          recordGraspOutcome(work_order, grasp_candidates.front(), false);
           return false;
         }
 
@@ -638,6 +646,8 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         // Remove product from shelf
         shelf_->deleteProduct(work_order.bin_, work_order.product_);
 
+        recordGraspOutcome(work_order, grasp_candidates.front(), true);
+
         return true;
 
     }  // end switch
@@ -647,6 +657,25 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
   return true;
 }
 
+bool APCManager::chooseGrasp(const WorkOrder& work_order, JointModelGroup* arm_jmg,
+                             std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates,
+                             bool verbose)
+{
+  const ProductObjectPtr& product = work_order.product_;
+  return manipulation_->chooseGrasp(product->getWorldPose(shelf_, work_order.bin_),
+                                    product->getDepth(), product->getWidth(), product->getHeight(),
+                                    product->getName(), work_order.bin_->getName(), arm_jmg,
+                                    grasp_candidates, verbose);
+}
+
+void APCManager::recordGraspOutcome(const WorkOrder& work_order,
+                                    moveit_grasps::GraspCandidatePtr grasp_candidate, bool success)
+{
+  manipulation_->recordGraspOutcome(work_order.product_->getName(), work_order.bin_->getName(),
+                                    work_order.product_->getWorldPose(shelf_, work_order.bin_),
+                                    grasp_candidate, success);
+}
+
 // Mode 50
 bool APCManager::trainExperienceDatabase()
 {
@@ -987,7 +1016,7 @@ bool APCManager::testApproachLiftRetreat()
       std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
 
       // Generate and chose grasp
-      if (!manipulation_->chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose))
+      if (!chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose))
       {
         ROS_ERROR_STREAM_NAMED("apc_manager", "No grasps found for "
                                                   << work_order.product_->getName());
@@ -1265,10 +1294,11 @@ bool APCManager::recordCalibrationTrajectory(std::size_t id)
   trajectory_io_->getFilePath(file_path, file_name);
 
   // Start recording
-  trajectory_io_->recordTrajectoryToFile(file_path);
+  if (!trajectory_io_->recordTrajectoryToFile(file_path))
+    return false;
 
   ROS_INFO_STREAM_NAMED("apc_manager", "Done recording calibration trajectory");
-
+  return true;
   return true;
 }
 
@@ -1377,7 +1407,7 @@ bool APCManager::testGraspGenerator()
 
       // Generate and chose grasp
       bool success = true;
-      if (!manipulation_->chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose_))
+      if (!chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose_))
       {
         ROS_WARN_STREAM_NAMED("apc_manager", "No grasps found for product " << product->getName()
                                                                             << " in bin "
@@ -1700,7 +1730,8 @@ bool APCManager::recordBinWithCamera(BinObjectPtr bin)
   trajectory_io_->getFilePath(file_path, file_name);
 
   // Start recording
-  trajectory_io_->recordTrajectoryToFile(file_path);
+  if (!trajectory_io_->recordTrajectoryToFile(file_path))
+    return false;
 
   ROS_INFO_STREAM_NAMED("apc_manager", "Done recording bin with camera");
 
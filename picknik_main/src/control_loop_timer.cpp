@@ -0,0 +1,137 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Fixed period timing for control loops that run on their own thread
+*/
+
+// PickNik
+#include <picknik_main/control_loop_timer.h>
+
+// C++
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <algorithm>
+
+namespace picknik_main
+{
+namespace
+{
+const long NSEC_PER_SEC = 1000000000L;
+
+double toSec(const timespec& t)
+{
+  return t.tv_sec + t.tv_nsec / double(NSEC_PER_SEC);
+}
+}  // end anonymous namespace
+
+ControlLoopStats::ControlLoopStats() : period_(0.0)
+{
+  reset();
+}
+
+void ControlLoopStats::reset()
+{
+  steps_ = 0;
+  overruns_ = 0;
+  jitter_.clear();
+  mean_jitter_ = 0.0;
+  max_jitter_ = 0.0;
+  realtime_priority_ = false;
+}
+
+void ControlLoopStats::summarize()
+{
+  mean_jitter_ = 0.0;
+  max_jitter_ = 0.0;
+  if (jitter_.empty())
+    return;
+
+  for (std::size_t i = 0; i < jitter_.size(); ++i)
+  {
+    mean_jitter_ += jitter_[i];
+    max_jitter_ = std::max(max_jitter_, jitter_[i]);
+  }
+  mean_jitter_ /= jitter_.size();
+}
+
+void ControlLoopStats::print(std::ostream& out) const
+{
+  out << steps_ << " steps at " << period_ * 1000.0 << " ms, " << overruns_
+      << " overruns, jitter mean " << mean_jitter_ * 1000.0 << " ms max " << max_jitter_ * 1000.0
+      << " ms" << (realtime_priority_ ? "" : " (not real-time)");
+}
+
+ControlLoopTimer::ControlLoopTimer(double period, std::size_t expected_steps)
+  : period_ns_(static_cast<long>(period * NSEC_PER_SEC))
+{
+  stats_.period_ = period;
+  stats_.jitter_.reserve(expected_steps);
+}
+
+bool ControlLoopTimer::setRealtimePriority(int priority)
+{
+  if (priority <= 0)
+    return false;
+
+  sched_param param;
+  param.sched_priority = std::min(priority, sched_get_priority_max(SCHED_FIFO));
+  stats_.realtime_priority_ = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+  return stats_.realtime_priority_;
+}
+
+void ControlLoopTimer::start()
+{
+  clock_gettime(CLOCK_MONOTONIC, &deadline_);
+  advanceDeadline();
+}
+
+bool ControlLoopTimer::waitForNextStep()
+{
+  ++stats_.steps_;
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  // Work took longer than the period, skip the deadlines we already missed
+  bool on_time = true;
+  while (toSec(now) > toSec(deadline_))
+  {
+    on_time = false;
+    advanceDeadline();
+  }
+  if (!on_time)
+    ++stats_.overruns_;
+
+  // Retry if interrupted by a signal
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline_, NULL) == EINTR)
+  {
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (stats_.jitter_.size() < stats_.jitter_.capacity())
+    stats_.jitter_.push_back(toSec(now) - toSec(deadline_));
+
+  advanceDeadline();
+  return on_time;
+}
+
+void ControlLoopTimer::advanceDeadline()
+{
+  deadline_.tv_nsec += period_ns_;
+  while (deadline_.tv_nsec >= NSEC_PER_SEC)
+  {
+    deadline_.tv_nsec -= NSEC_PER_SEC;
+    ++deadline_.tv_sec;
+  }
+}
+
+}  // end namespace
@@ -244,6 +244,19 @@ bool ExecutionInterface::executeTrajectory(moveit_msgs::RobotTrajectory &traject
   return true;
 }
 
+bool ExecutionInterface::stopExecution()
+{
+  ROS_INFO_STREAM_NAMED("execution_interface", "Stopping trajectory execution");
+
+  // Ensure that execution manager has been loaded
+  if (!loadExecutionManager())
+    return false;
+
+  const bool auto_clear = true;
+  trajectory_execution_manager_->stopExecution(auto_clear);
+  return true;
+}
+
 bool ExecutionInterface::waitForExecution()
 {
   ROS_DEBUG_STREAM_NAMED("execution_interface", "Waiting for executing trajectory to finish");
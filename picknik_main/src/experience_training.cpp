@@ -0,0 +1,145 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Split experience database training across several processes on one machine
+*/
+
+// PickNik
+#include <picknik_main/experience_training.h>
+
+// Boost
+#include <boost/lexical_cast.hpp>
+
+// C++
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace picknik_main
+{
+std::string getWorkerDatabasePath(const std::string& database_path, int worker_id)
+{
+  const std::string suffix = "_worker" + boost::lexical_cast<std::string>(worker_id);
+
+  // Keep the extension, if the file name has one
+  const std::size_t slash = database_path.find_last_of('/');
+  const std::size_t dot = database_path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return database_path + suffix;
+  return database_path.substr(0, dot) + suffix + database_path.substr(dot);
+}
+
+ExperienceTrainingCoordinator::ExperienceTrainingCoordinator(ros::NodeHandle nh) : nh_(nh)
+{
+}
+
+bool ExperienceTrainingCoordinator::runWorkers(int num_workers,
+                                               const std::vector<std::string>& worker_args)
+{
+  // Workers are copies of this executable
+  char executable[PATH_MAX];
+  const ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+  if (length < 0)
+  {
+    ROS_ERROR_STREAM_NAMED("experience_training", "Unable to find own executable: "
+                                                      << strerror(errno));
+    return false;
+  }
+  executable[length] = '\0';
+
+  ROS_INFO_STREAM_NAMED("experience_training", "Starting " << num_workers << " training workers");
+  const ros::WallTime start_time = ros::WallTime::now();
+
+  bool success = true;
+  std::vector<pid_t> pids;
+  for (int worker_id = 0; worker_id < num_workers; ++worker_id)
+  {
+    // A namespace per worker keeps node names and relative topics apart
+    const std::string worker_namespace =
+        "/training_worker_" + boost::lexical_cast<std::string>(worker_id);
+    if (!copyParameters(worker_namespace))
+    {
+      success = false;
+      break;
+    }
+
+    std::vector<std::string> args;
+    args.push_back(executable);
+    args.insert(args.end(), worker_args.begin(), worker_args.end());
+    args.push_back("--worker_id=" + boost::lexical_cast<std::string>(worker_id));
+    args.push_back("--num_workers=" + boost::lexical_cast<std::string>(num_workers));
+    args.push_back("__ns:=" + worker_namespace);
+
+    // Build argv before forking, only exec is safe in the child of a threaded process
+    std::vector<char*> argv;
+    for (std::size_t i = 0; i < args.size(); ++i)
+      argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(NULL);
+
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+      execv(executable, &argv[0]);
+      _exit(127);
+    }
+    if (pid < 0)
+    {
+      ROS_ERROR_STREAM_NAMED("experience_training", "Unable to start worker " << worker_id << ": "
+                                                                              << strerror(errno));
+      success = false;
+      break;
+    }
+    pids.push_back(pid);
+  }
+
+  // Wait for every worker that started, even if a later one failed
+  for (std::size_t worker_id = 0; worker_id < pids.size(); ++worker_id)
+  {
+    int status = 0;
+    while (waitpid(pids[worker_id], &status, 0) < 0 && errno == EINTR)
+    {
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      ROS_ERROR_STREAM_NAMED("experience_training", "Worker " << worker_id
+                                                              << " did not finish cleanly");
+      success = false;
+    }
+    else
+      ROS_INFO_STREAM_NAMED("experience_training", "Worker " << worker_id << " finished");
+  }
+
+  ROS_INFO_STREAM_NAMED("experience_training", "Training workers done in "
+                                                   << (ros::WallTime::now() - start_time).toSec()
+                                                   << " s");
+  return success;
+}
+
+bool ExperienceTrainingCoordinator::copyParameters(const std::string& worker_namespace)
+{
+  XmlRpc::XmlRpcValue parameters;
+  if (!nh_.getParam(nh_.getNamespace(), parameters))
+  {
+    ROS_ERROR_STREAM_NAMED("experience_training", "Unable to read parameters of "
+                                                      << nh_.getNamespace());
+    return false;
+  }
+
+  // The worker node keeps this node's name inside its own namespace
+  ros::param::set(worker_namespace + ros::this_node::getName(), parameters);
+  return true;
+}
+
+}  // end namespace
@@ -0,0 +1,191 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Persistent record of grasp attempts used to try the grasps that worked before first
+*/
+
+// PickNik
+#include <picknik_main/grasp_statistics.h>
+
+// ROS
+#include <eigen_conversions/eigen_msg.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace picknik_main
+{
+namespace
+{
+/** \brief Sorts candidate indices by score, best first */
+struct ScoreGreater
+{
+  explicit ScoreGreater(const std::vector<double>& scores) : scores_(scores) {}
+  bool operator()(std::size_t a, std::size_t b) const { return scores_[a] > scores_[b]; }
+  const std::vector<double>& scores_;
+};
+}  // end anonymous namespace
+
+GraspStatistics::GraspStatistics(double position_resolution, std::size_t min_bin_attempts)
+  : position_resolution_(position_resolution), min_bin_attempts_(min_bin_attempts), attempts_(0)
+{
+}
+
+bool GraspStatistics::load(const std::string& file_path)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  // Replay previous attempts, a missing file just means nothing was recorded yet
+  std::ifstream input(file_path.c_str());
+  std::string line;
+  std::size_t loaded = 0;
+  while (std::getline(input, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    // product bin x y z qx qy qz qw success
+    std::istringstream stream(line);
+    GraspAttempt attempt;
+    double x, y, z, qx, qy, qz, qw;
+    if (!(stream >> attempt.product_ >> attempt.bin_ >> x >> y >> z >> qx >> qy >> qz >> qw >>
+          attempt.success_))
+    {
+      ROS_WARN_STREAM_NAMED("grasp_statistics", "Skipping malformed line: " << line);
+      continue;
+    }
+    attempt.product_to_grasp_ =
+        Eigen::Translation3d(x, y, z) * Eigen::Quaterniond(qw, qx, qy, qz).normalized();
+    count(attempt);
+    ++loaded;
+  }
+  input.close();
+
+  file_.close();
+  file_.open(file_path.c_str(), std::ios::app);
+  if (!file_.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_statistics", "Unable to open " << file_path);
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("grasp_statistics", "Loaded " << loaded << " grasp attempts from "
+                                                      << file_path);
+  return true;
+}
+
+void GraspStatistics::record(const GraspAttempt& attempt)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  count(attempt);
+
+  if (!file_.is_open())
+    return;
+
+  const Eigen::Quaterniond rotation(attempt.product_to_grasp_.rotation());
+  const Eigen::Vector3d& position = attempt.product_to_grasp_.translation();
+  file_ << attempt.product_ << " " << attempt.bin_ << " " << position.x() << " " << position.y()
+        << " " << position.z() << " " << rotation.x() << " " << rotation.y() << " "
+        << rotation.z() << " " << rotation.w() << " " << attempt.success_ << std::endl;
+}
+
+double GraspStatistics::getSuccessScore(const std::string& product, const std::string& bin,
+                                        const Eigen::Affine3d& product_to_grasp) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  // Prefer what happened in this bin once there is enough of it
+  Counts counts;
+  CountsMap::const_iterator it = counts_.find(getKey(product, bin, product_to_grasp));
+  if (it != counts_.end() && it->second.attempts_ >= min_bin_attempts_)
+    counts = it->second;
+  else
+  {
+    it = counts_.find(getKey(product, "", product_to_grasp));
+    if (it != counts_.end())
+      counts = it->second;
+  }
+
+  return (counts.successes_ + 1.0) / (counts.attempts_ + 2.0);
+}
+
+void GraspStatistics::rankGrasps(const std::string& product, const std::string& bin,
+                                 const Eigen::Affine3d& world_to_product,
+                                 std::vector<moveit_grasps::GraspCandidatePtr>& candidates) const
+{
+  const Eigen::Affine3d product_to_world = world_to_product.inverse();
+
+  std::vector<double> scores(candidates.size());
+  std::vector<std::size_t> order(candidates.size());
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+  {
+    Eigen::Affine3d world_to_grasp;
+    tf::poseMsgToEigen(candidates[i]->grasp_.grasp_pose.pose, world_to_grasp);
+    scores[i] = getSuccessScore(product, bin, product_to_world * world_to_grasp);
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), ScoreGreater(scores));
+
+  std::vector<moveit_grasps::GraspCandidatePtr> ranked(candidates.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    ranked[i] = candidates[order[i]];
+  candidates.swap(ranked);
+
+  if (!candidates.empty())
+    ROS_DEBUG_STREAM_NAMED("grasp_statistics", "Best of " << candidates.size()
+                                                          << " grasps scores "
+                                                          << scores[order.front()]);
+}
+
+std::string GraspStatistics::getApproachType(const Eigen::Affine3d& product_to_grasp)
+{
+  // Grasp poses approach the product along their x axis
+  const Eigen::Vector3d approach = product_to_grasp.rotation().col(0);
+
+  std::size_t axis = 0;
+  for (std::size_t i = 1; i < 3; ++i)
+    if (std::fabs(approach[i]) > std::fabs(approach[axis]))
+      axis = i;
+
+  // Named after the face entered through, which is opposite to the direction of travel
+  static const char* AXES[3] = {"x", "y", "z"};
+  return std::string(approach[axis] > 0 ? "-" : "+") + AXES[axis];
+}
+
+std::string GraspStatistics::getKey(const std::string& product, const std::string& bin,
+                                    const Eigen::Affine3d& product_to_grasp) const
+{
+  std::ostringstream key;
+  key << product << "/" << bin << "/" << getApproachType(product_to_grasp);
+  for (std::size_t i = 0; i < 3; ++i)
+    key << "/" << static_cast<long>(
+                      std::floor(product_to_grasp.translation()[i] / position_resolution_ + 0.5));
+  return key.str();
+}
+
+void GraspStatistics::count(const GraspAttempt& attempt)
+{
+  // Every attempt counts for its bin and for the product in general
+  Counts& bin_counts = counts_[getKey(attempt.product_, attempt.bin_, attempt.product_to_grasp_)];
+  Counts& product_counts = counts_[getKey(attempt.product_, "", attempt.product_to_grasp_)];
+  ++bin_counts.attempts_;
+  ++product_counts.attempts_;
+  if (attempt.success_)
+  {
+    ++bin_counts.successes_;
+    ++product_counts.successes_;
+  }
+  ++attempts_;
+}
+
+}  // end namespace
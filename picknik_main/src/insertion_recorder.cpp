@@ -0,0 +1,277 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Record tactile samples, tool poses and insertion decisions to a compact binary log
+*/
+
+// PickNik
+#include <picknik_main/insertion_recorder.h>
+
+// ROS
+#include <ros/ros.h>
+
+// C++
+#include <algorithm>
+#include <cstring>
+
+namespace picknik_main
+{
+namespace
+{
+// Writer falls this far behind before records are dropped, several seconds at full rate
+const std::size_t MAX_QUEUED_RECORDS = 100000;
+
+void fillPoseRecord(InsertionRecord& record, InsertionRecordType type, std::size_t step,
+                    const Eigen::Affine3d& pose)
+{
+  record.type_ = type;
+  record.step_ = step;
+  record.stamp_ = ros::Time::now().toSec();
+
+  const Eigen::Quaterniond q(pose.rotation());
+  record.values_[0] = pose.translation().x();
+  record.values_[1] = pose.translation().y();
+  record.values_[2] = pose.translation().z();
+  record.values_[3] = q.x();
+  record.values_[4] = q.y();
+  record.values_[5] = q.z();
+  record.values_[6] = q.w();
+  record.count_ = 7;
+}
+}  // end anonymous namespace
+
+InsertionRecorder::InsertionRecorder()
+  : recording_(false), stop_requested_(false), dropped_(0), written_(0), actual_pose_period_(0.02)
+{
+}
+
+InsertionRecorder::~InsertionRecorder()
+{
+  stop();
+}
+
+bool InsertionRecorder::start(const std::string& file_path)
+{
+  stop();
+
+  file_.open(file_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file_.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_recorder", "Unable to open log " << file_path);
+    return false;
+  }
+  file_.write(INSERTION_LOG_MAGIC, sizeof(INSERTION_LOG_MAGIC));
+  file_.write(reinterpret_cast<const char*>(&INSERTION_LOG_VERSION), sizeof(uint32_t));
+
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    queue_.clear();
+    queue_.reserve(MAX_QUEUED_RECORDS);
+    stop_requested_ = false;
+    dropped_ = 0;
+  }
+  written_ = 0;
+
+  writer_thread_ = boost::thread(&InsertionRecorder::writerThread, this);
+  recording_ = true;
+
+  ROS_INFO_STREAM_NAMED("insertion_recorder", "Recording insertion log to " << file_path);
+  return true;
+}
+
+void InsertionRecorder::stop()
+{
+  if (!writer_thread_.joinable())
+    return;
+
+  // Stop producers first so nothing is queued after the writer drains
+  recording_ = false;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    stop_requested_ = true;
+  }
+  queue_condition_.notify_one();
+  writer_thread_.join();
+
+  file_.close();
+
+  ROS_INFO_STREAM_NAMED("insertion_recorder", "Insertion log closed with "
+                                                  << written_ << " records, " << dropped_
+                                                  << " dropped");
+}
+
+void InsertionRecorder::setActualPoseSource(PoseSource source, double rate)
+{
+  actual_pose_source_ = source;
+  actual_pose_period_ = rate > 0 ? 1.0 / rate : 0.0;
+}
+
+void InsertionRecorder::recordTactile(const TactileSample& sample)
+{
+  if (!recording_)
+    return;
+
+  InsertionRecord record;
+  record.type_ = RECORD_TACTILE;
+  record.step_ = 0;
+  record.stamp_ = sample.stamp_.toSec();
+
+  std::size_t i = 0;
+  for (std::size_t j = 0; j < ALWAYS_AT_END; ++j)
+    record.values_[i++] = sample.data_[j];
+  record.values_[i++] = sample.filtered_force_;
+  record.values_[i++] = sample.filtered_torque_;
+  record.values_[i++] = sample.force_rate_;
+  record.values_[i++] = sample.torque_rate_;
+  record.values_[i++] = sample.sheer_theta_;
+  record.values_[i++] = sample.in_contact_;
+  record.values_[i++] = sample.slipping_;
+  record.count_ = i;
+
+  push(record);
+}
+
+void InsertionRecorder::recordCommandedPose(std::size_t step, const Eigen::Affine3d& pose)
+{
+  if (!recording_)
+    return;
+
+  InsertionRecord record;
+  fillPoseRecord(record, RECORD_COMMANDED_POSE, step, pose);
+  push(record);
+}
+
+void InsertionRecorder::recordDecision(std::size_t step, bool corrected, std::size_t hold_steps,
+                                       bool slipping)
+{
+  if (!recording_)
+    return;
+
+  InsertionRecord record;
+  record.type_ = RECORD_DECISION;
+  record.step_ = step;
+  record.stamp_ = ros::Time::now().toSec();
+  record.values_[0] = corrected;
+  record.values_[1] = hold_steps;
+  record.values_[2] = slipping;
+  record.count_ = 3;
+
+  push(record);
+}
+
+void InsertionRecorder::push(const InsertionRecord& record)
+{
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    if (queue_.size() >= MAX_QUEUED_RECORDS)
+    {
+      ++dropped_;
+      return;
+    }
+    queue_.push_back(record);  // capacity is reserved, never allocates
+  }
+  queue_condition_.notify_one();
+}
+
+void InsertionRecorder::writerThread()
+{
+  std::vector<InsertionRecord> batch;
+  batch.reserve(MAX_QUEUED_RECORDS);
+
+  ros::WallTime next_pose_sample = ros::WallTime::now();
+  bool done = false;
+  while (!done)
+  {
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      if (queue_.empty() && !stop_requested_)
+      {
+        // Wake up at least as often as actual poses need sampling
+        const double timeout = actual_pose_source_ && actual_pose_period_ > 0
+                                   ? actual_pose_period_
+                                   : 0.1;
+        queue_condition_.timed_wait(lock, boost::posix_time::microseconds(timeout * 1000000));
+      }
+      batch.swap(queue_);
+      done = stop_requested_;
+    }
+
+    for (std::size_t i = 0; i < batch.size(); ++i)
+      write(batch[i]);
+    batch.clear();
+
+    // Sample the actual pose here so that the robot state lock is never taken by the loop thread
+    if (!done && actual_pose_source_ && actual_pose_period_ > 0 &&
+        ros::WallTime::now() >= next_pose_sample)
+    {
+      next_pose_sample = ros::WallTime::now() + ros::WallDuration(actual_pose_period_);
+      Eigen::Affine3d pose;
+      if (actual_pose_source_(pose))
+      {
+        InsertionRecord record;
+        fillPoseRecord(record, RECORD_ACTUAL_POSE, 0, pose);
+        write(record);
+      }
+    }
+  }
+
+  file_.flush();
+}
+
+void InsertionRecorder::write(const InsertionRecord& record)
+{
+  file_.write(reinterpret_cast<const char*>(&record.type_), sizeof(record.type_));
+  file_.write(reinterpret_cast<const char*>(&record.count_), sizeof(record.count_));
+  file_.write(reinterpret_cast<const char*>(&record.step_), sizeof(record.step_));
+  file_.write(reinterpret_cast<const char*>(&record.stamp_), sizeof(record.stamp_));
+  file_.write(reinterpret_cast<const char*>(record.values_), record.count_ * sizeof(double));
+  ++written_;
+}
+
+bool InsertionRecorder::readHeader(std::istream& in)
+{
+  char magic[sizeof(INSERTION_LOG_MAGIC)];
+  uint32_t version = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  if (!in || memcmp(magic, INSERTION_LOG_MAGIC, sizeof(magic)) != 0)
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_recorder", "Not an insertion log");
+    return false;
+  }
+  if (version != INSERTION_LOG_VERSION)
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_recorder", "Unsupported insertion log version " << version);
+    return false;
+  }
+  return true;
+}
+
+bool InsertionRecorder::readRecord(std::istream& in, InsertionRecord& record)
+{
+  in.read(reinterpret_cast<char*>(&record.type_), sizeof(record.type_));
+  in.read(reinterpret_cast<char*>(&record.count_), sizeof(record.count_));
+  in.read(reinterpret_cast<char*>(&record.step_), sizeof(record.step_));
+  in.read(reinterpret_cast<char*>(&record.stamp_), sizeof(record.stamp_));
+  if (!in)
+    return false;
+
+  if (record.count_ > INSERTION_RECORD_MAX_VALUES)
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_recorder", "Corrupt record with " << record.count_
+                                                                       << " values");
+    return false;
+  }
+  in.read(reinterpret_cast<char*>(record.values_), record.count_ * sizeof(double));
+  return static_cast<bool>(in);
+}
+
+}  // end namespace
@@ -0,0 +1,317 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Search over insertion parameters by running trials back to back and scoring them
+*/
+
+// PickNik
+#include <picknik_main/insertion_sweep.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+// Boost
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// C++
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+
+namespace picknik_main
+{
+bool InsertionSweepScore::operator<(const InsertionSweepScore& other) const
+{
+  if (successes_ * other.trials_ != other.successes_ * trials_)
+    return getSuccessRate() > other.getSuccessRate();
+  return mean_time_ < other.mean_time_;
+}
+
+InsertionSweep::InsertionSweep(ManipulationDataPtr config, ros::NodeHandle nh)
+  : nh_(nh)
+  , config_(config)
+  , random_search_(false)
+  , random_trials_(20)
+  , seed_(0)
+  , repeats_(1)
+  , reset_pause_(1.0)
+  , output_directory_("/tmp")
+{
+  bindParameters();
+}
+
+void InsertionSweep::bindParameters()
+{
+  bound_parameters_["insertion_duration"] = &config_->insertion_duration_;
+  bound_parameters_["insertion_step_period"] = &config_->insertion_step_period_;
+  bound_parameters_["insertion_alter_pause"] = &config_->insertion_alter_pause_;
+  bound_parameters_["insertion_torque_scale"] = &config_->insertion_torque_scale_;
+  bound_parameters_["insertion_torque_max"] = &config_->insertion_torque_max_;
+  bound_parameters_["insertion_torque_min"] = &config_->insertion_torque_min_;
+}
+
+bool InsertionSweep::load()
+{
+  const std::string parent_name = "insertion_sweep";  // for namespacing logging messages
+
+  std::string search;
+  ros_param_utilities::getStringParameter(parent_name, nh_, "insertion_sweep/search", search);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "insertion_sweep/random_trials",
+                                       random_trials_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "insertion_sweep/seed", seed_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "insertion_sweep/repeats", repeats_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_sweep/reset_pause",
+                                          reset_pause_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "insertion_sweep/output_directory",
+                                          output_directory_);
+
+  if (search != "grid" && search != "random")
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_sweep", "Unknown search '" << search
+                                                                 << "', use grid or random");
+    return false;
+  }
+  random_search_ = search == "random";
+
+  // Logged by run() so a random sweep can be repeated
+  if (seed_ <= 0)
+    seed_ = time(NULL);
+
+  if (repeats_ < 1 || (random_search_ && random_trials_ < 1))
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_sweep", "Need at least one trial per configuration");
+    return false;
+  }
+
+  if (!nh_.getParam("insertion_sweep/parameters", names_) || names_.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_sweep", "No parameters to sweep, set "
+                                                  << nh_.getNamespace()
+                                                  << "/insertion_sweep/parameters");
+    return false;
+  }
+
+  values_.clear();
+  values_.resize(names_.size());
+  for (std::size_t i = 0; i < names_.size(); ++i)
+  {
+    if (!bound_parameters_.count(names_[i]))
+    {
+      ROS_ERROR_STREAM_NAMED("insertion_sweep", "Parameter " << names_[i]
+                                                              << " can not be swept");
+      return false;
+    }
+
+    ros_param_utilities::getDoubleParameters(parent_name, nh_,
+                                             "insertion_sweep/values/" + names_[i], values_[i]);
+    if (values_[i].empty() || (random_search_ && values_[i].size() != 2))
+    {
+      ROS_ERROR_STREAM_NAMED("insertion_sweep", "Parameter "
+                                                    << names_[i] << " needs "
+                                                    << (random_search_ ? "a [min, max] range"
+                                                                       : "a list of values"));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void InsertionSweep::generateConfigurations(
+    std::vector<std::vector<double> >& configurations) const
+{
+  configurations.clear();
+
+  if (random_search_)
+  {
+    std::mt19937 generator(seed_);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (int trial = 0; trial < random_trials_; ++trial)
+    {
+      std::vector<double> config(names_.size());
+      for (std::size_t i = 0; i < names_.size(); ++i)
+        config[i] = values_[i][0] + (values_[i][1] - values_[i][0]) * uniform(generator);
+      configurations.push_back(config);
+    }
+    return;
+  }
+
+  // Count through every combination like an odometer, last parameter changing fastest
+  std::vector<std::size_t> index(names_.size(), 0);
+  while (true)
+  {
+    std::vector<double> config(names_.size());
+    for (std::size_t i = 0; i < names_.size(); ++i)
+      config[i] = values_[i][index[i]];
+    configurations.push_back(config);
+
+    std::size_t i = names_.size();
+    while (i > 0 && ++index[i - 1] == values_[i - 1].size())
+    {
+      index[i - 1] = 0;
+      --i;
+    }
+    if (i == 0)
+      return;
+  }
+}
+
+void InsertionSweep::applyConfiguration(const std::vector<double>& values)
+{
+  for (std::size_t i = 0; i < names_.size(); ++i)
+    *bound_parameters_[names_[i]] = values[i];
+}
+
+bool InsertionSweep::run(TrialFunction trial)
+{
+  std::vector<std::vector<double> > configurations;
+  generateConfigurations(configurations);
+
+  const std::string file_prefix =
+      output_directory_ + "/insertion_sweep_" +
+      boost::posix_time::to_iso_string(boost::posix_time::second_clock::local_time());
+
+  // Rows are written as trials finish so an aborted sweep still leaves its results
+  const std::string results_path = file_prefix + ".csv";
+  std::ofstream results(results_path.c_str());
+  if (!results.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_sweep", "Unable to open " << results_path);
+    return false;
+  }
+  results << std::setprecision(10) << "config,repeat";
+  for (std::size_t i = 0; i < names_.size(); ++i)
+    results << "," << names_[i];
+  results << ",success,time_to_insert,depth,peak_force,corrections" << std::endl;
+
+  // Put the config back the way it was loaded no matter how the sweep ends
+  std::vector<double> original(names_.size());
+  for (std::size_t i = 0; i < names_.size(); ++i)
+    original[i] = *bound_parameters_[names_[i]];
+
+  ROS_INFO_STREAM_NAMED("insertion_sweep", "Sweeping " << names_.size() << " parameters over "
+                                                       << configurations.size()
+                                                       << " configurations, " << repeats_
+                                                       << " trials each");
+  if (random_search_)
+    ROS_INFO_STREAM_NAMED("insertion_sweep", "Random search seed " << seed_
+                                                                   << ", set insertion_sweep/seed "
+                                                                   << "to repeat it");
+
+  std::vector<InsertionSweepScore> scores;
+  bool aborted = false;
+  for (std::size_t config_id = 0; config_id < configurations.size() && !aborted; ++config_id)
+  {
+    applyConfiguration(configurations[config_id]);
+
+    InsertionSweepScore score;
+    score.config_id_ = config_id;
+    score.values_ = configurations[config_id];
+    score.successes_ = 0;
+    score.trials_ = 0;
+    score.mean_time_ = 0.0;
+
+    for (int repeat = 0; repeat < repeats_; ++repeat)
+    {
+      if (!ros::ok())
+      {
+        aborted = true;
+        break;
+      }
+
+      ROS_INFO_STREAM_NAMED("insertion_sweep", "Configuration " << config_id + 1 << "/"
+                                                                << configurations.size()
+                                                                << " trial " << repeat + 1 << "/"
+                                                                << repeats_);
+      InsertionTrialResult result;
+      if (!trial(result))
+      {
+        ROS_ERROR_STREAM_NAMED("insertion_sweep", "Trial failed to run, aborting sweep");
+        aborted = true;
+        break;
+      }
+
+      ++score.trials_;
+      if (result.success_)
+      {
+        ++score.successes_;
+        score.mean_time_ += result.time_to_insert_;
+      }
+
+      results << config_id << "," << repeat;
+      for (std::size_t i = 0; i < score.values_.size(); ++i)
+        results << "," << score.values_[i];
+      results << "," << result.success_ << "," << result.time_to_insert_ << ","
+              << result.depth_ << "," << result.peak_force_ << "," << result.corrections_
+              << std::endl;
+
+      ros::Duration(reset_pause_).sleep();
+    }
+
+    if (score.trials_ == 0)
+      continue;
+    score.mean_time_ = score.successes_ ? score.mean_time_ / score.successes_
+                                        : std::numeric_limits<double>::infinity();
+    scores.push_back(score);
+
+    ROS_INFO_STREAM_NAMED("insertion_sweep", "Configuration " << config_id + 1 << " succeeded "
+                                                              << score.successes_ << "/"
+                                                              << score.trials_ << ", mean time "
+                                                              << score.mean_time_ << " s");
+  }
+
+  applyConfiguration(original);
+  results.close();
+  ROS_INFO_STREAM_NAMED("insertion_sweep", "Wrote trial results to " << results_path);
+
+  if (scores.empty())
+    return false;
+
+  const InsertionSweepScore& best = *std::min_element(scores.begin(), scores.end());
+  if (best.successes_ == 0)
+  {
+    ROS_WARN_STREAM_NAMED("insertion_sweep", "No configuration succeeded");
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("insertion_sweep", "Best configuration " << best.config_id_
+                                                                 << " succeeded "
+                                                                 << best.successes_ << "/"
+                                                                 << best.trials_ << " in "
+                                                                 << best.mean_time_ << " s");
+  return writeBestConfig(file_prefix + "_best.yaml", best) && !aborted;
+}
+
+bool InsertionSweep::writeBestConfig(const std::string& file_path,
+                                     const InsertionSweepScore& best) const
+{
+  std::ofstream file(file_path.c_str());
+  if (!file.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("insertion_sweep", "Unable to open " << file_path);
+    return false;
+  }
+
+  // Same keys as picknik_r3.yaml so the snippet can be pasted over the old values
+  file << std::setprecision(10);
+  file << "# Insertion sweep best configuration, succeeded " << best.successes_ << "/"
+       << best.trials_ << " with mean time to insert " << best.mean_time_ << " s" << std::endl;
+  for (std::size_t i = 0; i < names_.size(); ++i)
+    file << names_[i] << ": " << best.values_[i] << std::endl;
+
+  ROS_INFO_STREAM_NAMED("insertion_sweep", "Wrote best configuration to " << file_path);
+  return true;
+}
+
+}  // end namespace
@@ -41,6 +41,13 @@
 
 #include <picknik_main/learning_pipeline.h>
 
+// Boost
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// C++
+#include <algorithm>
+
 namespace picknik_main
 {
 LearningPipeline::LearningPipeline(
@@ -126,148 +133,208 @@ bool LearningPipeline::generateTrainingGoalsBin(Eigen::Affine3d bin_transpose,
   }
 }
 
-bool LearningPipeline::analyzeGrasps(const moveit::core::JointModelGroup* arm_jmg)
+void LearningPipeline::createGrasps(const BinExperienceData& data,
+                                    const moveit::core::JointModelGroup* arm_jmg,
+                                    std::vector<moveit_msgs::Grasp>& possible_grasps)
 {
   const moveit::core::JointModelGroup* ee_jmg =
       robot_model_->getJointModelGroup(grasp_datas_[arm_jmg].ee_group_name_);
 
-  // Convert grasp vectors to grasp msgs
-  std::vector<moveit_msgs::Grasp> possible_grasps;
-
-  // Statistics for testing
-  std::size_t total_generated_grasps = 0;
-  std::size_t total_valid_ik_grasps = 0;
-  std::size_t total_collision_free_grasps = 0;
-
-  for (BinExperienceDataMap::iterator bin_it = bin_experience_data_.begin();
-       bin_it != bin_experience_data_.end(); bin_it++)
+  for (std::size_t i = 0; i < data.poses.size(); ++i)
   {
-    BinExperienceData& data = bin_it->second;
+    moveit_msgs::Grasp new_grasp;
+
+    /* The estimated probability of success for this grasp, or some other measure of how "good" it
+     * is.
+     * Here we base bias the score based on how far the wrist is from the surface, preferring a
+     * greater
+     * distance to prevent wrist/end effector collision with the table
+     */
+    new_grasp.grasp_quality = 1;  // TODO
+
+    // A name for this grasp
+    static int grasp_id = 0;
+    new_grasp.id = "Grasp" + boost::lexical_cast<std::string>(grasp_id);
+    ++grasp_id;
+
+    // The internal posture of the hand for the pre-grasp only positions are used
+    new_grasp.pre_grasp_posture = grasp_datas_[arm_jmg].pre_grasp_posture_;
+
+    // The internal posture of the hand for the grasp positions and efforts are used
+    new_grasp.grasp_posture = grasp_datas_[arm_jmg].grasp_posture_;
+
+    // The position of the end-effector for the grasp relative to a reference frame (that is
+    // always specified elsewhere, not in this message)
+    geometry_msgs::PoseStamped grasp_pose_msg;
+    grasp_pose_msg.header.stamp = ros::Time::now();
+    grasp_pose_msg.header.frame_id = robot_model_->getModelFrame();
+
+    // Transform based on EE type
+    Eigen::Affine3d eigen_grasp_pose =
+        data.poses[i] * grasp_datas_[arm_jmg].grasp_pose_to_eef_pose_;
+    tf::poseEigenToMsg(eigen_grasp_pose, grasp_pose_msg.pose);
+    new_grasp.grasp_pose = grasp_pose_msg;
+
+    // debug mode
+    if (false)
+    {
+      visuals_->visual_tools_->publishArrow(grasp_pose_msg.pose, rvt::RED);
+      visuals_->visual_tools_->publishEEMarkers(grasp_pose_msg.pose, ee_jmg);
+      ros::Duration(1).sleep();
+    }
 
-    for (std::size_t i = 0; i < data.poses.size(); ++i)
+    // the maximum contact force to use while grasping (<=0 to disable)
+    new_grasp.max_contact_force = 0;
+
+    // ---------------------------------------------------------------------------------------------
+    // Grasp parameters
+
+    // Create re-usable approach motion
+    moveit_msgs::GripperTranslation pre_grasp_approach;
+    pre_grasp_approach.direction.header.stamp = ros::Time::now();
+    pre_grasp_approach.desired_distance =
+        grasp_datas_[arm_jmg].finger_to_palm_depth_ +
+        approach_distance_desired_;  // The distance the origin of a robot link needs to travel
+    pre_grasp_approach.min_distance =
+        grasp_datas_[arm_jmg].finger_to_palm_depth_;  // half of the desired? Untested.
+
+    // Create re-usable retreat motion
+    moveit_msgs::GripperTranslation post_grasp_retreat;
+    post_grasp_retreat.direction.header.stamp = ros::Time::now();
+    post_grasp_retreat.desired_distance =
+        grasp_datas_[arm_jmg].finger_to_palm_depth_ +
+        approach_distance_desired_;  // The distance the origin of a robot link needs to travel
+    post_grasp_retreat.min_distance =
+        grasp_datas_[arm_jmg].finger_to_palm_depth_;  // half of the desired? Untested.
+
+    // Angled with pose
+    // -------------------------------------------------------------------------------------
+    // Approach with respect to end effector orientation
+
+    // Approach
+    bool approach_down = false;
+    if (approach_down)
     {
-      moveit_msgs::Grasp new_grasp;
-      total_generated_grasps++;
-
-      /* The estimated probability of success for this grasp, or some other measure of how "good" it
-       * is.
-       * Here we base bias the score based on how far the wrist is from the surface, preferring a
-       * greater
-       * distance to prevent wrist/end effector collision with the table
-       */
-      new_grasp.grasp_quality = 1;  // TODO
-
-      // A name for this grasp
-      static int grasp_id = 0;
-      new_grasp.id = "Grasp" + boost::lexical_cast<std::string>(grasp_id);
-      ++grasp_id;
-
-      // The internal posture of the hand for the pre-grasp only positions are used
-      new_grasp.pre_grasp_posture = grasp_datas_[arm_jmg].pre_grasp_posture_;
-
-      // The internal posture of the hand for the grasp positions and efforts are used
-      new_grasp.grasp_posture = grasp_datas_[arm_jmg].grasp_posture_;
-
-      // The position of the end-effector for the grasp relative to a reference frame (that is
-      // always specified elsewhere, not in this message)
-      geometry_msgs::PoseStamped grasp_pose_msg;
-      grasp_pose_msg.header.stamp = ros::Time::now();
-      grasp_pose_msg.header.frame_id = robot_model_->getModelFrame();
-
-      // Transform based on EE type
-      Eigen::Affine3d eigen_grasp_pose =
-          data.poses[i] * grasp_datas_[arm_jmg].grasp_pose_to_eef_pose_;
-      tf::poseEigenToMsg(eigen_grasp_pose, grasp_pose_msg.pose);
-      new_grasp.grasp_pose = grasp_pose_msg;
-
-      // debug mode
-      if (false)
-      {
-        visuals_->visual_tools_->publishArrow(grasp_pose_msg.pose, rvt::RED);
-        visuals_->visual_tools_->publishEEMarkers(grasp_pose_msg.pose, ee_jmg);
-        ros::Duration(1).sleep();
-      }
+      pre_grasp_approach.direction.header.frame_id = robot_model_->getModelFrame();
+      pre_grasp_approach.direction.vector.z = -1;
+    }
+    else
+    {
+      pre_grasp_approach.direction.header.frame_id = grasp_datas_[arm_jmg].parent_link_name_;
+      pre_grasp_approach.direction.vector.z = 1;
+    }
+    pre_grasp_approach.direction.vector.x = 0;
+    pre_grasp_approach.direction.vector.y = 0;
+    new_grasp.pre_grasp_approach = pre_grasp_approach;
 
-      // the maximum contact force to use while grasping (<=0 to disable)
-      new_grasp.max_contact_force = 0;
-
-      // ---------------------------------------------------------------------------------------------
-      // Grasp parameters
-
-      // Create re-usable approach motion
-      moveit_msgs::GripperTranslation pre_grasp_approach;
-      pre_grasp_approach.direction.header.stamp = ros::Time::now();
-      pre_grasp_approach.desired_distance =
-          grasp_datas_[arm_jmg].finger_to_palm_depth_ +
-          approach_distance_desired_;  // The distance the origin of a robot link needs to travel
-      pre_grasp_approach.min_distance =
-          grasp_datas_[arm_jmg].finger_to_palm_depth_;  // half of the desired? Untested.
-
-      // Create re-usable retreat motion
-      moveit_msgs::GripperTranslation post_grasp_retreat;
-      post_grasp_retreat.direction.header.stamp = ros::Time::now();
-      post_grasp_retreat.desired_distance =
-          grasp_datas_[arm_jmg].finger_to_palm_depth_ +
-          approach_distance_desired_;  // The distance the origin of a robot link needs to travel
-      post_grasp_retreat.min_distance =
-          grasp_datas_[arm_jmg].finger_to_palm_depth_;  // half of the desired? Untested.
-
-      // Angled with pose
-      // -------------------------------------------------------------------------------------
-      // Approach with respect to end effector orientation
-
-      // Approach
-      bool approach_down = false;
-      if (approach_down)
-      {
-        pre_grasp_approach.direction.header.frame_id = robot_model_->getModelFrame();
-        pre_grasp_approach.direction.vector.z = -1;
-      }
-      else
-      {
-        pre_grasp_approach.direction.header.frame_id = grasp_datas_[arm_jmg].parent_link_name_;
-        pre_grasp_approach.direction.vector.z = 1;
-      }
-      pre_grasp_approach.direction.vector.x = 0;
-      pre_grasp_approach.direction.vector.y = 0;
-      new_grasp.pre_grasp_approach = pre_grasp_approach;
+    // Retreat
+    if (approach_down)
+    {
+      post_grasp_retreat.direction.header.frame_id = robot_model_->getModelFrame();
+      post_grasp_retreat.direction.vector.z = 1;
+    }
+    else
+    {
+      post_grasp_retreat.direction.header.frame_id = grasp_datas_[arm_jmg].parent_link_name_;
+      post_grasp_retreat.direction.vector.z = -1;
+    }
+    post_grasp_retreat.direction.vector.x = 0;
+    post_grasp_retreat.direction.vector.y = 0;
+    new_grasp.post_grasp_retreat = post_grasp_retreat;
 
-      // Retreat
-      if (approach_down)
-      {
-        post_grasp_retreat.direction.header.frame_id = robot_model_->getModelFrame();
-        post_grasp_retreat.direction.vector.z = 1;
-      }
-      else
-      {
-        post_grasp_retreat.direction.header.frame_id = grasp_datas_[arm_jmg].parent_link_name_;
-        post_grasp_retreat.direction.vector.z = -1;
-      }
-      post_grasp_retreat.direction.vector.x = 0;
-      post_grasp_retreat.direction.vector.y = 0;
-      new_grasp.post_grasp_retreat = post_grasp_retreat;
+    // Add to vector
+    possible_grasps.push_back(new_grasp);
+  }
+}
 
-      // Add to vector
-      possible_grasps.push_back(new_grasp);
-    }
+bool LearningPipeline::analyzeGrasps(const moveit::core::JointModelGroup* arm_jmg)
+{
+  const moveit::core::JointModelGroup* ee_jmg =
+      robot_model_->getJointModelGroup(grasp_datas_[arm_jmg].ee_group_name_);
+
+  // One job per bin, so that workers never share grasps
+  std::vector<BinGraspJob> jobs;
+  for (BinExperienceDataMap::iterator bin_it = bin_experience_data_.begin();
+       bin_it != bin_experience_data_.end(); bin_it++)
+  {
+    jobs.push_back(BinGraspJob());
+    BinGraspJob& job = jobs.back();
+    job.bin_name_ = bin_it->first;
+    job.valid_ik_grasps_ = 0;
+    job.ik_time_ = 0;
+    job.collision_time_ = 0;
+    createGrasps(bin_it->second, arm_jmg, job.possible_grasps_);
+  }
+
+  // Snapshot the scene and start state once, workers only read them
+  planning_scene::PlanningScenePtr scene;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO locked_scene(
+        planning_scene_monitor_);  // Lock planning scene
+    (*current_state_) = locked_scene->getCurrentState();
+    scene = planning_scene::PlanningScene::clone(locked_scene);
   }
+  setStateWithOpenEE(true, current_state_);  // to be passed to the grasp filter
+  moveit::core::RobotStateConstPtr start_state(new moveit::core::RobotState(*current_state_));
+
+  const std::size_t num_workers =
+      std::max(1u, std::min<unsigned int>(boost::thread::hardware_concurrency(), jobs.size()));
 
-  // Filter the grasp for only the ones that are reachable
-  bool filter_pregrasps = true;
   std::cout << std::endl;
   std::cout << std::endl;
-  ROS_INFO_STREAM_NAMED("learning_pipeline", "Filtering grasps using IK, may take a minute");
-  grasp_filter_->filterGraspsKinematically(possible_grasps, filtered_grasps_, filter_pregrasps,
-                                           arm_jmg);
-  total_valid_ik_grasps = filtered_grasps_.size();
+  ROS_INFO_STREAM_NAMED("learning_pipeline", "Filtering grasps of " << jobs.size() << " bins");
+  const ros::WallTime start_time = ros::WallTime::now();
+
+  // The grasp filter already solves IK on a thread per core, so bins go through it one at a
+  // time instead of each on a worker of its own
+  moveit::core::RobotStatePtr ik_state(new moveit::core::RobotState(*start_state));
+  moveit_grasps::GraspFilter grasp_filter(ik_state, visuals_->grasp_markers_);
+  for (std::size_t i = 0; i < jobs.size() && ros::ok(); ++i)
+  {
+    const ros::WallTime ik_start = ros::WallTime::now();
+    bool filter_pregrasps = true;
+    grasp_filter.filterGraspsKinematically(jobs[i].possible_grasps_, jobs[i].filtered_grasps_,
+                                           filter_pregrasps, arm_jmg);
+    jobs[i].valid_ik_grasps_ = jobs[i].filtered_grasps_.size();
+    jobs[i].ik_time_ = (ros::WallTime::now() - ik_start).toSec();
+  }
+
+  // Collision checking is single threaded, so that is spread over the cores instead
+  std::size_t next_job = 0;
+  boost::mutex job_mutex;
+  boost::thread_group workers;
+  for (std::size_t i = 0; i < num_workers; ++i)
+    workers.create_thread(boost::bind(&LearningPipeline::filterCollisionsWorker, this, &jobs,
+                                      &next_job, &job_mutex, arm_jmg, start_state, scene));
+  workers.join_all();
+
+  const double total_time = (ros::WallTime::now() - start_time).toSec();
+
+  // Merge in bin order so results do not depend on thread timing
+  std::vector<moveit_msgs::Grasp> possible_grasps;
+  std::size_t total_generated_grasps = 0;
+  std::size_t total_valid_ik_grasps = 0;
+  std::size_t total_collision_free_grasps = 0;
+  double total_ik_time = 0;
+  double total_collision_time = 0;
+  filtered_grasps_.clear();
+  for (std::size_t i = 0; i < jobs.size(); ++i)
+  {
+    total_generated_grasps += jobs[i].possible_grasps_.size();
+    total_valid_ik_grasps += jobs[i].valid_ik_grasps_;
+    total_collision_free_grasps += jobs[i].filtered_grasps_.size();
+    total_ik_time += jobs[i].ik_time_;
+    total_collision_time += jobs[i].collision_time_;
+    filtered_grasps_.insert(filtered_grasps_.end(), jobs[i].filtered_grasps_.begin(),
+                            jobs[i].filtered_grasps_.end());
+    if (verbose_)
+      possible_grasps.insert(possible_grasps.end(), jobs[i].possible_grasps_.begin(),
+                             jobs[i].possible_grasps_.end());
+  }
 
   // Visulizations
   if (verbose_)
   {
-    // Visualize valid grasps as arrows with cartesian path as well
-    ROS_DEBUG_STREAM_NAMED("learning.ik_filtered_grasps",
-                           "enabled" << visualizeGrasps(filtered_grasps_, arm_jmg));
-
     // Visualize animated grasps
     double animation_speed = 0.01;
     ROS_DEBUG_STREAM_NAMED("learning.ik_animated_grasps",
@@ -275,59 +342,103 @@ bool LearningPipeline::analyzeGrasps(const moveit::core::JointModelGroup* arm_jm
                                << visuals_->visual_tools_->publishAnimatedGrasps(
                                    possible_grasps, ee_jmg, animation_speed));
 
-    // Visualize IK solutions
-    ROS_DEBUG_STREAM_NAMED("learning.ik_filtered_solutions",
+    // Visualize valid grasps after collision filtering with arrows
+    bool show_cartesian_path = false;
+    ROS_DEBUG_STREAM_NAMED("learning.collision_filtered_grasps",
+                           "enabled"
+                               << visuals_->visual_tools_->deleteAllMarkers()
+                               << visualizeGrasps(filtered_grasps_, arm_jmg, show_cartesian_path));
+
+    // Visualize IK solutions after collision filtering
+    ROS_DEBUG_STREAM_NAMED("learning.collision_filtered_solutions",
                            "enabled" << visualizeIKSolutions(filtered_grasps_, arm_jmg));
   }
 
-  ROS_INFO_STREAM_NAMED("learning_pipeline", "Filtering grasps by collision");
+  // Output statistics
+  std::cout << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+  for (std::size_t i = 0; i < jobs.size(); ++i)
+    std::cout << jobs[i].bin_name_ << ": " << jobs[i].possible_grasps_.size() << " generated, "
+              << jobs[i].valid_ik_grasps_ << " IK (" << jobs[i].ik_time_ << " s), "
+              << jobs[i].filtered_grasps_.size() << " collision free ("
+              << jobs[i].collision_time_ << " s)" << std::endl;
+  std::cout << std::endl;
+  std::cout << "Total Generated Grasps: " << total_generated_grasps << std::endl;
+  std::cout << "Grasps with valid IK:   " << total_valid_ik_grasps << std::endl;
+  std::cout << "Percent valid: "
+            << (double(total_valid_ik_grasps) / total_generated_grasps * 100.0) << " %"
+            << std::endl;
+  std::cout << std::endl;
+  std::cout << "Grasps not in collision: " << total_collision_free_grasps << std::endl;
+  std::cout << "Percent valid: "
+            << (double(total_collision_free_grasps) / total_generated_grasps * 100.0) << " %"
+            << std::endl;
+  std::cout << std::endl;
+  std::cout << "IK filtering:        " << total_ik_time << " s" << std::endl;
+  std::cout << "Collision filtering: " << total_collision_time << " s of thread time" << std::endl;
+  std::cout << "Wall time:           " << total_time << " s, collisions on " << num_workers
+            << " threads" << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+  std::cout << std::endl;
 
-  // Filter grasps based on collision
+  return true;
+}
+
+void LearningPipeline::filterCollisionsWorker(std::vector<BinGraspJob>* jobs,
+                                              std::size_t* next_job, boost::mutex* job_mutex,
+                                              const moveit::core::JointModelGroup* arm_jmg,
+                                              moveit::core::RobotStateConstPtr start_state,
+                                              planning_scene::PlanningSceneConstPtr scene)
+{
+  // Nothing here is shared with the other workers except the scene, which is only read
+  moveit::core::RobotState robot_state(*start_state);
+  planning_scene::PlanningScenePtr worker_scene = scene->diff();
+
+  while (ros::ok())
   {
-    planning_scene_monitor::LockedPlanningSceneRO scene(
-        planning_scene_monitor_);  // Lock planning scene
-    (*current_state_) = scene->getCurrentState();
-  }
+    BinGraspJob* job;
+    {
+      boost::mutex::scoped_lock lock(*job_mutex);
+      if (*next_job >= jobs->size())
+        return;
+      job = &(*jobs)[(*next_job)++];
+    }
 
-  setStateWithOpenEE(true, current_state_);  // to be passed to the grasp filter
+    const ros::WallTime stage_start = ros::WallTime::now();
+    robot_state = *start_state;
+    filterGraspsInCollision(job->filtered_grasps_, *worker_scene, robot_state, arm_jmg);
+    job->collision_time_ = (ros::WallTime::now() - stage_start).toSec();
+  }
+}
 
-  // Filter by collision
-  ROS_INFO_STREAM_NAMED("learning", "Filtering grasps by collision checking");
-  bool filter_verbose = false;
-  grasp_filter_->filterGraspsInCollision(filtered_grasps_, planning_scene_monitor_, arm_jmg,
-                                         current_state_, filter_verbose);
-  total_collision_free_grasps = filtered_grasps_.size();
+void LearningPipeline::filterGraspsInCollision(std::vector<moveit_grasps::GraspSolution>& grasps,
+                                               const planning_scene::PlanningScene& scene,
+                                               moveit::core::RobotState& robot_state,
+                                               const moveit::core::JointModelGroup* arm_jmg)
+{
+  std::vector<moveit_grasps::GraspSolution> collision_free;
+  collision_free.reserve(grasps.size());
 
-  // Visualize valid grasps after collision filtering with arrows
-  if (verbose_)
+  for (std::size_t i = 0; i < grasps.size(); ++i)
   {
-    // Visualize valid grasps as arrows with cartesian path as well
-    bool show_cartesian_path = false;
-    ROS_DEBUG_STREAM_NAMED("learning.collision_filtered_grasps",
-                           "enabled"
-                               << visuals_->visual_tools_->deleteAllMarkers()
-                               << visualizeGrasps(filtered_grasps_, arm_jmg, show_cartesian_path));
+    // Check every link, the open fingers hit the shelf walls more often than the arm does
+    robot_state.setJointGroupPositions(arm_jmg, grasps[i].grasp_ik_solution_);
+    robot_state.update();
+    if (scene.isStateColliding(robot_state))
+      continue;
 
-    // Output statistics
-    std::cout << std::endl;
-    std::cout << "-------------------------------------------------------" << std::endl;
-    std::cout << "Total Generated Grasps: " << total_generated_grasps << std::endl;
-    std::cout << "Grasps with valid IK:   " << total_valid_ik_grasps << std::endl;
-    std::cout << "Percent valid: "
-              << (double(total_valid_ik_grasps) / total_generated_grasps * 100.0) << " %"
-              << std::endl;
-    std::cout << std::endl;
-    std::cout << "Grasps not in collision: " << total_collision_free_grasps << std::endl;
-    std::cout << "Percent valid: "
-              << (double(total_collision_free_grasps) / total_generated_grasps * 100.0) << " %"
-              << std::endl;
-    std::cout << "-------------------------------------------------------" << std::endl;
-    std::cout << std::endl;
+    if (!grasps[i].pregrasp_ik_solution_.empty())
+    {
+      robot_state.setJointGroupPositions(arm_jmg, grasps[i].pregrasp_ik_solution_);
+      robot_state.update();
+      if (scene.isStateColliding(robot_state))
+        continue;
+    }
 
-    // Visualize IK solutions after collision filtering
-    ROS_DEBUG_STREAM_NAMED("learning.collision_filtered_solutions",
-                           "enabled" << visualizeIKSolutions(filtered_grasps_, arm_jmg));
+    collision_free.push_back(grasps[i]);
   }
+
+  grasps.swap(collision_free);
 }
 
 bool LearningPipeline::planToGrasps(const moveit::core::JointModelGroup* arm_jmg)
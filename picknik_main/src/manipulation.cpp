@@ -27,12 +27,127 @@
 // OMPL
 #include <ompl/tools/lightning/Lightning.h>
 #include <ompl/tools/thunder/Thunder.h>
+#include <ompl/geometric/PathSimplifier.h>
 
 // moveit_grasps
 #include <moveit_grasps/grasp_generator.h>
 
+// ROS
+#include <eigen_conversions/eigen_msg.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <sstream>
+
 namespace picknik_main
 {
+namespace
+{
+// States closer than this in every coordinate are treated as the same when merging databases
+const double MERGE_RESOLUTION = 1e-4;
+
+typedef std::vector<long> StateKey;
+
+void appendStateKey(const ompl::base::StateSpacePtr& space, const ompl::base::State* state,
+                    StateKey& key)
+{
+  std::vector<double> reals;
+  space->copyToReals(reals, state);
+  for (std::size_t i = 0; i < reals.size(); ++i)
+    key.push_back(static_cast<long>(std::floor(reals[i] / MERGE_RESOLUTION + 0.5)));
+}
+
+/** \brief Undirected edge between two graph vertices */
+StateKey getEdgeKey(const ompl::base::StateSpacePtr& space, const ompl::base::State* a,
+                    const ompl::base::State* b)
+{
+  StateKey key_a, key_b;
+  appendStateKey(space, a, key_a);
+  appendStateKey(space, b, key_b);
+  if (key_b < key_a)
+    key_a.swap(key_b);
+  key_a.insert(key_a.end(), key_b.begin(), key_b.end());
+  return key_a;
+}
+
+/** \brief All vertices of a lightning path, in order */
+StateKey getPathKey(const ompl::base::StateSpacePtr& space, const ompl::base::PlannerData& path)
+{
+  StateKey key;
+  for (std::size_t i = 0; i < path.numVertices(); ++i)
+    appendStateKey(space, path.getVertex(i).getState(), key);
+  return key;
+}
+
+/** \brief A second database of the same type on the same state space, loaded from file_path */
+ompl::tools::ExperienceSetupPtr loadExperienceDatabase(bool thunder,
+                                                       const ompl::base::StateSpacePtr& space,
+                                                       const std::string& file_path,
+                                                       double& load_time)
+{
+  ompl::tools::ExperienceSetupPtr experience_setup;
+  if (thunder)
+    experience_setup.reset(new ompl::tools::Thunder(space));
+  else
+    experience_setup.reset(new ompl::tools::Lightning(space));
+
+  // setup() loads the database at the file path
+  const ros::WallTime start_time = ros::WallTime::now();
+  experience_setup->setFilePath(file_path);
+  experience_setup->setup();
+  load_time = (ros::WallTime::now() - start_time).toSec();
+  return experience_setup;
+}
+
+/** \brief Bytes on disk, 0 if the file is missing */
+std::size_t getFileSize(const std::string& file_path)
+{
+  std::ifstream file(file_path.c_str(), std::ios::binary | std::ios::ate);
+  return file.is_open() ? static_cast<std::size_t>(file.tellg()) : 0;
+}
+
+/**
+ * \brief Seconds to recall the nearest experiences of every start and goal pair, which is the
+ *        part of planning that the size and layout of a database affect
+ */
+double timeRecall(const ompl::tools::ExperienceSetupPtr& experience_setup, bool thunder,
+                  const std::vector<ompl::base::State*>& starts,
+                  const std::vector<ompl::base::State*>& goals)
+{
+  static const int NEAREST_K = 10;
+
+  const ros::WallTime start_time = ros::WallTime::now();
+  for (std::size_t i = 0; i < starts.size(); ++i)
+  {
+    if (thunder)
+    {
+      ompl::geometric::SPARSdb::CandidateSolution candidate_solution;
+      boost::dynamic_pointer_cast<ompl::tools::Thunder>(experience_setup)
+          ->getExperienceDB()
+          ->findNearestStartGoal(NEAREST_K, starts[i], goals[i], candidate_solution,
+                                 ompl::base::plannerNonTerminatingCondition());
+    }
+    else
+      boost::dynamic_pointer_cast<ompl::tools::Lightning>(experience_setup)
+          ->getExperienceDB()
+          ->findNearestStartGoal(NEAREST_K, starts[i], goals[i]);
+  }
+  return (ros::WallTime::now() - start_time).toSec();
+}
+
+/** \brief Both ends and the motion between them are valid in the current planning scene */
+bool isMotionValid(const ompl::base::SpaceInformationPtr& si, const ompl::base::State* from,
+                   const ompl::base::State* to)
+{
+  return si->isValid(from) && si->checkMotion(from, to);
+}
+}  // end anonymous namespace
+
 Manipulation::Manipulation(bool verbose, VisualsPtr visuals,
                            planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
                            ManipulationDataPtr config, moveit_grasps::GraspDatas grasp_datas,
@@ -46,6 +161,14 @@ Manipulation::Manipulation(bool verbose, VisualsPtr visuals,
   , grasp_datas_(grasp_datas)
   , remote_control_(remote_control)
   , tactile_feedback_(tactile_feedback)
+  , tactile_slipping_(false)
+  , insertion_corrections_(0)
+  , insertion_peak_force_(0.0)
+  , insertion_depth_(0.0)
+  , teleop_target_move_(false)
+  , teleop_target_sequence_(0)
+  , teleop_arm_jmg_(NULL)
+  , teleop_running_(false)
 {
   // Create initial robot state
   {
@@ -87,10 +210,39 @@ Manipulation::Manipulation(bool verbose, VisualsPtr visuals,
   grasp_planner_->setWaitForNextStepCallback(
       boost::bind(&picknik_main::RemoteControl::waitForNextStep, remote_control_, _1));
 
+  // Load reachability map
+  reachability_rejections_ = 0;
+  if (!config_->reachability_map_file_.empty())
+  {
+    reachability_map_.reset(new ReachabilityMap());
+    if (!reachability_map_->load(config_->reachability_map_file_))
+    {
+      ROS_WARN_STREAM_NAMED("manipulation", "Running without a reachability map, build one with "
+                                            "--mode 14");
+      reachability_map_.reset();
+    }
+  }
+
+  // Load grasp outcomes
+  grasp_statistics_.reset(new GraspStatistics());
+  if (!config_->grasp_statistics_file_.empty())
+    grasp_statistics_->load(config_->grasp_statistics_file_);
+
+  // Listen for contact and slip of the tactile sensor
+  if (tactile_feedback_)
+    tactile_feedback_->setTactileEventCallback(std::bind(&Manipulation::tactileEventCallback, this,
+                                                         std::placeholders::_1,
+                                                         std::placeholders::_2));
+
   // Done
   ROS_INFO_STREAM_NAMED("manipulation", "Manipulation Ready.");
 }
 
+Manipulation::~Manipulation()
+{
+  stopTeleoperation();
+}
+
 bool Manipulation::computeCartesianWaypointPath(
     JointModelGroup* arm_jmg, const moveit::core::RobotStatePtr start_state,
     const EigenSTL::vector_Affine3d& waypoints,
@@ -238,6 +390,94 @@ bool Manipulation::moveCartesianWaypointPath(JointModelGroup* arm_jmg,
   return true;
 }
 
+bool Manipulation::executeSearchPath(JointModelGroup* arm_jmg,
+                                     const EigenSTL::vector_Affine3d& tool_waypoints,
+                                     double velocity_scaling_factor, bool stop_on_contact,
+                                     bool& contact_found)
+{
+  contact_found = false;
+  if (tool_waypoints.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "No search waypoints");
+    return false;
+  }
+
+  // Move poses from tips of finger (tool) back to base of EE
+  EigenSTL::vector_Affine3d ee_waypoints(tool_waypoints.size());
+  for (std::size_t i = 0; i < tool_waypoints.size(); ++i)
+    ee_waypoints[i] = tool_waypoints[i] * config_->teleoperation_offset_;
+
+  // Solve IK for the whole pattern at once
+  moveit_grasps::GraspTrajectories segmented_cartesian_traj;
+  if (!computeCartesianWaypointPath(arm_jmg, getCurrentState(), ee_waypoints,
+                                    segmented_cartesian_traj))
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Unable to plan search path");
+    return false;
+  }
+
+  // Combine segmented trajectory into single trajectory, starting from the current state
+  std::vector<moveit::core::RobotStatePtr> robot_state_trajectory;
+  robot_state_trajectory.push_back(getCurrentState());
+  for (std::size_t i = 0; i < segmented_cartesian_traj.size(); ++i)
+    robot_state_trajectory.insert(robot_state_trajectory.end(),
+                                  segmented_cartesian_traj[i].begin(),
+                                  segmented_cartesian_traj[i].end());
+
+  // Time parameterize once
+  moveit_msgs::RobotTrajectory trajectory_msg;
+  const bool interpolate = false;  // waypoints are already dense
+  if (!convertRobotStatesToTrajectory(robot_state_trajectory, trajectory_msg, arm_jmg,
+                                      velocity_scaling_factor, interpolate))
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Failed to convert to parameterized trajectory");
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("manipulation", "Executing search path of "
+                                            << tool_waypoints.size() << " waypoints, "
+                                            << robot_state_trajectory.size() << " states");
+
+  if (!stop_on_contact)
+    return execution_interface_->executeTrajectory(trajectory_msg, arm_jmg);
+
+  // Send without blocking so that we can watch for contact
+  const bool wait_for_execution = false;
+  if (!execution_interface_->executeTrajectory(trajectory_msg, arm_jmg, wait_for_execution))
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Failed to execute search path");
+    return false;
+  }
+
+  std::atomic<bool> finished(false);
+  boost::thread wait_thread(
+      std::bind(&Manipulation::waitForExecutionThread, this, std::ref(finished)));
+
+  ros::Rate contact_rate(100);
+  while (!finished && ros::ok())
+  {
+    if (tactile_feedback_ && tactile_feedback_->getLatestSample().in_contact_)
+    {
+      contact_found = true;
+      execution_interface_->stopExecution();
+      break;
+    }
+    contact_rate.sleep();
+  }
+  wait_thread.join();
+
+  if (contact_found)
+    ROS_INFO_STREAM_NAMED("manipulation", "Search path stopped on contact");
+
+  return true;
+}
+
+void Manipulation::waitForExecutionThread(std::atomic<bool>& finished)
+{
+  execution_interface_->waitForExecution();
+  finished = true;
+}
+
 bool Manipulation::moveToSRDFPose(JointModelGroup* arm_jmg, const std::string& pose_name,
                                   double velocity_scaling_factor, bool check_validity)
 {
@@ -566,6 +806,8 @@ bool Manipulation::planPostProcessing()
 
     // Save database
     ROS_DEBUG_STREAM_NAMED("manipulation", "Saving experience db...");
+    if (!experience_database_path_.empty())
+      experience_setup->setFilePath(experience_database_path_);
     experience_setup->saveIfChanged();
 
     // Display logs
@@ -801,6 +1043,82 @@ bool Manipulation::moveDirectToState(const moveit::core::RobotStatePtr goal_stat
   return true;
 }
 
+bool Manipulation::chooseGrasp(const Eigen::Affine3d& world_to_product, double depth,
+                               double width, double height, const std::string& product,
+                               const std::string& bin, JointModelGroup* arm_jmg,
+                               std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates,
+                               bool verbose, moveit::core::RobotStatePtr seed_state)
+{
+  grasp_candidates.clear();
+  if (!grasp_generator_->generateGrasps(world_to_product, depth, width, height,
+                                        grasp_datas_[arm_jmg], grasp_candidates))
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Unable to generate grasps for " << product);
+    return false;
+  }
+
+  // Try the grasps that worked before first, IK is by far the slowest part so the ranked grasps
+  // are checked a batch at a time and the rest are only checked if a whole batch fails
+  std::vector<moveit_grasps::GraspCandidatePtr> ranked_candidates;
+  ranked_candidates.swap(grasp_candidates);
+  const std::size_t generated = ranked_candidates.size();
+  grasp_statistics_->rankGrasps(product, bin, world_to_product, ranked_candidates);
+  const std::size_t batch_size = config_->grasp_filter_max_candidates_ > 0
+                                     ? std::size_t(config_->grasp_filter_max_candidates_)
+                                     : generated;
+
+  if (!seed_state)
+    seed_state = getCurrentState();
+
+  std::size_t checked = 0;
+  while (grasp_candidates.empty() && checked < generated)
+  {
+    const std::size_t batch_end = std::min(generated, checked + batch_size);
+    grasp_candidates.assign(ranked_candidates.begin() + checked,
+                            ranked_candidates.begin() + batch_end);
+    checked = batch_end;
+
+    bool filter_pregrasps = true;
+    if (!grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg,
+                                     seed_state, filter_pregrasps))
+    {
+      ROS_ERROR_STREAM_NAMED("manipulation", "Filter grasps failed");
+      return false;
+    }
+
+    // Removal keeps the ranked order
+    grasp_filter_->removeInvalidGrasps(grasp_candidates);
+  }
+
+  if (grasp_candidates.empty())
+  {
+    ROS_WARN_STREAM_NAMED("manipulation", "No valid grasps for " << product << " in " << bin);
+    return false;
+  }
+
+  if (verbose)
+    ROS_INFO_STREAM_NAMED("manipulation", grasp_candidates.size() << " valid of the best "
+                                                                  << checked << " of " << generated
+                                                                  << " generated grasps");
+  return true;
+}
+
+void Manipulation::recordGraspOutcome(const std::string& product, const std::string& bin,
+                                      const Eigen::Affine3d& world_to_product,
+                                      const moveit_grasps::GraspCandidatePtr& grasp_candidate,
+                                      bool success)
+{
+  Eigen::Affine3d world_to_grasp;
+  tf::poseMsgToEigen(grasp_candidate->grasp_.grasp_pose.pose, world_to_grasp);
+
+  GraspAttempt attempt;
+  attempt.product_ = product;
+  attempt.bin_ = bin;
+  attempt.product_to_grasp_ = world_to_product.inverse() * world_to_grasp;
+  attempt.success_ = success;
+  grasp_statistics_->record(attempt);
+}
+
 bool Manipulation::executeApproachPath(moveit_grasps::GraspCandidatePtr chosen_grasp)
 {
   ROS_WARN_STREAM_NAMED("temp", "deprecated");
@@ -1126,6 +1444,13 @@ bool Manipulation::executeInsertionClosedLoop(JointModelGroup* arm_jmg, double d
                                               Eigen::Affine3d& desired_world_to_tool,
                                               bool direction_in, bool& achieved_depth)
 {
+  const double step_period = config_->insertion_step_period_;
+  if (step_period <= 0)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Invalid insertion step period " << step_period);
+    return false;
+  }
+
   // Copy pose
   teleop_world_to_tool_ = desired_world_to_tool;
 
@@ -1136,93 +1461,164 @@ bool Manipulation::executeInsertionClosedLoop(JointModelGroup* arm_jmg, double d
   // the direction can be in the local reference frame (in which case we rotate it)
   const Eigen::Vector3d rotated_direction = teleop_world_to_tool_.rotation() * approach_direction;
 
-  // The target pose is built by applying a translation to the start pose for the desired direction
-  // and distance
-  // Eigen::Affine3d teleop_world_to_tool__base_frame;
-  std::size_t num_steps = desired_distance * config_->insertion_steps_per_meter_;
-  // don't allow waypoints to be reached before next goal sent
-  static const double SMOOTH_FACTOR = 1.1;
-
   // Pre-calculate values
-  double step_distance = desired_distance / double(num_steps);
-  double step_duration = config_->insertion_duration_ / double(num_steps);
+  const std::size_t num_steps =
+      std::max(1.0, ceil(config_->insertion_duration_ / step_period));
+  const double step_distance = desired_distance / double(num_steps);
+  // After a correction hold depth this many steps so the arm can settle
+  const std::size_t hold_steps = config_->insertion_alter_pause_ / step_period;
+
+  // The base does not move during insertion, so look it up once instead of locking the scene
+  // every step
+  const Eigen::Affine3d base_to_world =
+      getCurrentState()->getGlobalLinkTransform("base_link").inverse();
 
-  std::cout << "step_distance: " << step_distance << std::endl;
-  std::cout << "step_duration: " << step_duration << std::endl;
+  ROS_INFO_STREAM_NAMED("manipulation", (direction_in ? "Inserting " : "Retracting ")
+                                            << desired_distance << "m in " << num_steps
+                                            << " steps of " << step_period * 1000.0 << " ms");
 
   achieved_depth = true;  // assume it works
+  const Eigen::Affine3d start_world_to_tool = teleop_world_to_tool_;
 
-  ros::Rate rate_limiter(1 / step_duration);  // specify the hz
-  // Begin soft-real time loop
-  for (std::size_t i = 0; i < num_steps; ++i)
+  ControlLoopTimer timer(step_period, num_steps);
+  std::size_t step = 0;
+  std::size_t corrections = 0;
+  bool rejected = false;
+  insertion_peak_force_ = 0.0;
+  while (step < num_steps && !rejected && ros::ok())
   {
-    // Check if program needs to end
-    if (!ros::ok())
-      break;
-
+    // The loop thread never blocks on the user, so pause out here and then resume
     if (remote_control_->getStop())
       remote_control_->waitForNextStep("clear stop");
 
-    if (direction_in)
-      std::cout << "insertion,  step " << i << std::endl;
-    else
-      std::cout << "retracting, step " << i << std::endl;
+    boost::thread loop_thread(std::bind(&Manipulation::insertionLoop, this, arm_jmg,
+                                        std::cref(rotated_direction), step_distance, num_steps,
+                                        hold_steps, std::cref(base_to_world), direction_in,
+                                        std::ref(timer), std::ref(step), std::ref(corrections),
+                                        std::ref(rejected)));
+    loop_thread.join();
+  }
+
+  // Check how far the tool actually went, the commanded pose says nothing about a jammed part.
+  // The arm trails the last command, so let it settle before reading its pose
+  static const double SETTLE_TIMEOUT = 2.0;  // sec
+  waitForRobotToStop(SETTLE_TIMEOUT);
+  insertion_depth_ = 0.0;
+  Eigen::Affine3d actual_world_to_tool;
+  if (getActualToolPose(arm_jmg, actual_world_to_tool))
+    insertion_depth_ =
+        (actual_world_to_tool.translation() - start_world_to_tool.translation()).dot(
+            rotated_direction);
+
+  if (rejected)
+  {
+    ROS_WARN_STREAM_NAMED("manipulation", "Sheer force passed "
+                                              << config_->sheer_force_rejection_max_ << " at step "
+                                              << step << " of " << num_steps
+                                              << ", stopped insertion");
+    achieved_depth = false;
+  }
+  else if (direction_in &&
+           insertion_depth_ < desired_distance - config_->insertion_depth_tolerance_)
+  {
+    ROS_WARN_STREAM_NAMED("manipulation", "Tool only reached " << insertion_depth_ << "m of "
+                                                               << desired_distance << "m");
+    achieved_depth = false;
+  }
+
+  // Report timing now that the loop is done
+  insertion_loop_stats_ = timer.getStats();
+  insertion_loop_stats_.summarize();
+  insertion_corrections_ = corrections;
+  std::stringstream stats;
+  insertion_loop_stats_.print(stats);
+  ROS_INFO_STREAM_NAMED("manipulation", "Insertion loop: " << stats.str() << ", " << corrections
+                                                           << " corrections");
+  if (insertion_loop_stats_.overruns_ > 0)
+    ROS_WARN_STREAM_NAMED("manipulation", "Insertion loop overran "
+                                              << insertion_loop_stats_.overruns_
+                                              << " times, consider a longer insertion_step_period");
+
+  // Visualize the final pivot point for pose rotations
+  visuals_->visual_tools_->publishSphere(
+      visuals_->visual_tools_->convertPose(teleop_world_to_tool_), rvt::PURPLE,
+      visuals_->visual_tools_->getScale(rvt::LARGE, false, 0.1), "Sphere", 1);
+  visuals_->trajectory_lines_->publishZArrow(teleop_world_to_ee_, rvt::BLACK, rvt::REGULAR);
 
-    // Move target pose inward
-    teleop_world_to_tool_.translation() += rotated_direction * step_distance;
+  // Copy pose back
+  desired_world_to_tool = teleop_world_to_tool_;
 
-    // Track if tactile sensor was used
-    bool corrected = false;
+  return true;
+}
 
-    // Adjust pose based on tactile feedback
-    corrected = adjustPoseFromTactile();
+void Manipulation::insertionLoop(JointModelGroup* arm_jmg, const Eigen::Vector3d& rotated_direction,
+                                 double step_distance, std::size_t num_steps,
+                                 std::size_t hold_steps, const Eigen::Affine3d& base_to_world,
+                                 bool direction_in, ControlLoopTimer& timer, std::size_t& step,
+                                 std::size_t& corrections, bool& rejected)
+{
+  // No logging, markers or blocking calls in here - only sensor reads and pose commands
 
-    // Decide when to stop inserting based on negative z-axis sheer force
-    // if (direction_in && adjustPoseAndReject())
-    // {
-    //   std::cout << "Breaking insertion loop because sheer force too high" << std::endl;
-    //   achieved_depth = false;
-    //   remote_control_->waitForNextStep("reverse direction");
-    //   break;
-    // }
+  // don't allow waypoints to be reached before next goal sent
+  static const double SMOOTH_FACTOR = 1.1;
+  const double command_duration = timer.getStats().period_ * SMOOTH_FACTOR;
+
+  timer.setRealtimePriority(config_->insertion_loop_priority_);
+  timer.start();
 
-    // Visualize the pivot point for pose rotations
-    visuals_->visual_tools_->publishSphere(
-        visuals_->visual_tools_->convertPose(teleop_world_to_tool_), rvt::PURPLE,
-        visuals_->visual_tools_->getScale(rvt::LARGE, false, 0.1), "Sphere", 1);
+  std::size_t hold = 0;
+  while (step < num_steps)
+  {
+    // Check if program needs to end
+    if (!ros::ok() || remote_control_->getStop())
+      return;
+
+    // Move target pose inward, unless settling after a correction
+    if (hold > 0)
+      --hold;
+    else
+    {
+      teleop_world_to_tool_.translation() += rotated_direction * step_distance;
+      ++step;
+    }
+
+    // Adjust pose based on tactile feedback, torque is not meaningful while the part slips
+    const bool visualize = false;
+    const bool corrected = !tactile_slipping_ && adjustPoseFromTactile(visualize);
+    if (corrected)
+    {
+      ++corrections;
+      hold = hold_steps;
+    }
+    const double sheer_force = tactile_feedback_->getFilteredSheerForce();
+    insertion_peak_force_ = std::max(insertion_peak_force_, sheer_force);
+
+    // Pushing this hard before reaching depth means the part jammed, stop instead of forcing it
+    if (direction_in && config_->insertion_force_rejection_ &&
+        sheer_force > config_->sheer_force_rejection_max_)
+    {
+      rejected = true;
+      return;
+    }
 
     // Move pose from tips of finger (tool) back to base of EE
     teleop_world_to_ee_ = teleop_world_to_tool_ * config_->teleoperation_offset_;
 
-    // Show pose-rotation pose
-    visuals_->trajectory_lines_->publishZArrow(teleop_world_to_ee_, rvt::BLACK, rvt::REGULAR);
-
     // Convert desired pose from 'world' frame to 'robot base' frame
-    transformWorldToBase(teleop_world_to_ee_, teleop_base_to_ee_);
-
-    if (corrected)
-      remote_control_->waitForNextStep("move");
+    teleop_base_to_ee_ = base_to_world * teleop_world_to_ee_;
 
     // Move robot
-    execution_interface_->executePose(teleop_base_to_ee_, arm_jmg, step_duration * SMOOTH_FACTOR);
+    execution_interface_->executePose(teleop_base_to_ee_, arm_jmg, command_duration);
 
-    if (corrected)
-    {
-      std::cout << "CORRECTED" << std::endl;
-      ros::Duration(config_->insertion_alter_pause_).sleep();
-      // tactile_feedback_->recalibrateTactileSensor();
-    }
-    else
+    if (recorder_)
     {
-      // Wait for next loop
-      rate_limiter.sleep();
+      recorder_->recordCommandedPose(step, teleop_world_to_tool_);
+      recorder_->recordDecision(step, corrected, hold, tactile_slipping_);
     }
-  }
-
-  // Copy pose back
-  desired_world_to_tool = teleop_world_to_tool_;
 
-  return true;
+    // Wait for next loop
+    timer.waitForNextStep();
+  }
 }
 
 bool Manipulation::executeInsertionOpenLoopNew(JointModelGroup* arm_jmg, double desired_distance,
@@ -1277,6 +1673,9 @@ bool Manipulation::executeInsertionOpenLoopNew(JointModelGroup* arm_jmg, double
     // Move Robot
     executeToolPose(arm_jmg, teleop_world_to_tool_, step_duration * SMOOTH_FACTOR);
 
+    if (recorder_)
+      recorder_->recordCommandedPose(i, teleop_world_to_tool_);
+
     // Wait for next loop
     rate_limiter.sleep();
   }
@@ -1287,6 +1686,35 @@ bool Manipulation::executeInsertionOpenLoopNew(JointModelGroup* arm_jmg, double
   return true;
 }
 
+void Manipulation::setRecorder(InsertionRecorderPtr recorder, JointModelGroup* arm_jmg,
+                               double actual_pose_rate)
+{
+  recorder_ = recorder;
+  recorder_->setActualPoseSource(
+      std::bind(&Manipulation::getActualToolPose, this, arm_jmg, std::placeholders::_1),
+      actual_pose_rate);
+}
+
+bool Manipulation::getActualToolPose(JointModelGroup* arm_jmg, Eigen::Affine3d& world_to_tool)
+{
+  // Avoid operator[], this may run on another thread
+  moveit_grasps::GraspDatas::const_iterator grasp_data = grasp_datas_.find(arm_jmg);
+  if (grasp_data == grasp_datas_.end())
+    return false;
+
+  moveit::core::RobotStatePtr state;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor_);
+    state.reset(new moveit::core::RobotState(scene->getCurrentState()));
+  }
+  state->update();
+
+  // Move from EE base forward to finger tips
+  world_to_tool = state->getGlobalLinkTransform(grasp_data->second->parent_link_) *
+                  config_->teleoperation_offset_.inverse();
+  return true;
+}
+
 bool Manipulation::executeToolPose(JointModelGroup* arm_jmg, Eigen::Affine3d& pose_world_to_tool,
                                    double duration)
 {
@@ -1372,9 +1800,9 @@ bool Manipulation::executeInsertionOpenLoop(JointModelGroup* arm_jmg, double des
 bool Manipulation::adjustPoseAndReject()
 {
   // Check if overall sheer force is enough to move the arm
-  if (tactile_feedback_->getSheerForce() > config_->sheer_force_rejection_max_)
+  if (tactile_feedback_->getFilteredSheerForce() > config_->sheer_force_rejection_max_)
   {
-    std::cout << "sheer force reached max, actual: " << tactile_feedback_->getSheerForce()
+    std::cout << "sheer force reached max, actual: " << tactile_feedback_->getFilteredSheerForce()
               << ", max:" << config_->sheer_force_rejection_max_
               << " --------------------------------\n";
     return true;
@@ -1659,6 +2087,16 @@ bool Manipulation::getRobotStateFromPose(const Eigen::Affine3d& ee_pose,
                                          moveit::core::RobotStatePtr& robot_state,
                                          JointModelGroup* arm_jmg, bool use_consistency_limits)
 {
+  // Skip IK for poses already known to be out of reach
+  if (reachability_map_ && reachability_map_->getGroupName() == arm_jmg->getName() &&
+      reachability_map_->isUnreachable(ee_pose))
+  {
+    const std::size_t rejections = ++reachability_rejections_;
+    ROS_DEBUG_STREAM_NAMED("manipulation", "Pose unreachable according to reachability map, "
+                                               << rejections << " rejected so far");
+    return false;
+  }
+
   // Setup collision checking with a locked planning scene
   {
     bool collision_checking_verbose = false;
@@ -1683,7 +2121,14 @@ bool Manipulation::getRobotStateFromPose(const Eigen::Affine3d& ee_pose,
            ++i)  // TODO hard coded njoints
         consistency_limits.push_back(0.5);
 
-    const moveit::core::LinkModel* ik_tip_link = grasp_datas_[arm_jmg]->parent_link_;
+    // Avoid operator[], this is also called from the teleoperation thread
+    moveit_grasps::GraspDatas::const_iterator grasp_data = grasp_datas_.find(arm_jmg);
+    if (grasp_data == grasp_datas_.end())
+    {
+      ROS_ERROR_STREAM_NAMED("manipulation", "No grasp data for " << arm_jmg->getName());
+      return false;
+    }
+    const moveit::core::LinkModel* ik_tip_link = grasp_data->second->parent_link_;
     if (!robot_state->setFromIK(arm_jmg, ee_pose, ik_tip_link->getName(), consistency_limits,
                                 attempts, timeout, constraint_fn))
     {
@@ -2205,6 +2650,341 @@ bool Manipulation::displayExperienceDatabase(JointModelGroup* arm_jmg)
   return true;
 }
 
+bool Manipulation::mergeExperienceDatabases(JointModelGroup* arm_jmg,
+                                            const std::vector<std::string>& partial_paths)
+{
+  ompl::tools::ExperienceSetupPtr experience_setup = getExperienceSetup(arm_jmg);
+  if (!experience_setup)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "No experience database, is use_experience_setup on?");
+    return false;
+  }
+  const ompl::base::SpaceInformationPtr& si = experience_setup->getSpaceInformation();
+  const ompl::base::StateSpacePtr& space = si->getStateSpace();
+
+  ompl::tools::ThunderPtr thunder =
+      boost::dynamic_pointer_cast<ompl::tools::Thunder>(experience_setup);
+  ompl::tools::LightningPtr lightning =
+      boost::dynamic_pointer_cast<ompl::tools::Lightning>(experience_setup);
+  if (!thunder && !lightning)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Unrecognized experience type");
+    return false;
+  }
+
+  // Remember what is already stored so that it is not added twice
+  std::set<StateKey> known;
+  std::vector<ompl::base::PlannerDataPtr> graphs;
+  experience_setup->getAllPlannerDatas(graphs);
+  const std::size_t experiences_before = experience_setup->getExperiencesCount();
+  for (std::size_t graph_id = 0; graph_id < graphs.size(); ++graph_id)
+  {
+    const ompl::base::PlannerData& graph = *graphs[graph_id];
+    if (lightning)
+    {
+      known.insert(getPathKey(space, graph));
+      continue;
+    }
+    for (unsigned int v = 0; v < graph.numVertices(); ++v)
+    {
+      std::vector<unsigned int> neighbors;
+      graph.getEdges(v, neighbors);
+      for (std::size_t i = 0; i < neighbors.size(); ++i)
+        known.insert(getEdgeKey(space, graph.getVertex(v).getState(),
+                                graph.getVertex(neighbors[i]).getState()));
+    }
+  }
+
+  const ros::WallTime start_time = ros::WallTime::now();
+  std::size_t added = 0;
+  std::size_t duplicates = 0;
+  for (std::size_t path_id = 0; path_id < partial_paths.size(); ++path_id)
+  {
+    double load_time;
+    ompl::tools::ExperienceSetupPtr partial =
+        loadExperienceDatabase(thunder, space, partial_paths[path_id], load_time);
+
+    graphs.clear();
+    partial->getAllPlannerDatas(graphs);
+    ROS_INFO_STREAM_NAMED("manipulation", "Merging " << partial_paths[path_id] << " with "
+                                                     << partial->getExperiencesCount()
+                                                     << " experiences");
+
+    double insertion_time;
+    for (std::size_t graph_id = 0; graph_id < graphs.size(); ++graph_id)
+    {
+      const ompl::base::PlannerData& graph = *graphs[graph_id];
+
+      // Lightning stores whole paths
+      if (lightning)
+      {
+        if (!known.insert(getPathKey(space, graph)).second)
+        {
+          ++duplicates;
+          continue;
+        }
+        ompl::geometric::PathGeometric path(si);
+        for (std::size_t i = 0; i < graph.numVertices(); ++i)
+          path.append(graph.getVertex(i).getState());
+        lightning->getExperienceDB()->addPath(path, insertion_time);
+        ++added;
+        continue;
+      }
+
+      // Thunder stores one sparse graph, insert it an edge at a time
+      for (unsigned int v = 0; v < graph.numVertices() && ros::ok(); ++v)
+      {
+        std::vector<unsigned int> neighbors;
+        graph.getEdges(v, neighbors);
+        for (std::size_t i = 0; i < neighbors.size(); ++i)
+        {
+          const ompl::base::State* from = graph.getVertex(v).getState();
+          const ompl::base::State* to = graph.getVertex(neighbors[i]).getState();
+          if (!known.insert(getEdgeKey(space, from, to)).second)
+          {
+            ++duplicates;
+            continue;
+          }
+          ompl::geometric::PathGeometric path(si, from, to);
+          thunder->getExperienceDB()->addPath(path, insertion_time);
+          ++added;
+        }
+      }
+    }
+  }
+
+  ROS_INFO_STREAM_NAMED("manipulation", "Merged " << added << " "
+                                                  << (lightning ? "paths" : "edges") << ", skipped "
+                                                  << duplicates << " duplicates in "
+                                                  << (ros::WallTime::now() - start_time).toSec()
+                                                  << " s. Experiences " << experiences_before
+                                                  << " -> "
+                                                  << experience_setup->getExperiencesCount());
+
+  if (!experience_database_path_.empty())
+    experience_setup->setFilePath(experience_database_path_);
+  return experience_setup->save();
+}
+
+bool Manipulation::compactExperienceDatabase(JointModelGroup* arm_jmg,
+                                             const std::string& input_path,
+                                             const std::string& output_path)
+{
+  // The planner's setup validates against the current planning scene, including the shelf
+  ompl::tools::ExperienceSetupPtr experience_setup = getExperienceSetup(arm_jmg);
+  if (!experience_setup)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "No experience database, is use_experience_setup on?");
+    return false;
+  }
+  const ompl::base::SpaceInformationPtr& si = experience_setup->getSpaceInformation();
+  const ompl::base::StateSpacePtr& space = si->getStateSpace();
+
+  const bool thunder =
+      boost::dynamic_pointer_cast<ompl::tools::Thunder>(experience_setup).get() != NULL;
+  if (!thunder && !boost::dynamic_pointer_cast<ompl::tools::Lightning>(experience_setup))
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Unrecognized experience type");
+    return false;
+  }
+  if (input_path == output_path)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Write the compacted database to a new file");
+    return false;
+  }
+
+  double load_time;
+  ompl::tools::ExperienceSetupPtr input =
+      loadExperienceDatabase(thunder, space, input_path, load_time);
+  const std::size_t experiences_before = input->getExperiencesCount();
+
+  // Start the output from an empty file
+  std::remove(output_path.c_str());
+  ompl::tools::ExperienceSetupPtr output =
+      loadExperienceDatabase(thunder, space, output_path, load_time);
+
+  std::vector<ompl::base::PlannerDataPtr> graphs;
+  input->getAllPlannerDatas(graphs);
+
+  // The same recall queries are timed on both databases, the ends of lightning paths or spread
+  // out vertex pairs of the thunder graph
+  static const std::size_t NUM_RECALL_QUERIES = 100;
+  std::vector<ompl::base::State*> query_starts;
+  std::vector<ompl::base::State*> query_goals;
+  for (std::size_t i = 0; i < NUM_RECALL_QUERIES && !graphs.empty(); ++i)
+  {
+    const ompl::base::PlannerData& graph = *graphs[i % graphs.size()];
+    const std::size_t num_vertices = graph.numVertices();
+    if (num_vertices < 2)
+      continue;
+    const std::size_t start = thunder ? (i * 7919) % num_vertices : 0;
+    const std::size_t goal = thunder ? (start + num_vertices / 2) % num_vertices : num_vertices - 1;
+    query_starts.push_back(space->cloneState(graph.getVertex(start).getState()));
+    query_goals.push_back(space->cloneState(graph.getVertex(goal).getState()));
+  }
+  const double recall_time_before = timeRecall(input, thunder, query_starts, query_goals);
+
+  ompl::geometric::PathSimplifier simplifier(si);
+  std::set<StateKey> known;
+  std::size_t invalid = 0;
+  std::size_t redundant = 0;
+  std::size_t states_before = 0;
+  std::size_t states_after = 0;
+  double insertion_time;
+  for (std::size_t graph_id = 0; graph_id < graphs.size() && ros::ok(); ++graph_id)
+  {
+    const ompl::base::PlannerData& graph = *graphs[graph_id];
+    states_before += graph.numVertices();
+
+    // Lightning paths are checked whole, then shortcut and smoothed
+    if (!thunder)
+    {
+      // Duplicates are dropped before the expensive part, simplifying would also make them differ
+      if (!known.insert(getPathKey(space, graph)).second)
+      {
+        ++redundant;
+        continue;
+      }
+
+      ompl::geometric::PathGeometric path(si);
+      for (std::size_t i = 0; i < graph.numVertices(); ++i)
+        path.append(graph.getVertex(i).getState());
+
+      bool valid = path.getStateCount() > 1;
+      for (std::size_t i = 1; i < path.getStateCount() && valid; ++i)
+        valid = isMotionValid(si, path.getState(i - 1), path.getState(i));
+      if (!valid)
+      {
+        ++invalid;
+        continue;
+      }
+
+      simplifier.reduceVertices(path);
+      simplifier.shortcutPath(path);
+      simplifier.smoothBSpline(path);
+      if (!path.check())
+      {
+        ++invalid;
+        continue;
+      }
+
+      boost::dynamic_pointer_cast<ompl::tools::Lightning>(output)->getExperienceDB()->addPath(
+          path, insertion_time);
+      states_after += path.getStateCount();
+      continue;
+    }
+
+    // The thunder graph is rebuilt from its valid edges, dropping vertices left unconnected
+    for (unsigned int v = 0; v < graph.numVertices() && ros::ok(); ++v)
+    {
+      std::vector<unsigned int> neighbors;
+      graph.getEdges(v, neighbors);
+      for (std::size_t i = 0; i < neighbors.size(); ++i)
+      {
+        const ompl::base::State* from = graph.getVertex(v).getState();
+        const ompl::base::State* to = graph.getVertex(neighbors[i]).getState();
+        if (!known.insert(getEdgeKey(space, from, to)).second)
+        {
+          ++redundant;
+          continue;
+        }
+        if (!isMotionValid(si, from, to))
+        {
+          ++invalid;
+          continue;
+        }
+        ompl::geometric::PathGeometric path(si, from, to);
+        boost::dynamic_pointer_cast<ompl::tools::Thunder>(output)->getExperienceDB()->addPath(
+            path, insertion_time);
+      }
+    }
+  }
+  if (thunder)
+  {
+    graphs.clear();
+    output->getAllPlannerDatas(graphs);
+    for (std::size_t graph_id = 0; graph_id < graphs.size(); ++graph_id)
+      states_after += graphs[graph_id]->numVertices();
+  }
+
+  bool saved = ros::ok() && output->save();
+
+  // Reload to query what the planner will actually use
+  ompl::tools::ExperienceSetupPtr compacted;
+  double recall_time_after = 0.0;
+  if (saved)
+  {
+    compacted = loadExperienceDatabase(thunder, space, output_path, load_time);
+    recall_time_after = timeRecall(compacted, thunder, query_starts, query_goals);
+  }
+  for (std::size_t i = 0; i < query_starts.size(); ++i)
+  {
+    space->freeState(query_starts[i]);
+    space->freeState(query_goals[i]);
+  }
+
+  if (!saved)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Compaction did not finish, " << output_path
+                                                                          << " is incomplete");
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("manipulation", "Compacted experience database:"
+                                            << "\n  dropped invalid: " << invalid
+                                            << "\n  dropped redundant: " << redundant
+                                            << "\n  experiences: " << experiences_before << " -> "
+                                            << compacted->getExperiencesCount()
+                                            << "\n  states: " << states_before << " -> "
+                                            << states_after
+                                            << "\n  bytes: " << getFileSize(input_path) << " -> "
+                                            << getFileSize(output_path)
+                                            << "\n  recall time of " << query_starts.size()
+                                            << " queries: " << recall_time_before << " -> "
+                                            << recall_time_after << " s");
+  return true;
+}
+
+bool Manipulation::buildReachabilityMap(JointModelGroup* arm_jmg, ros::NodeHandle nh)
+{
+  if (config_->reachability_map_file_.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Set reachability_map_file to build a map");
+    return false;
+  }
+
+  ReachabilityMapPtr reachability_map(new ReachabilityMap());
+  if (!reachability_map->loadParameters(nh))
+    return false;
+
+  // Building takes minutes, so check against a copy instead of holding the monitor's lock the
+  // whole time
+  planning_scene::PlanningScenePtr scene;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO ls(planning_scene_monitor_);
+    scene = ls->diff();
+  }
+
+  // Only self collision, the map should not depend on what is in the shelf
+  bool collision_checking_verbose = false;
+  bool only_check_self_collision = true;
+  moveit::core::GroupStateValidityCallbackFn constraint_fn =
+      boost::bind(&isStateValid, scene.get(), collision_checking_verbose,
+                  only_check_self_collision, visuals_, _1, _2, _3);
+
+  moveit::core::RobotState robot_state(scene->getCurrentState());
+  const moveit::core::JointModel* gantry_joint = config_->has_gantry_ ? getGantryJoint() : NULL;
+  if (!reachability_map->build(robot_state, arm_jmg, grasp_datas_[arm_jmg]->parent_link_,
+                               constraint_fn, gantry_joint))
+    return false;
+
+  if (!reachability_map->save(config_->reachability_map_file_))
+    return false;
+
+  reachability_map_ = reachability_map;
+  return true;
+}
+
 // bool Manipulation::visualizeGrasps(std::vector<moveit_grasps::GraspCandidatePtr>
 // grasp_candidates,
 //                                    JointModelGroup *arm_jmg, bool show_cartesian_path)
@@ -2639,17 +3419,18 @@ bool Manipulation::beginTouchControl()
 }
 
 // Multi-use function for adjusting teleoperating and insertion tasks
-bool Manipulation::adjustPoseFromTactile()
+bool Manipulation::adjustPoseFromTactile(bool visualize)
 {
   // Two experimental modes - translation and pitch rotation
   bool translation_teleop = false;
   if (translation_teleop)
   {
     // Check if overall sheer force is enough to move the arm
-    if (tactile_feedback_->getSheerForce() < config_->sheer_force_threshold_)
+    if (tactile_feedback_->getFilteredSheerForce() < config_->sheer_force_threshold_)
     {
-      std::cout << "force to low: " << tactile_feedback_->getSheerForce() << "/"
-                << config_->sheer_force_threshold_ << " --------------------------------\n";
+      if (visualize)
+        std::cout << "force to low: " << tactile_feedback_->getFilteredSheerForce() << "/"
+                  << config_->sheer_force_threshold_ << " --------------------------------\n";
       return false;
     }
 
@@ -2660,7 +3441,8 @@ bool Manipulation::adjustPoseFromTactile()
 
     // Calculate translation amount based on sheer force
     static const double SHEER_FORCE_MAX = 20;  // ignore sheer force higher than this
-    const double sheer_force = std::min(SHEER_FORCE_MAX, tactile_feedback_->getSheerForce());
+    const double sheer_force =
+        std::min(SHEER_FORCE_MAX, tactile_feedback_->getFilteredSheerForce());
     static const double SHEER_RATIO = config_->touch_teleop_max_translation_step_ / SHEER_FORCE_MAX;
     const double sheer_force_gain = sheer_force * SHEER_RATIO;
 
@@ -2672,18 +3454,19 @@ bool Manipulation::adjustPoseFromTactile()
   else
   {
     // rotate based on torque
-    bool verbose_torque = true;
+    bool verbose_torque = visualize;
 
     // Max threhold, absolute
     // Notes: getSheerTorque() will generally return values between -360 -> 0 -> 360 but can exceed
     // those values also. 0 is the calibrated position, i.e. no toruqe
-    double torque = std::min(tactile_feedback_->getSheerTorque(), config_->insertion_torque_max_);
-    torque = std::max(tactile_feedback_->getSheerTorque(), -config_->insertion_torque_max_);
+    const double filtered_torque = tactile_feedback_->getFilteredSheerTorque();
+    double torque = std::min(filtered_torque, config_->insertion_torque_max_);
+    torque = std::max(torque, -config_->insertion_torque_max_);
 
     // Debug
     if (verbose_torque && false)
     {
-      std::cout << "raw torque: " << tactile_feedback_->getSheerTorque() << std::endl;
+      std::cout << "filtered torque: " << filtered_torque << std::endl;
       std::cout << "capped torque: " << torque << std::endl;
     }
 
@@ -2691,7 +3474,8 @@ bool Manipulation::adjustPoseFromTactile()
     if (fabs(torque) < config_->insertion_torque_min_)
     {
       const bool show = false;
-      showDirectionArrow(torque, show);
+      if (visualize)
+        showDirectionArrow(torque, show);
 
       if (verbose_torque && false)
         std::cout << "Ignoring torque because below threshold: " << torque << std::endl;
@@ -2718,7 +3502,8 @@ bool Manipulation::adjustPoseFromTactile()
 
     // Show arrow in direction of movement
     const bool show = true;
-    showDirectionArrow(torque, show);
+    if (visualize)
+      showDirectionArrow(torque, show);
 
     // Apply torque to EE pose
     Eigen::Affine3d rotation;
@@ -2774,6 +3559,30 @@ void Manipulation::showDirectionArrow(double torque, bool show)
   visuals_->trajectory_lines_->publishMarker(arrow_marker);
 }
 
+// This function is called from tactile_feedback.cpp as a binded function
+void Manipulation::tactileEventCallback(TactileEventType event, const TactileSample& sample)
+{
+  switch (event)
+  {
+    case TACTILE_CONTACT_BEGIN:
+      ROS_DEBUG_STREAM_NAMED("manipulation.tactile", "Contact began, force "
+                                                         << sample.filtered_force_);
+      break;
+    case TACTILE_CONTACT_END:
+      ROS_DEBUG_STREAM_NAMED("manipulation.tactile", "Contact ended");
+      break;
+    case TACTILE_SLIP_BEGIN:
+      tactile_slipping_ = true;
+      ROS_DEBUG_STREAM_NAMED("manipulation.tactile", "Slip began, torque rate "
+                                                         << sample.torque_rate_);
+      break;
+    case TACTILE_SLIP_END:
+      tactile_slipping_ = false;
+      ROS_DEBUG_STREAM_NAMED("manipulation.tactile", "Slip ended");
+      break;
+  }
+}
+
 // This function is called from tactile_feedback.cpp as a binded function
 void Manipulation::updateTouchControl(JointModelGroup* arm_jmg)
 {
@@ -2811,32 +3620,113 @@ void Manipulation::updateTouchControl(JointModelGroup* arm_jmg)
 // Note: deprecated function
 bool Manipulation::teleoperation(const Eigen::Affine3d& ee_pose, bool move,
                                  JointModelGroup* arm_jmg)
+{
+  // NOTE this is called from the interactive marker thread, so it only hands off the pose
+  if (!teleop_running_ || arm_jmg != teleop_arm_jmg_)
+    return false;
+
+  boost::mutex::scoped_lock lock(teleop_target_mutex_);
+  teleop_target_ = ee_pose;
+  teleop_target_move_ = move;
+  ++teleop_target_sequence_;
+  return true;
+}
+
+void Manipulation::startTeleoperation(JointModelGroup* arm_jmg)
+{
+  stopTeleoperation();
+
+  if (config_->teleoperation_command_period_ <= 0)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Invalid teleoperation command period "
+                                               << config_->teleoperation_command_period_);
+    return;
+  }
+
+  // Seed IK from where the arm is now
+  enableTeleoperation();
+
+  // The base does not move during teleoperation, so look it up once instead of copying the robot
+  // state for every command
+  const Eigen::Affine3d base_to_world =
+      getCurrentState()->getGlobalLinkTransform("base_link").inverse();
+
+  {
+    boost::mutex::scoped_lock lock(teleop_target_mutex_);
+    teleop_target_sequence_ = 0;
+  }
+  teleop_arm_jmg_ = arm_jmg;
+  teleop_running_ = true;
+  teleop_thread_ =
+      boost::thread(std::bind(&Manipulation::teleoperationLoop, this, arm_jmg, base_to_world));
+}
+
+void Manipulation::stopTeleoperation()
+{
+  teleop_running_ = false;
+  if (teleop_thread_.joinable())
+    teleop_thread_.join();
+}
+
+void Manipulation::teleoperationLoop(JointModelGroup* arm_jmg,
+                                     const Eigen::Affine3d& base_to_world)
 {
   // NOTE this is in a separate thread, so we should only use visuals_->trajectory_lines_ for
   // debugging!
 
-  // Solve IK
-  bool use_consistency_limits = true;
-  if (!getRobotStateFromPose(ee_pose, teleop_state_, arm_jmg, use_consistency_limits))
-    return false;
+  // don't allow waypoints to be reached before next goal sent
+  static const double SMOOTH_FACTOR = 1.1;
+  const double period = config_->teleoperation_command_period_;
+  const bool use_consistency_limits = true;
+
+  ControlLoopTimer timer(period, 0);
+  timer.start();
 
-  // Execute robot pose
-  if (move)
+  std::size_t handled_sequence = 0;
+  std::size_t unreachable = 0;
+  while (teleop_running_ && ros::ok())
   {
-    const double velocity_scaling_factor = 1.0;
-    if (!moveDirectToState(teleop_state_, arm_jmg, velocity_scaling_factor))
+    // Only the newest request matters, any that arrived before it since the last step are stale
+    Eigen::Affine3d world_to_ee;
+    bool move;
+    bool new_target;
     {
-      ROS_ERROR_STREAM_NAMED("pick_manager", "Failed to execute state");
-      return false;
+      boost::mutex::scoped_lock lock(teleop_target_mutex_);
+      new_target = teleop_target_sequence_ != handled_sequence;
+      handled_sequence = teleop_target_sequence_;
+      world_to_ee = teleop_target_;
+      move = teleop_target_move_;
     }
-  }
-  else
-  {
-    // Visualize what we would have done
-    visuals_->goal_state_->publishRobotState(teleop_state_, rvt::BLUE);
+
+    if (new_target)
+    {
+      // teleop_state_ still holds the previous solution, which seeds IK so that it converges
+      // quickly and stays on the same branch
+      bool solved = false;
+      if (config_->teleoperation_check_ik_ || !move)
+        solved = getRobotStateFromPose(world_to_ee, teleop_state_, arm_jmg, use_consistency_limits);
+
+      if (!move)
+      {
+        // Visualize what we would have done
+        if (solved)
+          visuals_->goal_state_->publishRobotState(teleop_state_, rvt::BLUE);
+      }
+      else if (solved || !config_->teleoperation_check_ik_)
+        execution_interface_->executePose(base_to_world * world_to_ee, arm_jmg,
+                                          period * SMOOTH_FACTOR);
+      else
+        ++unreachable;
+    }
+
+    timer.waitForNextStep();
   }
 
-  return true;
+  const ControlLoopStats& stats = timer.getStats();
+  ROS_INFO_STREAM_NAMED("manipulation", "Teleoperation stopped after "
+                                            << stats.steps_ << " steps, " << stats.overruns_
+                                            << " overruns, " << unreachable
+                                            << " unreachable poses skipped");
 }
 
 bool Manipulation::enableTeleoperation()
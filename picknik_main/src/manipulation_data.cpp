@@ -46,7 +46,7 @@
 namespace picknik_main
 {
 ManipulationData::ManipulationData()
-  : nh_("~")
+  : nh_("~"), insertion_force_rejection_(false)
 {
 }
 
@@ -132,6 +132,27 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
                                            teleoperation_offset_doubles);
   ros_param_utilities::convertDoublesToEigen(parent_name, teleoperation_offset_doubles,
                                              teleoperation_offset_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "teleoperation_command_period",
+                                          teleoperation_command_period_);
+  ros_param_utilities::getBoolParameter(parent_name, nh_, "teleoperation_check_ik",
+                                        teleoperation_check_ik_);
+
+  // Experience database training
+  ros_param_utilities::getStringParameter(parent_name, nh_, "experience_training_database",
+                                          experience_training_database_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "experience_training_queries",
+                                       experience_training_queries_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "experience_compaction_input",
+                                          experience_compaction_input_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "experience_compaction_output",
+                                          experience_compaction_output_);
+
+  ros_param_utilities::getStringParameter(parent_name, nh_, "reachability_map_file",
+                                          reachability_map_file_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "grasp_statistics_file",
+                                          grasp_statistics_file_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "grasp_filter_max_candidates",
+                                       grasp_filter_max_candidates_);
 
   // Get grasp location doubles
   // std::vector<double> grasp_location_transform_doubles;
@@ -145,14 +166,41 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
                                           sheer_force_threshold_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "sheer_force_rejection_max",
                                           sheer_force_rejection_max_);
+  ros_param_utilities::getBoolParameter(parent_name, nh_, "insertion_force_rejection",
+                                        insertion_force_rejection_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "touch_teleop_max_translation_step",
                                           touch_teleop_max_translation_step_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_visualization_rate",
+                                          tactile_visualization_rate_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "tactile_filter", tactile_filter_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_filter_cutoff",
+                                          tactile_filter_cutoff_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_kalman_process_noise",
+                                          tactile_kalman_process_noise_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_kalman_measurement_noise",
+                                          tactile_kalman_measurement_noise_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_contact_force_on",
+                                          tactile_contact_force_on_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_contact_force_off",
+                                          tactile_contact_force_off_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_slip_force_rate",
+                                          tactile_slip_force_rate_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_slip_torque_rate",
+                                          tactile_slip_torque_rate_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_event_debounce",
+                                          tactile_event_debounce_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_steps_per_meter",
                                           insertion_steps_per_meter_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_duration",
                                           insertion_duration_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_step_period",
+                                          insertion_step_period_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "insertion_loop_priority",
+                                       insertion_loop_priority_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_distance",
                                           insertion_distance_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_depth_tolerance",
+                                          insertion_depth_tolerance_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_updown_pause",
                                           insertion_updown_pause_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_alter_pause",
@@ -173,6 +221,24 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
                                           insertion_attempt_distance_scale_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_spiral_distance",
                                           insertion_spiral_distance_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "insertion_search_pattern",
+                                          insertion_search_pattern_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_search_width",
+                                          insertion_search_width_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_search_velocity_scaling",
+                                          insertion_search_velocity_scaling_);
+
+  // Insertion experiment logging
+  ros_param_utilities::getStringParameter(parent_name, nh_, "insertion_log_directory",
+                                          insertion_log_directory_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_log_pose_rate",
+                                          insertion_log_pose_rate_);
+
+  // Trajectory recording downsampling
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "trajectory_record_min_period",
+                                          trajectory_record_min_period_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "trajectory_record_min_change",
+                                          trajectory_record_min_change_);
 
   // Automated insertion test
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "automated_insertion_distance",
@@ -185,6 +251,8 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
   // Pick Manager settings
   ros_param_utilities::getStringParameter(parent_name, nh_, "joint_state_topic",
                                           joint_state_topic_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "clutter_map_topic",
+                                          clutter_map_topic_);
 
   // Load proper groups
   // TODO - check if joint model group exists
@@ -50,6 +50,9 @@
 // Parameter loading
 #include <ros_param_utilities/ros_param_utilities.h>
 
+// C++
+#include <cmath>
+
 namespace picknik_main
 {
 PerceptionInterface::PerceptionInterface(bool verbose, VisualsPtr visuals,
@@ -63,6 +66,7 @@ PerceptionInterface::PerceptionInterface(bool verbose, VisualsPtr visuals,
   , tf_(tf)
   , find_objects_action_(PERCEPTION_TOPIC)
   , is_processing_perception_(false)
+  , perception_cache_max_age_(0)
 {
   // Load ROS publisher
   stop_perception_client_ =
@@ -81,6 +85,8 @@ PerceptionInterface::PerceptionInterface(bool verbose, VisualsPtr visuals,
                                           camera_min_depth_);
   // ros_param_utilities::getDoubleParameter(parent_name, nh, "bounding_box_reduction",
   // bounding_box_reduction_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh, "perception_cache_max_age",
+                                          perception_cache_max_age_);
 
   ROS_INFO_STREAM_NAMED("perception_interface", "PerceptionInterface Ready.");
 }
@@ -100,6 +106,210 @@ bool PerceptionInterface::isPerceptionReady()
   return true;
 }
 
+bool PerceptionInterface::startPerception(const picknik_msgs::FindObjectsGoal& goal)
+{
+  if (is_processing_perception_)
+  {
+    ROS_ERROR_STREAM_NAMED("perception_interface", "Perception is already processing bin "
+                                                       << processing_goal_.bin_name);
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("perception_interface", "Requesting perception of bin "
+                                                    << goal.bin_name << " with "
+                                                    << goal.expected_objects_names.size()
+                                                    << " expected products");
+
+  // Anything cached for this bin is about to be superseded
+  invalidateBin(goal.bin_name);
+
+  find_objects_action_.sendGoal(goal);
+  processing_goal_ = goal;
+  is_processing_perception_ = true;
+
+  return true;
+}
+
+bool PerceptionInterface::endPerception(picknik_msgs::FindObjectsResult& result, double timeout)
+{
+  if (!is_processing_perception_)
+  {
+    ROS_ERROR_STREAM_NAMED("perception_interface", "Perception was never started");
+    return false;
+  }
+  is_processing_perception_ = false;
+  const std::string& bin_name = processing_goal_.bin_name;
+
+  // Tell the perception server the camera has stopped moving
+  picknik_msgs::StopPerception stop_srv;
+  stop_srv.request.stop = true;
+  if (!stop_perception_client_.call(stop_srv))
+  {
+    ROS_ERROR_STREAM_NAMED("perception_interface", "Failed to call service "
+                                                       << stop_perception_client_.getService());
+    find_objects_action_.cancelGoal();
+    return false;
+  }
+
+  if (!find_objects_action_.waitForResult(ros::Duration(timeout)))
+  {
+    ROS_ERROR_STREAM_NAMED("perception_interface", "Perception of bin " << bin_name
+                                                                        << " timed out after "
+                                                                        << timeout << " seconds");
+    find_objects_action_.cancelGoal();
+    return false;
+  }
+
+  result = *find_objects_action_.getResult();
+  if (!result.succeeded)
+  {
+    ROS_ERROR_STREAM_NAMED("perception_interface", "Perception of bin " << bin_name << " failed");
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("perception_interface", "Found " << result.found_objects.size()
+                                                         << " products in bin " << bin_name);
+
+  // Remember the result so later requests for this bin can skip perception
+  boost::mutex::scoped_lock lock(bin_perception_cache_mutex_);
+  BinPerception& cached = bin_perception_cache_[bin_name];
+  cached.goal_ = processing_goal_;
+  cached.result_ = result;
+  cached.stamp_ = ros::Time::now();
+
+  return true;
+}
+
+bool PerceptionInterface::getCachedPerception(const std::string& bin_name,
+                                              picknik_msgs::FindObjectsResult& result)
+{
+  boost::mutex::scoped_lock lock(bin_perception_cache_mutex_);
+
+  std::map<std::string, BinPerception>::iterator bin = bin_perception_cache_.find(bin_name);
+  if (bin == bin_perception_cache_.end() || expireBin(bin))
+    return false;
+
+  result = bin->second.result_;
+  return true;
+}
+
+bool PerceptionInterface::getProductPose(const std::string& bin_name,
+                                         const std::string& product_name,
+                                         Eigen::Affine3d& world_to_product)
+{
+  boost::mutex::scoped_lock lock(bin_perception_cache_mutex_);
+
+  std::map<std::string, BinPerception>::iterator bin = bin_perception_cache_.find(bin_name);
+  if (bin == bin_perception_cache_.end() || expireBin(bin))
+    return false;
+
+  const std::vector<picknik_msgs::FoundObject>& found = bin->second.result_.found_objects;
+  for (std::size_t i = 0; i < found.size(); ++i)
+  {
+    if (found[i].object_name == product_name)
+    {
+      world_to_product = getWorldToBinCorner(bin->second.goal_) *
+                         visuals_->visual_tools_->convertPose(found[i].object_pose.pose);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PerceptionInterface::applyCachedPerception(const std::string& bin_name)
+{
+  BinPerception cached;
+  {
+    boost::mutex::scoped_lock lock(bin_perception_cache_mutex_);
+    std::map<std::string, BinPerception>::iterator bin = bin_perception_cache_.find(bin_name);
+    if (bin == bin_perception_cache_.end() || expireBin(bin))
+    {
+      ROS_ERROR_STREAM_NAMED("perception_interface", "No cached perception of bin " << bin_name);
+      return false;
+    }
+    cached = bin->second;
+  }
+
+  // The server reports each pose relative to the bin corner and each mesh relative to its pose
+  const Eigen::Affine3d world_to_bin = getWorldToBinCorner(cached.goal_);
+  const std::vector<picknik_msgs::FoundObject>& found = cached.result_.found_objects;
+  for (std::size_t i = 0; i < found.size(); ++i)
+  {
+    const Eigen::Affine3d world_to_product =
+        world_to_bin * visuals_->visual_tools_->convertPose(found[i].object_pose.pose);
+    visuals_->visual_tools_->publishCollisionMesh(world_to_product, found[i].object_name,
+                                                  found[i].bounding_mesh, rvt::RAND);
+  }
+
+  ROS_INFO_STREAM_NAMED("perception_interface", "Placed " << found.size() << " products from the "
+                                                          << "perception of bin " << bin_name);
+  return true;
+}
+
+void PerceptionInterface::invalidateBin(const std::string& bin_name)
+{
+  boost::mutex::scoped_lock lock(bin_perception_cache_mutex_);
+  if (bin_perception_cache_.erase(bin_name))
+    ROS_DEBUG_STREAM_NAMED("perception_interface", "Invalidated cached perception of bin "
+                                                       << bin_name);
+}
+
+void PerceptionInterface::invalidateBinsAt(const Eigen::Vector3d& world_point)
+{
+  boost::mutex::scoped_lock lock(bin_perception_cache_mutex_);
+
+  std::map<std::string, BinPerception>::iterator bin = bin_perception_cache_.begin();
+  while (bin != bin_perception_cache_.end())
+  {
+    // Same axis aligned region the server crops to
+    const picknik_msgs::FindObjectsGoal& goal = bin->second.goal_;
+    const Eigen::Vector3d bin_to_point =
+        world_point - visuals_->visual_tools_->convertPose(goal.bin_centroid).translation();
+    bool inside = goal.bin_dimensions.dimensions.size() >= 3;
+    for (std::size_t i = 0; i < 3 && inside; ++i)
+      inside = std::abs(bin_to_point[i]) <= goal.bin_dimensions.dimensions[i] / 2.0;
+
+    if (inside)
+    {
+      ROS_DEBUG_STREAM_NAMED("perception_interface", "Invalidated cached perception of bin "
+                                                         << bin->first << ", arm entered it");
+      bin_perception_cache_.erase(bin++);
+    }
+    else
+      ++bin;
+  }
+}
+
+void PerceptionInterface::invalidateAllBins()
+{
+  boost::mutex::scoped_lock lock(bin_perception_cache_mutex_);
+  bin_perception_cache_.clear();
+}
+
+Eigen::Affine3d PerceptionInterface::getWorldToBinCorner(
+    const picknik_msgs::FindObjectsGoal& goal) const
+{
+  // Front bottom right corner, as computed by the perception server
+  Eigen::Affine3d world_to_bin = visuals_->visual_tools_->convertPose(goal.bin_centroid);
+  if (goal.bin_dimensions.dimensions.size() >= 3)
+    world_to_bin.translation() -= Eigen::Vector3d(goal.bin_dimensions.dimensions[0],
+                                                  goal.bin_dimensions.dimensions[1],
+                                                  goal.bin_dimensions.dimensions[2]) / 2.0;
+  return world_to_bin;
+}
+
+bool PerceptionInterface::expireBin(std::map<std::string, BinPerception>::iterator bin)
+{
+  if (perception_cache_max_age_ <= 0 ||
+      (ros::Time::now() - bin->second.stamp_).toSec() <= perception_cache_max_age_)
+    return false;
+
+  ROS_DEBUG_STREAM_NAMED("perception_interface", "Cached perception of bin " << bin->first
+                                                                             << " expired");
+  bin_perception_cache_.erase(bin);
+  return true;
+}
+
 bool PerceptionInterface::getTFTransform(Eigen::Affine3d& world_to_frame, ros::Time& time_stamp,
                                          const std::string& frame_id)
 {
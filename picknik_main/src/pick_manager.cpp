@@ -21,11 +21,21 @@
 // MoveIt
 //#include <moveit/robot_state/conversions.h>
 #include <moveit/macros/console_colors.h>
+#include <random_numbers/random_numbers.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
 
 // Boost
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
 //#include <boost/filesystem.hpp>
 //#include <boost/foreach.hpp>
 
+// C++
+#include <limits>
+
 namespace picknik_main
 {
 DEFINE_bool(fake_execution, false, "Fake execution of motions");
@@ -33,6 +43,8 @@ DEFINE_bool(fake_perception, true, "Fake perception of things");
 DEFINE_bool(use_experience, true, "Plan with an experience database");
 DEFINE_bool(show_database, true, "Show experience database");
 DEFINE_int32(id, 0, "Identification number for various component modes");
+DEFINE_int32(num_workers, 0, "Experience training processes, 0 for one per core");
+DEFINE_int32(worker_id, -1, "Set by the experience training coordinator on its workers");
 
 PickManager::PickManager(bool verbose)
   : nh_private_("~")
@@ -104,6 +116,12 @@ PickManager::PickManager(bool verbose)
                                        grasp_datas_, remote_control_, FLAGS_fake_execution,
                                        tactile_feedback_));
 
+  // Load insertion experiment recorder, idle until an insertion starts
+  insertion_recorder_.reset(new InsertionRecorder());
+  tactile_feedback_->setRecorder(insertion_recorder_);
+  manipulation_->setRecorder(insertion_recorder_, config_->right_arm_,
+                             config_->insertion_log_pose_rate_);
+
   // Load trajectory IO class
   // trajectory_io_.reset(new TrajectoryIO(remote_control_, visuals_, config_, manipulation_));
 
@@ -518,7 +536,8 @@ bool PickManager::recordTrajectory()
   trajectory_io_->getFilePath(file_path, file_name);
 
   // Start recording
-  trajectory_io_->recordTrajectoryToFile(file_path);
+  if (!trajectory_io_->recordTrajectoryToFile(file_path))
+    return false;
 
   ROS_INFO_STREAM_NAMED("pick_manager", "Done recording");
 
@@ -572,6 +591,10 @@ bool PickManager::loadPlanningSceneMonitor()
     planning_scene_monitor_->startPublishingPlanningScene(
         planning_scene_monitor::PlanningSceneMonitor::UPDATE_SCENE, "picknik_planning_scene");
     planning_scene_monitor_->getPlanningScene()->setName("picknik_planning_scene");
+
+    // Apply the octomap of unmodelled objects in the shelf as it changes
+    if (!config_->clutter_map_topic_.empty())
+      planning_scene_monitor_->startSceneMonitor(config_->clutter_map_topic_);
   }
   else
   {
@@ -898,13 +921,11 @@ void PickManager::processMarkerPose(const geometry_msgs::Pose& pose, bool move)
   // of hand
   Eigen::Affine3d ee_pose = interactive_marker_pose_ * config_->teleoperation_offset_;
 
-  // Convert pose to frame of robot base
-  const Eigen::Affine3d& world_to_base =
-      manipulation_->getCurrentState()->getGlobalLinkTransform("base_link");
-  Eigen::Affine3d base_to_desired = world_to_base.inverse() * ee_pose;
+  // Anything perceived in a bin the hand moves into may have been disturbed
+  perception_interface_->invalidateBinsAt(ee_pose.translation());
 
-  // New Method
-  manipulation_->getExecutionInterface()->executePose(base_to_desired, arm_jmg);
+  // Bursts of feedback only replace the target, the teleoperation thread sends it at a fixed rate
+  manipulation_->teleoperation(ee_pose, move, arm_jmg);
 }
 
 // Mode 3
@@ -928,9 +949,7 @@ void PickManager::insertion()
     ros::Duration(1.0).sleep();
   }
 
-  // Reusable transform from robot base to world. Could be identity. Assumes that it does not change
-  Eigen::Affine3d base_to_world =
-      manipulation_->getCurrentState()->getGlobalLinkTransform("base_link").inverse();
+  startInsertionRecording("insertion");
 
   // Get current pose - retracted position
   const Eigen::Affine3d desired_world_to_ee =
@@ -945,17 +964,20 @@ void PickManager::insertion()
   bool achieved_depth = true;  // flag that lets us know if insertion went all the way in
 
   // Spiral poses
-  std::vector<Eigen::Affine3d> poses;
+  EigenSTL::vector_Affine3d poses;
   // allow for alternative insertion poses to be tried if needed
   std::size_t insertion_spiral_pose = 0;
-  getSpiralPoses(poses, desired_world_to_tool, config_->insertion_spiral_distance_);
+  if (config_->insertion_search_pattern_ == "raster")
+    getRasterPoses(poses, desired_world_to_tool, config_->insertion_search_width_,
+                   config_->insertion_spiral_distance_);
+  else
+    getSpiralPoses(poses, desired_world_to_tool, config_->insertion_spiral_distance_);
+
+  // Show whole pattern at once
+  visuals_->visual_tools_->enableBatchPublishing(true);
   for (std::size_t i = 0; i < poses.size(); ++i)
-  {
-    visuals_->visual_tools_->printTransform(poses[i]);
     visuals_->visual_tools_->publishZArrow(poses[i], rvt::RED, rvt::REGULAR);
-  }
-  ros::Duration(0.5).sleep();
-  visuals_->visual_tools_->deleteAllMarkers();
+  visuals_->visual_tools_->triggerBatchPublishAndDisable();
 
   while (ros::ok())
   {
@@ -979,18 +1001,31 @@ void PickManager::insertion()
 
       if (!achieved_depth)
       {
-        ROS_INFO_STREAM_NAMED("pick_manager", "Moving to next insertion location "
-                                                  << insertion_spiral_pose);
-        desired_world_to_tool = poses[insertion_spiral_pose++];
+        if (insertion_spiral_pose >= poses.size())
+        {
+          ROS_WARN_STREAM_NAMED("pick_manager", "Search pattern exhausted, giving up insertion");
+          break;
+        }
 
-        visuals_->visual_tools_->publishZArrow(desired_world_to_tool, rvt::GREEN, rvt::REGULAR);
+        // Nothing touches the surface at the retracted height, so a sweep there can not find the
+        // hole. Move over the next location of the pattern and insert there instead
+        ROS_INFO_STREAM_NAMED("pick_manager", "Trying insertion location "
+                                                  << insertion_spiral_pose + 1 << " of "
+                                                  << poses.size());
+        const EigenSTL::vector_Affine3d next_location(1, poses[insertion_spiral_pose]);
+        const bool stop_on_contact = false;
+        bool contact_found = false;
+        if (!manipulation_->executeSearchPath(arm_jmg, next_location,
+                                              config_->insertion_search_velocity_scaling_,
+                                              stop_on_contact, contact_found))
+        {
+          ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to move to insertion location");
+          break;
+        }
+        desired_world_to_tool = poses[insertion_spiral_pose];
+        ++insertion_spiral_pose;
 
-        // // Move pose from tips of finger (tool) back to base of EE
-        Eigen::Affine3d new_world_to_ee = desired_world_to_tool * config_->teleoperation_offset_;
-        // // Convert desired pose from 'world' frame to 'robot base' frame
-        Eigen::Affine3d new_base_to_ee = base_to_world * new_world_to_ee;
-        manipulation_->getExecutionInterface()->executePose(new_base_to_ee, arm_jmg);
-        ros::Duration(0.5).sleep();
+        visuals_->visual_tools_->publishZArrow(desired_world_to_tool, rvt::GREEN, rvt::REGULAR);
       }
     }
     else
@@ -1000,6 +1035,9 @@ void PickManager::insertion()
       std::cout << "-------------------------------------------------------" << std::endl;
       std::cout << "INSERTING " << std::endl;
 
+      // Anything perceived where the tool goes may be disturbed
+      perception_interface_->invalidateBinsAt(desired_world_to_tool.translation());
+
       bool direction_in = true;
       if (!manipulation_->executeInsertionClosedLoop(arm_jmg, config_->insertion_distance_,
                                                      desired_world_to_tool, direction_in,
@@ -1023,6 +1061,7 @@ void PickManager::insertion()
     in = !in;
   }
 
+  insertion_recorder_->stop();
   ROS_INFO_STREAM_NAMED("manipulation", "Finished insertion path");
 }
 
@@ -1030,8 +1069,9 @@ void PickManager::insertion()
 void PickManager::enableTeleoperation()
 {
   ROS_INFO_STREAM_NAMED("pick_manager", "Teleoperation enabled");
+  JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
+  manipulation_->startTeleoperation(arm_jmg);
   teleoperation_enabled_ = true;
-  manipulation_->enableTeleoperation();
 
   // TEST - measure the offset between blue tool frame and ROS tool frame
   if (false)
@@ -1039,8 +1079,6 @@ void PickManager::enableTeleoperation()
     moveit::core::RobotStatePtr before_state(
         new moveit::core::RobotState(*manipulation_->getCurrentState()));
 
-    JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
-
     const Eigen::Affine3d world_to_desired = interactive_marker_pose_;
     const Eigen::Affine3d& world_to_base =
         manipulation_->getCurrentState()->getGlobalLinkTransform("base_link");
@@ -1098,86 +1136,91 @@ void PickManager::drawSpiral()
 
   // Move the pose forward from EE base to finger tips
   Eigen::Affine3d world_to_tool = world_to_ee * config_->teleoperation_offset_.inverse();
-  Eigen::Affine3d new_sphere = world_to_tool;
 
-  // Center along x/y axis
-  double center_x = world_to_tool.translation().x();
-  double center_y = world_to_tool.translation().y();
+  EigenSTL::vector_Affine3d poses;
+  getArchimedeanSpiralPoses(poses, world_to_tool, config_->insertion_attempt_radius_,
+                            config_->insertion_attempt_radius_,
+                            config_->insertion_attempt_distance_);
 
-  double coils = config_->insertion_attempt_radius_;
-  double rotation = 3.14;
+  // Show whole spiral at once
+  visuals_->visual_tools_->enableBatchPublishing(true);
+  for (std::size_t i = 0; i < poses.size(); ++i)
+    visuals_->visual_tools_->publishZArrow(poses[i], rvt::RED, rvt::SMALL);
+  visuals_->visual_tools_->triggerBatchPublishAndDisable();
+
+  // Follow it as a single trajectory, stopping at the first contact
+  const bool stop_on_contact = true;
+  bool contact_found = false;
+  if (!manipulation_->executeSearchPath(arm_jmg, poses, config_->insertion_search_velocity_scaling_,
+                                        stop_on_contact, contact_found))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to follow spiral");
+    return;
+  }
+
+  ROS_INFO_STREAM_NAMED("pick_manager", "Spiral finished" << (contact_found ? " at contact" : ""));
+}
+
+void PickManager::getArchimedeanSpiralPoses(EigenSTL::vector_Affine3d& poses,
+                                            const Eigen::Affine3d& center_pose, double coils,
+                                            double radius, double chord)
+{
+  Eigen::Affine3d this_pose = center_pose;
+
+  // Center along x/y axis
+  const double center_x = center_pose.translation().x();
+  const double center_y = center_pose.translation().y();
+  const double rotation = 3.14;
 
   // value of theta corresponding to end of last coil
-  const double thetaMax = coils * 2 * M_PI;
+  const double theta_max = coils * 2 * M_PI;
 
   // How far to step away from center for each side.
-  const double awayStep = config_->insertion_attempt_radius_ / thetaMax;
-
-  // distance between points to plot
-  const double chord = config_->insertion_attempt_distance_;
+  const double away_step = radius / theta_max;
 
   // For every side, step around and away from center.
   // start at the angle corresponding to a distance of chord
   // away from centre.
-  for (double theta = chord / awayStep; theta <= thetaMax;)
+  for (double theta = chord / away_step; theta <= theta_max;)
   {
     // How far away from center
-    double away = awayStep * theta;
+    const double away = away_step * theta;
 
     // How far around the center.
-    double around = theta + rotation;
+    const double around = theta + rotation;
 
     // Convert 'around' and 'away' to X and Y.
-    double x = center_x + cos(around) * away;
-    double y = center_y + sin(around) * away;
-
-    // Now that you know it, do it.
-    new_sphere.translation().x() = x;
-    new_sphere.translation().y() = y;
-    visuals_->visual_tools_->publishZArrow(new_sphere, rvt::RED, rvt::SMALL);
-    visuals_->visual_tools_->printTransform(new_sphere);
-    ros::Duration(0.001).sleep();
+    this_pose.translation().x() = center_x + cos(around) * away;
+    this_pose.translation().y() = center_y + sin(around) * away;
+    poses.push_back(this_pose);
 
     // to a first approximation, the points are on a circle
     // so the angle between them is chord/radius
     theta += chord / away;
-
-    if (!ros::ok())
-      break;
   }
+}
 
-  /*
-    // Draw spiral
-    double x, y;
-    double distance = config_->insertion_attempt_distance_;
-    double radius = config_->insertion_attempt_radius_;
-    int rotations = 4;
-    while (distance <= rotations * 2.0 * M_PI)
-    {
-      // Increment
-      distance += config_->insertion_attempt_distance_;
-      radius += config_->insertion_attempt_radius_;
-
-      // x = rx + (sin(distance) * distance) * radius;
-      // y = ry + (sin(distance + (M_PI / 2.0)) * distance + (M_PI / 2)) * radius;
-
-      x = rx + sin(distance) * radius;
-      y = ry + sin(distance + M_PI / 2.0) * radius;
-
-      new_sphere.translation().x() = x;
-      new_sphere.translation().y() = y;
-      visuals_->visual_tools_->publishZArrow(new_sphere, rvt::RED, rvt::SMALL);
-      ros::Duration(0.001).sleep();
-
-      // visuals_->visual_tools_->printTransform(new_sphere);
+void PickManager::getRasterPoses(EigenSTL::vector_Affine3d& poses,
+                                 const Eigen::Affine3d& center_pose, double width, double distance)
+{
+  Eigen::Affine3d this_pose = center_pose;
+  const std::size_t rows = std::max(1.0, ceil(width / distance)) + 1;
+  const double half_width = (rows - 1) * distance / 2.0;
 
-      if (!ros::ok())
-        break;
+  // Back and forth along x, stepping along y between rows
+  for (std::size_t row = 0; row < rows; ++row)
+  {
+    this_pose.translation().y() = center_pose.translation().y() - half_width + row * distance;
+    for (std::size_t col = 0; col < rows; ++col)
+    {
+      const std::size_t x_index = (row % 2 == 0) ? col : rows - 1 - col;
+      this_pose.translation().x() = center_pose.translation().x() - half_width + x_index * distance;
+      poses.push_back(this_pose);
     }
-  */
+  }
 }
 
-void PickManager::getSpiralPoses(std::vector<Eigen::Affine3d>& poses,
+void PickManager::getSpiralPoses(EigenSTL::vector_Affine3d& poses,
                                  const Eigen::Affine3d& center_pose, double distance)
 {
   Eigen::Affine3d this_pose = center_pose;
@@ -1224,6 +1267,465 @@ void PickManager::getSpiralPoses(std::vector<Eigen::Affine3d>& poses,
 }
 
 void PickManager::automatedInsertionTest()
+{
+  startInsertionRecording("automated_insertion");
+  runAutomatedInsertionTest();
+  insertion_recorder_->stop();
+}
+
+void PickManager::insertionParameterSweep()
+{
+  JointModelGroup* arm_jmg = config_->right_arm_;
+
+  InsertionSweep sweep(config_, nh_private_);
+  if (!sweep.load())
+    return;
+
+  // Every trial starts from the same place above the hole
+  double duration = 5;
+  if (!manipulation_->moveToSRDFPoseNoPlan(arm_jmg, "insertion_location_side", duration))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to move to inseriton location");
+    return;
+  }
+  ros::Duration(duration).sleep();
+
+  const Eigen::Affine3d start_world_to_ee =
+      manipulation_->getCurrentState()->getGlobalLinkTransform(grasp_datas_[arm_jmg]->parent_link_);
+  const Eigen::Affine3d start_world_to_tool =
+      start_world_to_ee * config_->teleoperation_offset_.inverse();
+
+  remote_control_->waitForNextStep("start insertion sweep");
+
+  tactile_feedback_->recalibrateTactileSensor();
+  ros::Duration(sweep.getResetPause()).sleep();
+
+  startInsertionRecording("insertion_sweep");
+  sweep.run(std::bind(&PickManager::runInsertionTrial, this, arm_jmg,
+                      std::cref(start_world_to_tool), std::placeholders::_1));
+  insertion_recorder_->stop();
+}
+
+bool PickManager::runInsertionTrial(JointModelGroup* arm_jmg,
+                                    const Eigen::Affine3d& start_world_to_tool,
+                                    InsertionTrialResult& result)
+{
+  Eigen::Affine3d world_to_tool = start_world_to_tool;
+
+  bool direction_in = true;
+  bool achieved_depth = false;
+
+  // The loop always runs for insertion_duration, so time the part itself from the side
+  const double seated_depth =
+      config_->automated_insertion_distance_ - config_->insertion_depth_tolerance_;
+  std::atomic<bool> done(false);
+  ros::WallTime contact_time;
+  ros::WallTime seated_time;
+  const ros::WallTime start_time = ros::WallTime::now();
+  boost::thread watch_thread(std::bind(&PickManager::watchInsertionTrial, this, arm_jmg,
+                                       std::cref(start_world_to_tool), seated_depth,
+                                       std::cref(done), std::ref(contact_time),
+                                       std::ref(seated_time)));
+  const bool inserted = manipulation_->executeInsertionClosedLoop(
+      arm_jmg, config_->automated_insertion_distance_, world_to_tool, direction_in, achieved_depth);
+  done = true;
+  watch_thread.join();
+  if (!inserted)
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to insert");
+    return false;
+  }
+
+  result.depth_ = manipulation_->getInsertionDepth();
+  result.peak_force_ = manipulation_->getInsertionPeakForce();
+  result.corrections_ = manipulation_->getInsertionCorrections();
+
+  // achieved_depth is false when the force rejected the insertion or the tool ended short
+  result.success_ = ros::ok() && achieved_depth && !seated_time.isZero();
+
+  // Time from the first touch, or from the start if the part went in without touching
+  if (!seated_time.isZero())
+  {
+    const ros::WallTime from =
+        (!contact_time.isZero() && contact_time < seated_time) ? contact_time : start_time;
+    result.time_to_insert_ = (seated_time - from).toSec();
+  }
+
+  // Back out along the corrected axis so the part clears the hole, then restore the start pose
+  direction_in = false;
+  double duration = 5;
+  if (!manipulation_->executeInsertionOpenLoopNew(arm_jmg, config_->automated_insertion_distance_,
+                                                  duration, world_to_tool, direction_in,
+                                                  achieved_depth))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to retract");
+    return false;
+  }
+
+  world_to_tool = start_world_to_tool;
+  duration = 2;
+  manipulation_->executeToolPose(arm_jmg, world_to_tool, duration);
+  ros::Duration(duration).sleep();
+
+  // Zero the sensor out of contact so the next trial starts the same way
+  tactile_feedback_->recalibrateTactileSensor();
+  return true;
+}
+
+void PickManager::watchInsertionTrial(JointModelGroup* arm_jmg,
+                                      const Eigen::Affine3d& start_world_to_tool,
+                                      double seated_depth, const std::atomic<bool>& done,
+                                      ros::WallTime& contact_time, ros::WallTime& seated_time)
+{
+  const Eigen::Vector3d insertion_axis = start_world_to_tool.rotation().col(2);
+
+  ros::WallRate rate(100);
+  while (ros::ok())
+  {
+    // Read done first so a sample is always taken after the insertion finished
+    const bool last = done;
+    const ros::WallTime now = ros::WallTime::now();
+
+    if (contact_time.isZero() && tactile_feedback_->getLatestSample().in_contact_)
+      contact_time = now;
+
+    Eigen::Affine3d actual_world_to_tool;
+    if (seated_time.isZero() && manipulation_->getActualToolPose(arm_jmg, actual_world_to_tool) &&
+        (actual_world_to_tool.translation() - start_world_to_tool.translation()).dot(
+            insertion_axis) >= seated_depth)
+      seated_time = now;
+
+    if (last)
+      break;
+    rate.sleep();
+  }
+}
+
+// Mode 13
+bool PickManager::trainExperienceDatabase()
+{
+  if (!config_->use_experience_setup_)
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Experience training requires use_experience_setup");
+    return false;
+  }
+  JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
+
+  if (FLAGS_worker_id >= 0)
+    return runExperienceTrainingWorker(arm_jmg,
+                                       TrainingPartition(FLAGS_worker_id, FLAGS_num_workers));
+
+  int num_workers = FLAGS_num_workers;
+  if (num_workers <= 0)
+    num_workers = std::max(1u, boost::thread::hardware_concurrency());
+
+  // Workers never move the real robot, they only plan and save experiences
+  std::vector<std::string> worker_args;
+  worker_args.push_back("--mode=13");
+  worker_args.push_back("--fake_execution=true");
+  worker_args.push_back("--use_experience=true");
+  worker_args.push_back("--show_database=false");
+
+  ExperienceTrainingCoordinator coordinator(nh_private_);
+  if (!coordinator.runWorkers(num_workers, worker_args))
+    return false;
+
+  std::vector<std::string> partial_paths;
+  for (int worker_id = 0; worker_id < num_workers; ++worker_id)
+    partial_paths.push_back(getWorkerDatabasePath(config_->experience_training_database_,
+                                                  worker_id));
+
+  manipulation_->setExperienceDatabasePath(config_->experience_training_database_);
+  return manipulation_->mergeExperienceDatabases(arm_jmg, partial_paths);
+}
+
+bool PickManager::runExperienceTrainingWorker(JointModelGroup* arm_jmg,
+                                              const TrainingPartition& partition)
+{
+  manipulation_->setExperienceDatabasePath(
+      getWorkerDatabasePath(config_->experience_training_database_, partition.worker_id_));
+
+  std::size_t solved = 0;
+  std::size_t attempted = 0;
+  moveit::core::RobotStatePtr start_state = manipulation_->getCurrentState();
+  for (int query = 0; query < config_->experience_training_queries_ && ros::ok(); ++query)
+  {
+    if (!partition.owns(query))
+      continue;
+    ++attempted;
+
+    // Seeding by query draws the same candidate goals however many workers there are. Start
+    // states chain within each worker, so which candidate is valid still depends on the split
+    random_numbers::RandomNumberGenerator rng(query + 1);
+    moveit::core::RobotStatePtr goal_state(new moveit::core::RobotState(*start_state));
+
+    static const std::size_t MAX_ATTEMPTS = 200;
+    bool found = false;
+    for (std::size_t i = 0; i < MAX_ATTEMPTS && !found; ++i)
+    {
+      goal_state->setToRandomPositions(arm_jmg, rng);
+      bool collision_verbose = false;
+      found = manipulation_->checkCollisionAndBounds(start_state, goal_state, collision_verbose);
+    }
+    if (!found)
+    {
+      ROS_WARN_STREAM_NAMED("pick_manager", "No valid goal for query " << query);
+      continue;
+    }
+
+    // Chain queries so the experiences do not all start from the same state
+    bool verbose = false;
+    bool execute_trajectory = false;
+    if (!manipulation_->move(start_state, goal_state, arm_jmg,
+                             config_->main_velocity_scaling_factor_, verbose, execute_trajectory))
+    {
+      ROS_WARN_STREAM_NAMED("pick_manager", "Failed to plan query " << query);
+      continue;
+    }
+    start_state = goal_state;
+    ++solved;
+  }
+
+  ROS_INFO_STREAM_NAMED("pick_manager", "Worker " << partition.worker_id_ << " solved " << solved
+                                                  << " of " << attempted << " queries");
+
+  // A worker left without queries by the split has nothing to fail
+  if (attempted > 0 && solved == 0)
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Worker " << partition.worker_id_
+                                                     << " did not solve any query");
+    return false;
+  }
+  return ros::ok();
+}
+
+// Mode 14
+bool PickManager::buildReachabilityMap()
+{
+  return manipulation_->buildReachabilityMap(config_->right_arm_, nh_private_);
+}
+
+// Mode 15
+bool PickManager::compactExperienceDatabase()
+{
+  if (!config_->use_experience_setup_)
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Compaction requires use_experience_setup");
+    return false;
+  }
+  JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
+  return manipulation_->compactExperienceDatabase(arm_jmg, config_->experience_compaction_input_,
+                                                  config_->experience_compaction_output_);
+}
+
+// Mode 16
+bool PickManager::perceiveBins(const std::string& bin_names)
+{
+  if (fake_perception_)
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Perceiving bins requires --fake_perception=false");
+    return false;
+  }
+
+  std::vector<std::string> bins;
+  boost::split(bins, bin_names, boost::is_any_of(","), boost::token_compress_on);
+
+  bool success = true;
+  for (std::size_t i = 0; i < bins.size() && ros::ok(); ++i)
+  {
+    if (bins[i].empty())
+      continue;
+    if (!perceiveBin(bins[i]))
+      success = false;
+  }
+  return success;
+}
+
+bool PickManager::perceiveBin(const std::string& bin_name)
+{
+  // Orders in a bin seen recently, and not entered since, need no camera move or perception
+  picknik_msgs::FindObjectsResult result;
+  if (perception_interface_->getCachedPerception(bin_name, result))
+  {
+    ROS_INFO_STREAM_NAMED("pick_manager", "Reusing cached perception of bin " << bin_name);
+    return perception_interface_->applyCachedPerception(bin_name);
+  }
+
+  // Load the bin region and every product expected in it
+  const std::string parent_name = "pick_manager";  // for namespacing logging messages
+  const std::string bin_param = "perception_bins/" + bin_name;
+  std::vector<double> centroid;
+  std::vector<double> dimensions;
+  std::string camera_pose;
+  std::vector<std::string> products;
+  if (!ros_param_utilities::getDoubleParameters(parent_name, nh_private_, bin_param + "/centroid",
+                                                centroid) ||
+      !ros_param_utilities::getDoubleParameters(parent_name, nh_private_,
+                                                bin_param + "/dimensions", dimensions) ||
+      !ros_param_utilities::getStringParameter(parent_name, nh_private_,
+                                               bin_param + "/camera_pose", camera_pose) ||
+      !ros_param_utilities::getStringParameters(parent_name, nh_private_,
+                                                bin_param + "/products", products))
+    return false;
+  if (centroid.size() != 6 || dimensions.size() != 3 || products.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Bin " << bin_name << " needs an x,y,z,r,p,y centroid, "
+                                                  << "depth, width, height and some products");
+    return false;
+  }
+
+  Eigen::Affine3d world_to_bin;
+  ros_param_utilities::convertDoublesToEigen(parent_name, centroid, world_to_bin);
+
+  picknik_msgs::FindObjectsGoal goal;
+  goal.bin_name = bin_name;
+  goal.desired_object_name = products.front();
+  goal.expected_objects_names = products;
+  goal.bin_centroid = visuals_->visual_tools_->convertPose(world_to_bin);
+  goal.bin_dimensions.type = shape_msgs::SolidPrimitive::BOX;
+  goal.bin_dimensions.dimensions = dimensions;
+
+  if (!camera_pose.empty() && !gotoPose(camera_pose))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to move camera to bin " << bin_name);
+    return false;
+  }
+
+  if (!perception_interface_->startPerception(goal))
+    return false;
+
+  // Let arm come to rest
+  double timeout = 20;
+  manipulation_->waitForRobotToStop(timeout);
+
+  if (!perception_interface_->endPerception(result))
+    return false;
+
+  return perception_interface_->applyCachedPerception(bin_name);
+}
+
+// Mode 18
+bool PickManager::pickProducts(const std::string& bin_names)
+{
+  std::vector<std::string> bins;
+  boost::split(bins, bin_names, boost::is_any_of(","), boost::token_compress_on);
+
+  bool success = true;
+  for (std::size_t i = 0; i < bins.size() && ros::ok(); ++i)
+  {
+    if (bins[i].empty())
+      continue;
+    if (!pickProduct(bins[i]))
+      success = false;
+  }
+  return success;
+}
+
+bool PickManager::pickProduct(const std::string& bin_name)
+{
+  if (!perceiveBin(bin_name))
+    return false;
+
+  picknik_msgs::FindObjectsResult result;
+  if (!perception_interface_->getCachedPerception(bin_name, result) ||
+      result.found_objects.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "No product perceived in bin " << bin_name);
+    return false;
+  }
+  const picknik_msgs::FoundObject& product = result.found_objects.front();
+
+  Eigen::Affine3d world_to_pose;
+  if (!perception_interface_->getProductPose(bin_name, product.object_name, world_to_pose))
+    return false;
+
+  if (product.bounding_mesh.vertices.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Perceived " << product.object_name << " has no mesh");
+    return false;
+  }
+
+  // The grasp generator wants the centre and size of a cuboid, the mesh is relative to the pose
+  Eigen::Vector3d min_corner = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  Eigen::Vector3d max_corner = -min_corner;
+  for (std::size_t i = 0; i < product.bounding_mesh.vertices.size(); ++i)
+  {
+    const geometry_msgs::Point& vertex = product.bounding_mesh.vertices[i];
+    min_corner = min_corner.cwiseMin(Eigen::Vector3d(vertex.x, vertex.y, vertex.z));
+    max_corner = max_corner.cwiseMax(Eigen::Vector3d(vertex.x, vertex.y, vertex.z));
+  }
+  const Eigen::Affine3d world_to_product =
+      world_to_pose * Eigen::Translation3d((min_corner + max_corner) / 2.0);
+  const Eigen::Vector3d size = max_corner - min_corner;
+
+  JointModelGroup* arm_jmg = manipulation_->chooseArm(world_to_product);
+  manipulation_->allowFingerTouch(product.object_name, arm_jmg);
+
+  // Best ranked valid grasp first
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  if (!manipulation_->chooseGrasp(world_to_product, size.x(), size.y(), size.z(),
+                                  product.object_name, bin_name, arm_jmg, grasp_candidates,
+                                  verbose_))
+    return false;
+  const moveit_grasps::GraspCandidatePtr& grasp = grasp_candidates.front();
+
+  // Move to the pre-grasp with the fingers already open to the grasp width
+  moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
+  moveit::core::RobotStatePtr pre_grasp_state(new moveit::core::RobotState(*current_state));
+  grasp->getPreGraspState(pre_grasp_state);
+  if (!manipulation_->setEEGraspPosture(grasp->grasp_.pre_grasp_posture, arm_jmg))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to set EE to correct grasp posture");
+    return false;
+  }
+  if (!manipulation_->move(current_state, pre_grasp_state, arm_jmg,
+                           config_->main_velocity_scaling_factor_, verbose_))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to plan to pre-grasp position");
+    return false;
+  }
+
+  // Entering the bin disturbs whatever was perceived in it
+  perception_interface_->invalidateBin(bin_name);
+  if (!manipulation_->executeSavedCartesianPath(grasp, moveit_grasps::APPROACH))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to move through approach path");
+    return false;
+  }
+
+  // From here on a failure says something about the grasp itself
+  if (!manipulation_->openEE(false, arm_jmg))
+    ROS_WARN_STREAM_NAMED("pick_manager", "Unable to close end effector");
+
+  bool success = true;
+  if (!manipulation_->executeSavedCartesianPath(grasp, moveit_grasps::LIFT))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to execute lift path after grasping");
+    success = false;
+  }
+  else if (!manipulation_->executeSavedCartesianPath(grasp, moveit_grasps::RETREAT))
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to execute retreat path");
+    success = false;
+  }
+
+  manipulation_->recordGraspOutcome(product.object_name, bin_name, world_to_product, grasp,
+                                    success);
+  return success;
+}
+
+void PickManager::startInsertionRecording(const std::string& name)
+{
+  if (config_->insertion_log_directory_.empty())
+    return;
+
+  const std::string file_path =
+      config_->insertion_log_directory_ + "/" + name + "_" +
+      boost::posix_time::to_iso_string(boost::posix_time::second_clock::local_time()) + ".bin";
+  insertion_recorder_->start(file_path);
+}
+
+void PickManager::runAutomatedInsertionTest()
 {
   JointModelGroup* arm_jmg = config_->right_arm_;
 
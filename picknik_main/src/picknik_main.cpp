@@ -24,6 +24,7 @@
 #include <ros/ros.h>
 
 DEFINE_string(pose, "", "Requested robot pose");
+DEFINE_string(bins, "", "Comma separated bins to perceive or pick from, in order");
 DEFINE_int32(mode, 2, "Mode");
 DEFINE_bool(verbose, false, "Verbose");
 
@@ -54,6 +55,8 @@ int main(int argc, char** argv)
   std::cout << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
 
+  // Exit status of the mode, so that scripts and the training coordinator see failures
+  bool success = true;
   switch (FLAGS_mode)
   {
     case 0:
@@ -67,7 +70,7 @@ int main(int argc, char** argv)
       break;
     case 2:
       ROS_INFO_STREAM_NAMED("main", "Go to home position");
-      manager.testGoHome();
+      success = manager.testGoHome();
       break;
     case 3:
       ROS_INFO_STREAM_NAMED("main", "Insertion");
@@ -79,11 +82,11 @@ int main(int argc, char** argv)
       break;
     case 5:
       ROS_INFO_STREAM_NAMED("main", "Raise the roof (go up and down)");
-      manager.testUpAndDown();
+      success = manager.testUpAndDown();
       break;
     case 6:
       ROS_INFO_STREAM_NAMED("main", "Plan to random valid locations");
-      manager.testRandomValidMotions();
+      success = manager.testRandomValidMotions();
       break;
     case 7:
       ROS_INFO_STREAM_NAMED("main", "Draw spiral");
@@ -91,11 +94,11 @@ int main(int argc, char** argv)
       break;
     case 8:
       ROS_INFO_STREAM_NAMED("main", "Test end effectors mode");
-      manager.testEndEffectors();
+      success = manager.testEndEffectors();
       break;
     case 9:
       ROS_INFO_STREAM_NAMED("main", "Going to pose " << FLAGS_pose);
-      manager.gotoPose(FLAGS_pose);
+      success = manager.gotoPose(FLAGS_pose);
       break;
     case 10:
       ROS_INFO_STREAM_NAMED("main", "Automated insertion test");
@@ -103,24 +106,49 @@ int main(int argc, char** argv)
       break;
     case 11:
       ROS_INFO_STREAM_NAMED("main", "Going in circle for calibration");
-      manager.calibrateInCircle();
+      success = manager.calibrateInCircle();
+      break;
+    case 12:
+      ROS_INFO_STREAM_NAMED("main", "Insertion parameter sweep");
+      manager.insertionParameterSweep();
+      break;
+    case 13:
+      ROS_INFO_STREAM_NAMED("main", "Train experience database");
+      success = manager.trainExperienceDatabase();
+      break;
+    case 14:
+      ROS_INFO_STREAM_NAMED("main", "Build reachability map");
+      success = manager.buildReachabilityMap();
+      break;
+    case 15:
+      ROS_INFO_STREAM_NAMED("main", "Compact experience database");
+      success = manager.compactExperienceDatabase();
+      break;
+    case 16:
+      ROS_INFO_STREAM_NAMED("main", "Perceive bins " << FLAGS_bins);
+      success = manager.perceiveBins(FLAGS_bins);
       break;
     case 17:
       ROS_INFO_STREAM_NAMED("main", "Test joint limits");
-      manager.testJointLimits();
+      success = manager.testJointLimits();
+      break;
+    case 18:
+      ROS_INFO_STREAM_NAMED("main", "Pick products from bins " << FLAGS_bins);
+      success = manager.pickProducts(FLAGS_bins);
       break;
     case 41:
       ROS_INFO_STREAM_NAMED("main", "Get SRDF pose");
-      manager.getSRDFPose();
+      success = manager.getSRDFPose();
       break;
     case 42:
       ROS_INFO_STREAM_NAMED("main", "Check if current state is in collision");
-      manager.testInCollision();
+      success = manager.testInCollision();
       ros::Duration(5.0).sleep();
       break;
 
     default:
       ROS_WARN_STREAM_NAMED("main", "Unkown mode: " << FLAGS_mode);
+      success = false;
   }
 
   // Shutdown
@@ -140,5 +168,5 @@ int main(int argc, char** argv)
 
   ros::shutdown();
 
-  return 0;
+  return success ? 0 : 1;
 }
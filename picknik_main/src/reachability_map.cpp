@@ -0,0 +1,447 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Offline grid of which end effector poses in front of the shelf the arm can reach
+*/
+
+// PickNik
+#include <picknik_main/reachability_map.h>
+
+// MoveIt
+#include <moveit/kinematics_metrics/kinematics_metrics.h>
+#include <random_numbers/random_numbers.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+namespace picknik_main
+{
+namespace
+{
+const char MAGIC[8] = {'P', 'N', 'K', 'R', 'E', 'A', 'C', 'H'};
+const uint32_t VERSION = 1;
+
+template <typename T>
+void writeValue(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& file, T& value)
+{
+  file.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return file.good();
+}
+
+template <typename T>
+void writeArray(std::ofstream& file, const std::vector<T>& values)
+{
+  file.write(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool readArray(std::ifstream& file, std::vector<T>& values)
+{
+  file.read(reinterpret_cast<char*>(&values[0]), values.size() * sizeof(T));
+  return file.good();
+}
+
+void writePose(std::ofstream& file, const Eigen::Affine3d& pose)
+{
+  const Eigen::Quaterniond rotation(pose.rotation());
+  for (std::size_t i = 0; i < 3; ++i)
+    writeValue(file, pose.translation()[i]);
+  writeValue(file, rotation.x());
+  writeValue(file, rotation.y());
+  writeValue(file, rotation.z());
+  writeValue(file, rotation.w());
+}
+
+bool readPose(std::ifstream& file, Eigen::Affine3d& pose)
+{
+  double values[7];
+  for (std::size_t i = 0; i < 7; ++i)
+    if (!readValue(file, values[i]))
+      return false;
+  pose = Eigen::Translation3d(values[0], values[1], values[2]) *
+         Eigen::Quaterniond(values[6], values[3], values[4], values[5]);
+  return true;
+}
+}  // end anonymous namespace
+
+ReachabilityMap::ReachabilityMap()
+  : world_to_face_(Eigen::Affine3d::Identity())
+  , resolution_(0.05)
+  , orientation_tolerance_(0.2)
+  , ik_seeds_(8)
+  , ik_timeout_(0.01)
+  , distinct_solution_distance_(0.5)
+{
+  dims_[0] = dims_[1] = dims_[2] = 0;
+}
+
+bool ReachabilityMap::loadParameters(ros::NodeHandle nh)
+{
+  const std::string parent_name = "reachability_map";  // for namespacing logging messages
+
+  std::vector<double> world_to_face_doubles;
+  std::vector<double> size;
+  std::vector<double> approach_doubles;
+  ros_param_utilities::getDoubleParameters(parent_name, nh, "reachability_map/world_to_face",
+                                           world_to_face_doubles);
+  ros_param_utilities::convertDoublesToEigen(parent_name, world_to_face_doubles, world_to_face_);
+  ros_param_utilities::getDoubleParameters(parent_name, nh, "reachability_map/size", size);
+  ros_param_utilities::getDoubleParameter(parent_name, nh, "reachability_map/resolution",
+                                          resolution_);
+  ros_param_utilities::getDoubleParameters(parent_name, nh, "reachability_map/approaches",
+                                           approach_doubles);
+  ros_param_utilities::getDoubleParameter(parent_name, nh,
+                                          "reachability_map/orientation_tolerance",
+                                          orientation_tolerance_);
+  ros_param_utilities::getIntParameter(parent_name, nh, "reachability_map/ik_seeds", ik_seeds_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh, "reachability_map/ik_timeout",
+                                          ik_timeout_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh,
+                                          "reachability_map/distinct_solution_distance",
+                                          distinct_solution_distance_);
+
+  if (size.size() != 3 || resolution_ <= 0 || ik_seeds_ < 1)
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Need a [depth, width, height] size, a positive "
+                                               "resolution and at least one ik seed");
+    return false;
+  }
+  if (approach_doubles.empty() || approach_doubles.size() % 3 != 0)
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Approaches must be a list of roll, pitch, yaw");
+    return false;
+  }
+
+  // Cell centers are on the region's boundaries as well as inside it
+  for (std::size_t i = 0; i < 3; ++i)
+    dims_[i] = static_cast<std::size_t>(std::floor(size[i] / resolution_ + 0.5)) + 1;
+
+  approaches_.clear();
+  for (std::size_t i = 0; i < approach_doubles.size(); i += 3)
+  {
+    std::vector<double> rotation_doubles(3, 0.0);
+    rotation_doubles.insert(rotation_doubles.end(), approach_doubles.begin() + i,
+                            approach_doubles.begin() + i + 3);
+    Eigen::Affine3d approach;
+    ros_param_utilities::convertDoublesToEigen(parent_name, rotation_doubles, approach);
+    approaches_.push_back(approach);
+  }
+
+  return true;
+}
+
+bool ReachabilityMap::build(moveit::core::RobotState& robot_state,
+                            const moveit::core::JointModelGroup* arm_jmg,
+                            const moveit::core::LinkModel* ik_tip_link,
+                            const moveit::core::GroupStateValidityCallbackFn& validity_fn,
+                            const moveit::core::JointModel* gantry_joint)
+{
+  if (!getNumCells())
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Parameters not loaded");
+    return false;
+  }
+  group_name_ = arm_jmg->getName();
+
+  const std::size_t num_cells = getNumCells();
+  solutions_.assign(num_cells, 0);
+  gantry_heights_.assign(num_cells, std::numeric_limits<float>::quiet_NaN());
+  manipulabilities_.assign(num_cells, 0.0f);
+
+  kinematics_metrics::KinematicsMetrics metrics(robot_state.getRobotModel());
+
+  ROS_INFO_STREAM_NAMED("reachability_map", "Sampling " << num_cells << " cells of "
+                                                        << group_name_ << " with " << ik_seeds_
+                                                        << " ik seeds each");
+  const ros::WallTime start_time = ros::WallTime::now();
+
+  // Seeded so that rebuilding gives the same map
+  random_numbers::RandomNumberGenerator rng(0);
+
+  std::size_t index = 0;
+  std::size_t reachable = 0;
+  for (std::size_t x = 0; x < dims_[0]; ++x)
+  {
+    for (std::size_t y = 0; y < dims_[1]; ++y)
+    {
+      for (std::size_t z = 0; z < dims_[2]; ++z)
+      {
+        if (!ros::ok())
+        {
+          solutions_.clear();
+          return false;
+        }
+
+        for (std::size_t o = 0; o < approaches_.size(); ++o, ++index)
+        {
+          const Eigen::Affine3d world_to_tip = getCellPose(x, y, z, o);
+
+          std::vector<std::vector<double> > distinct;
+          for (int seed = 0; seed < ik_seeds_; ++seed)
+          {
+            robot_state.setToRandomPositions(arm_jmg, rng);
+            if (!robot_state.setFromIK(arm_jmg, world_to_tip, ik_tip_link->getName(), 1,
+                                       ik_timeout_, validity_fn))
+              continue;
+
+            std::vector<double> positions;
+            robot_state.copyJointGroupPositions(arm_jmg, positions);
+
+            // Count solutions in different configurations, not the same one found twice
+            bool is_new = true;
+            for (std::size_t i = 0; i < distinct.size() && is_new; ++i)
+            {
+              double distance = 0.0;
+              for (std::size_t j = 0; j < positions.size(); ++j)
+                distance = std::max(distance, std::fabs(positions[j] - distinct[i][j]));
+              is_new = distance > distinct_solution_distance_;
+            }
+            if (!is_new)
+              continue;
+            distinct.push_back(positions);
+
+            double manipulability = 0.0;
+            metrics.getManipulabilityIndex(robot_state, arm_jmg, manipulability);
+            if (distinct.size() == 1 || manipulability > manipulabilities_[index])
+            {
+              manipulabilities_[index] = manipulability;
+              if (gantry_joint)
+                gantry_heights_[index] = robot_state.getJointPositions(gantry_joint)[0];
+            }
+          }
+
+          solutions_[index] = std::min<std::size_t>(distinct.size(), 255);
+          if (!distinct.empty())
+            ++reachable;
+        }
+      }
+    }
+    ROS_INFO_STREAM_NAMED("reachability_map", "Sampled depth " << x + 1 << "/" << dims_[0]);
+  }
+
+  ROS_INFO_STREAM_NAMED("reachability_map", reachable << " of " << num_cells
+                                                      << " cells reachable, built in "
+                                                      << (ros::WallTime::now() - start_time).toSec()
+                                                      << " s");
+  return true;
+}
+
+bool ReachabilityMap::save(const std::string& file_path) const
+{
+  if (!isLoaded())
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Nothing to save, build the map first");
+    return false;
+  }
+
+  std::ofstream file(file_path.c_str(), std::ios::binary);
+  if (!file.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Unable to open " << file_path);
+    return false;
+  }
+
+  file.write(MAGIC, sizeof(MAGIC));
+  writeValue(file, VERSION);
+  writeValue(file, static_cast<uint32_t>(group_name_.size()));
+  file.write(group_name_.c_str(), group_name_.size());
+  writePose(file, world_to_face_);
+  writeValue(file, resolution_);
+  for (std::size_t i = 0; i < 3; ++i)
+    writeValue(file, static_cast<uint32_t>(dims_[i]));
+  writeValue(file, orientation_tolerance_);
+  writeValue(file, static_cast<uint32_t>(approaches_.size()));
+  for (std::size_t i = 0; i < approaches_.size(); ++i)
+    writePose(file, approaches_[i]);
+
+  writeArray(file, solutions_);
+  writeArray(file, gantry_heights_);
+  writeArray(file, manipulabilities_);
+
+  if (!file.good())
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Failed writing " << file_path);
+    return false;
+  }
+  ROS_INFO_STREAM_NAMED("reachability_map", "Saved " << getNumCells() << " cells to "
+                                                     << file_path);
+  return true;
+}
+
+bool ReachabilityMap::load(const std::string& file_path)
+{
+  solutions_.clear();
+
+  std::ifstream file(file_path.c_str(), std::ios::binary);
+  if (!file.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Unable to open " << file_path);
+    return false;
+  }
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version = 0;
+  if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+      !readValue(file, version) || version != VERSION)
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", file_path << " is not a version " << VERSION
+                                                         << " reachability map");
+    return false;
+  }
+
+  uint32_t name_length = 0;
+  uint32_t dims[3];
+  uint32_t num_approaches = 0;
+  bool read = readValue(file, name_length);
+  if (read)
+  {
+    group_name_.resize(name_length);
+    read = name_length == 0 || file.read(&group_name_[0], name_length);
+  }
+  read = read && readPose(file, world_to_face_) && readValue(file, resolution_);
+  for (std::size_t i = 0; i < 3; ++i)
+    read = read && readValue(file, dims[i]);
+  read = read && readValue(file, orientation_tolerance_) && readValue(file, num_approaches);
+  if (!read)
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Truncated header in " << file_path);
+    return false;
+  }
+
+  for (std::size_t i = 0; i < 3; ++i)
+    dims_[i] = dims[i];
+  approaches_.resize(num_approaches);
+  for (std::size_t i = 0; i < approaches_.size() && read; ++i)
+    read = readPose(file, approaches_[i]);
+
+  const std::size_t num_cells = getNumCells();
+  std::vector<uint8_t> solutions(num_cells);
+  gantry_heights_.resize(num_cells);
+  manipulabilities_.resize(num_cells);
+  if (!read || !num_cells || !readArray(file, solutions) || !readArray(file, gantry_heights_) ||
+      !readArray(file, manipulabilities_))
+  {
+    ROS_ERROR_STREAM_NAMED("reachability_map", "Truncated cells in " << file_path);
+    return false;
+  }
+  solutions_.swap(solutions);
+
+  ROS_INFO_STREAM_NAMED("reachability_map", "Loaded " << num_cells << " cells for "
+                                                      << group_name_ << " from " << file_path);
+  return true;
+}
+
+bool ReachabilityMap::isUnreachable(const Eigen::Affine3d& world_to_tip) const
+{
+  std::size_t cell[3];
+  std::size_t approach;
+  if (!getCellCoordinates(world_to_tip, cell, approach))
+    return false;
+
+  // A pose between cell centers, or one the sampling missed, may still have a solution. Only
+  // reject it when the whole neighbourhood failed, and a neighbour outside the map is unknown
+  for (int dx = -1; dx <= 1; ++dx)
+    for (int dy = -1; dy <= 1; ++dy)
+      for (int dz = -1; dz <= 1; ++dz)
+      {
+        const int x = static_cast<int>(cell[0]) + dx;
+        const int y = static_cast<int>(cell[1]) + dy;
+        const int z = static_cast<int>(cell[2]) + dz;
+        if (x < 0 || y < 0 || z < 0 || x >= static_cast<int>(dims_[0]) ||
+            y >= static_cast<int>(dims_[1]) || z >= static_cast<int>(dims_[2]))
+          return false;
+        if (solutions_[getIndex(x, y, z, approach)] > 0)
+          return false;
+      }
+  return true;
+}
+
+bool ReachabilityMap::getCell(const Eigen::Affine3d& world_to_tip, std::size_t& solutions,
+                              double& gantry_height, double& manipulability) const
+{
+  std::size_t index;
+  if (!getCellIndex(world_to_tip, index) || solutions_[index] == 0)
+    return false;
+
+  solutions = solutions_[index];
+  gantry_height = gantry_heights_[index];
+  manipulability = manipulabilities_[index];
+  return true;
+}
+
+bool ReachabilityMap::getCellIndex(const Eigen::Affine3d& world_to_tip, std::size_t& index) const
+{
+  std::size_t cell[3];
+  std::size_t approach;
+  if (!getCellCoordinates(world_to_tip, cell, approach))
+    return false;
+
+  index = getIndex(cell[0], cell[1], cell[2], approach);
+  return true;
+}
+
+bool ReachabilityMap::getCellCoordinates(const Eigen::Affine3d& world_to_tip, std::size_t cell[3],
+                                         std::size_t& approach) const
+{
+  if (!isLoaded())
+    return false;
+
+  const Eigen::Affine3d face_to_tip = world_to_face_.inverse() * world_to_tip;
+
+  // Nearest cell center, rounding keeps poses half a cell outside the region covered
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    const double position = std::floor(face_to_tip.translation()[i] / resolution_ + 0.5);
+    if (position < 0 || position >= dims_[i])
+      return false;
+    cell[i] = static_cast<std::size_t>(position);
+  }
+
+  // Nearest approach orientation
+  std::size_t best_approach = 0;
+  double best_angle = std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0; i < approaches_.size(); ++i)
+  {
+    const double angle =
+        Eigen::AngleAxisd(approaches_[i].rotation().transpose() * face_to_tip.rotation()).angle();
+    if (angle < best_angle)
+    {
+      best_angle = angle;
+      best_approach = i;
+    }
+  }
+  if (best_angle > orientation_tolerance_)
+    return false;
+
+  approach = best_approach;
+  return true;
+}
+
+Eigen::Affine3d ReachabilityMap::getCellPose(std::size_t x, std::size_t y, std::size_t z,
+                                             std::size_t orientation) const
+{
+  return world_to_face_ * Eigen::Translation3d(x * resolution_, y * resolution_, z * resolution_) *
+         approaches_[orientation];
+}
+
+}  // end namespace
@@ -22,9 +22,24 @@
 namespace picknik_main
 {
 TactileFeedback::TactileFeedback(ManipulationDataPtr config)
-  : sheer_theta_(0.0)
-  , end_effector_data_cached_(ALWAYS_AT_END, 0.0)  // initial dummy data
+  : visualization_running_(true), filter_reset_requested_(false)
 {
+  // Load signal processing settings
+  TactileFilterSettings filter_settings;
+  if (!parseTactileFilterMode(config->tactile_filter_, filter_settings.mode_))
+    ROS_ERROR_STREAM_NAMED("tactile_feedback", "Unknown tactile filter '"
+                                                   << config->tactile_filter_
+                                                   << "', using raw sensor data");
+  filter_settings.low_pass_cutoff_ = config->tactile_filter_cutoff_;
+  filter_settings.kalman_process_noise_ = config->tactile_kalman_process_noise_;
+  filter_settings.kalman_measurement_noise_ = config->tactile_kalman_measurement_noise_;
+  filter_settings.contact_force_on_ = config->tactile_contact_force_on_;
+  filter_settings.contact_force_off_ = config->tactile_contact_force_off_;
+  filter_settings.slip_force_rate_ = config->tactile_slip_force_rate_;
+  filter_settings.slip_torque_rate_ = config->tactile_slip_torque_rate_;
+  filter_settings.event_debounce_ = config->tactile_event_debounce_;
+  filter_.configure(filter_settings);
+
   // Load visual tools
   visual_tools_.reset(new rviz_visual_tools::RvizVisualTools(config->robot_base_frame_,
                                                              "/picknik_main/tactile_feedback"));
@@ -34,6 +49,17 @@ TactileFeedback::TactileFeedback(ManipulationDataPtr config)
       nh_.subscribe("/end_effector_data", queue_size, &TactileFeedback::dataCallback, this);
 
   tactile_calibration_pub_ = nh_.advertise<std_msgs::Bool>("/calibrate_tactile_sensor", queue_size);
+
+  if (config->tactile_visualization_rate_ > 0)
+    visualization_thread_ = boost::thread(&TactileFeedback::visualizationThread, this,
+                                          config->tactile_visualization_rate_);
+}
+
+TactileFeedback::~TactileFeedback()
+{
+  visualization_running_ = false;
+  if (visualization_thread_.joinable())
+    visualization_thread_.join();
 }
 
 void TactileFeedback::recalibrateTactileSensor()
@@ -41,6 +67,9 @@ void TactileFeedback::recalibrateTactileSensor()
   ROS_INFO_STREAM_NAMED("tactile_feedback", "Recalibrating");
   std_msgs::Bool msg;
   tactile_calibration_pub_.publish(msg);
+
+  // Old history no longer matches the recalibrated zero
+  filter_reset_requested_ = true;
 }
 
 void TactileFeedback::dataCallback(const std_msgs::Float64MultiArray::ConstPtr& msg)
@@ -55,28 +84,118 @@ void TactileFeedback::dataCallback(const std_msgs::Float64MultiArray::ConstPtr&
   }
 
   // Save latest data
-  end_effector_data_cached_ = msg->data;
+  TactileSample sample;
+  sample.stamp_ = ros::Time::now();
+  std::copy(msg->data.begin(), msg->data.begin() + ALWAYS_AT_END, sample.data_);
+
+  // Filter and detect events
+  if (filter_reset_requested_.exchange(false))
+    filter_.reset();
+  TactileEventType events[TactileFilter::MAX_EVENTS];
+  const std::size_t num_events = filter_.update(sample, events);
+
+  // Find the angle between the sheer displacement and the horizontal (x) axis of the pad
+  geometry_msgs::Pose center;
+  center.position.x = sample.data_[IMAGE_HEIGHT] / 2.0;
+  center.position.y = sample.data_[IMAGE_WIDTH] / 2.0;
+  geometry_msgs::Pose displacement;
+  displacement.position.x = sample.filtered_displacement_x_;
+  displacement.position.y = sample.filtered_displacement_y_;
+  convertPixelToMeters(center, sample.data_[IMAGE_HEIGHT], sample.data_[IMAGE_WIDTH]);
+  convertPixelToMeters(displacement, sample.data_[IMAGE_HEIGHT], sample.data_[IMAGE_WIDTH]);
+  sample.sheer_theta_ = atan2(displacement.position.y - center.position.y,
+                              displacement.position.x - center.position.x);  // radians
+
+  samples_.push(sample);
+
+  // Copies, so the callbacks run without holding the lock
+  InsertionRecorderPtr recorder;
+  std::function<void(TactileEventType, const TactileSample&)> tactile_event_callback;
+  std::function<void()> end_effector_data_callback;
+  {
+    boost::mutex::scoped_lock lock(callbacks_mutex_);
+    recorder = recorder_;
+    if (num_events)
+      tactile_event_callback = tactile_event_callback_;
+    end_effector_data_callback = end_effector_data_callback_;
+  }
+
+  if (recorder)
+    recorder->recordTactile(sample);
 
-  // displayLineDirection();
-  displaySheerForce();
+  if (tactile_event_callback)
+    for (std::size_t i = 0; i < num_events; ++i)
+      tactile_event_callback(events[i], sample);
 
   // Do callback if provided
-  if (end_effector_data_callback_)
-    end_effector_data_callback_();
+  if (end_effector_data_callback)
+    end_effector_data_callback();
+}
+
+TactileSample TactileFeedback::getLatestSample() const
+{
+  TactileSample sample;
+  if (!samples_.readLatest(sample))
+  {
+    // No data yet
+    sample = TactileSample();
+  }
+  return sample;
 }
 
-void TactileFeedback::displayLineDirection()
+std::size_t TactileFeedback::getSamples(std::size_t count,
+                                        std::vector<TactileSample>& samples) const
+{
+  return samples_.readWindow(count, samples);
+}
+
+std::size_t TactileFeedback::getSamples(const ros::Duration& duration,
+                                        std::vector<TactileSample>& samples) const
+{
+  samples_.readWindow(TactileSampleBuffer::capacity(), samples);
+  if (samples.empty())
+    return 0;
+
+  // Drop everything older than the window, measured from the newest sample
+  const ros::Time start = samples.back().stamp_ - duration;
+  std::size_t first = 0;
+  while (first < samples.size() && samples[first].stamp_ < start)
+    ++first;
+  samples.erase(samples.begin(), samples.begin() + first);
+  return samples.size();
+}
+
+void TactileFeedback::visualizationThread(double rate)
+{
+  ros::Rate visualization_rate(rate);
+  uint64_t last_displayed = 0;
+  while (visualization_running_ && ros::ok())
+  {
+    // Only redraw when new data has arrived
+    const uint64_t pushed = samples_.getTotalPushed();
+    if (pushed != last_displayed)
+    {
+      last_displayed = pushed;
+      const TactileSample sample = getLatestSample();
+      // displayLineDirection(sample);
+      displaySheerForce(sample);
+    }
+    visualization_rate.sleep();
+  }
+}
+
+void TactileFeedback::displayLineDirection(const TactileSample& sample)
 {
   bool verbose = false;
 
   // Unpack vector to variable names
-  const double& pt1_x = end_effector_data_cached_[LINE_CENTER_X];
-  const double& pt1_y = end_effector_data_cached_[LINE_CENTER_Y];
-  const double& eigen_vec_x = end_effector_data_cached_[LINE_EIGEN_VEC_X];
-  const double& eigen_vec_y = end_effector_data_cached_[LINE_EIGEN_VEC_Y];
-  const double& eigen_vec_val = end_effector_data_cached_[LINE_EIGEN_VAL];
-  const double& image_height = end_effector_data_cached_[IMAGE_HEIGHT];
-  const double& image_width = end_effector_data_cached_[IMAGE_WIDTH];
+  const double& pt1_x = sample.data_[LINE_CENTER_X];
+  const double& pt1_y = sample.data_[LINE_CENTER_Y];
+  const double& eigen_vec_x = sample.data_[LINE_EIGEN_VEC_X];
+  const double& eigen_vec_y = sample.data_[LINE_EIGEN_VEC_Y];
+  const double& eigen_vec_val = sample.data_[LINE_EIGEN_VAL];
+  const double& image_height = sample.data_[IMAGE_HEIGHT];
+  const double& image_width = sample.data_[IMAGE_WIDTH];
 
   // Calculate point 2
   const double distance_between_points = 2000;
@@ -141,12 +260,12 @@ void TactileFeedback::displayLineDirection()
   visual_tools_->publishArrow(pose_msg, rvt::GREY, rvt::SMALL, length, id);
 }
 
-void TactileFeedback::displaySheerForce()
+void TactileFeedback::displaySheerForce(const TactileSample& sample)
 {
-  const double& sheer_displacement_x = end_effector_data_cached_[SHEER_DISPLACEMENT_X];
-  const double& sheer_displacement_y = end_effector_data_cached_[SHEER_DISPLACEMENT_Y];
-  const double& image_height = end_effector_data_cached_[IMAGE_HEIGHT];
-  const double& image_width = end_effector_data_cached_[IMAGE_WIDTH];
+  const double& sheer_displacement_x = sample.filtered_displacement_x_;
+  const double& sheer_displacement_y = sample.filtered_displacement_y_;
+  const double& image_height = sample.data_[IMAGE_HEIGHT];
+  const double& image_width = sample.data_[IMAGE_WIDTH];
 
   // Convert to ROS msg
   geometry_msgs::PoseStamped pt1;
@@ -172,15 +291,8 @@ void TactileFeedback::displaySheerForce()
   // Visualize tool always pointing down away from gripper
   Eigen::Affine3d eigen_pose = visual_tools_->convertPose(pt1.pose);
 
-  // Find the angle between the line and the horizontal (x) axis
-  double delta_y = pt2.pose.position.y - pt1.pose.position.y;
-  double delta_x = pt2.pose.position.x - pt1.pose.position.x;
-
-  // Save for later use
-  sheer_theta_ = atan2(delta_y, delta_x);  // radians
-
   // Create new pose
-  eigen_pose = eigen_pose * Eigen::AngleAxisd(sheer_theta_, Eigen::Vector3d::UnitZ());
+  eigen_pose = eigen_pose * Eigen::AngleAxisd(sample.sheer_theta_, Eigen::Vector3d::UnitZ());
 
   geometry_msgs::PoseStamped pose_msg;
   pose_msg.header.frame_id = ATTACH_FRAME;
@@ -190,7 +302,7 @@ void TactileFeedback::displaySheerForce()
   static const double VISUAL_MAX_LENGTH = 0.5;  // based on personal visual preferance
   static const double SHEER_FORCE_MAX = 20;     // ignore sheer force higher than this
   static const double SHEER_RATIO = VISUAL_MAX_LENGTH / SHEER_FORCE_MAX;
-  double sheer_force = std::min(SHEER_FORCE_MAX, getSheerForce());
+  double sheer_force = std::min(SHEER_FORCE_MAX, sample.filtered_force_);
   const double length = sheer_force * SHEER_RATIO;
   const int id = 1;
   visual_tools_->publishArrow(pose_msg, rvt::RED, rvt::REGULAR, length, id);
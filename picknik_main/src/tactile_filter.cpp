@@ -0,0 +1,241 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Filter tactile sensor signals, estimate their rates and detect contact and slip
+*/
+
+// PickNik
+#include <picknik_main/tactile_filter.h>
+
+// C++
+#include <cmath>
+
+namespace picknik_main
+{
+bool parseTactileFilterMode(const std::string& name, TactileFilterMode& mode)
+{
+  if (name == "none")
+    mode = TACTILE_FILTER_NONE;
+  else if (name == "low_pass")
+    mode = TACTILE_FILTER_LOW_PASS;
+  else if (name == "kalman")
+    mode = TACTILE_FILTER_KALMAN;
+  else
+    return false;
+  return true;
+}
+
+TactileFilterSettings::TactileFilterSettings()
+  : mode_(TACTILE_FILTER_NONE)
+  , low_pass_cutoff_(5.0)
+  , kalman_process_noise_(1000.0)
+  , kalman_measurement_noise_(4.0)
+  , contact_force_on_(3.0)
+  , contact_force_off_(2.0)
+  , slip_force_rate_(50.0)
+  , slip_torque_rate_(500.0)
+  , event_debounce_(0.05)
+{
+}
+
+// -------------------------------------------------------------------------------------------------
+// SignalFilter
+// -------------------------------------------------------------------------------------------------
+
+SignalFilter::SignalFilter()
+{
+  reset();
+}
+
+void SignalFilter::configure(const TactileFilterSettings& settings)
+{
+  settings_ = settings;
+  reset();
+}
+
+void SignalFilter::reset()
+{
+  initialized_ = false;
+  value_ = 0.0;
+  rate_ = 0.0;
+  p00_ = p01_ = p10_ = p11_ = 0.0;
+}
+
+void SignalFilter::update(double measurement, double dt)
+{
+  if (!initialized_)
+  {
+    value_ = measurement;
+    rate_ = 0.0;
+    p00_ = settings_.kalman_measurement_noise_;
+    p11_ = settings_.kalman_process_noise_;
+    p01_ = p10_ = 0.0;
+    initialized_ = true;
+    return;
+  }
+
+  // Repeated or out of order stamp, nothing to integrate over
+  if (dt <= 0.0)
+    return;
+
+  switch (settings_.mode_)
+  {
+    case TACTILE_FILTER_NONE:
+    {
+      rate_ = (measurement - value_) / dt;
+      value_ = measurement;
+    }
+    break;
+    case TACTILE_FILTER_LOW_PASS:
+    {
+      const double rc = 1.0 / (2.0 * M_PI * settings_.low_pass_cutoff_);
+      const double alpha = dt / (dt + rc);
+      const double previous = value_;
+      value_ += alpha * (measurement - value_);
+      // Smooth the derivative with the same time constant
+      rate_ += alpha * ((value_ - previous) / dt - rate_);
+    }
+    break;
+    case TACTILE_FILTER_KALMAN:
+    {
+      // Predict with constant velocity model
+      const double q = settings_.kalman_process_noise_;
+      value_ += rate_ * dt;
+      const double n00 = p00_ + dt * (p10_ + p01_) + dt * dt * p11_ + q * dt * dt * dt / 3.0;
+      const double n01 = p01_ + dt * p11_ + q * dt * dt / 2.0;
+      const double n10 = p10_ + dt * p11_ + q * dt * dt / 2.0;
+      const double n11 = p11_ + q * dt;
+
+      // Correct with measurement of the value only
+      const double innovation = measurement - value_;
+      const double s = n00 + settings_.kalman_measurement_noise_;
+      const double k0 = n00 / s;
+      const double k1 = n10 / s;
+      value_ += k0 * innovation;
+      rate_ += k1 * innovation;
+
+      p00_ = (1.0 - k0) * n00;
+      p01_ = (1.0 - k0) * n01;
+      p10_ = n10 - k1 * n00;
+      p11_ = n11 - k1 * n01;
+    }
+    break;
+  }
+}
+
+// -------------------------------------------------------------------------------------------------
+// DebouncedState
+// -------------------------------------------------------------------------------------------------
+
+DebouncedState::DebouncedState()
+{
+  reset();
+}
+
+void DebouncedState::reset()
+{
+  state_ = false;
+  pending_ = false;
+}
+
+bool DebouncedState::update(bool condition, const ros::Time& stamp, double debounce)
+{
+  if (condition == state_)
+  {
+    pending_ = false;
+    return false;
+  }
+
+  if (!pending_)
+  {
+    pending_ = true;
+    pending_since_ = stamp;
+  }
+
+  if ((stamp - pending_since_).toSec() < debounce)
+    return false;
+
+  state_ = condition;
+  pending_ = false;
+  return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+// TactileFilter
+// -------------------------------------------------------------------------------------------------
+
+TactileFilter::TactileFilter()
+{
+  configure(TactileFilterSettings());
+}
+
+void TactileFilter::configure(const TactileFilterSettings& settings)
+{
+  settings_ = settings;
+  force_.configure(settings);
+  torque_.configure(settings);
+  displacement_x_.configure(settings);
+  displacement_y_.configure(settings);
+  reset();
+}
+
+void TactileFilter::reset()
+{
+  force_.reset();
+  torque_.reset();
+  displacement_x_.reset();
+  displacement_y_.reset();
+  contact_.reset();
+  slip_.reset();
+  has_previous_ = false;
+}
+
+std::size_t TactileFilter::update(TactileSample& sample, TactileEventType* events)
+{
+  const double dt = has_previous_ ? (sample.stamp_ - previous_stamp_).toSec() : 0.0;
+  previous_stamp_ = sample.stamp_;
+  has_previous_ = true;
+
+  force_.update(sample.data_[SHEER_FORCE], dt);
+  torque_.update(sample.data_[SHEER_TORQUE], dt);
+  displacement_x_.update(sample.data_[SHEER_DISPLACEMENT_X], dt);
+  displacement_y_.update(sample.data_[SHEER_DISPLACEMENT_Y], dt);
+
+  sample.filtered_force_ = force_.getValue();
+  sample.filtered_torque_ = torque_.getValue();
+  sample.filtered_displacement_x_ = displacement_x_.getValue();
+  sample.filtered_displacement_y_ = displacement_y_.getValue();
+  sample.force_rate_ = force_.getRate();
+  sample.torque_rate_ = torque_.getRate();
+
+  std::size_t num_events = 0;
+
+  // Contact, with hysteresis between the on and off thresholds
+  const double force = fabs(sample.filtered_force_);
+  const bool touching =
+      contact_.getState() ? force > settings_.contact_force_off_ : force > settings_.contact_force_on_;
+  if (contact_.update(touching, sample.stamp_, settings_.event_debounce_))
+    events[num_events++] = contact_.getState() ? TACTILE_CONTACT_BEGIN : TACTILE_CONTACT_END;
+
+  // Slip, only meaningful while in contact
+  const bool sliding = contact_.getState() &&
+                       (fabs(sample.force_rate_) > settings_.slip_force_rate_ ||
+                        fabs(sample.torque_rate_) > settings_.slip_torque_rate_);
+  if (slip_.update(sliding, sample.stamp_, settings_.event_debounce_))
+    events[num_events++] = slip_.getState() ? TACTILE_SLIP_BEGIN : TACTILE_SLIP_END;
+
+  sample.in_contact_ = contact_.getState();
+  sample.slipping_ = slip_.getState();
+
+  return num_events;
+}
+
+}  // end namespace
@@ -0,0 +1,128 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Convert a binary insertion log into one csv file per record type for analysis
+
+   Usage: rosrun picknik_main insertion_log_to_csv --log=<file> [--output=<prefix>]
+   Writes <prefix>_tactile.csv, <prefix>_commanded.csv, <prefix>_actual.csv and
+   <prefix>_decision.csv. The prefix defaults to the log path without its extension
+*/
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+// Command line arguments
+#include <gflags/gflags.h>
+
+// PickNik
+#include <picknik_main/insertion_recorder.h>
+
+DEFINE_string(log, "", "Binary insertion log to convert");
+DEFINE_string(output, "", "Prefix of the csv files to write");
+
+namespace
+{
+const char* TACTILE_COLUMNS =
+    "stamp,sheer_force,line_center_x,line_center_y,line_eigen_vec_x,line_eigen_vec_y,"
+    "line_eigen_val,sheer_displacement_x,sheer_displacement_y,sheer_torque,image_height,"
+    "image_width,filtered_force,filtered_torque,force_rate,torque_rate,sheer_theta,in_contact,"
+    "slipping";
+const char* POSE_COLUMNS = "stamp,step,x,y,z,qx,qy,qz,qw";
+const char* DECISION_COLUMNS = "stamp,step,corrected,hold_steps,slipping";
+
+bool openCSV(std::ofstream& file, const std::string& path, const char* columns)
+{
+  file.open(path.c_str());
+  if (!file.is_open())
+  {
+    std::cerr << "Unable to open " << path << std::endl;
+    return false;
+  }
+  file << std::setprecision(12) << columns << std::endl;
+  return true;
+}
+
+void writeRow(std::ofstream& file, const picknik_main::InsertionRecord& record, bool with_step)
+{
+  file << record.stamp_;
+  if (with_step)
+    file << "," << record.step_;
+  for (std::size_t i = 0; i < record.count_; ++i)
+    file << "," << record.values_[i];
+  file << "\n";
+}
+}  // end anonymous namespace
+
+int main(int argc, char** argv)
+{
+  google::SetUsageMessage("Convert a binary insertion log to csv");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_log.empty())
+  {
+    std::cerr << "No log specified, use --log=<file>" << std::endl;
+    return 1;
+  }
+
+  std::ifstream input(FLAGS_log.c_str(), std::ios::in | std::ios::binary);
+  if (!input.is_open())
+  {
+    std::cerr << "Unable to open " << FLAGS_log << std::endl;
+    return 1;
+  }
+  if (!picknik_main::InsertionRecorder::readHeader(input))
+    return 1;
+
+  std::string prefix = FLAGS_output;
+  if (prefix.empty())
+    prefix = FLAGS_log.substr(0, FLAGS_log.find_last_of('.'));
+
+  std::ofstream tactile, commanded, actual, decision;
+  if (!openCSV(tactile, prefix + "_tactile.csv", TACTILE_COLUMNS) ||
+      !openCSV(commanded, prefix + "_commanded.csv", POSE_COLUMNS) ||
+      !openCSV(actual, prefix + "_actual.csv", POSE_COLUMNS) ||
+      !openCSV(decision, prefix + "_decision.csv", DECISION_COLUMNS))
+    return 1;
+
+  std::size_t count = 0;
+  std::size_t unknown = 0;
+  picknik_main::InsertionRecord record;
+  while (picknik_main::InsertionRecorder::readRecord(input, record))
+  {
+    ++count;
+    switch (record.type_)
+    {
+      case picknik_main::RECORD_TACTILE:
+        writeRow(tactile, record, false);
+        break;
+      case picknik_main::RECORD_COMMANDED_POSE:
+        writeRow(commanded, record, true);
+        break;
+      case picknik_main::RECORD_ACTUAL_POSE:
+        writeRow(actual, record, true);
+        break;
+      case picknik_main::RECORD_DECISION:
+        writeRow(decision, record, true);
+        break;
+      default:
+        ++unknown;
+    }
+  }
+
+  std::cout << "Converted " << count << " records to " << prefix << "_*.csv";
+  if (unknown)
+    std::cout << ", skipped " << unknown << " of unknown type";
+  std::cout << std::endl;
+
+  return 0;
+}
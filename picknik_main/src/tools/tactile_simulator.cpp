@@ -0,0 +1,232 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Stand-in for the tactile sensor so insertion sweeps can run without the robot
+
+   Usage: rosrun picknik_main tactile_simulator [--hole_angle=<rad>] [--noise=<std dev>] ...
+   Watches the cartesian commands of the insertion and publishes end effector data as if the
+   part were pushed into a hole tilted by hole_angle about the tool x axis. Past contact_depth the
+   sensor reports a torque proportional to the misalignment, and the force rises with depth while
+   the misalignment is outside alignment_tolerance, like a jammed part. The first command received
+   is taken as the start of the insertion, restart the simulator to move the hole.
+
+   With hole_offset_x/y the hole centre is moved away from the start, in the start tool frame.
+   Outside hole_radius the part lands on the surface around the hole and the force rises with
+   depth until the insertion is rejected, which exercises the search of the insertion mode (set
+   insertion_force_rejection). Moves between search locations are sent as trajectories, not
+   cartesian commands, so they are not seen here and the next insertion is judged from wherever it
+   starts. Every insertion is logged with its location, so the log shows which locations of the
+   search pattern were tried. Run picknik_main with fake_execution:=1 alongside it
+*/
+
+#include <cmath>
+
+// Command line arguments
+#include <gflags/gflags.h>
+
+// ROS
+#include <ros/ros.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <cartesian_msgs/CartesianCommand.h>
+#include <eigen_conversions/eigen_msg.h>
+
+// Boost
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/thread/mutex.hpp>
+
+// PickNik
+#include <picknik_main/tactile_filter.h>
+
+DEFINE_double(rate, 100, "Hz to publish sensor data");
+DEFINE_double(hole_angle, 0.05, "Radians the hole is tilted about the tool x axis");
+DEFINE_double(contact_depth, 0.02, "Meters of insertion before the part touches the hole");
+DEFINE_double(alignment_tolerance, 0.01, "Radians of misalignment the part slides in with");
+DEFINE_double(torque_gain, 1000, "Torque per radian of misalignment, flip the sign if the "
+                                 "insertion rotates away from the hole");
+DEFINE_double(contact_force, 8, "Force while touching the hole");
+DEFINE_double(jam_stiffness, 2000, "Force per meter pushed past contact while misaligned");
+DEFINE_double(noise, 0.5, "Standard deviation of the noise added to force and torque");
+DEFINE_double(hole_offset_x, 0, "Meters from the start to the hole centre along the tool x axis");
+DEFINE_double(hole_offset_y, 0, "Meters from the start to the hole centre along the tool y axis");
+DEFINE_double(hole_radius, 0.003, "Meters off the hole centre the part still drops in");
+DEFINE_double(attempt_gap, 0.25, "Seconds without commands that separate two insertions");
+
+namespace picknik_main
+{
+class TactileSimulator
+{
+public:
+  TactileSimulator()
+    : has_reference_(false)
+    , has_command_(false)
+    , attempt_counted_(false)
+    , attempts_(0)
+    , hole_found_attempt_(0)
+    , noise_(boost::mt19937(time(NULL)), boost::normal_distribution<double>(0.0, FLAGS_noise))
+  {
+    const std::size_t queue_size = 10;
+    command_sub_ = nh_.subscribe("/r3/cartesian_command", queue_size,
+                                 &TactileSimulator::commandCallback, this);
+    data_pub_ = nh_.advertise<std_msgs::Float64MultiArray>("/end_effector_data", queue_size);
+
+    msg_.data.resize(ALWAYS_AT_END, 0.0);
+    msg_.data[IMAGE_HEIGHT] = 480;
+    msg_.data[IMAGE_WIDTH] = 640;
+
+    ROS_INFO_STREAM_NAMED("tactile_simulator", "Simulating a hole tilted "
+                                                   << FLAGS_hole_angle << " rad, offset "
+                                                   << FLAGS_hole_offset_x << ", "
+                                                   << FLAGS_hole_offset_y << " m");
+  }
+
+  void publish()
+  {
+    double depth = 0.0;
+    double misalignment = 0.0;
+    double miss = 0.0;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (has_reference_ && has_command_)
+      {
+        // Command position in the start tool frame
+        const Eigen::Vector3d offset =
+            reference_.rotation().transpose() * (command_.translation() - reference_.translation());
+        depth = offset.z();
+        miss = hypot(offset.x() - FLAGS_hole_offset_x, offset.y() - FLAGS_hole_offset_y);
+
+        // Rotation of the command relative to the start about the tool x axis
+        const Eigen::Matrix3d relative = reference_.rotation().transpose() * command_.rotation();
+        misalignment = atan2(relative(2, 1), relative(2, 2)) - FLAGS_hole_angle;
+      }
+    }
+
+    double force = 0.0;
+    double torque = 0.0;
+    const double penetration = depth - FLAGS_contact_depth;
+    if (penetration > 0)
+    {
+      force = FLAGS_contact_force;
+      torque = FLAGS_torque_gain * misalignment;
+      if (miss > FLAGS_hole_radius || fabs(misalignment) > FLAGS_alignment_tolerance)
+        force += FLAGS_jam_stiffness * penetration;
+    }
+
+    msg_.data[SHEER_FORCE] = force + noise_();
+    msg_.data[SHEER_TORQUE] = torque + noise_();
+    data_pub_.publish(msg_);
+  }
+
+  /** \brief Report how many insertions were tried and whether one found the hole */
+  void printSummary()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (hole_found_attempt_)
+      ROS_INFO_STREAM_NAMED("tactile_simulator", attempts_ << " insertions, the hole was found by "
+                                                           << "insertion " << hole_found_attempt_);
+    else
+      ROS_WARN_STREAM_NAMED("tactile_simulator", attempts_ << " insertions, none found the hole");
+  }
+
+private:
+  void commandCallback(const cartesian_msgs::CartesianCommand::ConstPtr& msg)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    tf::poseMsgToEigen(msg->desired_pose.pose, command_);
+    has_command_ = true;
+    if (!has_reference_)
+    {
+      reference_ = command_;
+      has_reference_ = true;
+    }
+
+    // Command position in the start tool frame
+    const Eigen::Vector3d offset =
+        reference_.rotation().transpose() * (command_.translation() - reference_.translation());
+
+    // A pause in the commands starts a new insertion or retraction
+    const ros::WallTime now = ros::WallTime::now();
+    if (last_command_time_.isZero() || (now - last_command_time_).toSec() > FLAGS_attempt_gap)
+    {
+      attempt_start_ = offset;
+      attempt_counted_ = false;
+    }
+    last_command_time_ = now;
+
+    // Only moves deeper are insertions
+    static const double MIN_INSERTION = 0.001;  // meters
+    if (!attempt_counted_ && offset.z() - attempt_start_.z() > MIN_INSERTION)
+    {
+      attempt_counted_ = true;
+      ++attempts_;
+      const double miss =
+          hypot(attempt_start_.x() - FLAGS_hole_offset_x, attempt_start_.y() - FLAGS_hole_offset_y);
+      const bool in_hole = miss <= FLAGS_hole_radius;
+      if (in_hole && !hole_found_attempt_)
+        hole_found_attempt_ = attempts_;
+      ROS_INFO_STREAM_NAMED("tactile_simulator", "Insertion " << attempts_ << " at "
+                                                               << attempt_start_.x() << ", "
+                                                               << attempt_start_.y() << " m, "
+                                                               << miss << " m off the hole"
+                                                               << (in_hole ? ", drops in" : ""));
+    }
+  }
+
+  // A shared node handle
+  ros::NodeHandle nh_;
+
+  ros::Subscriber command_sub_;
+  ros::Publisher data_pub_;
+  std_msgs::Float64MultiArray msg_;
+
+  // Latest command and the pose the first insertion started from, in robot base frame
+  boost::mutex mutex_;
+  Eigen::Affine3d reference_;
+  Eigen::Affine3d command_;
+  bool has_reference_;
+  bool has_command_;
+
+  // Each insertion, to show which locations of the search pattern were tried
+  ros::WallTime last_command_time_;
+  Eigen::Vector3d attempt_start_;
+  bool attempt_counted_;
+  std::size_t attempts_;
+  std::size_t hole_found_attempt_;  // 0 until an insertion starts inside hole_radius
+
+  boost::variate_generator<boost::mt19937, boost::normal_distribution<double> > noise_;
+};  // end class
+
+}  // end namespace
+
+int main(int argc, char** argv)
+{
+  google::SetUsageMessage("Simulated tactile sensor for insertion testing");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  ros::init(argc, argv, "tactile_simulator");
+
+  // Receive commands while the main thread publishes
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+
+  picknik_main::TactileSimulator simulator;
+
+  ros::Rate rate(FLAGS_rate);
+  while (ros::ok())
+  {
+    simulator.publish();
+    rate.sleep();
+  }
+
+  simulator.printSummary();
+  return 0;
+}
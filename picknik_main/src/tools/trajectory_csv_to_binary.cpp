@@ -0,0 +1,125 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   One time conversion of csv trajectories to the binary trajectory format
+
+   Usage: rosrun picknik_main trajectory_csv_to_binary --input=<file.csv> [--poses]
+          [--output=<file.traj>]
+   Joint trajectories are rows of every robot variable as recordTrajectoryToFile() used to write,
+   their names are read from the robot_description parameter. With --poses rows are 16 values of a
+   row major 4x4 matrix, as read by playbackWaypointsFromFile(). The output defaults to the input
+   with a .traj extension, which TrajectoryIO then loads instead of the csv
+*/
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Command line arguments
+#include <gflags/gflags.h>
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_model_loader/robot_model_loader.h>
+
+// PickNik
+#include <picknik_main/trajectory_file.h>
+
+DEFINE_string(input, "", "CSV trajectory to convert");
+DEFINE_string(output, "", "Binary file to write, defaults to the input with a .traj extension");
+DEFINE_bool(poses, false, "Rows are 4x4 pose matrices rather than joint positions");
+
+namespace
+{
+/** \brief Values of one comma separated row, skipping empty cells such as a trailing comma */
+void parseRow(const std::string& line, std::vector<double>& values)
+{
+  values.clear();
+  std::stringstream line_stream(line);
+  std::string cell;
+  while (std::getline(line_stream, cell, ','))
+    if (cell.find_first_not_of(" \t\r") != std::string::npos)
+      values.push_back(atof(cell.c_str()));
+}
+}  // end anonymous namespace
+
+int main(int argc, char** argv)
+{
+  google::SetUsageMessage("Convert a csv trajectory to the binary trajectory format");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_input.empty())
+  {
+    std::cerr << "No input specified, use --input=<file>" << std::endl;
+    return 1;
+  }
+  const std::string output =
+      FLAGS_output.empty() ? picknik_main::getBinaryTrajectoryPath(FLAGS_input) : FLAGS_output;
+
+  std::ifstream input(FLAGS_input.c_str());
+  if (!input.is_open())
+  {
+    std::cerr << "Unable to open " << FLAGS_input << std::endl;
+    return 1;
+  }
+
+  // Joint rows hold every variable of the robot in model order
+  std::vector<std::string> names;
+  std::size_t num_variables = 16;
+  uint32_t flags = picknik_main::TRAJECTORY_POSES;
+  if (!FLAGS_poses)
+  {
+    ros::init(argc, argv, "trajectory_csv_to_binary", ros::init_options::AnonymousName);
+    robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+    if (!robot_model_loader.getModel())
+    {
+      std::cerr << "Unable to load the robot model, is robot_description set?" << std::endl;
+      return 1;
+    }
+    names = robot_model_loader.getModel()->getVariableNames();
+    num_variables = names.size();
+    flags = 0;
+  }
+
+  picknik_main::TrajectoryFileWriter writer;
+  if (!writer.open(output, names, num_variables, flags))
+    return 1;
+
+  std::string line;
+  std::vector<double> values;
+  std::size_t line_number = 0;
+  while (std::getline(input, line))
+  {
+    ++line_number;
+    parseRow(line, values);
+    if (values.empty())
+      continue;
+    if (values.size() != num_variables)
+    {
+      std::cerr << "Line " << line_number << " has " << values.size() << " values, expected "
+                << num_variables << std::endl;
+      return 1;
+    }
+    writer.append(&values[0]);
+  }
+
+  const std::size_t num_points = writer.getPointCount();
+  if (!writer.close())
+    return 1;
+
+  std::cout << "Converted " << num_points << " points to " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,257 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Binary trajectory files that are read in place through a memory map
+*/
+
+// PickNik
+#include <picknik_main/trajectory_file.h>
+
+// ROS
+#include <ros/ros.h>
+
+// C++
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace picknik_main
+{
+namespace
+{
+// Magic, version, flags, variable count, name count
+const std::size_t POINT_COUNT_OFFSET = sizeof(TRAJECTORY_FILE_MAGIC) + 4 * sizeof(uint32_t);
+const std::size_t FIXED_HEADER_SIZE = POINT_COUNT_OFFSET + sizeof(uint64_t);
+
+std::size_t getPadding(std::size_t size)
+{
+  return (sizeof(double) - size % sizeof(double)) % sizeof(double);
+}
+
+uint32_t byteSwap(uint32_t value)
+{
+  return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+}  // end anonymous namespace
+
+std::string getBinaryTrajectoryPath(const std::string& csv_path)
+{
+  const std::size_t slash = csv_path.find_last_of('/');
+  const std::size_t dot = csv_path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return csv_path + TRAJECTORY_FILE_EXTENSION;
+  return csv_path.substr(0, dot) + TRAJECTORY_FILE_EXTENSION;
+}
+
+TrajectoryFileWriter::TrajectoryFileWriter() : flags_(0), num_variables_(0), num_points_(0)
+{
+}
+
+TrajectoryFileWriter::~TrajectoryFileWriter()
+{
+  if (isOpen())
+    close();
+}
+
+bool TrajectoryFileWriter::open(const std::string& file_path,
+                                const std::vector<std::string>& names, std::size_t num_variables,
+                                uint32_t flags)
+{
+  if (isOpen())
+    close();
+
+  if (!names.empty() && names.size() != num_variables)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Got " << names.size() << " names for "
+                                                     << num_variables << " variables");
+    return false;
+  }
+
+  file_.open(file_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file_.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Unable to open " << file_path);
+    return false;
+  }
+  file_path_ = file_path;
+  flags_ = flags;
+  num_variables_ = num_variables;
+  num_points_ = 0;
+
+  const uint32_t header[4] = {TRAJECTORY_FILE_VERSION, flags, static_cast<uint32_t>(num_variables),
+                              static_cast<uint32_t>(names.size())};
+  file_.write(TRAJECTORY_FILE_MAGIC, sizeof(TRAJECTORY_FILE_MAGIC));
+  file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+  file_.write(reinterpret_cast<const char*>(&num_points_), sizeof(num_points_));
+
+  std::size_t size = FIXED_HEADER_SIZE;
+  for (std::size_t i = 0; i < names.size(); ++i)
+  {
+    const uint32_t length = names[i].size();
+    file_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    file_.write(names[i].c_str(), length);
+    size += sizeof(length) + length;
+  }
+
+  // Keep the points aligned for reading them straight from the map
+  static const char ZEROS[sizeof(double)] = {0};
+  file_.write(ZEROS, getPadding(size));
+
+  return file_.good();
+}
+
+void TrajectoryFileWriter::append(const double* values, double time)
+{
+  if (flags_ & TRAJECTORY_HAS_TIMES)
+    file_.write(reinterpret_cast<const char*>(&time), sizeof(time));
+  file_.write(reinterpret_cast<const char*>(values), num_variables_ * sizeof(double));
+  ++num_points_;
+}
+
+bool TrajectoryFileWriter::close()
+{
+  if (!isOpen())
+    return false;
+
+  file_.seekp(POINT_COUNT_OFFSET);
+  file_.write(reinterpret_cast<const char*>(&num_points_), sizeof(num_points_));
+  const bool success = file_.good();
+  file_.close();
+
+  if (!success)
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Failed writing " << file_path_);
+  return success;
+}
+
+TrajectoryFileReader::TrajectoryFileReader()
+  : data_(NULL), size_(0), flags_(0), num_variables_(0), num_points_(0), stride_(0), points_(NULL)
+{
+}
+
+TrajectoryFileReader::~TrajectoryFileReader()
+{
+  close();
+}
+
+bool TrajectoryFileReader::isTrajectoryFile(const std::string& file_path)
+{
+  std::ifstream file(file_path.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(TRAJECTORY_FILE_MAGIC)];
+  file.read(magic, sizeof(magic));
+  return file.good() && memcmp(magic, TRAJECTORY_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool TrajectoryFileReader::open(const std::string& file_path)
+{
+  close();
+
+  const int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Unable to open " << file_path << ": "
+                                                                << strerror(errno));
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || file_stat.st_size < static_cast<off_t>(FIXED_HEADER_SIZE))
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", file_path << " is too short for a trajectory");
+    ::close(fd);
+    return false;
+  }
+  size_ = file_stat.st_size;
+
+  // The mapping stays valid after the descriptor is closed
+  data_ = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data_ == MAP_FAILED)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Unable to map " << file_path << ": "
+                                                               << strerror(errno));
+    data_ = NULL;
+    return false;
+  }
+
+  const char* bytes = static_cast<const char*>(data_);
+  uint32_t header[4];
+  uint64_t num_points;
+  memcpy(header, bytes + sizeof(TRAJECTORY_FILE_MAGIC), sizeof(header));
+  memcpy(&num_points, bytes + POINT_COUNT_OFFSET, sizeof(num_points));
+  if (memcmp(bytes, TRAJECTORY_FILE_MAGIC, sizeof(TRAJECTORY_FILE_MAGIC)) == 0 &&
+      header[0] == byteSwap(TRAJECTORY_FILE_VERSION))
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", file_path << " was written on a machine of the other "
+                                                           "byte order, convert it there again");
+    close();
+    return false;
+  }
+  if (memcmp(bytes, TRAJECTORY_FILE_MAGIC, sizeof(TRAJECTORY_FILE_MAGIC)) != 0 ||
+      header[0] != TRAJECTORY_FILE_VERSION || (header[3] && header[3] != header[2]))
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", file_path << " is not a version "
+                                                        << TRAJECTORY_FILE_VERSION
+                                                        << " trajectory file");
+    close();
+    return false;
+  }
+  flags_ = header[1];
+  num_variables_ = header[2];
+
+  std::size_t offset = FIXED_HEADER_SIZE;
+  names_.resize(header[3]);
+  for (std::size_t i = 0; i < names_.size(); ++i)
+  {
+    uint32_t length = 0;
+    if (offset + sizeof(length) <= size_)
+      memcpy(&length, bytes + offset, sizeof(length));
+    offset += sizeof(length);
+    if (offset + length > size_)
+    {
+      ROS_ERROR_STREAM_NAMED("trajectory_file", "Truncated names in " << file_path);
+      close();
+      return false;
+    }
+    names_[i].assign(bytes + offset, length);
+    offset += length;
+  }
+  offset += getPadding(offset);
+
+  stride_ = num_variables_ + (hasTimes() ? 1 : 0);
+  const std::size_t complete_points =
+      offset <= size_ && stride_ ? (size_ - offset) / (stride_ * sizeof(double)) : 0;
+  num_points_ = num_points ? num_points : complete_points;
+  if (!stride_ || num_points_ > complete_points)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Truncated points in " << file_path);
+    close();
+    return false;
+  }
+  points_ = reinterpret_cast<const double*>(bytes + offset);
+
+  return true;
+}
+
+void TrajectoryFileReader::close()
+{
+  if (data_)
+    munmap(data_, size_);
+  data_ = NULL;
+  size_ = 0;
+  names_.clear();
+  num_points_ = 0;
+  points_ = NULL;
+}
+
+}  // end namespace
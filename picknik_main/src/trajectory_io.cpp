@@ -42,6 +42,9 @@
 #include <iostream>
 #include <fstream>
 
+// C++
+#include <algorithm>
+
 // MoveIt
 #include <moveit/robot_state/conversions.h>
 
@@ -50,6 +53,30 @@
 
 namespace picknik_main
 {
+namespace
+{
+/** \brief Whether to read the binary version of a csv file instead of the csv itself */
+bool useBinaryTrajectory(const std::string& csv_path, const std::string& binary_path)
+{
+  if (!TrajectoryFileReader::isTrajectoryFile(binary_path))
+    return false;
+
+  // A csv edited after it was converted is what the user meant to load
+  boost::system::error_code csv_error;
+  boost::system::error_code binary_error;
+  const std::time_t csv_time = boost::filesystem::last_write_time(csv_path, csv_error);
+  const std::time_t binary_time = boost::filesystem::last_write_time(binary_path, binary_error);
+  if (!csv_error && !binary_error && csv_time > binary_time)
+  {
+    ROS_WARN_STREAM_NAMED("trajectory_io", csv_path << " is newer than " << binary_path
+                                                    << ", loading the csv. Convert it again with "
+                                                       "trajectory_csv_to_binary");
+    return false;
+  }
+  return true;
+}
+}  // end anonymous namespace
+
 TrajectoryIO::TrajectoryIO(RemoteControlPtr remote_control, VisualsPtr visuals,
                            ManipulationDataPtr config, ManipulationPtr manipulation)
   : remote_control_(remote_control)
@@ -63,44 +90,32 @@ bool TrajectoryIO::playbackTrajectoryFromFile(const std::string& file_name,
                                               JointModelGroup* arm_jmg,
                                               double velocity_scaling_factor)
 {
-  std::ifstream input_file;
-  input_file.open(file_name.c_str());
-  ROS_DEBUG_STREAM_NAMED("manipultion", "Loading trajectory from file " << file_name);
-
-  std::string line;
   moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
 
   robot_trajectory::RobotTrajectoryPtr robot_traj(
       new robot_trajectory::RobotTrajectory(current_state->getRobotModel(), arm_jmg));
-  double dummy_dt = 1;  // temp value
-
-  // Read each line
-  while (std::getline(input_file, line))
-  {
-    // Convert line to a robot state
-    moveit::core::RobotStatePtr new_state(new moveit::core::RobotState(*current_state));
-    moveit::core::streamToRobotState(*new_state, line, ",");
-    robot_traj->addSuffixWayPoint(new_state, dummy_dt);
-  }
-
-  // Close file
-  input_file.close();
-
-  // Error check
-  if (robot_traj->getWayPointCount() == 0)
-  {
-    ROS_ERROR_STREAM_NAMED("manipultion", "No states loaded from CSV file " << file_name);
+  bool has_times = false;
+  if (!loadJointTrajectory(file_name, current_state, robot_traj, has_times))
     return false;
-  }
 
   // Unwrap joint values if needed
 
-  // Interpolate between each point
-  double discretization = 0.25;
-  manipulation_->interpolate(robot_traj, discretization);
+  if (has_times)
+  {
+    // Recorded at the joint state rate, so replay the timing as demonstrated
+    for (std::size_t i = 1; i < robot_traj->getWayPointCount(); ++i)
+      robot_traj->setWayPointDurationFromPrevious(
+          i, robot_traj->getWayPointDurationFromPrevious(i) / velocity_scaling_factor);
+  }
+  else
+  {
+    // Interpolate between each point
+    double discretization = 0.25;
+    manipulation_->interpolate(robot_traj, discretization);
 
-  // Perform iterative parabolic smoothing
-  manipulation_->getIterativeSmoother().computeTimeStamps(*robot_traj, velocity_scaling_factor);
+    // Perform iterative parabolic smoothing
+    manipulation_->getIterativeSmoother().computeTimeStamps(*robot_traj, velocity_scaling_factor);
+  }
 
   // Convert trajectory to a message
   moveit_msgs::RobotTrajectory trajectory_msg;
@@ -142,20 +157,14 @@ bool TrajectoryIO::playbackTrajectoryFromFile(const std::string& file_name,
 bool TrajectoryIO::playbackWaypointsFromFile(const std::string& file_name, JointModelGroup* arm_jmg,
                                              double velocity_scaling_factor)
 {
-  std::ifstream input_file;
-  std::string line;
-  input_file.open(file_name.c_str());
-  ROS_DEBUG_STREAM_NAMED("manipultion", "Loading waypoints from file " << file_name);
-
   // Create desired trajectory
   EigenSTL::vector_Affine3d waypoints;
+  if (!loadPoses(file_name, waypoints))
+    return false;
 
-  // Read each line
-  while (std::getline(input_file, line))
+  for (std::size_t i = 0; i < waypoints.size(); ++i)
   {
-    // Convert line to a robot state
-    Eigen::Affine3d pose;
-    streamToAffine3d(pose, line, " ");
+    Eigen::Affine3d& pose = waypoints[i];
 
     // Convert pose that has x arrow pointing to object, to pose that has z arrow pointing towards
     // object and x out in the grasp dir
@@ -170,18 +179,6 @@ bool TrajectoryIO::playbackWaypointsFromFile(const std::string& file_name, Joint
 
     // Translate to custom end effector geometry
     // Eigen::Affine3d grasp_pose = new_point * grasp_datas_[arm_jmg]->grasp_pose_to_eef_pose_;
-
-    waypoints.push_back(pose);
-  }
-
-  // Close file
-  input_file.close();
-
-  // Error check
-  if (waypoints.empty())
-  {
-    ROS_ERROR_STREAM_NAMED("trajectory_io", "No waypoints loaded from CSV file " << file_name);
-    return false;
   }
 
   // Visualize
@@ -209,38 +206,178 @@ bool TrajectoryIO::playbackWaypointsFromFile(const std::string& file_name, Joint
   return true;
 }
 
+bool TrajectoryIO::loadJointTrajectory(const std::string& file_name,
+                                       const moveit::core::RobotStatePtr& seed_state,
+                                       robot_trajectory::RobotTrajectoryPtr robot_traj,
+                                       bool& has_times)
+{
+  const ros::WallTime start_time = ros::WallTime::now();
+  double dummy_dt = 1;  // temp value
+  has_times = false;
+
+  // Prefer the binary version of the file, if it has been converted since the csv changed
+  const std::string binary_path = getBinaryTrajectoryPath(file_name);
+  TrajectoryFileReader reader;
+  if (useBinaryTrajectory(file_name, binary_path) && reader.open(binary_path))
+  {
+    // Match the file's variables to the robot's once, rather than per point
+    const std::vector<std::string>& robot_names = seed_state->getVariableNames();
+    const std::vector<std::string>& file_names = reader.getVariableNames();
+    std::vector<std::size_t> indices(reader.getVariableCount());
+    bool matches = !reader.isPoses();
+    for (std::size_t i = 0; i < indices.size() && matches; ++i)
+    {
+      // Unnamed variables are in the robot's order, like the CSV
+      if (file_names.empty())
+        indices[i] = i;
+      else
+        indices[i] = std::find(robot_names.begin(), robot_names.end(), file_names[i]) -
+                     robot_names.begin();
+      matches = indices[i] < robot_names.size();
+    }
+    if (!matches)
+    {
+      ROS_ERROR_STREAM_NAMED("trajectory_io", binary_path << " does not match this robot's joints");
+      return false;
+    }
+
+    has_times = reader.hasTimes();
+    double previous_time = 0.0;
+    for (std::size_t i = 0; i < reader.getPointCount(); ++i)
+    {
+      // Joints published separately share a stamp, the last of them has every update
+      if (has_times && i + 1 < reader.getPointCount() && reader.getTime(i + 1) <= reader.getTime(i))
+        continue;
+
+      moveit::core::RobotStatePtr new_state(new moveit::core::RobotState(*seed_state));
+      const double* values = reader.getValues(i);
+      for (std::size_t j = 0; j < indices.size(); ++j)
+        new_state->setVariablePosition(indices[j], values[j]);
+
+      const double dt = has_times ? reader.getTime(i) - previous_time : dummy_dt;
+      previous_time = reader.getTime(i);
+      robot_traj->addSuffixWayPoint(new_state, dt);
+    }
+  }
+  else
+  {
+    std::ifstream input_file;
+    input_file.open(file_name.c_str());
+    ROS_DEBUG_STREAM_NAMED("trajectory_io", "Loading trajectory from file " << file_name);
+
+    // Read each line
+    std::string line;
+    while (std::getline(input_file, line))
+    {
+      // Convert line to a robot state
+      moveit::core::RobotStatePtr new_state(new moveit::core::RobotState(*seed_state));
+      moveit::core::streamToRobotState(*new_state, line, ",");
+      robot_traj->addSuffixWayPoint(new_state, dummy_dt);
+    }
+
+    // Close file
+    input_file.close();
+  }
+
+  // Error check
+  if (robot_traj->getWayPointCount() == 0)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_io", "No states loaded from file " << file_name);
+    return false;
+  }
+
+  ROS_DEBUG_STREAM_NAMED("trajectory_io", "Loaded " << robot_traj->getWayPointCount()
+                                                    << " states in "
+                                                    << (ros::WallTime::now() - start_time).toSec()
+                                                    << " s");
+  return true;
+}
+
+bool TrajectoryIO::loadPoses(const std::string& file_name, EigenSTL::vector_Affine3d& poses)
+{
+  const ros::WallTime start_time = ros::WallTime::now();
+  poses.clear();
+
+  // Prefer the binary version of the file, if it has been converted since the csv changed
+  const std::string binary_path = getBinaryTrajectoryPath(file_name);
+  TrajectoryFileReader reader;
+  if (useBinaryTrajectory(file_name, binary_path) && reader.open(binary_path))
+  {
+    if (!reader.isPoses() || reader.getVariableCount() != 16)
+    {
+      ROS_ERROR_STREAM_NAMED("trajectory_io", binary_path << " does not hold poses");
+      return false;
+    }
+
+    poses.resize(reader.getPointCount());
+    for (std::size_t i = 0; i < poses.size(); ++i)
+      poses[i].matrix() = Eigen::Map<const Eigen::Matrix<double, 4, 4, Eigen::RowMajor> >(
+          reader.getValues(i));
+  }
+  else
+  {
+    std::ifstream input_file;
+    std::string line;
+    input_file.open(file_name.c_str());
+    ROS_DEBUG_STREAM_NAMED("trajectory_io", "Loading waypoints from file " << file_name);
+
+    // Read each line
+    while (std::getline(input_file, line))
+    {
+      Eigen::Affine3d pose;
+      streamToAffine3d(pose, line, " ");
+      poses.push_back(pose);
+    }
+
+    // Close file
+    input_file.close();
+  }
+
+  // Error check
+  if (poses.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_io", "No waypoints loaded from file " << file_name);
+    return false;
+  }
+
+  ROS_DEBUG_STREAM_NAMED("trajectory_io", "Loaded " << poses.size() << " poses in "
+                                                    << (ros::WallTime::now() - start_time).toSec()
+                                                    << " s");
+  return true;
+}
+
 bool TrajectoryIO::recordTrajectoryToFile(const std::string& file_path)
 {
-  bool include_header = false;
+  // Record every joint state message rather than polling the current state
+  const std::string binary_path = getBinaryTrajectoryPath(file_path);
+  moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
+  const std::vector<std::string>& names = current_state->getVariableNames();
+  std::vector<double> positions(current_state->getVariablePositions(),
+                                current_state->getVariablePositions() + names.size());
 
-  std::ofstream output_file;
-  output_file.open(file_path.c_str());
-  ROS_DEBUG_STREAM_NAMED("trajectory_io", "Saving bin trajectory to file " << file_path);
+  TrajectoryRecorder recorder(nh_, names, config_->joint_state_topic_);
+  recorder.setDownsampling(config_->trajectory_record_min_period_,
+                           config_->trajectory_record_min_change_);
+  ROS_DEBUG_STREAM_NAMED("trajectory_io", "Saving bin trajectory to file " << binary_path);
 
   remote_control_->waitForNextStep("record trajectory");
 
+  if (!recorder.start(binary_path, positions))
+    return false;
+
   std::cout << std::endl << std::endl << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
   std::cout << "START MOVING ARM " << std::endl;
   std::cout << "Press stop button to end recording " << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
 
-  std::size_t counter = 0;
   while (ros::ok() && !remote_control_->getStop())
-  {
-    ROS_INFO_STREAM_THROTTLE_NAMED(1, "trajectory_io", "Recording waypoint #" << counter++);
-
-    moveit::core::robotStateToStream(*manipulation_->getCurrentState(), output_file,
-                                     include_header);
-
-    ros::Duration(0.25).sleep();
-  }
+    ros::Duration(0.1).sleep();
 
   // Reset the stop button
   remote_control_->setStop(false);
 
-  output_file.close();
-  return true;
+  return recorder.stop();
 }
 
 bool TrajectoryIO::getFilePath(std::string& file_path, const std::string& file_name) const
@@ -0,0 +1,198 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Record demonstrations at the rate of the joint state stream
+*/
+
+// PickNik
+#include <picknik_main/trajectory_recorder.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace picknik_main
+{
+namespace
+{
+// Points the writer may fall behind before they are dropped, over a minute at 100 hz
+const std::size_t MAX_QUEUED_POINTS = 10000;
+}  // end anonymous namespace
+
+TrajectoryRecorder::TrajectoryRecorder(ros::NodeHandle nh,
+                                       const std::vector<std::string>& variable_names,
+                                       const std::string& joint_state_topic)
+  : nh_(nh)
+  , joint_state_topic_(joint_state_topic)
+  , variable_names_(variable_names)
+  , min_period_(0.0)
+  , min_change_(0.0)
+  , recording_(false)
+  , has_kept_(false)
+  , stop_requested_(false)
+  , dropped_(0)
+{
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+  stop();
+}
+
+void TrajectoryRecorder::setDownsampling(double min_period, double min_change)
+{
+  min_period_ = min_period;
+  min_change_ = min_change;
+}
+
+bool TrajectoryRecorder::start(const std::string& file_path,
+                               const std::vector<double>& initial_positions)
+{
+  stop();
+
+  if (initial_positions.size() != variable_names_.size())
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_recorder", "Need a position for every variable");
+    return false;
+  }
+  if (!writer_.open(file_path, variable_names_, variable_names_.size(), TRAJECTORY_HAS_TIMES))
+    return false;
+
+  positions_ = initial_positions;
+  msg_names_.clear();
+  has_kept_ = false;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    queue_.clear();
+    queue_.reserve(MAX_QUEUED_POINTS * (variable_names_.size() + 1));
+    stop_requested_ = false;
+    dropped_ = 0;
+  }
+
+  writer_thread_ = boost::thread(&TrajectoryRecorder::writerThread, this);
+  recording_ = true;
+
+  // Large queue so bursts are not lost while the callback queue is busy elsewhere
+  const std::size_t queue_size = 1000;
+  joint_state_sub_ = nh_.subscribe(joint_state_topic_, queue_size,
+                                   &TrajectoryRecorder::jointStateCallback, this);
+
+  ROS_INFO_STREAM_NAMED("trajectory_recorder", "Recording " << joint_state_topic_ << " to "
+                                                            << file_path);
+  return true;
+}
+
+bool TrajectoryRecorder::stop()
+{
+  if (!writer_thread_.joinable())
+    return true;
+
+  // Stop the callback first so nothing is queued after the writer drains
+  joint_state_sub_.shutdown();
+  recording_ = false;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    stop_requested_ = true;
+  }
+  queue_condition_.notify_one();
+  writer_thread_.join();
+
+  const std::size_t written = writer_.getPointCount();
+  if (!writer_.close())
+    return false;
+
+  ROS_INFO_STREAM_NAMED("trajectory_recorder", "Recorded " << written << " points, " << dropped_
+                                                           << " dropped");
+  return true;
+}
+
+void TrajectoryRecorder::jointStateCallback(const sensor_msgs::JointState::ConstPtr& msg)
+{
+  if (!recording_ || msg->position.size() != msg->name.size())
+    return;
+
+  // Publishers send the same names every time, so the lookup is only redone when they change
+  if (msg->name != msg_names_)
+  {
+    msg_names_ = msg->name;
+    msg_indices_.resize(msg_names_.size());
+    for (std::size_t i = 0; i < msg_names_.size(); ++i)
+      msg_indices_[i] = std::find(variable_names_.begin(), variable_names_.end(), msg_names_[i]) -
+                        variable_names_.begin();
+  }
+
+  for (std::size_t i = 0; i < msg_indices_.size(); ++i)
+    if (msg_indices_[i] < positions_.size())
+      positions_[msg_indices_[i]] = msg->position[i];
+
+  const ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+  if (has_kept_)
+  {
+    if ((stamp - last_kept_stamp_).toSec() < min_period_)
+      return;
+
+    if (min_change_ > 0)
+    {
+      double change = 0.0;
+      for (std::size_t i = 0; i < positions_.size(); ++i)
+        change = std::max(change, std::fabs(positions_[i] - last_kept_[i]));
+      if (change < min_change_)
+        return;
+    }
+  }
+
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    // A dropped point must not become the downsampling baseline, or the points after it would
+    // be compared to one that was never queued
+    if (queue_.size() >= MAX_QUEUED_POINTS * (positions_.size() + 1))
+    {
+      ++dropped_;
+      return;
+    }
+
+    if (!has_kept_)
+      first_stamp_ = stamp;
+    last_kept_ = positions_;
+    last_kept_stamp_ = stamp;
+    has_kept_ = true;
+
+    // Capacity is reserved, never allocates
+    queue_.push_back((stamp - first_stamp_).toSec());
+    queue_.insert(queue_.end(), positions_.begin(), positions_.end());
+  }
+  queue_condition_.notify_one();
+}
+
+void TrajectoryRecorder::writerThread()
+{
+  std::vector<double> batch;
+  batch.reserve(MAX_QUEUED_POINTS * (variable_names_.size() + 1));
+
+  const std::size_t stride = variable_names_.size() + 1;
+  bool done = false;
+  while (!done)
+  {
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      if (queue_.empty() && !stop_requested_)
+        queue_condition_.timed_wait(lock, boost::posix_time::milliseconds(100));
+      batch.swap(queue_);
+      done = stop_requested_;
+    }
+
+    for (std::size_t i = 0; i + stride <= batch.size(); i += stride)
+      writer_.append(&batch[i + 1], batch[i]);
+    batch.clear();
+  }
+}
+
+}  // end namespace
@@ -0,0 +1,187 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Unit tests of scoring and ranking grasps by the outcomes of similar grasps
+*/
+
+// PickNik
+#include <picknik_main/grasp_statistics.h>
+
+// ROS
+#include <eigen_conversions/eigen_msg.h>
+
+// Testing
+#include <gtest/gtest.h>
+
+// C++
+#include <cmath>
+#include <fstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace picknik_main;
+
+namespace
+{
+const double RESOLUTION = 0.02;
+const std::size_t MIN_BIN_ATTEMPTS = 3;
+
+/** \brief Approaching from the front of the product, along its +x axis */
+Eigen::Affine3d getFrontGrasp(double y = 0.0)
+{
+  return Eigen::Translation3d(-0.1, y, 0.0) * Eigen::Affine3d::Identity();
+}
+
+/** \brief Approaching from above, along the product's -z axis */
+Eigen::Affine3d getTopGrasp()
+{
+  return Eigen::Translation3d(0.0, 0.0, 0.1) *
+         Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitY());
+}
+
+GraspAttempt makeAttempt(const std::string& bin, const Eigen::Affine3d& product_to_grasp,
+                         bool success)
+{
+  GraspAttempt attempt;
+  attempt.product_ = "crayola_64_ct";
+  attempt.bin_ = bin;
+  attempt.product_to_grasp_ = product_to_grasp;
+  attempt.success_ = success;
+  return attempt;
+}
+
+moveit_grasps::GraspCandidatePtr makeCandidate(const Eigen::Affine3d& world_to_grasp)
+{
+  moveit_msgs::Grasp grasp;
+  tf::poseEigenToMsg(world_to_grasp, grasp.grasp_pose.pose);
+  return moveit_grasps::GraspCandidatePtr(
+      new moveit_grasps::GraspCandidate(grasp, moveit_grasps::GraspDataPtr(), world_to_grasp));
+}
+
+class GraspStatisticsTest : public testing::Test
+{
+protected:
+  GraspStatisticsTest() : statistics_(RESOLUTION, MIN_BIN_ATTEMPTS) {}
+
+  virtual void SetUp()
+  {
+    char file_path[] = "/tmp/test_grasp_statistics_XXXXXX";
+    const int fd = mkstemp(file_path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    file_path_ = file_path;
+  }
+
+  virtual void TearDown() { unlink(file_path_.c_str()); }
+
+  double getScore(const std::string& bin, const Eigen::Affine3d& product_to_grasp) const
+  {
+    return statistics_.getSuccessScore("crayola_64_ct", bin, product_to_grasp);
+  }
+
+  std::string file_path_;
+  GraspStatistics statistics_;
+};
+}  // end anonymous namespace
+
+TEST(GraspStatistics, NamesApproachByFaceEntered)
+{
+  EXPECT_EQ("-x", GraspStatistics::getApproachType(getFrontGrasp()));
+  EXPECT_EQ("+z", GraspStatistics::getApproachType(getTopGrasp()));
+  EXPECT_EQ("+y", GraspStatistics::getApproachType(
+                      Eigen::Affine3d(Eigen::AngleAxisd(-M_PI / 2.0, Eigen::Vector3d::UnitZ()))));
+}
+
+TEST_F(GraspStatisticsTest, UntriedGraspsScoreHalf)
+{
+  EXPECT_DOUBLE_EQ(0.5, getScore("bin_A", getFrontGrasp()));
+
+  statistics_.record(makeAttempt("bin_A", getFrontGrasp(), true));
+  EXPECT_DOUBLE_EQ(2.0 / 3.0, getScore("bin_A", getFrontGrasp()));
+  EXPECT_DOUBLE_EQ(0.5, getScore("bin_A", getTopGrasp()));
+  EXPECT_DOUBLE_EQ(0.5, statistics_.getSuccessScore("expo_dry_erase", "bin_A", getFrontGrasp()));
+}
+
+TEST_F(GraspStatisticsTest, GroupsNearbyGrasps)
+{
+  statistics_.record(makeAttempt("bin_A", getFrontGrasp(), false));
+
+  // Within half a grid cell the same group, beyond it another
+  EXPECT_DOUBLE_EQ(1.0 / 3.0, getScore("bin_A", getFrontGrasp(0.4 * RESOLUTION)));
+  EXPECT_DOUBLE_EQ(0.5, getScore("bin_A", getFrontGrasp(0.6 * RESOLUTION)));
+}
+
+TEST_F(GraspStatisticsTest, PrefersBinRateOnceItHasEnoughAttempts)
+{
+  statistics_.record(makeAttempt("bin_A", getFrontGrasp(), true));
+  statistics_.record(makeAttempt("bin_A", getFrontGrasp(), true));
+
+  // Too few attempts in bin_B, so every bin's attempts are used
+  statistics_.record(makeAttempt("bin_B", getFrontGrasp(), false));
+  EXPECT_DOUBLE_EQ(3.0 / 5.0, getScore("bin_B", getFrontGrasp()));
+  EXPECT_DOUBLE_EQ(3.0 / 5.0, getScore("bin_C", getFrontGrasp()));
+
+  for (std::size_t i = 1; i < MIN_BIN_ATTEMPTS; ++i)
+    statistics_.record(makeAttempt("bin_B", getFrontGrasp(), false));
+  EXPECT_DOUBLE_EQ(1.0 / (MIN_BIN_ATTEMPTS + 2.0), getScore("bin_B", getFrontGrasp()));
+  EXPECT_DOUBLE_EQ(3.0 / (MIN_BIN_ATTEMPTS + 4.0), getScore("bin_C", getFrontGrasp()));
+  EXPECT_EQ(MIN_BIN_ATTEMPTS + 2, statistics_.getAttemptCount());
+}
+
+TEST_F(GraspStatisticsTest, RanksBestFirstAndKeepsOrderOfTies)
+{
+  const Eigen::Affine3d world_to_product =
+      Eigen::Translation3d(1.0, 0.5, 0.8) * Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ());
+
+  // The top grasp failed, the front grasp worked and the side grasps are untried
+  statistics_.record(makeAttempt("bin_A", getTopGrasp(), false));
+  statistics_.record(makeAttempt("bin_A", getFrontGrasp(), true));
+
+  std::vector<moveit_grasps::GraspCandidatePtr> candidates;
+  candidates.push_back(makeCandidate(world_to_product * getTopGrasp()));
+  candidates.push_back(makeCandidate(world_to_product * getFrontGrasp(0.1)));
+  candidates.push_back(makeCandidate(world_to_product * getFrontGrasp()));
+  candidates.push_back(makeCandidate(world_to_product * getFrontGrasp(-0.1)));
+  const std::vector<moveit_grasps::GraspCandidatePtr> generated = candidates;
+
+  statistics_.rankGrasps("crayola_64_ct", "bin_A", world_to_product, candidates);
+  ASSERT_EQ(generated.size(), candidates.size());
+  EXPECT_EQ(generated[2], candidates[0]);
+  EXPECT_EQ(generated[1], candidates[1]);
+  EXPECT_EQ(generated[3], candidates[2]);
+  EXPECT_EQ(generated[0], candidates[3]);
+}
+
+TEST_F(GraspStatisticsTest, ReplaysRecordedAttempts)
+{
+  ASSERT_TRUE(statistics_.load(file_path_));
+  statistics_.record(makeAttempt("bin_A", getTopGrasp(), true));
+  statistics_.record(makeAttempt("bin_A", getTopGrasp(), false));
+  statistics_.record(makeAttempt("bin_A", getTopGrasp(), true));
+  const double score = getScore("bin_A", getTopGrasp());
+
+  // Lines that do not parse are skipped
+  {
+    std::ofstream file(file_path_.c_str(), std::ios::app);
+    file << "crayola_64_ct bin_A not a pose" << std::endl;
+  }
+
+  GraspStatistics loaded(RESOLUTION, MIN_BIN_ATTEMPTS);
+  ASSERT_TRUE(loaded.load(file_path_));
+  EXPECT_EQ(3u, loaded.getAttemptCount());
+  EXPECT_NEAR(score, loaded.getSuccessScore("crayola_64_ct", "bin_A", getTopGrasp()), 1e-9);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,218 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Unit tests of looking up poses in a saved reachability map
+*/
+
+// PickNik
+#include <picknik_main/reachability_map.h>
+
+// Testing
+#include <gtest/gtest.h>
+
+// C++
+#include <cmath>
+#include <fstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace picknik_main;
+
+namespace
+{
+const std::size_t DIM = 3;  // cells along each axis
+const std::size_t NUM_APPROACHES = 2;
+const double RESOLUTION = 0.1;
+const double ORIENTATION_TOLERANCE = 0.2;
+
+/**
+ * \brief Writes maps in the format ReachabilityMap::save() uses, so lookups can be tested
+ *        without sampling IK on a robot. Approach 0 is the face orientation, approach 1 is
+ *        turned a quarter about z
+ */
+class ReachabilityMapTest : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    char file_path[] = "/tmp/test_reachability_map_XXXXXX";
+    const int fd = mkstemp(file_path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    file_path_ = file_path;
+
+    world_to_face_ = Eigen::Translation3d(1.0, 0.0, 0.5) * Eigen::Affine3d::Identity();
+    approaches_.push_back(Eigen::Affine3d::Identity());
+    approaches_.push_back(Eigen::Affine3d(Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitZ())));
+
+    const std::size_t num_cells = DIM * DIM * DIM * NUM_APPROACHES;
+    solutions_.assign(num_cells, 0);
+    gantry_heights_.assign(num_cells, 0.0f);
+    manipulabilities_.assign(num_cells, 0.0f);
+  }
+
+  virtual void TearDown() { unlink(file_path_.c_str()); }
+
+  std::size_t getIndex(std::size_t x, std::size_t y, std::size_t z, std::size_t approach) const
+  {
+    return ((x * DIM + y) * DIM + z) * NUM_APPROACHES + approach;
+  }
+
+  void setCell(std::size_t x, std::size_t y, std::size_t z, std::size_t approach,
+               uint8_t solutions, float gantry_height, float manipulability)
+  {
+    const std::size_t index = getIndex(x, y, z, approach);
+    solutions_[index] = solutions;
+    gantry_heights_[index] = gantry_height;
+    manipulabilities_[index] = manipulability;
+  }
+
+  Eigen::Affine3d getCellPose(double x, double y, double z, std::size_t approach) const
+  {
+    return world_to_face_ *
+           Eigen::Translation3d(x * RESOLUTION, y * RESOLUTION, z * RESOLUTION) *
+           approaches_[approach];
+  }
+
+  template <typename T>
+  void write(std::ofstream& file, const T& value)
+  {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void writePose(std::ofstream& file, const Eigen::Affine3d& pose)
+  {
+    const Eigen::Quaterniond rotation(pose.rotation());
+    for (std::size_t i = 0; i < 3; ++i)
+      write(file, pose.translation()[i]);
+    write(file, rotation.x());
+    write(file, rotation.y());
+    write(file, rotation.z());
+    write(file, rotation.w());
+  }
+
+  /** \brief Save the cells, leaving off the last bytes to simulate a truncated file */
+  void writeMap(std::size_t missing_bytes = 0)
+  {
+    std::ofstream file(file_path_.c_str(), std::ios::binary);
+    const std::string group_name = "right_arm";
+    file.write("PNKREACH", 8);
+    write(file, uint32_t(1));
+    write(file, uint32_t(group_name.size()));
+    file.write(group_name.c_str(), group_name.size());
+    writePose(file, world_to_face_);
+    write(file, RESOLUTION);
+    for (std::size_t i = 0; i < 3; ++i)
+      write(file, uint32_t(DIM));
+    write(file, ORIENTATION_TOLERANCE);
+    write(file, uint32_t(NUM_APPROACHES));
+    for (std::size_t i = 0; i < NUM_APPROACHES; ++i)
+      writePose(file, approaches_[i]);
+    file.write(reinterpret_cast<const char*>(&solutions_[0]), solutions_.size());
+    file.write(reinterpret_cast<const char*>(&gantry_heights_[0]),
+               gantry_heights_.size() * sizeof(float));
+    file.write(reinterpret_cast<const char*>(&manipulabilities_[0]),
+               manipulabilities_.size() * sizeof(float) - missing_bytes);
+  }
+
+  std::string file_path_;
+  Eigen::Affine3d world_to_face_;
+  EigenSTL::vector_Affine3d approaches_;
+  std::vector<uint8_t> solutions_;
+  std::vector<float> gantry_heights_;
+  std::vector<float> manipulabilities_;
+};
+}  // end anonymous namespace
+
+TEST_F(ReachabilityMapTest, EmptyMapCoversNothing)
+{
+  ReachabilityMap map;
+  EXPECT_FALSE(map.isLoaded());
+
+  std::size_t solutions;
+  double gantry_height, manipulability;
+  EXPECT_FALSE(map.getCell(getCellPose(1, 1, 1, 0), solutions, gantry_height, manipulability));
+  EXPECT_FALSE(map.isUnreachable(getCellPose(1, 1, 1, 0)));
+}
+
+TEST_F(ReachabilityMapTest, RejectsTruncatedFile)
+{
+  writeMap(1);
+  ReachabilityMap map;
+  EXPECT_FALSE(map.load(file_path_));
+  EXPECT_FALSE(map.isLoaded());
+}
+
+TEST_F(ReachabilityMapTest, LooksUpNearestCell)
+{
+  setCell(1, 2, 0, 1, 3, 0.25f, 0.5f);
+  writeMap();
+  ReachabilityMap map;
+  ASSERT_TRUE(map.load(file_path_));
+  EXPECT_EQ("right_arm", map.getGroupName());
+
+  std::size_t solutions = 0;
+  double gantry_height = 0.0;
+  double manipulability = 0.0;
+  ASSERT_TRUE(map.getCell(getCellPose(1, 2, 0, 1), solutions, gantry_height, manipulability));
+  EXPECT_EQ(3u, solutions);
+  EXPECT_DOUBLE_EQ(0.25, gantry_height);
+  EXPECT_DOUBLE_EQ(0.5, manipulability);
+
+  // Positions round to the nearest cell center, including half a cell outside the region
+  EXPECT_TRUE(map.getCell(getCellPose(1.4, 1.6, -0.4, 1), solutions, gantry_height,
+                          manipulability));
+  EXPECT_FALSE(map.getCell(getCellPose(1.6, 2, 0, 1), solutions, gantry_height,
+                           manipulability));
+  EXPECT_FALSE(map.getCell(getCellPose(1, 2, -0.6, 1), solutions, gantry_height,
+                           manipulability));
+
+  // The same cell with the other approach was not reachable
+  EXPECT_FALSE(map.getCell(getCellPose(1, 2, 0, 0), solutions, gantry_height, manipulability));
+
+  // Orientations snap to the nearest approach within the tolerance
+  const Eigen::Affine3d small_turn(Eigen::AngleAxisd(ORIENTATION_TOLERANCE / 2.0,
+                                                     Eigen::Vector3d::UnitX()));
+  const Eigen::Affine3d large_turn(Eigen::AngleAxisd(ORIENTATION_TOLERANCE * 2.0,
+                                                     Eigen::Vector3d::UnitX()));
+  EXPECT_TRUE(map.getCell(getCellPose(1, 2, 0, 1) * small_turn, solutions, gantry_height,
+                          manipulability));
+  EXPECT_FALSE(map.getCell(getCellPose(1, 2, 0, 1) * large_turn, solutions, gantry_height,
+                           manipulability));
+}
+
+TEST_F(ReachabilityMapTest, UnreachableNeedsWholeNeighbourhood)
+{
+  // Approach 0 is reachable nowhere, approach 1 only in one corner
+  setCell(0, 0, 0, 1, 1, 0.0f, 0.1f);
+  writeMap();
+  ReachabilityMap map;
+  ASSERT_TRUE(map.load(file_path_));
+
+  EXPECT_TRUE(map.isUnreachable(getCellPose(1, 1, 1, 0)));
+
+  // A neighbour outside the map might be reachable
+  EXPECT_FALSE(map.isUnreachable(getCellPose(0, 1, 1, 0)));
+
+  // A reachable neighbour with the same approach
+  EXPECT_FALSE(map.isUnreachable(getCellPose(1, 1, 1, 1)));
+
+  // Poses the map does not cover are never unreachable
+  EXPECT_FALSE(map.isUnreachable(getCellPose(1, 1, 5, 0)));
+  const Eigen::Affine3d half_turn(Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitY()));
+  EXPECT_FALSE(map.isUnreachable(getCellPose(1, 1, 1, 0) * half_turn));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
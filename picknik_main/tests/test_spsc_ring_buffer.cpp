@@ -0,0 +1,158 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Unit tests of the lock-free tactile sample ring buffer
+*/
+
+// PickNik
+#include <picknik_main/spsc_ring_buffer.h>
+
+// Testing
+#include <gtest/gtest.h>
+
+// Boost
+#include <boost/thread.hpp>
+
+using namespace picknik_main;
+
+namespace
+{
+const std::size_t CAPACITY = 4;
+
+/** \brief Large enough that copying it is not atomic, every word holds the same count */
+struct Sample
+{
+  uint64_t words_[32];
+};
+
+Sample makeSample(uint64_t count)
+{
+  Sample sample;
+  for (std::size_t i = 0; i < 32; ++i)
+    sample.words_[i] = count;
+  return sample;
+}
+
+/** \brief A torn copy mixes words of two samples */
+bool isWhole(const Sample& sample)
+{
+  for (std::size_t i = 1; i < 32; ++i)
+    if (sample.words_[i] != sample.words_[0])
+      return false;
+  return true;
+}
+}  // end anonymous namespace
+
+TEST(SpscRingBuffer, EmptyHasNothingToRead)
+{
+  SpscRingBuffer<int, CAPACITY> buffer;
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(0u, buffer.size());
+
+  int value = -1;
+  EXPECT_FALSE(buffer.readLatest(value));
+  std::vector<int> values(3, -1);
+  EXPECT_EQ(0u, buffer.readWindow(CAPACITY, values));
+  EXPECT_TRUE(values.empty());
+}
+
+TEST(SpscRingBuffer, ReadsWindowOldestFirst)
+{
+  SpscRingBuffer<int, CAPACITY> buffer;
+  buffer.push(1);
+  buffer.push(2);
+  buffer.push(3);
+  EXPECT_EQ(3u, buffer.size());
+
+  int value = 0;
+  ASSERT_TRUE(buffer.readLatest(value));
+  EXPECT_EQ(3, value);
+
+  std::vector<int> values;
+  ASSERT_EQ(2u, buffer.readWindow(2, values));
+  EXPECT_EQ(2, values[0]);
+  EXPECT_EQ(3, values[1]);
+
+  // Asking for more than was pushed gives what there is
+  ASSERT_EQ(3u, buffer.readWindow(CAPACITY, values));
+  EXPECT_EQ(1, values[0]);
+}
+
+TEST(SpscRingBuffer, OverwritesOldestWhenFull)
+{
+  SpscRingBuffer<int, CAPACITY> buffer;
+  for (int i = 0; i < 10; ++i)
+    buffer.push(i);
+  EXPECT_EQ(10u, buffer.getTotalPushed());
+  EXPECT_EQ(CAPACITY, buffer.size());
+
+  int value = 0;
+  ASSERT_TRUE(buffer.readLatest(value));
+  EXPECT_EQ(9, value);
+
+  // The window is clamped to the capacity
+  std::vector<int> values;
+  ASSERT_EQ(CAPACITY, buffer.readWindow(100, values));
+  for (std::size_t i = 0; i < CAPACITY; ++i)
+    EXPECT_EQ(int(10 - CAPACITY + i), values[i]);
+}
+
+TEST(SpscRingBuffer, ReadersNeverSeeTornSamples)
+{
+  // Small ring so the producer laps the readers constantly
+  typedef SpscRingBuffer<Sample, CAPACITY> Buffer;
+  Buffer buffer;
+  const uint64_t num_samples = 200000;
+
+  boost::thread producer([&buffer, num_samples]()
+                         {
+                           for (uint64_t count = 1; count <= num_samples; ++count)
+                             buffer.push(makeSample(count));
+                         });
+
+  std::size_t torn = 0;
+  std::size_t out_of_order = 0;
+  uint64_t last_latest = 0;
+  std::vector<Sample> window;
+  while (last_latest < num_samples)
+  {
+    Sample latest;
+    if (!buffer.readLatest(latest))
+      continue;
+    if (!isWhole(latest))
+      ++torn;
+    if (latest.words_[0] < last_latest)
+      ++out_of_order;
+    last_latest = latest.words_[0];
+
+    // A window may lose samples the producer overwrote while it was copied, but what remains is
+    // whole and oldest first
+    buffer.readWindow(CAPACITY, window);
+    for (std::size_t i = 0; i < window.size(); ++i)
+    {
+      if (!isWhole(window[i]))
+        ++torn;
+      if (i && window[i].words_[0] <= window[i - 1].words_[0])
+        ++out_of_order;
+    }
+  }
+  producer.join();
+
+  EXPECT_EQ(0u, torn);
+  EXPECT_EQ(0u, out_of_order);
+  EXPECT_EQ(num_samples, buffer.getTotalPushed());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
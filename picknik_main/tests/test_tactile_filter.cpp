@@ -0,0 +1,249 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Unit tests of the tactile signal filters and contact detection
+*/
+
+// PickNik
+#include <picknik_main/tactile_filter.h>
+
+// Testing
+#include <gtest/gtest.h>
+
+// C++
+#include <cmath>
+#include <limits>
+
+using namespace picknik_main;
+
+namespace
+{
+const double SENSOR_PERIOD = 0.01;  // 100 hz
+
+TactileSample makeSample(double time, double force, double torque = 0.0)
+{
+  TactileSample sample = TactileSample();
+  sample.stamp_.fromSec(time);
+  sample.data_[SHEER_FORCE] = force;
+  sample.data_[SHEER_TORQUE] = torque;
+  return sample;
+}
+
+/** \brief Filters that pass the force straight through and raise events without delay */
+TactileFilterSettings getUnfilteredSettings()
+{
+  TactileFilterSettings settings;
+  settings.mode_ = TACTILE_FILTER_NONE;
+  settings.event_debounce_ = 0.0;
+  return settings;
+}
+}  // end anonymous namespace
+
+TEST(TactileFilter, ParsesModes)
+{
+  TactileFilterMode mode;
+  EXPECT_TRUE(parseTactileFilterMode("none", mode));
+  EXPECT_EQ(TACTILE_FILTER_NONE, mode);
+  EXPECT_TRUE(parseTactileFilterMode("low_pass", mode));
+  EXPECT_EQ(TACTILE_FILTER_LOW_PASS, mode);
+  EXPECT_TRUE(parseTactileFilterMode("kalman", mode));
+  EXPECT_EQ(TACTILE_FILTER_KALMAN, mode);
+  EXPECT_FALSE(parseTactileFilterMode("median", mode));
+}
+
+TEST(SignalFilter, StartsAtFirstMeasurement)
+{
+  TactileFilterSettings settings;
+  settings.mode_ = TACTILE_FILTER_KALMAN;
+  SignalFilter filter;
+  filter.configure(settings);
+
+  filter.update(4.0, 0.0);
+  EXPECT_DOUBLE_EQ(4.0, filter.getValue());
+  EXPECT_DOUBLE_EQ(0.0, filter.getRate());
+
+  // A repeated stamp has no time to integrate over and is ignored
+  filter.update(100.0, 0.0);
+  EXPECT_DOUBLE_EQ(4.0, filter.getValue());
+}
+
+TEST(SignalFilter, FiniteDifferenceWithoutFiltering)
+{
+  TactileFilterSettings settings;
+  settings.mode_ = TACTILE_FILTER_NONE;
+  SignalFilter filter;
+  filter.configure(settings);
+
+  filter.update(1.0, 0.0);
+  filter.update(1.5, SENSOR_PERIOD);
+  EXPECT_DOUBLE_EQ(1.5, filter.getValue());
+  EXPECT_NEAR(50.0, filter.getRate(), 1e-9);
+}
+
+TEST(SignalFilter, LowPassLagsAStep)
+{
+  TactileFilterSettings settings;
+  settings.mode_ = TACTILE_FILTER_LOW_PASS;
+  SignalFilter filter;
+  filter.configure(settings);
+
+  filter.update(0.0, 0.0);
+  filter.update(10.0, SENSOR_PERIOD);
+  EXPECT_GT(filter.getValue(), 0.0);
+  EXPECT_LT(filter.getValue(), 10.0);
+
+  for (std::size_t i = 0; i < 200; ++i)
+    filter.update(10.0, SENSOR_PERIOD);
+  EXPECT_NEAR(10.0, filter.getValue(), 1e-3);
+}
+
+TEST(SignalFilter, KalmanTracksARamp)
+{
+  TactileFilterSettings settings;
+  settings.mode_ = TACTILE_FILTER_KALMAN;
+  SignalFilter filter;
+  filter.configure(settings);
+
+  // Alternating error of one standard deviation of the measurement noise on a ramp of 20 / s
+  const double slope = 20.0;
+  const double noise = std::sqrt(settings.kalman_measurement_noise_);
+  for (std::size_t i = 0; i < 300; ++i)
+    filter.update(slope * i * SENSOR_PERIOD + (i % 2 ? noise : -noise),
+                  i ? SENSOR_PERIOD : 0.0);
+
+  const double last_time = 299 * SENSOR_PERIOD;
+  EXPECT_NEAR(slope * last_time, filter.getValue(), noise);
+  EXPECT_NEAR(slope, filter.getRate(), 0.2 * slope);
+}
+
+TEST(SignalFilter, KalmanSettlesOnAConstant)
+{
+  TactileFilterSettings settings;
+  settings.mode_ = TACTILE_FILTER_KALMAN;
+  SignalFilter filter;
+  filter.configure(settings);
+
+  filter.update(0.0, 0.0);
+  for (std::size_t i = 0; i < 300; ++i)
+    filter.update(5.0, SENSOR_PERIOD);
+  EXPECT_NEAR(5.0, filter.getValue(), 1e-3);
+  EXPECT_NEAR(0.0, filter.getRate(), 1e-2);
+
+  filter.reset();
+  filter.update(-2.0, 0.0);
+  EXPECT_DOUBLE_EQ(-2.0, filter.getValue());
+}
+
+TEST(TactileFilter, ContactHysteresis)
+{
+  // Stepping the force is not slip here
+  TactileFilterSettings settings = getUnfilteredSettings();
+  settings.slip_force_rate_ = std::numeric_limits<double>::max();
+  TactileFilter filter;
+  filter.configure(settings);
+  TactileEventType events[TactileFilter::MAX_EVENTS];
+  const double between = (settings.contact_force_on_ + settings.contact_force_off_) / 2.0;
+
+  // Between the thresholds is not enough to begin contact
+  double time = 0.0;
+  TactileSample sample = makeSample(time, between);
+  EXPECT_EQ(0u, filter.update(sample, events));
+  EXPECT_FALSE(sample.in_contact_);
+
+  sample = makeSample(time += SENSOR_PERIOD, settings.contact_force_on_ + 1.0);
+  ASSERT_EQ(1u, filter.update(sample, events));
+  EXPECT_EQ(TACTILE_CONTACT_BEGIN, events[0]);
+  EXPECT_TRUE(sample.in_contact_);
+
+  // But it is enough to stay in contact, either direction of sheer counts
+  sample = makeSample(time += SENSOR_PERIOD, -between);
+  EXPECT_EQ(0u, filter.update(sample, events));
+  EXPECT_TRUE(sample.in_contact_);
+
+  sample = makeSample(time += SENSOR_PERIOD, settings.contact_force_off_ - 1.0);
+  ASSERT_EQ(1u, filter.update(sample, events));
+  EXPECT_EQ(TACTILE_CONTACT_END, events[0]);
+  EXPECT_FALSE(sample.in_contact_);
+}
+
+TEST(TactileFilter, ContactIsDebounced)
+{
+  TactileFilterSettings settings = getUnfilteredSettings();
+  settings.event_debounce_ = 0.05;
+  TactileFilter filter;
+  filter.configure(settings);
+  TactileEventType events[TactileFilter::MAX_EVENTS];
+  const double pressed = settings.contact_force_on_ + 1.0;
+
+  // A blip shorter than the debounce time is ignored
+  double time = 0.0;
+  TactileSample sample = makeSample(time, pressed);
+  EXPECT_EQ(0u, filter.update(sample, events));
+  sample = makeSample(time += SENSOR_PERIOD, 0.0);
+  EXPECT_EQ(0u, filter.update(sample, events));
+  EXPECT_FALSE(sample.in_contact_);
+
+  // A press held long enough begins contact once, when the debounce time has passed
+  const double press_time = time += SENSOR_PERIOD;
+  std::size_t num_events = 0;
+  for (; time < press_time + 0.1; time += SENSOR_PERIOD)
+  {
+    sample = makeSample(time, pressed);
+    const std::size_t new_events = filter.update(sample, events);
+    if (time - press_time < settings.event_debounce_ - 1e-9)
+    {
+      EXPECT_FALSE(sample.in_contact_);
+    }
+    if (new_events)
+    {
+      EXPECT_EQ(TACTILE_CONTACT_BEGIN, events[0]);
+    }
+    num_events += new_events;
+  }
+  EXPECT_EQ(1u, num_events);
+  EXPECT_TRUE(sample.in_contact_);
+}
+
+TEST(TactileFilter, SlipOnlyWhileInContact)
+{
+  const TactileFilterSettings settings = getUnfilteredSettings();
+  TactileFilter filter;
+  filter.configure(settings);
+  TactileEventType events[TactileFilter::MAX_EVENTS];
+  const double pressed = settings.contact_force_on_ + 1.0;
+
+  // Fast torque changes without contact are not slip
+  double time = 0.0;
+  TactileSample sample = makeSample(time, 0.0, 0.0);
+  filter.update(sample, events);
+  sample = makeSample(time += SENSOR_PERIOD, 0.0, 2.0 * settings.slip_torque_rate_ * SENSOR_PERIOD);
+  EXPECT_EQ(0u, filter.update(sample, events));
+  EXPECT_FALSE(sample.slipping_);
+
+  // Contact begins in the same sample as the fast force change
+  sample = makeSample(time += SENSOR_PERIOD, pressed, 0.0);
+  ASSERT_EQ(2u, filter.update(sample, events));
+  EXPECT_EQ(TACTILE_CONTACT_BEGIN, events[0]);
+  EXPECT_EQ(TACTILE_SLIP_BEGIN, events[1]);
+  EXPECT_TRUE(sample.slipping_);
+
+  // Holding still ends the slip but not the contact
+  sample = makeSample(time += SENSOR_PERIOD, pressed, 0.0);
+  ASSERT_EQ(1u, filter.update(sample, events));
+  EXPECT_EQ(TACTILE_SLIP_END, events[0]);
+  EXPECT_TRUE(sample.in_contact_);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
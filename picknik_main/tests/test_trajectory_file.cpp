@@ -0,0 +1,192 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Unit tests of the binary trajectory files
+*/
+
+// PickNik
+#include <picknik_main/trajectory_file.h>
+
+// Testing
+#include <gtest/gtest.h>
+
+// C++
+#include <fstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace picknik_main;
+
+namespace
+{
+// Magic, version, flags, variable count, name count
+const std::size_t VERSION_OFFSET = sizeof(TRAJECTORY_FILE_MAGIC);
+const std::size_t POINT_COUNT_OFFSET = VERSION_OFFSET + 4 * sizeof(uint32_t);
+
+const std::size_t NUM_POINTS = 3;
+const std::size_t NUM_VARIABLES = 2;
+
+class TrajectoryFileTest : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    char file_path[] = "/tmp/test_trajectory_file_XXXXXX";
+    const int fd = mkstemp(file_path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    file_path_ = file_path;
+
+    names_.push_back("joint_a");
+    names_.push_back("joint_b");
+  }
+
+  virtual void TearDown() { unlink(file_path_.c_str()); }
+
+  /** \brief Point i is (i, 10 i) at time 0.1 i */
+  void writeTrajectory(const std::vector<std::string>& names, uint32_t flags)
+  {
+    TrajectoryFileWriter writer;
+    ASSERT_TRUE(writer.open(file_path_, names, NUM_VARIABLES, flags));
+    for (std::size_t i = 0; i < NUM_POINTS; ++i)
+    {
+      const double values[NUM_VARIABLES] = {double(i), 10.0 * i};
+      writer.append(values, 0.1 * i);
+    }
+    EXPECT_EQ(NUM_POINTS, writer.getPointCount());
+    ASSERT_TRUE(writer.close());
+  }
+
+  void overwrite(std::size_t offset, const void* data, std::size_t size)
+  {
+    std::fstream file(file_path_.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offset);
+    file.write(static_cast<const char*>(data), size);
+  }
+
+  /** \brief Cut bytes off the end of the file */
+  void shorten(std::size_t bytes)
+  {
+    std::ifstream file(file_path_.c_str(), std::ios::binary | std::ios::ate);
+    const std::size_t size = file.tellg();
+    ASSERT_EQ(0, truncate(file_path_.c_str(), size - bytes));
+  }
+
+  std::string file_path_;
+  std::vector<std::string> names_;
+};
+}  // end anonymous namespace
+
+TEST_F(TrajectoryFileTest, RoundTrip)
+{
+  writeTrajectory(names_, TRAJECTORY_HAS_TIMES);
+  EXPECT_TRUE(TrajectoryFileReader::isTrajectoryFile(file_path_));
+
+  TrajectoryFileReader reader;
+  ASSERT_TRUE(reader.open(file_path_));
+  EXPECT_EQ(names_, reader.getVariableNames());
+  EXPECT_EQ(NUM_VARIABLES, reader.getVariableCount());
+  ASSERT_EQ(NUM_POINTS, reader.getPointCount());
+  EXPECT_TRUE(reader.hasTimes());
+  EXPECT_FALSE(reader.isPoses());
+  for (std::size_t i = 0; i < NUM_POINTS; ++i)
+  {
+    EXPECT_DOUBLE_EQ(0.1 * i, reader.getTime(i));
+    EXPECT_DOUBLE_EQ(double(i), reader.getValues(i)[0]);
+    EXPECT_DOUBLE_EQ(10.0 * i, reader.getValues(i)[1]);
+  }
+
+  // Points are read straight from the map, so must be aligned
+  EXPECT_EQ(0u, reinterpret_cast<std::size_t>(reader.getValues(0)) % sizeof(double));
+}
+
+TEST_F(TrajectoryFileTest, RoundTripWithoutNamesOrTimes)
+{
+  writeTrajectory(std::vector<std::string>(), TRAJECTORY_POSES);
+
+  TrajectoryFileReader reader;
+  ASSERT_TRUE(reader.open(file_path_));
+  EXPECT_TRUE(reader.getVariableNames().empty());
+  EXPECT_FALSE(reader.hasTimes());
+  EXPECT_TRUE(reader.isPoses());
+  ASSERT_EQ(NUM_POINTS, reader.getPointCount());
+  EXPECT_DOUBLE_EQ(0.0, reader.getTime(2));
+  EXPECT_DOUBLE_EQ(2.0, reader.getValues(2)[0]);
+  EXPECT_DOUBLE_EQ(20.0, reader.getValues(2)[1]);
+}
+
+TEST_F(TrajectoryFileTest, RejectsTruncatedPoints)
+{
+  writeTrajectory(names_, TRAJECTORY_HAS_TIMES);
+  shorten(sizeof(double));
+
+  TrajectoryFileReader reader;
+  EXPECT_FALSE(reader.open(file_path_));
+}
+
+TEST_F(TrajectoryFileTest, RejectsTruncatedNames)
+{
+  writeTrajectory(names_, TRAJECTORY_HAS_TIMES);
+  ASSERT_EQ(0, truncate(file_path_.c_str(), POINT_COUNT_OFFSET + sizeof(uint64_t) + 6));
+
+  TrajectoryFileReader reader;
+  EXPECT_FALSE(reader.open(file_path_));
+}
+
+TEST_F(TrajectoryFileTest, ReadsUnfinishedRecordingToLastCompletePoint)
+{
+  // A recording that was never closed has no point count and may end part way through a point
+  writeTrajectory(names_, TRAJECTORY_HAS_TIMES);
+  const uint64_t no_count = 0;
+  overwrite(POINT_COUNT_OFFSET, &no_count, sizeof(no_count));
+  shorten(sizeof(double));
+
+  TrajectoryFileReader reader;
+  ASSERT_TRUE(reader.open(file_path_));
+  ASSERT_EQ(NUM_POINTS - 1, reader.getPointCount());
+  EXPECT_DOUBLE_EQ(1.0, reader.getValues(1)[0]);
+}
+
+TEST_F(TrajectoryFileTest, RejectsSwappedByteOrder)
+{
+  writeTrajectory(names_, TRAJECTORY_HAS_TIMES);
+  const uint32_t swapped_version = TRAJECTORY_FILE_VERSION << 24;
+  overwrite(VERSION_OFFSET, &swapped_version, sizeof(swapped_version));
+
+  TrajectoryFileReader reader;
+  EXPECT_TRUE(TrajectoryFileReader::isTrajectoryFile(file_path_));
+  EXPECT_FALSE(reader.open(file_path_));
+}
+
+TEST_F(TrajectoryFileTest, RejectsOtherFiles)
+{
+  std::ofstream file(file_path_.c_str());
+  file << "0.1,0.2,0.3\n0.4,0.5,0.6\n0.7,0.8,0.9\n1.0,1.1,1.2\n";
+  file.close();
+
+  TrajectoryFileReader reader;
+  EXPECT_FALSE(TrajectoryFileReader::isTrajectoryFile(file_path_));
+  EXPECT_FALSE(reader.open(file_path_));
+  EXPECT_FALSE(reader.open(file_path_ + "_missing"));
+}
+
+TEST(TrajectoryFilePath, ReplacesExtension)
+{
+  EXPECT_EQ("trajectories/calib.traj", getBinaryTrajectoryPath("trajectories/calib.csv"));
+  EXPECT_EQ("trajectories/calib.traj", getBinaryTrajectoryPath("trajectories/calib"));
+  EXPECT_EQ("trajectories.d/calib.traj", getBinaryTrajectoryPath("trajectories.d/calib"));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
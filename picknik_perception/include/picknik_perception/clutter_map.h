@@ -0,0 +1,135 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Incremental octree map of everything inside the shelf, including objects no model exists for
+*/
+
+#ifndef PICKNIK_PERCEPTION_CLUTTER_MAP_
+#define PICKNIK_PERCEPTION_CLUTTER_MAP_
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Octomap
+#include <octomap/octomap.h>
+#include <octomap_msgs/Octomap.h>
+
+// Eigen
+#include <Eigen/Core>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace picknik_perception
+{
+
+class ClutterMap
+{
+public:
+  typedef pcl::PointCloud<pcl::PointXYZ> Cloud;
+
+  /**
+   * \brief Constructor
+   * \param min_corner - lower corner of the mapped volume in the map frame
+   * \param max_corner - upper corner of the mapped volume in the map frame
+   * \param resolution - edge length of one voxel
+   * \param max_range - points further than this from the sensor only clear space, negative for no limit
+   */
+  ClutterMap(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner, double resolution,
+             double max_range);
+
+  /**
+   * \brief Set the sensor model, see octomap::OccupancyOcTreeBase
+   */
+  void setProbabilities(double hit, double miss, double clamping_min, double clamping_max);
+
+  /**
+   * \brief Raycast a cloud into the map. Voxels already clamped to the state a ray would push them
+   *        towards are skipped, so a static scene costs almost nothing after the first few clouds
+   * \param cloud - points in the map frame
+   * \param sensor_origin - position of the sensor in the map frame
+   * \return number of voxels whose occupancy changed since the last resetChanges()
+   */
+  std::size_t insertCloud(const Cloud& cloud, const Eigen::Vector3d& sensor_origin);
+
+  /**
+   * \brief Mark every voxel in a box as free, e.g. a bin whose products perception models instead
+   * \return number of voxels that were not already free
+   */
+  std::size_t clearBox(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner);
+
+  /**
+   * \brief Number of voxels whose occupancy changed since the last resetChanges()
+   */
+  std::size_t getChangedCount() const;
+
+  /**
+   * \brief Start a new diff
+   */
+  void resetChanges();
+
+  /**
+   * \brief Forget everything, e.g. after the shelf was restocked
+   */
+  void clear();
+
+  /**
+   * \brief Serialize the whole pruned occupancy tree, for the planning scene
+   * \return true on success
+   */
+  bool writeMsg(octomap_msgs::Octomap& msg);
+
+  const octomap::OcTree& getTree() const
+  {
+    return tree_;
+  }
+
+private:
+  octomap::OcTree tree_;
+  double max_range_;
+
+  // Reused between clouds, it allocates a lot of memory on construction
+  octomap::KeyRay key_ray_;
+
+}; // class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ClutterMap> ClutterMapPtr;
+typedef boost::shared_ptr<const ClutterMap> ClutterMapConstPtr;
+
+} // end namespace
+
+#endif
@@ -42,6 +42,11 @@
 #include <picknik_msgs/FindObjectsAction.h>
 #include <picknik_msgs/StopPerception.h>
 
+// Boost
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread_time.hpp>
+
 namespace picknik_perception
 {
 
@@ -73,6 +78,21 @@ public:
    */
   bool isReadyToStopPerception();
 
+  /**
+   * \brief Block until a goal is recieved and accept it
+   * \param goal - the items to look for
+   * \param timeout - seconds to wait, negative to wait until ROS shuts down
+   * \return true if a goal was accepted, false on timeout, shutdown or a reset request
+   */
+  bool waitForStartPerception(picknik_msgs::FindObjectsGoalConstPtr& goal, double timeout = -1);
+
+  /**
+   * \brief Block until the manipulation pipeline says the camera has stopped moving
+   * \param timeout - seconds to wait, negative to wait until ROS shuts down
+   * \return true if stop was commanded, false on timeout, shutdown or a reset request
+   */
+  bool waitForStopPerception(double timeout = -1);
+
   /**
    * \brief Send result back to manipulation pipeline
    * \param result - discovered items to return back
@@ -103,11 +123,17 @@ private:
   bool resetPerception(picknik_msgs::StopPerception::Request&, picknik_msgs::StopPerception::Response &res);
 
   /**
-   * \brief Initialize state machine variables
+   * \brief Initialize state machine variables. Caller must hold state_mutex_
    * \return true on success
    */
   bool initialize();
 
+  /**
+   * \brief Wait on state_changed_ until a flag is set. Caller must hold lock on state_mutex_
+   * \return true if the flag was set
+   */
+  bool waitForFlag(boost::mutex::scoped_lock& lock, const bool& flag, double timeout);
+
   // A shared node handle
   ros::NodeHandle nh_;
 
@@ -118,10 +144,12 @@ private:
   ros::ServiceServer stop_service_;
   ros::ServiceServer reset_service_;
 
-  // State machine
+  // State machine, touched from the spinner threads and the perception main loop
   bool perception_running_; // whether we should start perception
   bool stop_perception_; // whether perception should end
   bool reset_perception_; // Whether to clear all previous progress and restart
+  boost::mutex state_mutex_;
+  boost::condition_variable state_changed_;
 
 }; // end class
 
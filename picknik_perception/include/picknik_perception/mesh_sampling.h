@@ -0,0 +1,77 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Convert mesh resources into point clouds
+*/
+
+#ifndef PICKNIK_PERCEPTION_MESH_SAMPLING_
+#define PICKNIK_PERCEPTION_MESH_SAMPLING_
+
+#include <string>
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Eigen
+#include <Eigen/Geometry>
+
+namespace picknik_perception
+{
+
+/**
+ * \brief Sample the surface of every triangle of a mesh on a regular barycentric grid
+ * \param resource - mesh to load, e.g. file:///.../collision.stl
+ * \param pose - transform applied to every sample
+ * \param spacing - maximum distance between neighboring samples along a triangle edge
+ * \param cloud - samples are appended to this cloud
+ * \return true on success
+ */
+bool sampleMeshSurface(const std::string& resource, const Eigen::Affine3d& pose, double spacing,
+                       pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+/**
+ * \brief Load the model points of one product folder, such as picknik_main/meshes/products/<name>.
+ *        A pcd in the folder is used as is, otherwise collision.stl is sampled
+ * \param product_path - folder of the product
+ * \param spacing - sample spacing used for meshes
+ * \param cloud - model points in the product frame
+ * \return true on success
+ */
+bool loadProductModelCloud(const std::string& product_path, double spacing, pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+} // end namespace
+
+#endif
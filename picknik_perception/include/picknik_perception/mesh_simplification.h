@@ -0,0 +1,88 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Reduce product bounding meshes to a bounded number of triangles before they reach the planning scene
+*/
+
+#ifndef PICKNIK_PERCEPTION_MESH_SIMPLIFICATION_
+#define PICKNIK_PERCEPTION_MESH_SIMPLIFICATION_
+
+#include <string>
+
+// ROS
+#include <shape_msgs/Mesh.h>
+
+namespace picknik_perception
+{
+
+enum MeshSimplificationMode
+{
+  MESH_UNCHANGED,  // keep the mesh as created from the cloud
+  MESH_CONVEX_HULL,  // convex hull, decimated to the triangle budget
+  MESH_ORIENTED_BOX  // box along the principal axes of the vertices, 12 triangles
+};
+
+struct MeshSimplificationSettings
+{
+  MeshSimplificationSettings()
+    : mode_(MESH_CONVEX_HULL)
+    , max_triangles_(100)
+  {
+  }
+
+  MeshSimplificationMode mode_;
+  std::size_t max_triangles_;
+};
+
+/**
+ * \brief Parse "none", "hull" or "box"
+ * \return true on success
+ */
+bool parseMeshSimplificationMode(const std::string& name, MeshSimplificationMode& mode);
+
+/**
+ * \brief Replace a mesh with a convex, bounded complexity approximation that closely bounds the
+ *        vertices of the input
+ * \param input - mesh created from a product cloud
+ * \param settings - what to build and the triangle budget
+ * \param output - simplified mesh, in the same frame as the input. May be the same object as input
+ * \return true on success, output is a copy of input otherwise
+ */
+bool simplifyMesh(const shape_msgs::Mesh& input, const MeshSimplificationSettings& settings,
+                  shape_msgs::Mesh& output);
+
+} // end namespace
+
+#endif
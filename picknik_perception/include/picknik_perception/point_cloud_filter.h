@@ -33,7 +33,8 @@
  *********************************************************************/
 
 /* Author: Dave Coleman
-   Desc:   Does not actually update the octomap, only filters point clouds
+   Desc:   Does not actually update the octomap, only filters point clouds. Removes points that
+           fall inside the robot's own link shapes, posed at the cloud's time stamp
 */
 
 #ifndef MOVEIT_PERCEPTION_POINTCLOUD_FILTER_
@@ -45,11 +46,14 @@
 #include <message_filters/subscriber.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <moveit/point_containment_filter/shape_mask.h>
+#include <moveit/robot_model/robot_model.h>
 #include <geometric_shapes/shapes.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
-#include <moveit/occupancy_map_monitor/occupancy_map.h>
 
 namespace picknik_perception
 {
@@ -73,6 +77,33 @@ public:
   ShapeHandle excludeShape(const shapes::ShapeConstPtr &shape, const double &scale, const double &padding);
   void forgetShape(ShapeHandle handle);
 
+  /**
+   * \brief Exclude a shape that is rigidly attached to a TF frame, e.g. a link collision body.
+   *        Used when no TransformCacheProvider is set
+   * \param frame - TF frame the shape moves with
+   * \param frame_to_shape - pose of the shape within that frame
+   * \return handle of the shape
+   */
+  ShapeHandle excludeFrameShape(const std::string &frame, const Eigen::Affine3d &frame_to_shape,
+                                const shapes::ShapeConstPtr &shape, const double &scale, const double &padding);
+
+  /**
+   * \brief Exclude the collision shapes of robot links, each moving with its link frame
+   * \param link_names - links to exclude, every link with collision geometry when empty
+   * \return number of shapes excluded
+   */
+  std::size_t excludeRobotLinks(const robot_model::RobotModelConstPtr &robot_model,
+                                std::vector<std::string> link_names, const double &scale, const double &padding);
+
+  /**
+   * \brief Remove all excluded shapes, beyond max range and subsampled points from a cloud.
+   *        Clouds are filtered one at a time, even when callbacks run on several spinner threads
+   * \param cloud_msg - input cloud, any point fields
+   * \param filtered_cloud - unorganized cloud with the same fields and frame as the input
+   * \return true on success
+   */
+  bool filter(const sensor_msgs::PointCloud2 &cloud_msg, sensor_msgs::PointCloud2 &filtered_cloud);
+
   void setTransformCacheCallback(const TransformCacheProvider &transform_callback)
   {
     transform_provider_callback_ = transform_callback;
@@ -91,6 +122,12 @@ protected:
 
   bool updateTransformCache(const std::string &target_frame, const ros::Time &target_time);
 
+  /**
+   * \brief Default transform provider, looks up every frame attached shape with TF
+   */
+  bool getFrameShapeTransforms(const std::string &target_frame, const ros::Time &target_time,
+                               ShapeTransformCache &cache);
+
 private:
 
   bool getShapeTransform(ShapeHandle h, Eigen::Affine3d &transform) const;
@@ -118,6 +155,20 @@ private:
   boost::scoped_ptr<point_containment_filter::ShapeMask> shape_mask_;
   std::vector<int> mask_;
 
+  /* held while filtering a cloud or changing shapes, transform_cache_ and mask_ are reused */
+  boost::mutex filter_mutex_;
+
+  /* shapes added with excludeFrameShape() */
+  struct FrameShape
+  {
+    std::string frame_;
+    Eigen::Affine3d frame_to_shape_;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+  typedef std::map<ShapeHandle, FrameShape, std::less<ShapeHandle>,
+                   Eigen::aligned_allocator<std::pair<const ShapeHandle, FrameShape> > > FrameShapeMap;
+  FrameShapeMap frame_shapes_;
+
   std::string map_frame_;
 }; // class
 
@@ -0,0 +1,193 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Precomputed shape descriptors of every product, used to label segmented clusters
+*/
+
+#ifndef PICKNIK_PERCEPTION_PRODUCT_DESCRIPTOR_LIBRARY_
+#define PICKNIK_PERCEPTION_PRODUCT_DESCRIPTOR_LIBRARY_
+
+#include <map>
+#include <string>
+#include <vector>
+
+// ROS
+#include <ros/ros.h>
+
+// Eigen
+#include <Eigen/Core>
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace picknik_perception
+{
+
+/**
+ * \brief Shape signature of one product or cluster
+ */
+struct ProductDescriptor
+{
+  std::string name_;
+
+  // Viewpoint feature histogram of the whole cloud
+  std::vector<float> global_;
+
+  // Fast point feature histograms averaged over every point
+  std::vector<float> local_;
+};
+
+/**
+ * \brief Descriptor settings, stored in the library file so the server computes matching descriptors
+ */
+struct DescriptorSettings
+{
+  DescriptorSettings()
+    : leaf_size_(0.005)
+    , normal_radius_(0.015)
+    , feature_radius_(0.025)
+    , view_count_(40)
+    , view_distance_(1.0)
+  {
+  }
+
+  float leaf_size_;
+  float normal_radius_;
+  float feature_radius_;
+
+  // Partial views rendered of each product model, spread evenly around it
+  boost::uint32_t view_count_;
+
+  // Distance of the rendered views from the product centroid, about that of the cameras to a bin
+  float view_distance_;
+};
+
+class ProductDescriptorLibrary
+{
+public:
+  typedef pcl::PointCloud<pcl::PointXYZ> Cloud;
+
+  /**
+   * \brief Constructor
+   */
+  ProductDescriptorLibrary(const DescriptorSettings& settings = DescriptorSettings());
+
+  /**
+   * \brief Compute the descriptors of a partial view with the library settings
+   * \param cloud - rendered view of a product model or segmented cluster
+   * \param viewpoint - position of the camera in the frame of the cloud. The viewpoint component of the VFH
+   *        and the normal orientation depend on it, so library and scene must both pass their real one
+   * \param descriptor - result, name is left unchanged
+   * \return true on success
+   */
+  bool computeDescriptor(const Cloud::ConstPtr& cloud, const Eigen::Vector3f& viewpoint,
+                         ProductDescriptor& descriptor) const;
+
+  /**
+   * \brief Compute and store the descriptors of view_count_ partial views of a product model
+   * \param cloud - points sampled densely over the whole model surface
+   * \return true if at least one view could be described
+   */
+  bool addProduct(const std::string& name, const Cloud::ConstPtr& cloud);
+
+  /**
+   * \brief Keep the points of a model that a camera at viewpoint would see, by z-buffering the samples
+   *        on a grid of pixel_size looking at the model centroid
+   */
+  static void renderView(const Cloud& model, const Eigen::Vector3f& viewpoint, float pixel_size, Cloud& view);
+
+  /**
+   * \brief Find the candidate product with the view most similar to a descriptor
+   * \param descriptor - of a segmented cluster
+   * \param candidates - product names to consider, e.g. the expected objects of a bin
+   * \param distance - dissimilarity of the best match, lower is better
+   * \return name of the best match, empty if no candidate is in the library
+   */
+  std::string match(const ProductDescriptor& descriptor, const std::vector<std::string>& candidates,
+                    double& distance) const;
+
+  /**
+   * \brief Dissimilarity between two descriptors, the sum of the chi-squared distances of both histograms
+   */
+  static double distance(const ProductDescriptor& a, const ProductDescriptor& b);
+
+  /**
+   * \brief Check if a product is in the library
+   */
+  bool hasProduct(const std::string& name) const;
+
+  /**
+   * \brief Write the library as a binary file: header, name index with view counts and data offsets, then
+   *        the histograms of every view
+   * \return true on success
+   */
+  bool save(const std::string& file_path) const;
+
+  /**
+   * \brief Replace the library with the contents of a file written by save()
+   * \return true on success
+   */
+  bool load(const std::string& file_path);
+
+  const DescriptorSettings& getSettings() const
+  {
+    return settings_;
+  }
+
+  std::size_t size() const
+  {
+    return descriptors_.size();
+  }
+
+private:
+  DescriptorSettings settings_;
+
+  // Product name to the descriptors of its views
+  std::map<std::string, std::vector<ProductDescriptor> > descriptors_;
+
+}; // class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ProductDescriptorLibrary> ProductDescriptorLibraryPtr;
+typedef boost::shared_ptr<const ProductDescriptorLibrary> ProductDescriptorLibraryConstPtr;
+
+} // end namespace
+
+#endif
@@ -0,0 +1,204 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Andy McEvoy <mcevoy.andy@gmail.com>, Dave Coleman <dave@dav.ee>
+   Desc:   Turns the cropped cloud of one bin into the found products of a FindObjects result. Shared by
+           pcl_perception_server and perception_benchmark so both run the same processing
+*/
+
+#ifndef PICKNIK_PERCEPTION_PRODUCT_PERCEPTION_
+#define PICKNIK_PERCEPTION_PRODUCT_PERCEPTION_
+
+#include <string>
+#include <vector>
+
+// ROS
+#include <ros/ros.h>
+
+// Picknik
+#include <picknik_msgs/FindObjectsAction.h>
+#include <picknik_perception/simple_point_cloud_filter.h>
+#include <picknik_perception/product_pose_estimator.h>
+#include <picknik_perception/product_descriptor_library.h>
+#include <picknik_perception/mesh_simplification.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace picknik_perception
+{
+
+// Corners of the whole shelf in the world frame
+static const Eigen::Vector3d SHELF_TOP_LEFT_BACK(1.531, 0.4365, 2.37);
+static const Eigen::Vector3d SHELF_BOTTOM_RIGHT_FRONT(0.656, -0.445, 0.002);
+
+/**
+ * \brief Wall time spent in each step of findObjects(), added to on every call
+ */
+struct ProductPerceptionTimes
+{
+  ProductPerceptionTimes()
+    : detection_(0)
+    , labeling_(0)
+    , mesh_(0)
+    , pose_(0)
+  {
+  }
+
+  double detection_;
+  double labeling_;
+  double mesh_;
+  double pose_;
+};
+
+class ProductPerception
+{
+public:
+  typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+  /**
+   * \brief Constructor
+   * \param filter - source of the cropped bin cloud, the background model is installed on it
+   * \param parent_name - for namespacing logging messages
+   */
+  ProductPerception(const SimplePointCloudFilterPtr& filter, const std::string& parent_name);
+
+  /**
+   * \brief Load the region of interest padding, outlier removal, background model, pose estimator, descriptor
+   *        library and mesh simplification as configured in pcl_perception_server.yaml
+   * \return false if an enabled part could not be loaded, the rest is still usable
+   */
+  bool loadFromParameters(ros::NodeHandle& nh);
+
+  /**
+   * \brief Crop every following cloud to a bin, less the region of interest padding
+   * \param goal - only the bin centroid and dimensions are used
+   */
+  void setBin(const picknik_msgs::FindObjectsGoal& goal);
+
+  /**
+   * \brief Find every expected product in the current cloud of the bin set by setBin()
+   * \param goal - same bin as passed to setBin()
+   * \param result - found products, each pose relative to the front bottom right corner of the bin
+   * \param times - optional, time spent in each step is added to it
+   * \return false if no objects could be detected, result.succeeded is set either way
+   */
+  bool findObjects(const picknik_msgs::FindObjectsGoal& goal, picknik_msgs::FindObjectsResult& result,
+                   ProductPerceptionTimes* times = NULL);
+
+  // Points of each product found by the last findObjects(), in the order of result.found_objects, world frame
+  std::vector<Cloud::Ptr> product_clouds_;
+
+private:
+  /**
+   * \brief Build the empty shelf occupancy grid from either the computer vision shelf mesh or an empty scan
+   * \return true on success
+   */
+  bool loadBackgroundModel(ros::NodeHandle& nh);
+
+  /**
+   * \brief Build the downsampled model and KD-tree of every product once, they stay resident
+   * \return true on success
+   */
+  bool loadPoseEstimator(ros::NodeHandle& nh);
+
+  /**
+   * \brief Load the descriptor library written by the build_descriptor_library tool
+   * \return true on success
+   */
+  bool loadDescriptorLibrary(ros::NodeHandle& nh);
+
+  /**
+   * \brief Load how bounding meshes are simplified before being returned
+   * \return true on success
+   */
+  bool loadMeshSimplification(ros::NodeHandle& nh);
+
+  /**
+   * \brief Assign a cloud to each expected product. Bins with several products are clustered and every cluster
+   *        is matched against the descriptor library
+   * \param expected_names - products the order says are in the bin
+   * \param names - labels of the found products
+   * \param clouds - points of each found product, in the world frame
+   */
+  void labelProducts(const std::vector<std::string>& expected_names, std::vector<std::string>& names,
+                     std::vector<Cloud::Ptr>& clouds);
+
+  /**
+   * \brief Register the detected cloud against a product model
+   * \param product_name - which model to use
+   * \param product_cloud - segmented points of the product in the world frame
+   * \param world_to_bin - frame to express the result in
+   * \param bin_to_product - resulting pose, unchanged on failure
+   * \param confidence - value between 0 and 1 based on the registration fitness
+   * \return true if a pose was found
+   */
+  bool estimateProductPose(const std::string& product_name, const Cloud& product_cloud,
+                           const Eigen::Affine3d& world_to_bin, Eigen::Affine3d& bin_to_product, double& confidence);
+
+  /**
+   * \brief Front bottom right corner of the bin in the goal, with world axes
+   */
+  Eigen::Affine3d getWorldToBin(const picknik_msgs::FindObjectsGoal& goal) const;
+
+  SimplePointCloudFilterPtr filter_;
+  std::string parent_name_;
+
+  // Amount to reduce the shelf region of interest by for error compensation
+  double roi_reduction_padding_x_;
+  double roi_reduction_padding_y_;
+  double roi_reduction_padding_z_;
+
+  bool use_outlier_removal_;
+
+  // Model based pose estimation, optional
+  ProductPoseEstimatorPtr pose_estimator_;
+  double max_pose_fitness_;
+
+  // Labeling of clusters in bins with several products, optional
+  ProductDescriptorLibraryPtr descriptor_library_;
+  double cluster_tolerance_;
+  int min_cluster_size_;
+
+  // Bounded complexity of returned meshes
+  MeshSimplificationSettings mesh_simplification_;
+}; // class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ProductPerception> ProductPerceptionPtr;
+typedef boost::shared_ptr<const ProductPerception> ProductPerceptionConstPtr;
+
+} // end namespace
+
+#endif
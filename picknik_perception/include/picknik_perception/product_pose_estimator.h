@@ -0,0 +1,171 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Estimate product poses by registering segmented clouds against cached product models
+*/
+
+#ifndef PICKNIK_PERCEPTION_PRODUCT_POSE_ESTIMATOR_
+#define PICKNIK_PERCEPTION_PRODUCT_POSE_ESTIMATOR_
+
+#include <limits>
+#include <map>
+#include <string>
+
+// ROS
+#include <ros/ros.h>
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace picknik_perception
+{
+
+/**
+ * \brief Downsampled model of one product, built once and kept resident
+ */
+struct ProductModel
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  std::string name_;
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_;
+  pcl::search::KdTree<pcl::PointXYZ>::Ptr tree_;
+
+  // Centroid and principal axes (columns, right handed) in the model frame, used for coarse alignment
+  Eigen::Vector3f centroid_;
+  Eigen::Matrix3f axes_;
+};
+typedef boost::shared_ptr<ProductModel> ProductModelPtr;
+typedef boost::shared_ptr<const ProductModel> ProductModelConstPtr;
+
+/**
+ * \brief Result of registering a cloud against one product
+ */
+struct PoseEstimate
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  PoseEstimate()
+    : pose_(Eigen::Affine3d::Identity())
+    , fitness_(std::numeric_limits<double>::max())
+    , converged_(false)
+  {
+  }
+
+  // Pose of the product model in the frame of the input cloud
+  Eigen::Affine3d pose_;
+
+  // Mean squared distance from the input points to the model
+  double fitness_;
+  bool converged_;
+};
+
+class ProductPoseEstimator
+{
+public:
+  typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+  /**
+   * \brief Constructor
+   * \param model_leaf_size - voxel size used to downsample the product models and input clouds
+   * \param max_correspondence_distance - ICP correspondence rejection distance
+   * \param max_iterations - ICP iterations per hypothesis
+   */
+  ProductPoseEstimator(double model_leaf_size, double max_correspondence_distance, int max_iterations);
+
+  /**
+   * \brief Load every product found in a folder such as picknik_main/meshes/products.
+   *        A pcd in a product folder is used as is, otherwise collision.stl is sampled
+   * \return number of products loaded
+   */
+  std::size_t loadProducts(const std::string& products_path);
+
+  /**
+   * \brief Load a single product model
+   * \return true on success
+   */
+  bool loadProduct(const std::string& name, const std::string& product_path);
+
+  /**
+   * \brief Check if a model exists for a product
+   */
+  bool hasProduct(const std::string& name) const;
+
+  /**
+   * \brief Register a segmented cloud against a product. Coarse PCA alignment hypotheses are each refined
+   *        with ICP in parallel and the best fit is returned
+   * \param name - product to look for
+   * \param cloud - segmented product points
+   * \param estimate - resulting pose in the frame of the cloud
+   * \return true if any hypothesis converged
+   */
+  bool estimatePose(const std::string& name, const Cloud& cloud, PoseEstimate& estimate) const;
+
+private:
+  /**
+   * \brief Downsample, compute principal axes and build the KD-tree of a model
+   */
+  bool finalizeModel(const ProductModelPtr& model) const;
+
+  /**
+   * \brief Centroid and right handed principal axes of a cloud
+   */
+  static void computePrincipalAxes(const pcl::PointCloud<pcl::PointXYZ>& cloud, Eigen::Vector3f& centroid,
+                                   Eigen::Matrix3f& axes);
+
+  double model_leaf_size_;
+  double max_correspondence_distance_;
+  int max_iterations_;
+
+  std::map<std::string, ProductModelPtr> models_;
+
+}; // class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ProductPoseEstimator> ProductPoseEstimatorPtr;
+typedef boost::shared_ptr<const ProductPoseEstimator> ProductPoseEstimatorConstPtr;
+
+} // end namespace
+
+#endif
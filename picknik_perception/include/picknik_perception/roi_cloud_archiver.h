@@ -0,0 +1,158 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Archives region of interest point clouds to disk on a background thread
+*/
+
+#ifndef PICKNIK_PERCEPTION_ROI_CLOUD_ARCHIVER_
+#define PICKNIK_PERCEPTION_ROI_CLOUD_ARCHIVER_
+
+#include <deque>
+#include <string>
+
+// ROS
+#include <ros/ros.h>
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace picknik_perception
+{
+
+class RoiCloudArchiver
+{
+public:
+  typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+  /**
+   * \brief Constructor
+   * \param save_directory - folder to write pcd files into, created if missing
+   * \param quota_bytes - oldest archived files are deleted once the folder exceeds this size, 0 to disable
+   * \param max_queue_size - clouds waiting to be written, the oldest is dropped when full
+   */
+  RoiCloudArchiver(const std::string& save_directory, std::size_t quota_bytes, std::size_t max_queue_size);
+
+  /**
+   * \brief Flushes remaining clouds and stops the writer thread
+   */
+  ~RoiCloudArchiver();
+
+  /**
+   * \brief Queue a copy of the cloud for writing. Does not touch the disk.
+   * \param cloud - cloud to archive, may be modified by the caller after this returns
+   * \return false if an older queued cloud had to be dropped to make room
+   */
+  bool archive(const Cloud& cloud);
+
+  /**
+   * \brief Block until every queued cloud has been written
+   */
+  void waitUntilEmpty();
+
+  /**
+   * \brief Create an archiver for picknik_perception/data/roi_pcds
+   */
+  static boost::shared_ptr<RoiCloudArchiver> createDefault(std::size_t quota_bytes = 0,
+                                                           std::size_t max_queue_size = 4);
+
+private:
+  struct ArchivedFile
+  {
+    std::string path_;
+    std::size_t size_;
+  };
+
+  /**
+   * \brief Find the existing archive size and next file id, only done once at startup
+   */
+  void scanSaveDirectory();
+
+  /**
+   * \brief Delete the oldest files until the archive fits within the quota
+   */
+  void enforceQuota();
+
+  /**
+   * \brief Writer thread
+   */
+  void writeLoop();
+
+  /**
+   * \brief Remove NaNs and save one cloud as binary compressed pcd
+   */
+  void writeCloud(const Cloud& cloud, std::size_t id, const ros::WallTime& stamp);
+
+  std::string save_directory_;
+  std::size_t quota_bytes_;
+  std::size_t max_queue_size_;
+
+  // Next unique identifier for a file
+  std::size_t next_id_;
+
+  // Files on disk, oldest first, and their total size
+  std::deque<ArchivedFile> archived_files_;
+  std::size_t archived_bytes_;
+
+  // Clouds waiting to be written
+  struct QueuedCloud
+  {
+    boost::shared_ptr<Cloud> cloud_;
+    std::size_t id_;
+    ros::WallTime stamp_;
+  };
+  std::deque<QueuedCloud> queue_;
+  bool writing_;
+  bool shutdown_;
+
+  boost::mutex queue_mutex_;
+  boost::condition_variable queue_changed_;
+  boost::thread writer_thread_;
+
+}; // class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<RoiCloudArchiver> RoiCloudArchiverPtr;
+typedef boost::shared_ptr<const RoiCloudArchiver> RoiCloudArchiverConstPtr;
+
+} // end namespace
+
+#endif
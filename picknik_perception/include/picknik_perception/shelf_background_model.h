@@ -0,0 +1,164 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Voxel occupancy model of the empty shelf, used to remove shelf points from product clouds
+*/
+
+#ifndef PICKNIK_PERCEPTION_SHELF_BACKGROUND_MODEL_
+#define PICKNIK_PERCEPTION_SHELF_BACKGROUND_MODEL_
+
+#include <string>
+#include <vector>
+
+// ROS
+#include <ros/ros.h>
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace picknik_perception
+{
+
+class ShelfBackgroundModel
+{
+public:
+  typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+  /**
+   * \brief Constructor
+   * \param min_corner - lower corner of the modelled volume in the world frame
+   * \param max_corner - upper corner of the modelled volume in the world frame
+   * \param resolution - edge length of one voxel
+   * \param inflation - number of voxels to grow every occupied voxel by, absorbs calibration and sensor noise
+   */
+  ShelfBackgroundModel(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner,
+                       double resolution, int inflation);
+
+  /**
+   * \brief Build a model from the background_* parameters, from either the computer vision shelf mesh
+   *        placed at collision_shelf_transform or an empty shelf scan
+   * \param nh - namespace of the parameters
+   * \param min_corner - lower corner of the modelled volume in the world frame
+   * \param max_corner - upper corner of the modelled volume in the world frame
+   * \return empty pointer on failure
+   */
+  static boost::shared_ptr<ShelfBackgroundModel> loadFromParameters(ros::NodeHandle nh,
+                                                                    const Eigen::Vector3d& min_corner,
+                                                                    const Eigen::Vector3d& max_corner);
+
+  /**
+   * \brief Mark the surface of a mesh as background
+   * \param resource - mesh to load, e.g. file:///.../meshes/computer_vision/shelf.stl
+   * \param pose - world pose of the mesh
+   * \return true on success
+   */
+  bool addMesh(const std::string& resource, const Eigen::Affine3d& pose);
+
+  /**
+   * \brief Mark every point of an empty shelf scan as background
+   * \param cloud - scan in the world frame
+   */
+  void addCloud(const Cloud& cloud);
+
+  /**
+   * \brief Load an empty shelf scan in the world frame from a pcd file
+   * \return true on success
+   */
+  bool addPCDFile(const std::string& file_path);
+
+  /**
+   * \brief Copy every point that does not fall in a background voxel
+   * \param input - cloud in the world frame
+   * \param output - foreground points
+   */
+  void removeBackground(const Cloud& input, Cloud& output) const;
+
+  /**
+   * \brief Check a single world point against the model
+   */
+  bool isBackground(double x, double y, double z) const;
+
+  /**
+   * \brief Number of voxels marked as background
+   */
+  std::size_t getOccupiedCount() const;
+
+  /**
+   * \brief Convert the pose convention of collision_shelf_transform (x, y, z, roll, pitch, yaw of the
+   *        computer vision frame) into the world pose of meshes/computer_vision/shelf.stl
+   */
+  static Eigen::Affine3d convertCollisionShelfTransform(const std::vector<double>& transform, double x_offset);
+
+private:
+  /**
+   * \brief Mark a world point and its inflated neighbors
+   */
+  void markPoint(const Eigen::Vector3d& point);
+
+  /**
+   * \brief Index of the voxel containing a point, false if outside of the model
+   */
+  bool getCell(double x, double y, double z, int& ix, int& iy, int& iz) const;
+
+  std::size_t getIndex(int ix, int iy, int iz) const
+  {
+    return (static_cast<std::size_t>(iz) * size_y_ + iy) * size_x_ + ix;
+  }
+
+  Eigen::Vector3d min_corner_;
+  double resolution_;
+  int inflation_;
+  int size_x_, size_y_, size_z_;
+
+  // One byte per voxel, non-zero for background
+  std::vector<unsigned char> occupied_;
+
+}; // class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ShelfBackgroundModel> ShelfBackgroundModelPtr;
+typedef boost::shared_ptr<const ShelfBackgroundModel> ShelfBackgroundModelConstPtr;
+
+} // end namespace
+
+#endif
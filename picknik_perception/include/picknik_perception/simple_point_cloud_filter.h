@@ -58,12 +58,19 @@
 // bounding_box
 #include <bounding_box/bounding_box.h>
 
+// PickNik
+#include <picknik_perception/roi_cloud_archiver.h>
+#include <picknik_perception/shelf_background_model.h>
+
 // boost
-#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace picknik_perception
 {
 
+typedef boost::function<void(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr&)> ProcessedCloudCallback;
+
 class SimplePointCloudFilter
 {
 public:
@@ -77,19 +84,42 @@ public:
   bool publishRegionOfInterest();
 
   /**
-   * \brief save the region of interest as a pcd file.
+   * \brief Queue the region of interest to be saved as a pcd file in the background
    */
-  static void saveRegionOfInterest(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud);
+  void saveRegionOfInterest(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud);
 
   /*
-   * \brief
+   * \brief Process an incoming cloud, skipped if the previous cloud or detectObjects() is still busy
    */
   void pointCloudCallback(const sensor_msgs::PointCloud2ConstPtr& msg);
 
   /*
-   * \brief
+   * \brief Crop a cloud already in the world frame into a new roi_cloud_, e.g. for offline replay.
+   *        Waits for any cloud or detectObjects() call in progress
    */
-  void processPointCloud(const sensor_msgs::PointCloud2ConstPtr& msg);
+  void processWorldCloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr& world_cloud);
+
+  /**
+   * \brief Called once with every newly processed region of interest cloud, from the subscriber thread.
+   *        The cloud is never modified after being handed over
+   */
+  void setProcessedCloudCallback(const ProcessedCloudCallback& callback);
+
+  /**
+   * \brief Remove points belonging to the empty shelf from every processed cloud
+   * \param model - background occupancy, or empty pointer to disable
+   */
+  void setBackgroundModel(const ShelfBackgroundModelConstPtr& model);
+
+  /**
+   * \brief Publish each processed cloud on ~roi_cloud. Disable when the owner does its own publishing
+   */
+  void enableRoiCloudPublishing(bool enable = true);
+
+  /**
+   * \brief Save the result of each detectObjects() call to data/roi_pcds
+   */
+  void enableRoiArchiving(bool enable = true);
 
   /**
    * \brief Processing of filtered point cloud
@@ -132,11 +162,12 @@ public:
   void getObjectPose(geometry_msgs::Pose &pose);
   Eigen::Affine3d& getObjectPose();
 
-  bool processing_;
-
-  // point clouds
+  // Latest cropped cloud. Replaced, never modified, by the point cloud callback
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr roi_cloud_;
 
+  // Result of the last detectObjects() call, not touched by the point cloud callback
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_cloud_;
+
   // Bounding box pose and dimensions
   bounding_box::BoundingBox bounding_box_;
   Eigen::Affine3d bbox_pose_;
@@ -145,6 +176,15 @@ public:
 
 private:
 
+  /*
+   * \brief Transform and crop a cloud into a new roi_cloud_. Caller must hold the processing lock
+   */
+  void processPointCloud(const sensor_msgs::PointCloud2ConstPtr& msg);
+
+  /*
+   * \brief Crop a cloud already in the world frame into a new roi_cloud_. Caller must hold the processing lock
+   */
+  void cropWorldCloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr& world_cloud);
 
   bool verbose_;
 
@@ -162,6 +202,16 @@ private:
 
   // Publish bin point cloud
   ros::Publisher roi_cloud_pub_;
+  bool publish_roi_cloud_;
+
+  // Held while a cloud is processed or objects are detected
+  boost::mutex processing_mutex_;
+
+  // Known shelf geometry subtracted after cropping
+  ShelfBackgroundModelConstPtr background_model_;
+
+  // Optional consumer of each processed cloud
+  ProcessedCloudCallback processed_cloud_callback_;
 
 
   double radius_of_outlier_removal_;
@@ -169,6 +219,10 @@ private:
   double mean_k_;
   double std_dev_thresh_;
 
+  // Writes region of interest clouds to disk without blocking perception
+  RoiCloudArchiverPtr roi_archiver_;
+  bool archive_roi_;
+
 }; // class
 
 // Create boost pointers for this class
@@ -8,6 +8,8 @@
 #include <rviz_visual_tools/rviz_visual_tools.h>
 #include <ros_param_utilities/ros_param_utilities.h>
 
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace picknik_perception
 {
@@ -21,24 +23,45 @@ private:
   ros::Publisher roi_cloud_pub_;
   rviz_visual_tools::RvizVisualToolsPtr visual_tools_;
 
-  SimplePointCloudFilter* filter_ptr_;
+  SimplePointCloudFilterPtr filter_ptr_;
+
+  // Most recent processed cloud, shared between the filter callback and the republish timer
+  boost::mutex latest_cloud_mutex_;
+  pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr latest_cloud_;
+  ros::WallTime latest_cloud_time_;
+
+  // Optionally resend the latest cloud when the input stream goes quiet
+  ros::WallTimer republish_timer_;
+  double republish_rate_;
 
 public:
   PreprocessingFilter()
     : nh_("~")
+    , republish_rate_(0.0)
   {
 
     visual_tools_.reset(new rviz_visual_tools::RvizVisualTools("base"));
     visual_tools_->deleteAllMarkers();
 
-    filter_ptr_ = new SimplePointCloudFilter(visual_tools_);
+    filter_ptr_.reset(new SimplePointCloudFilter(visual_tools_));
+
+    // Load parameters
+    const std::string parent_name = "cloud_preprocessor"; // for namespacing logging messages
+    std::string input_topic = "/xtion_left/depth_registered/points";
+    bool latch = true;
+    ros_param_utilities::getStringParameter(parent_name, nh_, "input_topic", input_topic);
+    ros_param_utilities::getBoolParameter(parent_name, nh_, "latch", latch);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "republish_rate", republish_rate_);
+
+    // publish aligned point cloud and bin point cloud. Latching gives late subscribers the last cloud
+    roi_cloud_pub_ = nh_.advertise<pcl::PointCloud<pcl::PointXYZRGB> >("roi_cloud", 1, latch);
 
-    // TODO: read from config file or pass as arg
-    pc_sub_ = nh_.subscribe("/xtion_left/depth_registered/points", 1, 
-                            &picknik_perception::SimplePointCloudFilter::pointCloudCallback, filter_ptr_);
+    // Each processed cloud is published exactly once from here, not by the filter itself
+    filter_ptr_->enableRoiCloudPublishing(false);
+    filter_ptr_->setProcessedCloudCallback(boost::bind(&PreprocessingFilter::processedCloudCallback, this, _1));
 
-    // publish aligned point cloud and bin point cloud
-    roi_cloud_pub_ = nh_.advertise<pcl::PointCloud<pcl::PointXYZRGB> >("roi_cloud",1);
+    pc_sub_ = nh_.subscribe(input_topic, 1, &picknik_perception::SimplePointCloudFilter::pointCloudCallback,
+                            filter_ptr_);
 
     // define region of interest
     // TODO: read from config file
@@ -54,19 +77,47 @@ public:
     // show region of interest and bounding box
     visual_tools_->publishWireframeCuboid(roi_pose, roi_depth, roi_width, roi_height, rviz_visual_tools::CYAN);
 
+    if (republish_rate_ > 0)
+    {
+      republish_timer_ = nh_.createWallTimer(ros::WallDuration(1.0 / republish_rate_),
+                                             &PreprocessingFilter::republishCallback, this);
+    }
+
     ROS_DEBUG_STREAM_NAMED("PC_preprocess","trimming point cloud down to region of interest...");
+  }
 
-    std::size_t id;
-    while (ros::ok())
+  /**
+   * \brief Publish a newly processed cloud once
+   */
+  void processedCloudCallback(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr& cloud)
+  {
+    {
+      boost::mutex::scoped_lock lock(latest_cloud_mutex_);
+      latest_cloud_ = cloud;
+      latest_cloud_time_ = ros::WallTime::now();
+    }
+    roi_cloud_pub_.publish(cloud);
+  }
+
+  /**
+   * \brief Resend the last cloud at a fixed rate for late subscribers, only while no new clouds arrive
+   */
+  void republishCallback(const ros::WallTimerEvent&)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr cloud;
     {
-      if (!filter_ptr_->processing_)
-      {
-        filter_ptr_->roi_cloud_->header.seq = id++;
-        filter_ptr_->roi_cloud_->header.frame_id = "/world";
-        //      pc_filter_ptr_->roi_cloud_->header.stamp = ros::Time::now();        
-        roi_cloud_pub_.publish(filter_ptr_->roi_cloud_);
-      }
+      boost::mutex::scoped_lock lock(latest_cloud_mutex_);
+      if (!latest_cloud_ || (ros::WallTime::now() - latest_cloud_time_).toSec() < 1.0 / republish_rate_)
+        return;
+      cloud = latest_cloud_;
+      latest_cloud_time_ = ros::WallTime::now();
     }
+
+    if (roi_cloud_pub_.getNumSubscribers() == 0)
+      return;
+
+    ROS_DEBUG_STREAM_THROTTLE_NAMED(5.0, "PC_preprocess","Republishing latest region of interest cloud");
+    roi_cloud_pub_.publish(cloud);
   }
 }; // end class PreprocessingFilter
 
@@ -81,4 +132,5 @@ int main (int argc, char** argv)
 
   picknik_perception::PreprocessingFilter filter;
 
+  ros::waitForShutdown();
 }
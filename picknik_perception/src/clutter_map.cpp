@@ -0,0 +1,208 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Incremental octree map of everything inside the shelf, including objects no model exists for
+*/
+
+#include <picknik_perception/clutter_map.h>
+
+// Octomap
+#include <octomap_msgs/conversions.h>
+
+// ROS
+#include <ros/ros.h>
+
+// C++
+#include <cmath>
+
+namespace picknik_perception
+{
+
+ClutterMap::ClutterMap(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner, double resolution,
+                       double max_range)
+  : tree_(resolution)
+  , max_range_(max_range)
+{
+  tree_.setBBXMin(octomap::point3d(min_corner.x(), min_corner.y(), min_corner.z()));
+  tree_.setBBXMax(octomap::point3d(max_corner.x(), max_corner.y(), max_corner.z()));
+  tree_.useBBXLimit(true);
+
+  // Track which voxels flip state so only the differences need to be considered downstream
+  tree_.enableChangeDetection(true);
+}
+
+void ClutterMap::setProbabilities(double hit, double miss, double clamping_min, double clamping_max)
+{
+  tree_.setProbHit(hit);
+  tree_.setProbMiss(miss);
+  tree_.setClampingThresMin(clamping_min);
+  tree_.setClampingThresMax(clamping_max);
+}
+
+std::size_t ClutterMap::insertCloud(const Cloud& cloud, const Eigen::Vector3d& sensor_origin)
+{
+  const octomap::point3d origin(sensor_origin.x(), sensor_origin.y(), sensor_origin.z());
+
+  // Collapse the cloud to one ray per end voxel, dense clouds hit the same voxel many times
+  octomap::KeySet occupied_cells;
+  octomap::KeySet clipped_ends;
+  for (std::size_t i = 0; i < cloud.size(); ++i)
+  {
+    const pcl::PointXYZ& pt = cloud.points[i];
+    if (!pcl_isfinite(pt.x) || !pcl_isfinite(pt.y) || !pcl_isfinite(pt.z))
+      continue;
+
+    octomap::point3d end(pt.x, pt.y, pt.z);
+    const double range = (end - origin).norm();
+    if (max_range_ > 0 && range > max_range_)
+    {
+      // Too far to trust as a hit, only clear space up to max range
+      end = origin + (end - origin) * (max_range_ / range);
+      octomap::OcTreeKey key;
+      if (tree_.coordToKeyChecked(end, key))
+        clipped_ends.insert(key);
+      continue;
+    }
+
+    octomap::OcTreeKey key;
+    if (tree_.coordToKeyChecked(end, key) && tree_.inBBX(key))
+      occupied_cells.insert(key);
+  }
+
+  // Space between the sensor and every end voxel is free
+  octomap::KeySet free_cells;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    const octomap::KeySet& ends = pass == 0 ? occupied_cells : clipped_ends;
+    for (octomap::KeySet::const_iterator it = ends.begin(); it != ends.end(); ++it)
+    {
+      if (!tree_.computeRayKeys(origin, tree_.keyToCoord(*it), key_ray_))
+        continue;
+      for (octomap::KeyRay::iterator ray_it = key_ray_.begin(); ray_it != key_ray_.end(); ++ray_it)
+      {
+        if (tree_.inBBX(*ray_it))
+          free_cells.insert(*ray_it);
+      }
+      if (pass == 1 && tree_.inBBX(*it))
+        free_cells.insert(*it);
+    }
+  }
+
+  // Update only the voxels that are not already clamped to the state they are being pushed towards
+  const float clamping_min = tree_.getClampingThresMinLog();
+  const float clamping_max = tree_.getClampingThresMaxLog();
+  std::size_t num_updates = 0;
+  for (octomap::KeySet::const_iterator it = free_cells.begin(); it != free_cells.end(); ++it)
+  {
+    if (occupied_cells.find(*it) != occupied_cells.end())
+      continue;
+    const octomap::OcTreeNode* node = tree_.search(*it);
+    if (node && node->getLogOdds() <= clamping_min)
+      continue;
+    tree_.updateNode(*it, false, true);
+    ++num_updates;
+  }
+  for (octomap::KeySet::const_iterator it = occupied_cells.begin(); it != occupied_cells.end(); ++it)
+  {
+    const octomap::OcTreeNode* node = tree_.search(*it);
+    if (node && node->getLogOdds() >= clamping_max)
+      continue;
+    tree_.updateNode(*it, true, true);
+    ++num_updates;
+  }
+
+  // Lazy updates above skipped inner node occupancy
+  if (num_updates)
+    tree_.updateInnerOccupancy();
+
+  ROS_DEBUG_STREAM_NAMED("clutter_map","Inserted " << cloud.size() << " points as " << occupied_cells.size()
+                         << " hits, updated " << num_updates << " of " << free_cells.size() + occupied_cells.size()
+                         << " voxels, " << tree_.numChangesDetected() << " changed");
+
+  return tree_.numChangesDetected();
+}
+
+std::size_t ClutterMap::clearBox(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner)
+{
+  octomap::OcTreeKey min_key;
+  octomap::OcTreeKey max_key;
+  if (!tree_.coordToKeyChecked(octomap::point3d(min_corner.x(), min_corner.y(), min_corner.z()), min_key) ||
+      !tree_.coordToKeyChecked(octomap::point3d(max_corner.x(), max_corner.y(), max_corner.z()), max_key))
+    return 0;
+
+  const float clamping_min = tree_.getClampingThresMinLog();
+  std::size_t num_cleared = 0;
+  octomap::OcTreeKey key;
+  for (key[0] = min_key[0]; key[0] <= max_key[0]; ++key[0])
+    for (key[1] = min_key[1]; key[1] <= max_key[1]; ++key[1])
+      for (key[2] = min_key[2]; key[2] <= max_key[2]; ++key[2])
+      {
+        // Unknown voxels are already free for planning
+        const octomap::OcTreeNode* node = tree_.search(key);
+        if (!node || node->getLogOdds() <= clamping_min)
+          continue;
+        tree_.setNodeValue(key, clamping_min, true);
+        ++num_cleared;
+      }
+
+  if (num_cleared)
+    tree_.updateInnerOccupancy();
+  return num_cleared;
+}
+
+std::size_t ClutterMap::getChangedCount() const
+{
+  return tree_.numChangesDetected();
+}
+
+void ClutterMap::resetChanges()
+{
+  tree_.resetChangeDetection();
+}
+
+void ClutterMap::clear()
+{
+  tree_.clear();
+  tree_.resetChangeDetection();
+}
+
+bool ClutterMap::writeMsg(octomap_msgs::Octomap& msg)
+{
+  // Collapse uniform regions, later updates expand them again where needed
+  tree_.prune();
+  return octomap_msgs::binaryMapToMsg(tree_, msg);
+}
+
+} // end namespace
@@ -0,0 +1,322 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Maps clutter in the shelf from the camera clouds and sends it to the planning scene
+*/
+
+#include <picknik_perception/clutter_map.h>
+#include <picknik_perception/point_cloud_filter.h>
+#include <picknik_perception/shelf_background_model.h>
+
+// ROS
+#include <ros/ros.h>
+#include <tf/transform_listener.h>
+#include <tf_conversions/tf_eigen.h>
+#include <pcl_ros/transforms.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <moveit_msgs/PlanningScene.h>
+#include <moveit/robot_model_loader/robot_model_loader.h>
+
+// PickNik Msgs
+#include <picknik_msgs/FindObjectsActionGoal.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+namespace picknik_perception
+{
+
+class ClutterMapper
+{
+public:
+  ClutterMapper()
+    : nh_("~")
+    , map_frame_("/world")
+    , publish_period_(0.5)
+    , target_bin_padding_(0.02)
+    , has_target_bin_(false)
+  {
+    // Load parameters
+    const std::string parent_name = "clutter_mapper"; // for namespacing logging messages
+    std::vector<std::string> input_topics;
+    input_topics.push_back("/xtion_left/depth_registered/points");
+    input_topics.push_back("/xtion_right/depth_registered/points");
+    double resolution = 0.02;
+    double max_range = 2.5;
+    double publish_rate = 2.0;
+    double prob_hit = 0.7;
+    double prob_miss = 0.4;
+    double clamping_min = 0.12;
+    double clamping_max = 0.97;
+    std::vector<double> shelf_min_corner;
+    std::vector<double> shelf_max_corner;
+    bool use_background_subtraction = true;
+    double link_scale = 1.0;
+    double link_padding = 0.02;
+    std::string perception_goal_topic = "/perception/recognize_objects/goal";
+    if (!nh_.getParam("input_topics", input_topics))
+      ROS_WARN_STREAM_NAMED("clutter_mapper","Missing parameter input_topics, using both cameras");
+    ros_param_utilities::getStringParameter(parent_name, nh_, "map_frame", map_frame_);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "resolution", resolution);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "max_range", max_range);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "publish_rate", publish_rate);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "prob_hit", prob_hit);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "prob_miss", prob_miss);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "clamping_min", clamping_min);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "clamping_max", clamping_max);
+    ros_param_utilities::getDoubleParameters(parent_name, nh_, "shelf_min_corner", shelf_min_corner);
+    ros_param_utilities::getDoubleParameters(parent_name, nh_, "shelf_max_corner", shelf_max_corner);
+    ros_param_utilities::getBoolParameter(parent_name, nh_, "use_background_subtraction", use_background_subtraction);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "link_scale", link_scale);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "link_padding", link_padding);
+    ros_param_utilities::getStringParameter(parent_name, nh_, "perception_goal_topic", perception_goal_topic);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "target_bin_padding", target_bin_padding_);
+
+    // Optional subset of links to filter, all links with collision geometry otherwise
+    std::vector<std::string> link_names;
+    nh_.getParam("links", link_names);
+
+    if (shelf_min_corner.size() != 3 || shelf_max_corner.size() != 3)
+    {
+      ROS_ERROR_STREAM_NAMED("clutter_mapper","shelf_min_corner and shelf_max_corner need 3 values each");
+      return;
+    }
+    if (publish_rate > 0)
+      publish_period_ = 1.0 / publish_rate;
+
+    map_.reset(new ClutterMap(Eigen::Vector3d(shelf_min_corner[0], shelf_min_corner[1], shelf_min_corner[2]),
+                              Eigen::Vector3d(shelf_max_corner[0], shelf_max_corner[1], shelf_max_corner[2]),
+                              resolution, max_range));
+    map_->setProbabilities(prob_hit, prob_miss, clamping_min, clamping_max);
+
+    // The arm is in the planning scene already, and would block every motion near the shelf if mapped
+    tf_listener_.reset(new tf::TransformListener());
+    self_filter_.reset(new PointCloudFilter(tf_listener_, map_frame_));
+    self_filter_->initialize();
+    robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+    robot_model::RobotModelConstPtr robot_model = robot_model_loader.getModel();
+    if (!robot_model)
+    {
+      ROS_ERROR_STREAM_NAMED("clutter_mapper","Unable to load robot model, not mapping");
+      return;
+    }
+    self_filter_->excludeRobotLinks(robot_model, link_names, link_scale, link_padding);
+
+    // The shelf is in the planning scene as a mesh already
+    if (use_background_subtraction)
+    {
+      background_model_ = ShelfBackgroundModel::loadFromParameters(
+        nh_, Eigen::Vector3d(shelf_min_corner[0], shelf_min_corner[1], shelf_min_corner[2]),
+        Eigen::Vector3d(shelf_max_corner[0], shelf_max_corner[1], shelf_max_corner[2]));
+      if (!background_model_)
+      {
+        ROS_ERROR_STREAM_NAMED("clutter_mapper","Unable to load background model, not mapping");
+        return;
+      }
+    }
+
+    // Products in the bin being picked are modelled by perception, not as clutter
+    perception_goal_sub_ = nh_.subscribe(perception_goal_topic, 1, &ClutterMapper::perceptionGoalCallback, this);
+
+    // The whole map is applied on top of the scene kept by the manipulation pipeline
+    scene_diff_pub_ = nh_.advertise<moveit_msgs::PlanningScene>("planning_scene_diff", 1);
+    // One subscriber per camera, so each cloud is raycast from the camera that took it
+    for (std::size_t i = 0; i < input_topics.size(); ++i)
+    {
+      cloud_subs_.push_back(nh_.subscribe(input_topics[i], 1, &ClutterMapper::cloudCallback, this));
+      ROS_INFO_STREAM_NAMED("clutter_mapper","Mapping clutter from " << input_topics[i] << " at " << resolution
+                            << " m resolution");
+    }
+  }
+
+  void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr& msg)
+  {
+    ros::WallTime start = ros::WallTime::now();
+
+    // Sensor pose at the time of the cloud, every input is a single camera's cloud in its own frame
+    const std::string& sensor_frame = msg->header.frame_id;
+    tf::StampedTransform map_to_sensor;
+    try
+    {
+      tf_listener_->waitForTransform(map_frame_, sensor_frame, msg->header.stamp, ros::Duration(1.0));
+      tf_listener_->lookupTransform(map_frame_, sensor_frame, msg->header.stamp, map_to_sensor);
+    }
+    catch (tf::TransformException& ex)
+    {
+      ROS_ERROR_STREAM_THROTTLE_NAMED(1.0, "clutter_mapper","TF error: " << ex.what());
+      return;
+    }
+    Eigen::Vector3d sensor_origin;
+    tf::vectorTFToEigen(map_to_sensor.getOrigin(), sensor_origin);
+
+    // Remove the robot
+    sensor_msgs::PointCloud2 self_filtered_msg;
+    if (!self_filter_->filter(*msg, self_filtered_msg))
+      return;
+
+    // Bring the cloud into the map frame
+    ClutterMap::Cloud cloud;
+    pcl::fromROSMsg(self_filtered_msg, cloud);
+    ClutterMap::Cloud map_cloud;
+    if (!pcl_ros::transformPointCloud(map_frame_, cloud, map_cloud, *tf_listener_))
+    {
+      ROS_ERROR_STREAM_THROTTLE_NAMED(1.0, "clutter_mapper","Unable to transform cloud into " << map_frame_);
+      return;
+    }
+
+    // Remove the shelf and the bin being picked from
+    ClutterMap::Cloud clutter_cloud;
+    clutter_cloud.reserve(map_cloud.size());
+    for (std::size_t i = 0; i < map_cloud.size(); ++i)
+    {
+      const pcl::PointXYZ& pt = map_cloud.points[i];
+      if (background_model_ && background_model_->isBackground(pt.x, pt.y, pt.z))
+        continue;
+      if (has_target_bin_ && isInTargetBin(pt))
+        continue;
+      clutter_cloud.push_back(pt);
+    }
+
+    const std::size_t num_changed = map_->insertCloud(clutter_cloud, sensor_origin);
+
+    ROS_DEBUG_STREAM_NAMED("clutter_mapper","Updated map in " << (ros::WallTime::now() - start).toSec() * 1000.0
+                           << " ms, " << num_changed << " voxels changed");
+
+    // Send nothing while the scene is static
+    if (num_changed == 0 || (ros::WallTime::now() - last_publish_time_).toSec() < publish_period_)
+      return;
+
+    publishMap(msg->header.stamp);
+  }
+
+  /**
+   * \brief Remember the bin perception was asked about, and forget any clutter mapped in it
+   */
+  void perceptionGoalCallback(const picknik_msgs::FindObjectsActionGoal::ConstPtr& msg)
+  {
+    const picknik_msgs::FindObjectsGoal& goal = msg->goal;
+    if (goal.bin_dimensions.dimensions.size() < 3)
+    {
+      ROS_WARN_STREAM_NAMED("clutter_mapper","Perception goal for " << goal.bin_name << " has no bin dimensions");
+      return;
+    }
+
+    // Same axis aligned region the perception server crops to
+    const Eigen::Vector3d centroid(goal.bin_centroid.position.x, goal.bin_centroid.position.y,
+                                   goal.bin_centroid.position.z);
+    const Eigen::Vector3d half_size(goal.bin_dimensions.dimensions[0] / 2.0 + target_bin_padding_,
+                                    goal.bin_dimensions.dimensions[1] / 2.0 + target_bin_padding_,
+                                    goal.bin_dimensions.dimensions[2] / 2.0 + target_bin_padding_);
+    target_bin_min_ = centroid - half_size;
+    target_bin_max_ = centroid + half_size;
+    has_target_bin_ = true;
+
+    const std::size_t num_cleared = map_->clearBox(target_bin_min_, target_bin_max_);
+    ROS_INFO_STREAM_NAMED("clutter_mapper","Leaving " << goal.bin_name << " to perception, cleared "
+                          << num_cleared << " voxels");
+    if (num_cleared)
+      publishMap(ros::Time::now());
+  }
+
+  bool isInTargetBin(const pcl::PointXYZ& pt) const
+  {
+    return pt.x >= target_bin_min_.x() && pt.x <= target_bin_max_.x() &&
+           pt.y >= target_bin_min_.y() && pt.y <= target_bin_max_.y() &&
+           pt.z >= target_bin_min_.z() && pt.z <= target_bin_max_.z();
+  }
+
+  /**
+   * \brief Send the world octomap as a planning scene diff, leaving everything else untouched.
+   *        The planning scene replaces its octomap as a whole, so the full map is sent, but only
+   *        after voxels changed
+   */
+  void publishMap(const ros::Time& stamp)
+  {
+    moveit_msgs::PlanningScene scene_diff;
+    scene_diff.is_diff = true;
+    scene_diff.robot_state.is_diff = true;
+    scene_diff.world.octomap.header.frame_id = map_frame_;
+    scene_diff.world.octomap.header.stamp = stamp;
+    scene_diff.world.octomap.origin.orientation.w = 1.0;
+    if (!map_->writeMsg(scene_diff.world.octomap.octomap))
+    {
+      ROS_ERROR_STREAM_NAMED("clutter_mapper","Unable to serialize clutter map");
+      return;
+    }
+    scene_diff.world.octomap.octomap.header = scene_diff.world.octomap.header;
+
+    ROS_DEBUG_STREAM_NAMED("clutter_mapper","Publishing whole map of " << scene_diff.world.octomap.octomap.data.size()
+                           << " bytes, " << map_->getChangedCount() << " voxels changed");
+
+    scene_diff_pub_.publish(scene_diff);
+    map_->resetChanges();
+    last_publish_time_ = ros::WallTime::now();
+  }
+
+private:
+  ros::NodeHandle nh_;
+  std::vector<ros::Subscriber> cloud_subs_;
+  ros::Subscriber perception_goal_sub_;
+  ros::Publisher scene_diff_pub_;
+  boost::shared_ptr<tf::TransformListener> tf_listener_;
+
+  ClutterMapPtr map_;
+
+  // Input filtering
+  PointCloudFilterPtr self_filter_;
+  ShelfBackgroundModelConstPtr background_model_;
+
+  // Bin perception was last asked about, not mapped
+  double target_bin_padding_;
+  bool has_target_bin_;
+  Eigen::Vector3d target_bin_min_;
+  Eigen::Vector3d target_bin_max_;
+
+  std::string map_frame_;
+  double publish_period_;
+  ros::WallTime last_publish_time_;
+}; // end class ClutterMapper
+
+} // end namespace picknik_perception
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "clutter_mapper");
+
+  picknik_perception::ClutterMapper mapper;
+
+  ros::spin();
+}
@@ -77,39 +77,29 @@ int main(int argc, char** argv)
   // Main loop
   while (ros::ok())
   {
-    if (client->resetIsNeeded())
-      break;
-
-    // Check if goal is recieved
+    // Block until a goal is recieved
     picknik_msgs::FindObjectsGoalConstPtr goal;
-    if (!client->isReadyToStartPerception(goal))
+    if (!client->waitForStartPerception(goal))
     {
-      ros::Duration(0.1).sleep();
+      // Check if cancel is desired
+      if (client->resetIsNeeded())
+        break;
       continue; // loop again
     }
 
     ROS_INFO_STREAM_NAMED("fake_perception_server","Starting perception, waiting for stop command");
 
-    while (ros::ok())
-    {
-      // Do perception processing HERE
-
-      // Wait until camera is done moving
-      if (client->isReadyToStopPerception())
-        break;
+    // Do perception processing HERE
 
+    // Wait until camera is done moving
+    if (!client->waitForStopPerception())
+    {
       // Check if cancel is desired
       if (client->resetIsNeeded())
         break;
-
-      // Wait
-      ros::Duration(0.1).sleep();
+      continue;
     }
 
-    // Check if cancel is desired
-    if (client->resetIsNeeded())
-      break;
-
     // Finish up perception
     ROS_INFO_STREAM_NAMED("fake_perception_server","Finishing up perception");
     // TODO
@@ -44,7 +44,10 @@ namespace picknik_perception
 ManipulationInterface::ManipulationInterface()
   : action_server_("perception/recognize_objects", false) // Load the action server
 {
-  initialize();
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    initialize();
+  }
 
   // Register the goal and feeback callbacks.
   action_server_.registerGoalCallback(boost::bind(&ManipulationInterface::goalCallback, this));
@@ -62,10 +65,14 @@ ManipulationInterface::ManipulationInterface()
 
 bool ManipulationInterface::resetIsNeeded()
 {
+  boost::mutex::scoped_lock lock(state_mutex_);
   if (reset_perception_)
   {
     ROS_WARN_STREAM_NAMED("manipulation_interface","Reset of perception pipeline requested");
     reset_perception_ = false;
+
+    // Let resetPerception() know the pipeline has seen the request
+    state_changed_.notify_all();
     return true;
   }
   return false;
@@ -73,17 +80,21 @@ bool ManipulationInterface::resetIsNeeded()
 
 bool ManipulationInterface::isReadyToStartPerception(picknik_msgs::FindObjectsGoalConstPtr& goal)
 {
-  if (perception_running_)
   {
-    // Accept the new goal
-    goal = action_server_.acceptNewGoal();
-    return true;
+    boost::mutex::scoped_lock lock(state_mutex_);
+    if (!perception_running_)
+      return false;
   }
-  return false;
+
+  // Accept the new goal. Never call into actionlib holding state_mutex_, goalCallback() takes them
+  // in the opposite order
+  goal = action_server_.acceptNewGoal();
+  return true;
 }
 
 bool ManipulationInterface::isReadyToStopPerception()
 {
+  boost::mutex::scoped_lock lock(state_mutex_);
   if (stop_perception_)
   {
     stop_perception_ = false;
@@ -92,24 +103,67 @@ bool ManipulationInterface::isReadyToStopPerception()
   return false;
 }
 
-bool ManipulationInterface::sendPerceptionResults(picknik_msgs::FindObjectsResult &result)
+bool ManipulationInterface::waitForStartPerception(picknik_msgs::FindObjectsGoalConstPtr& goal, double timeout)
 {
-  ROS_INFO_STREAM_NAMED("manipulation_interface","Returning result back to manipulation pipeline");
-
-  // Error check
-  if (stop_perception_)
   {
-    ROS_ERROR_STREAM_NAMED("manipulation_interface","Perception is commanded to stop but this value has not been checked, unable to send results");
+    boost::mutex::scoped_lock lock(state_mutex_);
+    if (!waitForFlag(lock, perception_running_, timeout))
+      return false;
+  }
+
+  // Accept the new goal, outside of state_mutex_ like isReadyToStartPerception()
+  goal = action_server_.acceptNewGoal();
+  return true;
+}
+
+bool ManipulationInterface::waitForStopPerception(double timeout)
+{
+  boost::mutex::scoped_lock lock(state_mutex_);
+  if (!waitForFlag(lock, stop_perception_, timeout))
     return false;
+
+  stop_perception_ = false;
+  return true;
+}
+
+bool ManipulationInterface::waitForFlag(boost::mutex::scoped_lock& lock, const bool& flag, double timeout)
+{
+  const ros::WallTime end_time = ros::WallTime::now() + ros::WallDuration(timeout < 0 ? 0 : timeout);
+
+  // Flags are only changed with state_changed_ notified, the bounded wait is just to notice ROS shutting down
+  static const boost::posix_time::milliseconds SHUTDOWN_CHECK_PERIOD(500);
+  while (!flag && !reset_perception_ && ros::ok())
+  {
+    if (timeout >= 0 && ros::WallTime::now() >= end_time)
+      return false;
+    state_changed_.timed_wait(lock, SHUTDOWN_CHECK_PERIOD);
   }
-  if (!perception_running_)
+  return flag && !reset_perception_;
+}
+
+bool ManipulationInterface::sendPerceptionResults(picknik_msgs::FindObjectsResult &result)
+{
+  ROS_INFO_STREAM_NAMED("manipulation_interface","Returning result back to manipulation pipeline");
+
   {
-    ROS_ERROR_STREAM_NAMED("manipulation_interface","Perception is not running, unable to send results");
-    return false;
+    boost::mutex::scoped_lock lock(state_mutex_);
+
+    // Error check
+    if (stop_perception_)
+    {
+      ROS_ERROR_STREAM_NAMED("manipulation_interface","Perception is commanded to stop but this value has not been checked, unable to send results");
+      return false;
+    }
+    if (!perception_running_)
+    {
+      ROS_ERROR_STREAM_NAMED("manipulation_interface","Perception is not running, unable to send results");
+      return false;
+    }
+    perception_running_ = false;
+    state_changed_.notify_all();
   }
-  perception_running_ = false;
 
-  // Mark action as completed
+  // Mark action as completed, outside of state_mutex_ so a goal arriving now cannot deadlock
   action_server_.setSucceeded(result);
   return true;
 }
@@ -118,6 +172,8 @@ void ManipulationInterface::goalCallback()
 {
   ROS_INFO_STREAM_NAMED("manipulation_interface","Recieved request to start perception");
 
+  boost::mutex::scoped_lock lock(state_mutex_);
+
   // Error check
   if (stop_perception_)
   {
@@ -126,10 +182,13 @@ void ManipulationInterface::goalCallback()
   }
 
   perception_running_ = true;
+  state_changed_.notify_all();
 }
 
 bool ManipulationInterface::stopPerception(picknik_msgs::StopPerception::Request&, picknik_msgs::StopPerception::Response &res)
 {
+  boost::mutex::scoped_lock lock(state_mutex_);
+
   // Error check
   if (stop_perception_)
   {
@@ -141,25 +200,35 @@ bool ManipulationInterface::stopPerception(picknik_msgs::StopPerception::Request
   // Mark as stopped
   res.stopped = true;
   stop_perception_ = true;
+  state_changed_.notify_all();
   ROS_INFO_STREAM_NAMED("manipulation_inteface","Perception stop command has been recieved.");
   return true;
 }
 
 bool ManipulationInterface::resetPerception(picknik_msgs::StopPerception::Request&, picknik_msgs::StopPerception::Response &res)
 {  
-  // Reset state machine
-  initialize();
-  reset_perception_ = true;
-
   // Reset Action Server
   if (action_server_.isActive())
     action_server_.setAborted();
 
-  ros::Duration(0.1).sleep();
+  boost::mutex::scoped_lock lock(state_mutex_);
+
+  // Reset state machine and wake up the perception pipeline wherever it is waiting
+  initialize();
+  reset_perception_ = true;
+  state_changed_.notify_all();
+
+  // Wait for the pipeline to acknowledge with resetIsNeeded(), other notifications do not extend the wait
+  static const boost::posix_time::seconds RESET_TIMEOUT(5);
+  const boost::system_time deadline = boost::get_system_time() + RESET_TIMEOUT;
   while (reset_perception_ && ros::ok())
   {
     ROS_INFO_STREAM_NAMED("manipulation_interface","Waiting for perception pipeline to finish resetting");
-    ros::Duration(0.1).sleep();
+    if (!state_changed_.timed_wait(lock, deadline) && reset_perception_)
+    {
+      ROS_WARN_STREAM_NAMED("manipulation_interface","Perception pipeline did not acknowledge reset");
+      break;
+    }
   }
 
   res.stopped = true;
@@ -46,7 +46,6 @@
 #include <pcl_ros/transforms.h>
 #include <pcl/point_types.h>
 #include <pcl/filters/filter.h>
-#include <pcl/registration/icp.h>
 
 namespace picknik_perception
 {
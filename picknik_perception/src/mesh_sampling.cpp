@@ -0,0 +1,119 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Convert mesh resources into point clouds
+*/
+
+#include <picknik_perception/mesh_sampling.h>
+
+#include <algorithm>
+#include <cmath>
+
+// ROS
+#include <ros/ros.h>
+
+// Mesh loading
+#include <geometric_shapes/shapes.h>
+#include <geometric_shapes/shape_operations.h>
+
+// PCL
+#include <pcl/io/pcd_io.h>
+
+// Boost
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace picknik_perception
+{
+
+bool sampleMeshSurface(const std::string& resource, const Eigen::Affine3d& pose, double spacing,
+                       pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  boost::scoped_ptr<shapes::Mesh> mesh(shapes::createMeshFromResource(resource));
+  if (!mesh)
+  {
+    ROS_ERROR_STREAM_NAMED("mesh_sampling","Unable to load mesh " << resource);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < mesh->triangle_count; ++i)
+  {
+    const unsigned int* triangle = &mesh->triangles[3 * i];
+    const Eigen::Vector3d a = pose * Eigen::Vector3d(&mesh->vertices[3 * triangle[0]]);
+    const Eigen::Vector3d b = pose * Eigen::Vector3d(&mesh->vertices[3 * triangle[1]]);
+    const Eigen::Vector3d c = pose * Eigen::Vector3d(&mesh->vertices[3 * triangle[2]]);
+
+    const double longest_edge = std::max((b - a).norm(), std::max((c - a).norm(), (c - b).norm()));
+    const int samples = std::max(1, static_cast<int>(std::ceil(longest_edge / spacing)));
+
+    for (int u = 0; u <= samples; ++u)
+    {
+      for (int v = 0; v <= samples - u; ++v)
+      {
+        const Eigen::Vector3d point = a + (b - a) * (static_cast<double>(u) / samples) +
+                                      (c - a) * (static_cast<double>(v) / samples);
+        cloud.push_back(pcl::PointXYZ(point.x(), point.y(), point.z()));
+      }
+    }
+  }
+
+  ROS_DEBUG_STREAM_NAMED("mesh_sampling","Sampled " << mesh->triangle_count << " triangles of " << resource
+                         << ", cloud now has " << cloud.size() << " points");
+  return true;
+}
+
+bool loadProductModelCloud(const std::string& product_path, double spacing, pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  namespace fs = boost::filesystem;
+  cloud.clear();
+
+  // Prefer a scanned model if one exists
+  for (fs::directory_iterator iter(product_path), end_iter; iter != end_iter; ++iter)
+  {
+    if (iter->path().extension() == ".pcd" &&
+        pcl::io::loadPCDFile<pcl::PointXYZ>(iter->path().string(), cloud) == 0 && !cloud.empty())
+      return true;
+  }
+
+  const fs::path mesh_path = fs::path(product_path) / "collision.stl";
+  if (!fs::exists(mesh_path))
+  {
+    ROS_WARN_STREAM_NAMED("mesh_sampling","No model points in " << product_path);
+    return false;
+  }
+  return sampleMeshSurface("file://" + mesh_path.string(), Eigen::Affine3d::Identity(), spacing, cloud);
+}
+
+} // end namespace
@@ -0,0 +1,279 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Reduce product bounding meshes to a bounded number of triangles before they reach the planning scene
+*/
+
+#include <picknik_perception/mesh_simplification.h>
+
+// ROS
+#include <ros/ros.h>
+
+// PCL
+#include <pcl/point_types.h>
+#include <pcl/conversions.h>
+#include <pcl/surface/convex_hull.h>
+#include <pcl/surface/vtk_smoothing/vtk_mesh_quadric_decimation.h>
+
+// Eigen
+#include <Eigen/Eigenvalues>
+
+// C++
+#include <limits>
+
+namespace picknik_perception
+{
+
+namespace
+{
+
+void meshToCloud(const shape_msgs::Mesh& mesh, pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  cloud.clear();
+  cloud.reserve(mesh.vertices.size());
+  for (std::size_t i = 0; i < mesh.vertices.size(); ++i)
+  {
+    const geometry_msgs::Point& vertex = mesh.vertices[i];
+    cloud.push_back(pcl::PointXYZ(vertex.x, vertex.y, vertex.z));
+  }
+}
+
+void polygonsToMesh(const pcl::PointCloud<pcl::PointXYZ>& cloud, const std::vector<pcl::Vertices>& polygons,
+                    shape_msgs::Mesh& mesh)
+{
+  mesh.vertices.resize(cloud.size());
+  for (std::size_t i = 0; i < cloud.size(); ++i)
+  {
+    mesh.vertices[i].x = cloud.points[i].x;
+    mesh.vertices[i].y = cloud.points[i].y;
+    mesh.vertices[i].z = cloud.points[i].z;
+  }
+
+  mesh.triangles.clear();
+  mesh.triangles.reserve(polygons.size());
+  for (std::size_t i = 0; i < polygons.size(); ++i)
+  {
+    // Fan out any polygon that is not already a triangle
+    const std::vector<uint32_t>& indices = polygons[i].vertices;
+    for (std::size_t j = 2; j < indices.size(); ++j)
+    {
+      shape_msgs::MeshTriangle triangle;
+      triangle.vertex_indices[0] = indices[0];
+      triangle.vertex_indices[1] = indices[j - 1];
+      triangle.vertex_indices[2] = indices[j];
+      mesh.triangles.push_back(triangle);
+    }
+  }
+}
+
+/**
+ * \brief Triangulated 3D convex hull of a set of points
+ */
+bool computeHull(const pcl::PointCloud<pcl::PointXYZ>::Ptr& points, pcl::PointCloud<pcl::PointXYZ>& hull,
+                 std::vector<pcl::Vertices>& polygons)
+{
+  // qhull needs a volume
+  if (points->size() < 4)
+    return false;
+
+  pcl::ConvexHull<pcl::PointXYZ> convex_hull;
+  convex_hull.setInputCloud(points);
+  convex_hull.setDimension(3);
+  convex_hull.reconstruct(hull, polygons);
+
+  return !polygons.empty() && convex_hull.getDimension() == 3;
+}
+
+bool computeConvexHull(const shape_msgs::Mesh& input, std::size_t max_triangles, shape_msgs::Mesh& output)
+{
+  pcl::PointCloud<pcl::PointXYZ>::Ptr points(new pcl::PointCloud<pcl::PointXYZ>());
+  meshToCloud(input, *points);
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr hull(new pcl::PointCloud<pcl::PointXYZ>());
+  std::vector<pcl::Vertices> polygons;
+  if (!computeHull(points, *hull, polygons))
+    return false;
+
+  if (max_triangles > 0 && polygons.size() > max_triangles)
+  {
+    // Quadric decimation of the hull surface to the triangle budget
+    pcl::PolygonMesh::Ptr hull_mesh(new pcl::PolygonMesh());
+    pcl::toPCLPointCloud2(*hull, hull_mesh->cloud);
+    hull_mesh->polygons = polygons;
+
+    pcl::PolygonMesh decimated;
+    pcl::MeshQuadricDecimationVTK decimation;
+    decimation.setInputMesh(hull_mesh);
+    decimation.setTargetReductionFactor(1.0f - static_cast<float>(max_triangles) / polygons.size());
+    decimation.process(decimated);
+
+    // Hull the remaining vertices again, decimation does not preserve convexity. A hull of V points has at
+    // most 2V - 4 triangles, which the decimated surface already had, so the budget still holds
+    pcl::PointCloud<pcl::PointXYZ>::Ptr decimated_points(new pcl::PointCloud<pcl::PointXYZ>());
+    pcl::fromPCLPointCloud2(decimated.cloud, *decimated_points);
+
+    pcl::PointCloud<pcl::PointXYZ> decimated_hull;
+    std::vector<pcl::Vertices> decimated_polygons;
+    if (computeHull(decimated_points, decimated_hull, decimated_polygons))
+    {
+      polygonsToMesh(decimated_hull, decimated_polygons, output);
+      return true;
+    }
+    ROS_WARN_STREAM_NAMED("mesh_simplification","Decimation degenerated the hull, keeping the full hull");
+  }
+
+  polygonsToMesh(*hull, polygons, output);
+  return true;
+}
+
+bool computeOrientedBox(const shape_msgs::Mesh& input, shape_msgs::Mesh& output)
+{
+  if (input.vertices.size() < 4)
+    return false;
+
+  // Principal axes of the vertices
+  Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+  for (std::size_t i = 0; i < input.vertices.size(); ++i)
+    centroid += Eigen::Vector3d(input.vertices[i].x, input.vertices[i].y, input.vertices[i].z);
+  centroid /= input.vertices.size();
+
+  Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+  for (std::size_t i = 0; i < input.vertices.size(); ++i)
+  {
+    const Eigen::Vector3d offset =
+        Eigen::Vector3d(input.vertices[i].x, input.vertices[i].y, input.vertices[i].z) - centroid;
+    covariance += offset * offset.transpose();
+  }
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+  const Eigen::Matrix3d axes = solver.eigenvectors();
+
+  // Extent along each axis
+  Eigen::Vector3d min_extent = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  Eigen::Vector3d max_extent = -min_extent;
+  for (std::size_t i = 0; i < input.vertices.size(); ++i)
+  {
+    const Eigen::Vector3d local = axes.transpose() *
+        (Eigen::Vector3d(input.vertices[i].x, input.vertices[i].y, input.vertices[i].z) - centroid);
+    min_extent = min_extent.cwiseMin(local);
+    max_extent = max_extent.cwiseMax(local);
+  }
+
+  // Corner i has bit 0, 1, 2 selecting the max extent along axis 0, 1, 2
+  output.vertices.resize(8);
+  for (std::size_t i = 0; i < 8; ++i)
+  {
+    const Eigen::Vector3d local((i & 1) ? max_extent.x() : min_extent.x(),
+                                (i & 2) ? max_extent.y() : min_extent.y(),
+                                (i & 4) ? max_extent.z() : min_extent.z());
+    const Eigen::Vector3d corner = centroid + axes * local;
+    output.vertices[i].x = corner.x();
+    output.vertices[i].y = corner.y();
+    output.vertices[i].z = corner.z();
+  }
+
+  // Two triangles per face, wound outwards for a right handed axes matrix
+  static const unsigned int FACES[12][3] = { { 0, 2, 1 }, { 1, 2, 3 },  // -z
+                                             { 4, 5, 6 }, { 5, 7, 6 },  // +z
+                                             { 0, 1, 4 }, { 1, 5, 4 },  // -y
+                                             { 2, 6, 3 }, { 3, 6, 7 },  // +y
+                                             { 0, 4, 2 }, { 2, 4, 6 },  // -x
+                                             { 1, 3, 5 }, { 3, 7, 5 } };  // +x
+  const bool flip = axes.determinant() < 0;
+  output.triangles.resize(12);
+  for (std::size_t i = 0; i < 12; ++i)
+  {
+    output.triangles[i].vertex_indices[0] = FACES[i][0];
+    output.triangles[i].vertex_indices[1] = flip ? FACES[i][2] : FACES[i][1];
+    output.triangles[i].vertex_indices[2] = flip ? FACES[i][1] : FACES[i][2];
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+bool parseMeshSimplificationMode(const std::string& name, MeshSimplificationMode& mode)
+{
+  if (name == "none")
+    mode = MESH_UNCHANGED;
+  else if (name == "hull")
+    mode = MESH_CONVEX_HULL;
+  else if (name == "box")
+    mode = MESH_ORIENTED_BOX;
+  else
+  {
+    ROS_ERROR_STREAM_NAMED("mesh_simplification","Unknown mesh simplification mode '" << name
+                           << "', expected none, hull or box");
+    return false;
+  }
+  return true;
+}
+
+bool simplifyMesh(const shape_msgs::Mesh& input, const MeshSimplificationSettings& settings,
+                  shape_msgs::Mesh& output)
+{
+  const std::size_t input_vertices = input.vertices.size();
+  const std::size_t input_triangles = input.triangles.size();
+
+  shape_msgs::Mesh simplified;
+  bool success = true;
+  switch (settings.mode_)
+  {
+    case MESH_UNCHANGED:
+      simplified = input;
+      break;
+    case MESH_CONVEX_HULL:
+      success = computeConvexHull(input, settings.max_triangles_, simplified);
+      break;
+    case MESH_ORIENTED_BOX:
+      success = computeOrientedBox(input, simplified);
+      break;
+  }
+
+  if (!success)
+  {
+    ROS_WARN_STREAM_NAMED("mesh_simplification","Unable to simplify mesh with " << input_vertices
+                          << " vertices, keeping it unchanged");
+    output = input;
+    return false;
+  }
+
+  output = simplified;
+  ROS_INFO_STREAM_NAMED("mesh_simplification","Simplified mesh from " << input_vertices << " vertices and "
+                        << input_triangles << " triangles to " << output.vertices.size() << " vertices and "
+                        << output.triangles.size() << " triangles");
+  return true;
+}
+
+} // end namespace
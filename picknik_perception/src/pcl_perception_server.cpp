@@ -39,9 +39,7 @@
 #include <picknik_perception/simple_point_cloud_filter.h>
 #include <picknik_perception/manual_tf_alignment.h>
 #include <picknik_perception/manipulation_interface.h>
-
-// Bounding Box
-#include <bounding_box/mesh_utilities.h>
+#include <picknik_perception/product_perception.h>
 
 // Visualization
 #include <rviz_visual_tools/rviz_visual_tools.h>
@@ -76,15 +74,12 @@ public:
     pointcloud_sub_ = nh_.subscribe("/merge_point_clouds/points", 1,
                                     &picknik_perception::SimplePointCloudFilter::pointCloudCallback, pointcloud_filter_);
 
-    // Load parameters
-    const std::string parent_name = "pcl_perception_server"; // for namespacing logging messages
-    ros_param_utilities::getDoubleParameter(parent_name, nh_, "roi_reduction_padding_x", roi_reduction_padding_x_);
-    ros_param_utilities::getDoubleParameter(parent_name, nh_, "roi_reduction_padding_y", roi_reduction_padding_y_);
-    ros_param_utilities::getDoubleParameter(parent_name, nh_, "roi_reduction_padding_z", roi_reduction_padding_z_);
-    ros_param_utilities::getBoolParameter(parent_name, nh_, "use_outlier_removal", use_outlier_removal_);
-
     // Show whole shelf
     loadShelfROI();
+
+    // Background model, pose estimation, labeling and mesh settings
+    product_perception_.reset(new ProductPerception(pointcloud_filter_, "pcl_perception_server"));
+    product_perception_->loadFromParameters(nh_);
   }
 
   bool changePointCloudTopic(std::string topic)
@@ -98,53 +93,28 @@ public:
 
   bool mainPipeline()
   {
-    ros::Rate rate(40.0);
-
     ROS_DEBUG_STREAM_NAMED("pcl_perception_server","Point cloud server main loop started");
 
     // Main looop
     while ( ros::ok() )
     {
-      rate.sleep();
-
-      // Check if goal is recieved
+      // Block until a goal is recieved
       picknik_msgs::FindObjectsGoalConstPtr request;
-      if (!manipulation_interface_->isReadyToStartPerception(request))
+      if (!manipulation_interface_->waitForStartPerception(request))
       {
-        ros::Duration(0.1).sleep();
+        manipulation_interface_->resetIsNeeded();
         continue; // loop again
       }
       ROS_INFO_STREAM_NAMED("pcl_perception_server","Starting perception for " << request->bin_name << ", waiting for stop command");
 
-      // Centroid of bin
-      Eigen::Affine3d roi_centroid = visual_tools_->convertPose(request->bin_centroid);
-
-      // Size of the bin
-      const double &bin_height = request->bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Z];
-      const double &bin_width  = request->bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Y];
-      const double &bin_depth  = request->bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_X];
-
-      // translate pose to corners
-      Eigen::Vector3d translate_to_corners(bin_depth / 2.0, bin_width / 2.0, bin_height / 2.0);
-
-      Eigen::Affine3d front_bottom_right = roi_centroid;
-      front_bottom_right.translation() -= translate_to_corners;
-      Eigen::Affine3d back_top_left = roi_centroid;
-      back_top_left.translation() += translate_to_corners;
-
       // Set regions of interest
-      pointcloud_filter_->setRegionOfInterest(front_bottom_right, back_top_left, roi_reduction_padding_x_, 
-                                              roi_reduction_padding_y_, roi_reduction_padding_z_);
+      product_perception_->setBin(*request);
 
-      // Unused feature: stop commmand
-      while (ros::ok())
+      // Wait until camera is done moving
+      if (!manipulation_interface_->waitForStopPerception())
       {
-        // Wait until camera is done moving
-        if (manipulation_interface_->isReadyToStopPerception())
-          break;
-
-        // Wait
-        rate.sleep();
+        manipulation_interface_->resetIsNeeded();
+        continue;
       }
       
       ROS_WARN_STREAM_NAMED("pcl_perception_server","Sleeping for 3 seconds to ensure cameras aren't moving...");
@@ -153,72 +123,14 @@ public:
       // Create results
       picknik_msgs::FindObjectsResult result;
 
-      if (!pointcloud_filter_->detectObjects(use_outlier_removal_))
+      // Meshes and poses are relative to the front bottom right corner of the bin
+      if (!product_perception_->findObjects(*request, result))
       {
-        ROS_ERROR_STREAM_NAMED("pcl_perception_server","Error occured when detecting objects");
-        result.succeeded = false;
         manipulation_interface_->sendPerceptionResults(result);
         ROS_DEBUG_STREAM_NAMED("pcl_perception_server","sending result.succeeded = false");
         continue;
-        //return false;
       }
 
-      // Finish up perception
-      ROS_INFO_STREAM_NAMED("pcl_perception_server","Finishing up perception");
-
-      // Convert point cloud to mesh
-      // NOTE: mesh is being saved in the BIN coordinate system
-
-      // check that point cloud is given in the world coordinate system (front_bottom_right is world -> bin)
-      std::string frame_check = pointcloud_filter_->roi_cloud_->header.frame_id; 
-      if ( frame_check.compare("/world") != 0 )
-      {
-        ROS_WARN_STREAM_NAMED("pcl_perception_server","input cloud expected to be in world. frame_id = " << frame_check);
-      }
-
-      // create mesh message in BIN frame
-      shape_msgs::Mesh mesh_msg;
-      mesh_msg = bounding_box::createMeshMsg(pointcloud_filter_->roi_cloud_, front_bottom_right);
-
-      ROS_INFO_STREAM_NAMED("pcl_perception_server","Finished computing mesh msg");
-      ROS_DEBUG_STREAM_NAMED("test","sizes = " << mesh_msg.triangles.size() << ", " << mesh_msg.vertices.size());
-
-      if (request->expected_objects_names.size() > 1)
-        ROS_WARN_STREAM_NAMED("pcl_perception_server","Perception can currently only handle one product");
-
-      // For each object in the bin
-      for (std::size_t i = 0; i < request->expected_objects_names.size(); ++i)
-      {
-        picknik_msgs::FoundObject new_product;
-        new_product.object_name = request->expected_objects_names[i];
-
-        // Object pose
-        // perception_interface assumes that everything is in the BIN frame
-        new_product.object_pose.pose = visual_tools_->convertPose(Eigen::Affine3d::Identity());
-
-        // Check that the product's frame_id is populated correctly
-        std::string product_frame_id = request->bin_name;;
-        if (product_frame_id.compare(0,3,"BIN") !=0)
-        {
-          ROS_WARN_STREAM_NAMED("pcl_perception_server","new_product frame_id. expected BIN_*, got " << request->bin_name);
-        }
-        new_product.object_pose.header.frame_id = product_frame_id;
-        
-        // Value between 0 and 1 for each expected object's confidence of its pose
-        new_product.expected_object_confidence = 1.0;
-
-        // Set mesh
-        // NOTE: the mesh message is with respect to the BIN frame
-        new_product.bounding_mesh = mesh_msg;
-
-        // Add object to result
-        result.found_objects.push_back(new_product);
-
-        break; // for now we only handle one prodcut
-      } // end for each product
-
-      // If the camera angle was bad or some other failure, return false
-      result.succeeded = true;
       //ROS_INFO_STREAM_NAMED("pcl_perception_server","Sending perception result:\n" << result);
       ROS_INFO_STREAM_NAMED("pcl_perception_server","Sending perception result");
 
@@ -241,9 +153,9 @@ public:
   {
     // load default ROI - the whole shelf
     Eigen::Affine3d top_left_back_corner = Eigen::Affine3d::Identity();
-    top_left_back_corner.translation() = Eigen::Vector3d(1.531, 0.4365, 2.37);
+    top_left_back_corner.translation() = SHELF_TOP_LEFT_BACK;
     Eigen::Affine3d bottom_right_front_corner = Eigen::Affine3d::Identity();
-    bottom_right_front_corner.translation() = Eigen::Vector3d(0.656, -0.445, 0.002);
+    bottom_right_front_corner.translation() = SHELF_BOTTOM_RIGHT_FRONT;
     double reduction_padding = 0;
     pointcloud_filter_->setRegionOfInterest( bottom_right_front_corner, top_left_back_corner, reduction_padding, reduction_padding, reduction_padding);
 
@@ -271,12 +183,8 @@ private:
 
   picknik_perception::ManipulationInterfacePtr manipulation_interface_;
 
-  // Amount to reduce the shelf region of interest by for error compensation
-  double roi_reduction_padding_x_;
-  double roi_reduction_padding_y_;
-  double roi_reduction_padding_z_;
-
-  bool use_outlier_removal_;
+  // Turns the cropped bin into found products
+  ProductPerceptionPtr product_perception_;
 
 }; // class
 
@@ -0,0 +1,329 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2014, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman
+   Desc:   Does not actually update the octomap, only filters point clouds
+*/
+
+#include <picknik_perception/point_cloud_filter.h>
+
+// ROS
+#include <tf_conversions/tf_eigen.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+// C++
+#include <cstring>
+#include <limits>
+
+namespace picknik_perception
+{
+
+PointCloudFilter::PointCloudFilter(const boost::shared_ptr<tf::Transformer> &tf, const std::string& map_frame)
+  : debug_info_(false)
+  , private_nh_("~")
+  , tf_(tf)
+  , max_range_(std::numeric_limits<double>::infinity())
+  , point_subsample_(1)
+  , point_cloud_subscriber_(NULL)
+  , point_cloud_filter_(NULL)
+  , map_frame_(map_frame)
+{
+}
+
+PointCloudFilter::~PointCloudFilter()
+{
+  stopHelper();
+}
+
+bool PointCloudFilter::initialize()
+{
+  // Load parameters
+  const std::string parent_name = "point_cloud_filter"; // for namespacing logging messages
+  int point_subsample = 1;
+  ros_param_utilities::getStringParameter(parent_name, private_nh_, "point_cloud_topic", point_cloud_topic_);
+  ros_param_utilities::getDoubleParameter(parent_name, private_nh_, "max_range", max_range_);
+  ros_param_utilities::getIntParameter(parent_name, private_nh_, "point_subsample", point_subsample);
+  ros_param_utilities::getStringParameter(parent_name, private_nh_, "filtered_cloud_topic", filtered_cloud_topic_);
+  point_subsample_ = point_subsample > 1 ? point_subsample : 1;
+
+  if (max_range_ <= 0)
+    max_range_ = std::numeric_limits<double>::infinity();
+
+  shape_mask_.reset(new point_containment_filter::ShapeMask(boost::bind(&PointCloudFilter::getShapeTransform,
+                                                                        this, _1, _2)));
+
+  if (!filtered_cloud_topic_.empty())
+    filtered_cloud_publisher_ = private_nh_.advertise<sensor_msgs::PointCloud2>(filtered_cloud_topic_, 1);
+
+  return true;
+}
+
+void PointCloudFilter::start()
+{
+  if (point_cloud_subscriber_)
+    return;
+
+  if (point_cloud_topic_.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("point_cloud_filter","No point_cloud_topic set, not starting");
+    return;
+  }
+
+  /* subscribe to point cloud topic using tf filter, so the robot pose at each cloud's stamp is available */
+  point_cloud_subscriber_ = new message_filters::Subscriber<sensor_msgs::PointCloud2>(root_nh_, point_cloud_topic_, 5);
+  if (tf_ && !map_frame_.empty())
+  {
+    point_cloud_filter_ = new tf::MessageFilter<sensor_msgs::PointCloud2>(*point_cloud_subscriber_, *tf_, map_frame_, 5);
+    point_cloud_filter_->registerCallback(boost::bind(&PointCloudFilter::cloudMsgCallback, this, _1));
+    ROS_INFO_STREAM_NAMED("point_cloud_filter","Listening to '" << point_cloud_topic_
+                          << "' using message filter with target frame '" << point_cloud_filter_->getTargetFramesString() << "'");
+  }
+  else
+  {
+    point_cloud_subscriber_->registerCallback(boost::bind(&PointCloudFilter::cloudMsgCallback, this, _1));
+    ROS_INFO_STREAM_NAMED("point_cloud_filter","Listening to '" << point_cloud_topic_ << "'");
+  }
+}
+
+void PointCloudFilter::stop()
+{
+  stopHelper();
+}
+
+void PointCloudFilter::stopHelper()
+{
+  delete point_cloud_filter_;
+  delete point_cloud_subscriber_;
+  point_cloud_filter_ = NULL;
+  point_cloud_subscriber_ = NULL;
+}
+
+ShapeHandle PointCloudFilter::excludeShape(const shapes::ShapeConstPtr &shape, const double &scale, const double &padding)
+{
+  boost::mutex::scoped_lock lock(filter_mutex_);
+  ShapeHandle h = 0;
+  if (shape_mask_)
+    h = shape_mask_->addShape(shape, scale, padding);
+  else
+    ROS_ERROR_STREAM_NAMED("point_cloud_filter","Shape filter not yet initialized!");
+  return h;
+}
+
+void PointCloudFilter::forgetShape(ShapeHandle handle)
+{
+  boost::mutex::scoped_lock lock(filter_mutex_);
+  if (shape_mask_)
+    shape_mask_->removeShape(handle);
+  frame_shapes_.erase(handle);
+}
+
+ShapeHandle PointCloudFilter::excludeFrameShape(const std::string &frame, const Eigen::Affine3d &frame_to_shape,
+                                                const shapes::ShapeConstPtr &shape, const double &scale,
+                                                const double &padding)
+{
+  ShapeHandle h = excludeShape(shape, scale, padding);
+  if (h)
+  {
+    boost::mutex::scoped_lock lock(filter_mutex_);
+    FrameShape& frame_shape = frame_shapes_[h];
+    frame_shape.frame_ = frame;
+    frame_shape.frame_to_shape_ = frame_to_shape;
+  }
+  return h;
+}
+
+std::size_t PointCloudFilter::excludeRobotLinks(const robot_model::RobotModelConstPtr &robot_model,
+                                                std::vector<std::string> link_names, const double &scale,
+                                                const double &padding)
+{
+  if (link_names.empty())
+    link_names = robot_model->getLinkModelNamesWithCollisionGeometry();
+
+  std::size_t num_shapes = 0;
+  for (std::size_t i = 0; i < link_names.size(); ++i)
+  {
+    const robot_model::LinkModel* link = robot_model->getLinkModel(link_names[i]);
+    if (!link)
+    {
+      ROS_WARN_STREAM_NAMED("point_cloud_filter","Unknown link " << link_names[i]);
+      continue;
+    }
+
+    const std::vector<shapes::ShapeConstPtr>& shapes = link->getShapes();
+    const EigenSTL::vector_Affine3d& origins = link->getCollisionOriginTransforms();
+    for (std::size_t j = 0; j < shapes.size(); ++j)
+    {
+      if (excludeFrameShape(link->getName(), origins[j], shapes[j], scale, padding))
+        ++num_shapes;
+    }
+  }
+
+  ROS_INFO_STREAM_NAMED("point_cloud_filter","Filtering " << num_shapes << " shapes from "
+                        << link_names.size() << " links");
+  return num_shapes;
+}
+
+bool PointCloudFilter::getShapeTransform(ShapeHandle h, Eigen::Affine3d &transform) const
+{
+  ShapeTransformCache::const_iterator it = transform_cache_.find(h);
+  if (it == transform_cache_.end())
+  {
+    ROS_ERROR_STREAM_NAMED("point_cloud_filter","Internal error. Shape filter handle " << h << " not found");
+    return false;
+  }
+  transform = it->second;
+  return true;
+}
+
+bool PointCloudFilter::updateTransformCache(const std::string &target_frame, const ros::Time &target_time)
+{
+  transform_cache_.clear();
+  if (transform_provider_callback_)
+    return transform_provider_callback_(target_frame, target_time, transform_cache_);
+  return getFrameShapeTransforms(target_frame, target_time, transform_cache_);
+}
+
+bool PointCloudFilter::getFrameShapeTransforms(const std::string &target_frame, const ros::Time &target_time,
+                                               ShapeTransformCache &cache)
+{
+  if (!tf_)
+  {
+    ROS_WARN_STREAM_THROTTLE_NAMED(1, "point_cloud_filter","No transform provider or TF available for shape filtering");
+    return false;
+  }
+
+  // Several shapes usually share a link frame, only look each one up once
+  typedef std::map<std::string, Eigen::Affine3d, std::less<std::string>,
+                   Eigen::aligned_allocator<std::pair<const std::string, Eigen::Affine3d> > > FrameTransformMap;
+  FrameTransformMap frame_transforms;
+
+  for (FrameShapeMap::const_iterator it = frame_shapes_.begin(); it != frame_shapes_.end(); ++it)
+  {
+    FrameTransformMap::const_iterator frame_it = frame_transforms.find(it->second.frame_);
+    if (frame_it == frame_transforms.end())
+    {
+      tf::StampedTransform tf_transform;
+      try
+      {
+        tf_->lookupTransform(target_frame, it->second.frame_, target_time, tf_transform);
+      }
+      catch (tf::TransformException &ex)
+      {
+        ROS_ERROR_STREAM_THROTTLE_NAMED(1, "point_cloud_filter","Transform error of frame '" << it->second.frame_
+                                        << "': " << ex.what());
+        return false;
+      }
+      Eigen::Affine3d target_to_frame;
+      tf::transformTFToEigen(tf_transform, target_to_frame);
+      frame_it = frame_transforms.insert(std::make_pair(it->second.frame_, target_to_frame)).first;
+    }
+    cache[it->first] = frame_it->second * it->second.frame_to_shape_;
+  }
+  return true;
+}
+
+bool PointCloudFilter::filter(const sensor_msgs::PointCloud2 &cloud_msg, sensor_msgs::PointCloud2 &filtered_cloud)
+{
+  boost::mutex::scoped_lock lock(filter_mutex_);
+
+  if (!shape_mask_)
+  {
+    ROS_ERROR_STREAM_NAMED("point_cloud_filter","Shape filter not yet initialized!");
+    return false;
+  }
+
+  /* compute the link poses at the time the cloud was taken, in the sensor frame */
+  if (!updateTransformCache(cloud_msg.header.frame_id, cloud_msg.header.stamp))
+  {
+    ROS_ERROR_STREAM_THROTTLE_NAMED(1, "point_cloud_filter","Transform cache was not updated. Self-filtering may fail.");
+    return false;
+  }
+
+  /* mask out points on the robot and beyond max range. The sensor is at the origin of its own frame */
+  shape_mask_->maskContainment(cloud_msg, Eigen::Vector3d::Zero(), 0.0, max_range_, mask_);
+
+  filtered_cloud.header = cloud_msg.header;
+  filtered_cloud.fields = cloud_msg.fields;
+  filtered_cloud.is_bigendian = cloud_msg.is_bigendian;
+  filtered_cloud.point_step = cloud_msg.point_step;
+  filtered_cloud.is_dense = cloud_msg.is_dense;
+  filtered_cloud.data.resize(cloud_msg.data.size());
+
+  /* copy the kept points whole so every field survives. Subsampling skips rows and columns alike */
+  std::size_t filtered_size = 0;
+  for (unsigned int row = 0; row < cloud_msg.height; row += point_subsample_)
+  {
+    const std::size_t row_start = row * cloud_msg.width;
+    for (unsigned int col = 0; col < cloud_msg.width; col += point_subsample_)
+    {
+      const std::size_t i = row_start + col;
+      if (mask_[i] != point_containment_filter::ShapeMask::OUTSIDE)
+        continue;
+
+      std::memcpy(&filtered_cloud.data[filtered_size * cloud_msg.point_step],
+                  &cloud_msg.data[row * cloud_msg.row_step + col * cloud_msg.point_step], cloud_msg.point_step);
+      ++filtered_size;
+    }
+  }
+
+  filtered_cloud.height = 1;
+  filtered_cloud.width = filtered_size;
+  filtered_cloud.row_step = filtered_size * cloud_msg.point_step;
+  filtered_cloud.data.resize(filtered_cloud.row_step);
+
+  if (debug_info_)
+    ROS_DEBUG_STREAM_NAMED("point_cloud_filter","Kept " << filtered_size << " of " << cloud_msg.width * cloud_msg.height
+                           << " points");
+
+  return true;
+}
+
+void PointCloudFilter::cloudMsgCallback(const sensor_msgs::PointCloud2::ConstPtr &cloud_msg)
+{
+  ros::WallTime start = ros::WallTime::now();
+
+  sensor_msgs::PointCloud2::Ptr filtered_cloud(new sensor_msgs::PointCloud2());
+  if (!filter(*cloud_msg, *filtered_cloud))
+    return;
+
+  if (filtered_cloud_publisher_)
+    filtered_cloud_publisher_.publish(filtered_cloud);
+
+  ROS_DEBUG_STREAM_NAMED("point_cloud_filter","Self-filtered cloud in " << (ros::WallTime::now() - start).toSec() * 1000.0
+                         << " ms");
+}
+
+} // namespace
@@ -0,0 +1,429 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Precomputed shape descriptors of every product, used to label segmented clusters
+*/
+
+#include <picknik_perception/product_descriptor_library.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+// PCL
+#include <pcl/common/centroid.h>
+#include <pcl/features/fpfh.h>
+#include <pcl/features/normal_3d.h>
+#include <pcl/features/vfh.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/search/kdtree.h>
+
+// Boost
+#include <boost/cstdint.hpp>
+
+namespace picknik_perception
+{
+
+namespace
+{
+static const char LIBRARY_MAGIC[4] = { 'P', 'K', 'D', 'L' };
+static const boost::uint32_t LIBRARY_VERSION = 2;
+static const std::size_t VFH_SIZE = 308;
+static const std::size_t FPFH_SIZE = 33;
+
+/**
+ * \brief Scale a histogram to sum to one so that clouds of any size compare
+ */
+void normalizeHistogram(std::vector<float>& histogram)
+{
+  double sum = 0;
+  for (std::size_t i = 0; i < histogram.size(); ++i)
+    sum += histogram[i];
+  if (sum <= 0)
+    return;
+  for (std::size_t i = 0; i < histogram.size(); ++i)
+    histogram[i] /= sum;
+}
+
+double chiSquared(const std::vector<float>& a, const std::vector<float>& b)
+{
+  if (a.size() != b.size())
+    return std::numeric_limits<double>::max();
+
+  double result = 0;
+  for (std::size_t i = 0; i < a.size(); ++i)
+  {
+    const double sum = a[i] + b[i];
+    if (sum > 0)
+      result += (a[i] - b[i]) * (a[i] - b[i]) / sum;
+  }
+  return 0.5 * result;
+}
+
+// Product entry of the index in a library file
+struct IndexEntry
+{
+  std::string name_;
+  boost::uint32_t view_count_;
+  boost::uint64_t offset_;
+};
+
+template <typename T>
+void writeValue(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& file, T& value)
+{
+  return !file.read(reinterpret_cast<char*>(&value), sizeof(T)).fail();
+}
+} // namespace
+
+ProductDescriptorLibrary::ProductDescriptorLibrary(const DescriptorSettings& settings)
+  : settings_(settings)
+{
+}
+
+bool ProductDescriptorLibrary::computeDescriptor(const Cloud::ConstPtr& cloud, const Eigen::Vector3f& viewpoint,
+                                                 ProductDescriptor& descriptor) const
+{
+  // Downsample so that descriptors do not depend on sensor or mesh density
+  Cloud::Ptr downsampled(new Cloud);
+  pcl::VoxelGrid<pcl::PointXYZ> voxel_grid;
+  voxel_grid.setInputCloud(cloud);
+  voxel_grid.setLeafSize(settings_.leaf_size_, settings_.leaf_size_, settings_.leaf_size_);
+  voxel_grid.filter(*downsampled);
+
+  if (downsampled->size() < 10)
+  {
+    ROS_WARN_STREAM_NAMED("descriptor_library","Too few points (" << downsampled->size() << ") to compute descriptors");
+    return false;
+  }
+
+  pcl::search::KdTree<pcl::PointXYZ>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZ>);
+
+  // Normals
+  pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
+  pcl::NormalEstimation<pcl::PointXYZ, pcl::Normal> normal_estimation;
+  normal_estimation.setInputCloud(downsampled);
+  normal_estimation.setSearchMethod(tree);
+  normal_estimation.setRadiusSearch(settings_.normal_radius_);
+  normal_estimation.setViewPoint(viewpoint.x(), viewpoint.y(), viewpoint.z());
+  normal_estimation.compute(*normals);
+
+  // Global descriptor
+  pcl::PointCloud<pcl::VFHSignature308> vfh;
+  pcl::VFHEstimation<pcl::PointXYZ, pcl::Normal, pcl::VFHSignature308> vfh_estimation;
+  vfh_estimation.setInputCloud(downsampled);
+  vfh_estimation.setInputNormals(normals);
+  vfh_estimation.setSearchMethod(tree);
+  vfh_estimation.setViewPoint(viewpoint.x(), viewpoint.y(), viewpoint.z());
+  vfh_estimation.compute(vfh);
+  if (vfh.empty())
+    return false;
+  descriptor.global_.assign(vfh.points[0].histogram, vfh.points[0].histogram + VFH_SIZE);
+  normalizeHistogram(descriptor.global_);
+
+  // Local descriptors, averaged
+  pcl::PointCloud<pcl::FPFHSignature33> fpfh;
+  pcl::FPFHEstimation<pcl::PointXYZ, pcl::Normal, pcl::FPFHSignature33> fpfh_estimation;
+  fpfh_estimation.setInputCloud(downsampled);
+  fpfh_estimation.setInputNormals(normals);
+  fpfh_estimation.setSearchMethod(tree);
+  fpfh_estimation.setRadiusSearch(settings_.feature_radius_);
+  fpfh_estimation.compute(fpfh);
+
+  descriptor.local_.assign(FPFH_SIZE, 0.0);
+  for (std::size_t i = 0; i < fpfh.size(); ++i)
+  {
+    const float* histogram = fpfh.points[i].histogram;
+    if (!pcl_isfinite(histogram[0]))
+      continue;
+    for (std::size_t j = 0; j < FPFH_SIZE; ++j)
+      descriptor.local_[j] += histogram[j];
+  }
+  normalizeHistogram(descriptor.local_);
+
+  return true;
+}
+
+bool ProductDescriptorLibrary::addProduct(const std::string& name, const Cloud::ConstPtr& cloud)
+{
+  Eigen::Vector4f centroid;
+  if (cloud->empty() || pcl::compute3DCentroid(*cloud, centroid) == 0)
+  {
+    ROS_WARN_STREAM_NAMED("descriptor_library","No points in the model of " << name);
+    return false;
+  }
+
+  // Views on a fibonacci sphere around the product, since it can lie in a bin in any orientation
+  std::vector<ProductDescriptor> views;
+  const double golden_angle = M_PI * (3.0 - std::sqrt(5.0));
+  for (std::size_t i = 0; i < settings_.view_count_; ++i)
+  {
+    const double z = 1.0 - (2.0 * i + 1.0) / settings_.view_count_;
+    const double radius = std::sqrt(1.0 - z * z);
+    const Eigen::Vector3f direction(radius * std::cos(golden_angle * i), radius * std::sin(golden_angle * i), z);
+    const Eigen::Vector3f viewpoint = centroid.head<3>() + settings_.view_distance_ * direction;
+
+    Cloud::Ptr view(new Cloud);
+    renderView(*cloud, viewpoint, settings_.leaf_size_, *view);
+
+    ProductDescriptor descriptor;
+    descriptor.name_ = name;
+    if (computeDescriptor(view, viewpoint, descriptor))
+      views.push_back(descriptor);
+  }
+
+  if (views.empty())
+  {
+    ROS_WARN_STREAM_NAMED("descriptor_library","Unable to compute descriptors for " << name);
+    return false;
+  }
+  if (views.size() < settings_.view_count_)
+    ROS_WARN_STREAM_NAMED("descriptor_library","Only described " << views.size() << " of " << settings_.view_count_
+                          << " views of " << name);
+
+  descriptors_[name].swap(views);
+  return true;
+}
+
+void ProductDescriptorLibrary::renderView(const Cloud& model, const Eigen::Vector3f& viewpoint, float pixel_size,
+                                          Cloud& view)
+{
+  view.clear();
+
+  Eigen::Vector4f centroid;
+  if (model.empty() || pcl::compute3DCentroid(model, centroid) == 0)
+    return;
+
+  // Orthographic image plane perpendicular to the line of sight through the centroid, products are small
+  // compared to their distance from the cameras
+  const Eigen::Vector3f axis = (centroid.head<3>() - viewpoint).normalized();
+  const Eigen::Vector3f helper = std::fabs(axis.z()) < 0.9 ? Eigen::Vector3f::UnitZ() : Eigen::Vector3f::UnitX();
+  const Eigen::Vector3f u = axis.cross(helper).normalized();
+  const Eigen::Vector3f v = axis.cross(u);
+
+  // Nearest depth seen through each pixel
+  std::map<std::pair<int, int>, float> depth_buffer;
+  std::vector<std::pair<int, int> > pixels(model.size());
+  std::vector<float> depths(model.size());
+  for (std::size_t i = 0; i < model.size(); ++i)
+  {
+    const Eigen::Vector3f ray = model.points[i].getVector3fMap() - viewpoint;
+    depths[i] = ray.dot(axis);
+    pixels[i] = std::make_pair(static_cast<int>(std::floor(ray.dot(u) / pixel_size)),
+                               static_cast<int>(std::floor(ray.dot(v) / pixel_size)));
+    std::map<std::pair<int, int>, float>::iterator it = depth_buffer.find(pixels[i]);
+    if (it == depth_buffer.end())
+      depth_buffer[pixels[i]] = depths[i];
+    else
+      it->second = std::min(it->second, depths[i]);
+  }
+
+  // Keep the front surface, the samples within a pixel of the nearest depth
+  for (std::size_t i = 0; i < model.size(); ++i)
+    if (depths[i] <= depth_buffer[pixels[i]] + pixel_size)
+      view.push_back(model.points[i]);
+}
+
+std::string ProductDescriptorLibrary::match(const ProductDescriptor& descriptor,
+                                            const std::vector<std::string>& candidates, double& distance) const
+{
+  std::string best;
+  distance = std::numeric_limits<double>::max();
+
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+  {
+    std::map<std::string, std::vector<ProductDescriptor> >::const_iterator it = descriptors_.find(candidates[i]);
+    if (it == descriptors_.end())
+      continue;
+
+    // A product matches as well as its most similar view
+    for (std::size_t j = 0; j < it->second.size(); ++j)
+    {
+      const double candidate_distance = ProductDescriptorLibrary::distance(descriptor, it->second[j]);
+      if (candidate_distance < distance)
+      {
+        distance = candidate_distance;
+        best = candidates[i];
+      }
+    }
+  }
+
+  return best;
+}
+
+double ProductDescriptorLibrary::distance(const ProductDescriptor& a, const ProductDescriptor& b)
+{
+  return chiSquared(a.global_, b.global_) + chiSquared(a.local_, b.local_);
+}
+
+bool ProductDescriptorLibrary::hasProduct(const std::string& name) const
+{
+  return descriptors_.find(name) != descriptors_.end();
+}
+
+bool ProductDescriptorLibrary::save(const std::string& file_path) const
+{
+  std::ofstream file(file_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("descriptor_library","Unable to open " << file_path << " for writing");
+    return false;
+  }
+
+  // Header
+  file.write(LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC));
+  writeValue(file, LIBRARY_VERSION);
+  writeValue(file, static_cast<boost::uint32_t>(descriptors_.size()));
+  writeValue(file, static_cast<boost::uint32_t>(VFH_SIZE));
+  writeValue(file, static_cast<boost::uint32_t>(FPFH_SIZE));
+  writeValue(file, settings_.leaf_size_);
+  writeValue(file, settings_.normal_radius_);
+  writeValue(file, settings_.feature_radius_);
+  writeValue(file, settings_.view_count_);
+  writeValue(file, settings_.view_distance_);
+
+  // Index of names, their view count and the offset of their histograms from the start of the data section
+  const boost::uint64_t record_size = (VFH_SIZE + FPFH_SIZE) * sizeof(float);
+  boost::uint64_t offset = 0;
+  typedef std::map<std::string, std::vector<ProductDescriptor> >::const_iterator DescriptorIterator;
+  for (DescriptorIterator it = descriptors_.begin(); it != descriptors_.end(); ++it)
+  {
+    writeValue(file, static_cast<boost::uint32_t>(it->first.size()));
+    file.write(it->first.data(), it->first.size());
+    writeValue(file, static_cast<boost::uint32_t>(it->second.size()));
+    writeValue(file, offset);
+    offset += record_size * it->second.size();
+  }
+
+  // Data
+  for (DescriptorIterator it = descriptors_.begin(); it != descriptors_.end(); ++it)
+    for (std::size_t i = 0; i < it->second.size(); ++i)
+    {
+      file.write(reinterpret_cast<const char*>(&it->second[i].global_[0]), VFH_SIZE * sizeof(float));
+      file.write(reinterpret_cast<const char*>(&it->second[i].local_[0]), FPFH_SIZE * sizeof(float));
+    }
+
+  if (!file.good())
+  {
+    ROS_ERROR_STREAM_NAMED("descriptor_library","Error writing " << file_path);
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("descriptor_library","Saved " << descriptors_.size() << " products to " << file_path);
+  return true;
+}
+
+bool ProductDescriptorLibrary::load(const std::string& file_path)
+{
+  std::ifstream file(file_path.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("descriptor_library","Unable to open " << file_path);
+    return false;
+  }
+
+  char magic[4];
+  boost::uint32_t version, count, global_size, local_size;
+  DescriptorSettings settings;
+  if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, LIBRARY_MAGIC, sizeof(magic)) != 0 ||
+      !readValue(file, version) || version != LIBRARY_VERSION)
+  {
+    ROS_ERROR_STREAM_NAMED("descriptor_library", file_path << " is not a version " << LIBRARY_VERSION
+                           << " descriptor library");
+    return false;
+  }
+  if (!readValue(file, count) || !readValue(file, global_size) || !readValue(file, local_size) ||
+      !readValue(file, settings.leaf_size_) || !readValue(file, settings.normal_radius_) ||
+      !readValue(file, settings.feature_radius_) || !readValue(file, settings.view_count_) ||
+      !readValue(file, settings.view_distance_) || global_size != VFH_SIZE || local_size != FPFH_SIZE)
+  {
+    ROS_ERROR_STREAM_NAMED("descriptor_library","Invalid header in " << file_path);
+    return false;
+  }
+
+  // Index
+  std::vector<IndexEntry> index(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    boost::uint32_t name_size;
+    if (!readValue(file, name_size) || name_size > 1024)
+      return false;
+    index[i].name_.resize(name_size);
+    if ((name_size && !file.read(&index[i].name_[0], name_size)) || !readValue(file, index[i].view_count_) ||
+        index[i].view_count_ > 10000 || !readValue(file, index[i].offset_))
+    {
+      ROS_ERROR_STREAM_NAMED("descriptor_library","Invalid index in " << file_path);
+      return false;
+    }
+  }
+
+  // Data
+  const std::streampos data_start = file.tellg();
+  std::map<std::string, std::vector<ProductDescriptor> > descriptors;
+  for (std::size_t i = 0; i < index.size(); ++i)
+  {
+    std::vector<ProductDescriptor>& views = descriptors[index[i].name_];
+    views.resize(index[i].view_count_);
+
+    file.seekg(data_start + static_cast<std::streamoff>(index[i].offset_));
+    for (std::size_t j = 0; j < views.size(); ++j)
+    {
+      ProductDescriptor& descriptor = views[j];
+      descriptor.name_ = index[i].name_;
+      descriptor.global_.resize(VFH_SIZE);
+      descriptor.local_.resize(FPFH_SIZE);
+      if (!file.read(reinterpret_cast<char*>(&descriptor.global_[0]), VFH_SIZE * sizeof(float)) ||
+          !file.read(reinterpret_cast<char*>(&descriptor.local_[0]), FPFH_SIZE * sizeof(float)))
+      {
+        ROS_ERROR_STREAM_NAMED("descriptor_library","Truncated data for " << index[i].name_ << " in " << file_path);
+        return false;
+      }
+    }
+  }
+
+  settings_ = settings;
+  descriptors_.swap(descriptors);
+
+  ROS_INFO_STREAM_NAMED("descriptor_library","Loaded " << descriptors_.size() << " products from " << file_path);
+  return true;
+}
+
+} // end namespace
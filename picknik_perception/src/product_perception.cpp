@@ -0,0 +1,445 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Andy McEvoy <mcevoy.andy@gmail.com>, Dave Coleman <dave@dav.ee>
+   Desc:   Turns the cropped cloud of one bin into the found products of a FindObjects result
+*/
+
+#include <picknik_perception/product_perception.h>
+
+#include <limits>
+
+// ROS
+#include <ros/package.h>
+#include <eigen_conversions/eigen_msg.h>
+
+// PCL
+#include <pcl/common/io.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/segmentation/extract_clusters.h>
+
+// Bounding Box
+#include <bounding_box/mesh_utilities.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+namespace picknik_perception
+{
+
+namespace
+{
+/**
+ * \brief Express every vertex of a mesh in a new frame
+ */
+shape_msgs::Mesh transformMesh(const shape_msgs::Mesh& mesh, const Eigen::Affine3d& transform)
+{
+  shape_msgs::Mesh result = mesh;
+  for (std::size_t i = 0; i < result.vertices.size(); ++i)
+  {
+    geometry_msgs::Point& vertex = result.vertices[i];
+    const Eigen::Vector3d point = transform * Eigen::Vector3d(vertex.x, vertex.y, vertex.z);
+    vertex.x = point.x();
+    vertex.y = point.y();
+    vertex.z = point.z();
+  }
+  return result;
+}
+} // namespace
+
+ProductPerception::ProductPerception(const SimplePointCloudFilterPtr& filter, const std::string& parent_name)
+  : filter_(filter)
+  , parent_name_(parent_name)
+  , roi_reduction_padding_x_(0)
+  , roi_reduction_padding_y_(0)
+  , roi_reduction_padding_z_(0)
+  , use_outlier_removal_(true)
+  , max_pose_fitness_(0.0)
+  , cluster_tolerance_(0.02)
+  , min_cluster_size_(100)
+{
+}
+
+bool ProductPerception::loadFromParameters(ros::NodeHandle& nh)
+{
+  ros_param_utilities::getDoubleParameter(parent_name_, nh, "roi_reduction_padding_x", roi_reduction_padding_x_);
+  ros_param_utilities::getDoubleParameter(parent_name_, nh, "roi_reduction_padding_y", roi_reduction_padding_y_);
+  ros_param_utilities::getDoubleParameter(parent_name_, nh, "roi_reduction_padding_z", roi_reduction_padding_z_);
+  ros_param_utilities::getBoolParameter(parent_name_, nh, "use_outlier_removal", use_outlier_removal_);
+
+  bool success = true;
+
+  // Remove known shelf geometry from product clouds
+  success &= loadBackgroundModel(nh);
+
+  // Product models for registration
+  success &= loadPoseEstimator(nh);
+
+  // Product descriptors for labeling bins with several products
+  success &= loadDescriptorLibrary(nh);
+
+  // Triangle budget of the returned bounding meshes
+  success &= loadMeshSimplification(nh);
+
+  return success;
+}
+
+void ProductPerception::setBin(const picknik_msgs::FindObjectsGoal& goal)
+{
+  const Eigen::Affine3d front_bottom_right = getWorldToBin(goal);
+  Eigen::Affine3d back_top_left = front_bottom_right;
+  back_top_left.translation() += Eigen::Vector3d(goal.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_X],
+                                                 goal.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Y],
+                                                 goal.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Z]);
+
+  filter_->setRegionOfInterest(front_bottom_right, back_top_left, roi_reduction_padding_x_,
+                               roi_reduction_padding_y_, roi_reduction_padding_z_);
+}
+
+bool ProductPerception::findObjects(const picknik_msgs::FindObjectsGoal& goal,
+                                    picknik_msgs::FindObjectsResult& result, ProductPerceptionTimes* times)
+{
+  product_clouds_.clear();
+  ros::WallTime step_start = ros::WallTime::now();
+
+  const bool detected = filter_->detectObjects(use_outlier_removal_);
+  if (times)
+    times->detection_ += (ros::WallTime::now() - step_start).toSec();
+  if (!detected)
+  {
+    ROS_ERROR_STREAM_NAMED(parent_name_,"Error occured when detecting objects");
+    result.succeeded = false;
+    return false;
+  }
+
+  // check that point cloud is given in the world coordinate system (front_bottom_right is world -> bin)
+  const std::string& frame_check = filter_->object_cloud_->header.frame_id;
+  if (frame_check.compare("/world") != 0)
+  {
+    ROS_WARN_STREAM_NAMED(parent_name_,"input cloud expected to be in world. frame_id = " << frame_check);
+  }
+
+  // Check that the products' frame_id is populated correctly
+  if (goal.bin_name.compare(0, 3, "BIN") != 0)
+  {
+    ROS_WARN_STREAM_NAMED(parent_name_,"new_product frame_id. expected BIN_*, got " << goal.bin_name);
+  }
+
+  const Eigen::Affine3d front_bottom_right = getWorldToBin(goal);
+
+  // Split the detected cloud into one cloud per expected product
+  step_start = ros::WallTime::now();
+  std::vector<std::string> product_names;
+  labelProducts(goal.expected_objects_names, product_names, product_clouds_);
+  if (times)
+    times->labeling_ += (ros::WallTime::now() - step_start).toSec();
+
+  // For each object in the bin
+  for (std::size_t i = 0; i < product_names.size(); ++i)
+  {
+    picknik_msgs::FoundObject new_product;
+    new_product.object_name = product_names[i];
+
+    // create mesh message in BIN frame
+    step_start = ros::WallTime::now();
+    shape_msgs::Mesh mesh_msg = bounding_box::createMeshMsg(product_clouds_[i], front_bottom_right);
+    ROS_DEBUG_STREAM_NAMED(parent_name_,"Finished computing mesh msg for " << new_product.object_name << ", "
+                           << mesh_msg.triangles.size() << " triangles, " << mesh_msg.vertices.size() << " vertices");
+
+    // Every triangle sent is checked for collision for the rest of the pick
+    simplifyMesh(mesh_msg, mesh_simplification_, mesh_msg);
+    if (times)
+      times->mesh_ += (ros::WallTime::now() - step_start).toSec();
+
+    // Object pose
+    // perception_interface assumes that everything is in the BIN frame
+    step_start = ros::WallTime::now();
+    Eigen::Affine3d bin_to_product = Eigen::Affine3d::Identity();
+    double confidence = 1.0;
+    const bool has_pose = estimateProductPose(new_product.object_name, *product_clouds_[i], front_bottom_right,
+                                              bin_to_product, confidence);
+    if (times)
+      times->pose_ += (ros::WallTime::now() - step_start).toSec();
+
+    tf::poseEigenToMsg(bin_to_product, new_product.object_pose.pose);
+    new_product.object_pose.header.frame_id = goal.bin_name;
+
+    // Value between 0 and 1 for each expected object's confidence of its pose
+    new_product.expected_object_confidence = confidence;
+
+    // Set mesh
+    // NOTE: the mesh message is with respect to the object pose, which is the BIN frame unless a pose was estimated
+    new_product.bounding_mesh = has_pose ? transformMesh(mesh_msg, bin_to_product.inverse()) : mesh_msg;
+
+    // Add object to result
+    result.found_objects.push_back(new_product);
+  } // end for each product
+
+  result.succeeded = true;
+  return true;
+}
+
+Eigen::Affine3d ProductPerception::getWorldToBin(const picknik_msgs::FindObjectsGoal& goal) const
+{
+  // Centroid of bin
+  Eigen::Affine3d front_bottom_right;
+  tf::poseMsgToEigen(goal.bin_centroid, front_bottom_right);
+
+  // Size of the bin
+  const double& bin_height = goal.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Z];
+  const double& bin_width = goal.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Y];
+  const double& bin_depth = goal.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_X];
+
+  // translate pose to corner
+  front_bottom_right.translation() -= Eigen::Vector3d(bin_depth / 2.0, bin_width / 2.0, bin_height / 2.0);
+  return front_bottom_right;
+}
+
+bool ProductPerception::loadBackgroundModel(ros::NodeHandle& nh)
+{
+  bool use_background_subtraction = false;
+  ros_param_utilities::getBoolParameter(parent_name_, nh, "use_background_subtraction", use_background_subtraction);
+  if (!use_background_subtraction)
+    return true;
+
+  // Model the whole shelf region, with room for calibration error
+  const Eigen::Vector3d margin(0.1, 0.1, 0.1);
+  ShelfBackgroundModelPtr background_model =
+    ShelfBackgroundModel::loadFromParameters(nh, SHELF_BOTTOM_RIGHT_FRONT - margin, SHELF_TOP_LEFT_BACK + margin);
+  if (!background_model)
+    return false;
+
+  filter_->setBackgroundModel(background_model);
+  return true;
+}
+
+bool ProductPerception::loadPoseEstimator(ros::NodeHandle& nh)
+{
+  bool use_pose_estimation = false;
+  ros_param_utilities::getBoolParameter(parent_name_, nh, "use_pose_estimation", use_pose_estimation);
+  if (!use_pose_estimation)
+    return true;
+
+  double model_leaf_size;
+  double icp_max_correspondence_distance;
+  int icp_max_iterations;
+  if (!ros_param_utilities::getDoubleParameter(parent_name_, nh, "model_leaf_size", model_leaf_size) ||
+      !ros_param_utilities::getDoubleParameter(parent_name_, nh, "icp_max_correspondence_distance",
+                                               icp_max_correspondence_distance) ||
+      !ros_param_utilities::getIntParameter(parent_name_, nh, "icp_max_iterations", icp_max_iterations) ||
+      !ros_param_utilities::getDoubleParameter(parent_name_, nh, "max_pose_fitness", max_pose_fitness_))
+    return false;
+
+  pose_estimator_.reset(new ProductPoseEstimator(model_leaf_size, icp_max_correspondence_distance, icp_max_iterations));
+  return pose_estimator_->loadProducts(ros::package::getPath("picknik_main") + "/meshes/products") > 0;
+}
+
+bool ProductPerception::loadMeshSimplification(ros::NodeHandle& nh)
+{
+  std::string mesh_simplification = "hull";
+  int mesh_max_triangles = 100;
+  ros_param_utilities::getStringParameter(parent_name_, nh, "mesh_simplification", mesh_simplification);
+  ros_param_utilities::getIntParameter(parent_name_, nh, "mesh_max_triangles", mesh_max_triangles);
+
+  if (!parseMeshSimplificationMode(mesh_simplification, mesh_simplification_.mode_))
+    return false;
+  mesh_simplification_.max_triangles_ = mesh_max_triangles > 0 ? mesh_max_triangles : 0;
+
+  return true;
+}
+
+bool ProductPerception::loadDescriptorLibrary(ros::NodeHandle& nh)
+{
+  bool use_descriptor_library = false;
+  ros_param_utilities::getBoolParameter(parent_name_, nh, "use_descriptor_library", use_descriptor_library);
+  if (!use_descriptor_library)
+    return true;
+
+  std::string descriptor_library_file;
+  if (!ros_param_utilities::getStringParameter(parent_name_, nh, "descriptor_library_file", descriptor_library_file) ||
+      !ros_param_utilities::getDoubleParameter(parent_name_, nh, "cluster_tolerance", cluster_tolerance_) ||
+      !ros_param_utilities::getIntParameter(parent_name_, nh, "min_cluster_size", min_cluster_size_))
+    return false;
+
+  // Relative paths are inside picknik_perception/data
+  if (!descriptor_library_file.empty() && descriptor_library_file[0] != '/')
+    descriptor_library_file = ros::package::getPath("picknik_perception") + "/data/" + descriptor_library_file;
+
+  descriptor_library_.reset(new ProductDescriptorLibrary());
+  if (!descriptor_library_->load(descriptor_library_file))
+  {
+    ROS_WARN_STREAM_NAMED(parent_name_,"Run build_descriptor_library to create " << descriptor_library_file
+                          << ", bins with several products get the whole cloud as their first product");
+    descriptor_library_.reset();
+    return false;
+  }
+  return true;
+}
+
+void ProductPerception::labelProducts(const std::vector<std::string>& expected_names, std::vector<std::string>& names,
+                                      std::vector<Cloud::Ptr>& clouds)
+{
+  const Cloud::Ptr& object_cloud = filter_->object_cloud_;
+  if (expected_names.empty())
+    return;
+
+  if (expected_names.size() == 1 || !descriptor_library_)
+  {
+    if (expected_names.size() > 1)
+      ROS_WARN_STREAM_NAMED(parent_name_,"No descriptor library loaded, can only handle one product");
+
+    names.push_back(expected_names.front());
+    clouds.push_back(object_cloud);
+    return;
+  }
+
+  ros::WallTime start_time = ros::WallTime::now();
+
+  // The library was rendered from views like the camera's, the descriptors need its position in the world frame
+  const Eigen::Vector3f viewpoint = object_cloud->sensor_origin_.head<3>();
+
+  // Segment into clusters
+  std::vector<pcl::PointIndices> cluster_indices;
+  pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
+  tree->setInputCloud(object_cloud);
+  pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> cluster_extraction;
+  cluster_extraction.setClusterTolerance(cluster_tolerance_);
+  cluster_extraction.setMinClusterSize(min_cluster_size_);
+  cluster_extraction.setSearchMethod(tree);
+  cluster_extraction.setInputCloud(object_cloud);
+  cluster_extraction.extract(cluster_indices);
+
+  // Describe each cluster and score it against every expected product
+  std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> cluster_clouds;
+  std::vector<std::vector<double> > distances;
+  for (std::size_t i = 0; i < cluster_indices.size(); ++i)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cluster(new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::copyPointCloud(*object_cloud, cluster_indices[i], *cluster);
+
+    ProductDescriptorLibrary::Cloud::Ptr cluster_xyz(new ProductDescriptorLibrary::Cloud);
+    pcl::copyPointCloud(*cluster, *cluster_xyz);
+    ProductDescriptor descriptor;
+    if (!descriptor_library_->computeDescriptor(cluster_xyz, viewpoint, descriptor))
+      continue;
+
+    std::vector<double> cluster_distances(expected_names.size(), std::numeric_limits<double>::max());
+    for (std::size_t j = 0; j < expected_names.size(); ++j)
+    {
+      std::vector<std::string> candidate(1, expected_names[j]);
+      double distance;
+      if (!descriptor_library_->match(descriptor, candidate, distance).empty())
+        cluster_distances[j] = distance;
+    }
+
+    cluster_clouds.push_back(cluster);
+    distances.push_back(cluster_distances);
+  }
+
+  // Greedily assign the most similar cluster and product pair until either runs out
+  std::vector<bool> cluster_used(cluster_clouds.size(), false);
+  std::vector<bool> name_used(expected_names.size(), false);
+  while (true)
+  {
+    double best_distance = std::numeric_limits<double>::max();
+    std::size_t best_cluster = 0;
+    std::size_t best_name = 0;
+    for (std::size_t i = 0; i < cluster_clouds.size(); ++i)
+      for (std::size_t j = 0; j < expected_names.size(); ++j)
+        if (!cluster_used[i] && !name_used[j] && distances[i][j] < best_distance)
+        {
+          best_distance = distances[i][j];
+          best_cluster = i;
+          best_name = j;
+        }
+
+    if (best_distance == std::numeric_limits<double>::max())
+      break;
+
+    cluster_used[best_cluster] = true;
+    name_used[best_name] = true;
+    names.push_back(expected_names[best_name]);
+    clouds.push_back(cluster_clouds[best_cluster]);
+    ROS_DEBUG_STREAM_NAMED(parent_name_,"Cluster " << best_cluster << " labeled "
+                           << expected_names[best_name] << " with distance " << best_distance);
+  }
+
+  for (std::size_t j = 0; j < expected_names.size(); ++j)
+    if (!name_used[j])
+      ROS_WARN_STREAM_NAMED(parent_name_,"No cluster matched " << expected_names[j]
+                            << (descriptor_library_->hasProduct(expected_names[j]) ? "" : ", it is not in the library"));
+
+  // Same as without a library rather than reporting nothing
+  if (names.empty())
+  {
+    ROS_WARN_STREAM_NAMED(parent_name_,"Unable to label any cluster, using the whole cloud for "
+                          << expected_names.front());
+    names.push_back(expected_names.front());
+    clouds.push_back(object_cloud);
+  }
+
+  ROS_INFO_STREAM_NAMED(parent_name_,"Labeled " << names.size() << " of " << expected_names.size()
+                        << " products from " << cluster_indices.size() << " clusters in "
+                        << (ros::WallTime::now() - start_time).toSec() << " seconds");
+}
+
+bool ProductPerception::estimateProductPose(const std::string& product_name, const Cloud& product_cloud,
+                                            const Eigen::Affine3d& world_to_bin, Eigen::Affine3d& bin_to_product,
+                                            double& confidence)
+{
+  if (!pose_estimator_ || !pose_estimator_->hasProduct(product_name))
+    return false;
+
+  ros::WallTime start_time = ros::WallTime::now();
+  PoseEstimate estimate;
+  if (!pose_estimator_->estimatePose(product_name, product_cloud, estimate))
+  {
+    ROS_WARN_STREAM_NAMED(parent_name_,"Unable to register model of " << product_name);
+    return false;
+  }
+  ROS_INFO_STREAM_NAMED(parent_name_,"Registered " << product_name << " with fitness " << estimate.fitness_
+                        << " in " << (ros::WallTime::now() - start_time).toSec() << " seconds");
+
+  if (estimate.fitness_ > max_pose_fitness_)
+  {
+    ROS_WARN_STREAM_NAMED(parent_name_,"Pose fitness of " << product_name << " is above max_pose_fitness");
+    return false;
+  }
+
+  bin_to_product = world_to_bin.inverse() * estimate.pose_;
+  confidence = 1.0 - estimate.fitness_ / max_pose_fitness_;
+  return true;
+}
+
+} // end namespace
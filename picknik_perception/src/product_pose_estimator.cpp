@@ -0,0 +1,251 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Estimate product poses by registering segmented clouds against cached product models
+*/
+
+#include <picknik_perception/product_pose_estimator.h>
+#include <picknik_perception/mesh_sampling.h>
+
+#include <vector>
+
+// Eigen
+#include <Eigen/Eigenvalues>
+
+// PCL
+#include <pcl/common/centroid.h>
+#include <pcl/common/io.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/registration/icp.h>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace picknik_perception
+{
+namespace fs = boost::filesystem;
+
+namespace
+{
+typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > TransformVector;
+typedef std::vector<PoseEstimate, Eigen::aligned_allocator<PoseEstimate> > PoseEstimateVector;
+
+/**
+ * \brief Refine one coarse hypothesis, run on its own thread
+ */
+void refineHypothesis(const ProductModelConstPtr& model, const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& scene,
+                      const Eigen::Matrix4f* scene_to_model_guess, double max_correspondence_distance,
+                      int max_iterations, PoseEstimate* result)
+{
+  // Register the scene against the model so that the resident model KD-tree is reused
+  pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ> icp;
+  icp.setInputSource(scene);
+  icp.setInputTarget(model->cloud_);
+  icp.setSearchMethodTarget(model->tree_, true);
+  icp.setMaxCorrespondenceDistance(max_correspondence_distance);
+  icp.setMaximumIterations(max_iterations);
+  icp.setTransformationEpsilon(1e-8);
+
+  pcl::PointCloud<pcl::PointXYZ> aligned;
+  icp.align(aligned, *scene_to_model_guess);
+
+  result->converged_ = icp.hasConverged();
+  result->fitness_ = icp.getFitnessScore();
+  result->pose_ = Eigen::Affine3d(icp.getFinalTransformation().cast<double>()).inverse();
+}
+} // namespace
+
+ProductPoseEstimator::ProductPoseEstimator(double model_leaf_size, double max_correspondence_distance,
+                                           int max_iterations)
+  : model_leaf_size_(model_leaf_size)
+  , max_correspondence_distance_(max_correspondence_distance)
+  , max_iterations_(max_iterations)
+{
+}
+
+std::size_t ProductPoseEstimator::loadProducts(const std::string& products_path)
+{
+  if (!fs::is_directory(products_path))
+  {
+    ROS_ERROR_STREAM_NAMED("pose_estimator","Products folder does not exist: " << products_path);
+    return 0;
+  }
+
+  ros::WallTime start_time = ros::WallTime::now();
+  for (fs::directory_iterator iter(products_path), end_iter; iter != end_iter; ++iter)
+  {
+    if (fs::is_directory(iter->path()))
+      loadProduct(iter->path().filename().string(), iter->path().string());
+  }
+
+  ROS_INFO_STREAM_NAMED("pose_estimator","Loaded " << models_.size() << " product models in "
+                        << (ros::WallTime::now() - start_time).toSec() << " seconds");
+  return models_.size();
+}
+
+bool ProductPoseEstimator::loadProduct(const std::string& name, const std::string& product_path)
+{
+  ProductModelPtr model(new ProductModel());
+  model->name_ = name;
+  model->cloud_.reset(new pcl::PointCloud<pcl::PointXYZ>);
+
+  if (!loadProductModelCloud(product_path, model_leaf_size_ / 2.0, *model->cloud_))
+    return false;
+
+  if (!finalizeModel(model))
+    return false;
+
+  models_[name] = model;
+  ROS_DEBUG_STREAM_NAMED("pose_estimator","Product " << name << " has " << model->cloud_->size() << " model points");
+  return true;
+}
+
+bool ProductPoseEstimator::hasProduct(const std::string& name) const
+{
+  return models_.find(name) != models_.end();
+}
+
+bool ProductPoseEstimator::estimatePose(const std::string& name, const Cloud& cloud, PoseEstimate& estimate) const
+{
+  std::map<std::string, ProductModelPtr>::const_iterator model_it = models_.find(name);
+  if (model_it == models_.end())
+  {
+    ROS_WARN_STREAM_NAMED("pose_estimator","No model loaded for product " << name);
+    return false;
+  }
+  const ProductModelConstPtr model = model_it->second;
+
+  // Downsample the scene to the resolution of the model
+  pcl::PointCloud<pcl::PointXYZ>::Ptr scene_full(new pcl::PointCloud<pcl::PointXYZ>);
+  pcl::copyPointCloud(cloud, *scene_full);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr scene(new pcl::PointCloud<pcl::PointXYZ>);
+  pcl::VoxelGrid<pcl::PointXYZ> voxel_grid;
+  voxel_grid.setInputCloud(scene_full);
+  voxel_grid.setLeafSize(model_leaf_size_, model_leaf_size_, model_leaf_size_);
+  voxel_grid.filter(*scene);
+
+  if (scene->size() < 3)
+  {
+    ROS_WARN_STREAM_NAMED("pose_estimator","Too few points to estimate the pose of " << name);
+    return false;
+  }
+
+  Eigen::Vector3f scene_centroid;
+  Eigen::Matrix3f scene_axes;
+  computePrincipalAxes(*scene, scene_centroid, scene_axes);
+
+  // Coarse alignment: match principal axes, for each of the four right handed axis sign combinations
+  static const float FLIPS[4][3] = { { 1, 1, 1 }, { 1, -1, -1 }, { -1, 1, -1 }, { -1, -1, 1 } };
+  TransformVector guesses(4);
+  for (std::size_t i = 0; i < guesses.size(); ++i)
+  {
+    const Eigen::Matrix3f flip = Eigen::Vector3f(FLIPS[i][0], FLIPS[i][1], FLIPS[i][2]).asDiagonal();
+    const Eigen::Matrix3f model_to_scene_rotation = scene_axes * flip * model->axes_.transpose();
+    const Eigen::Vector3f model_to_scene_translation = scene_centroid - model_to_scene_rotation * model->centroid_;
+
+    guesses[i] = Eigen::Matrix4f::Identity();
+    guesses[i].block<3, 3>(0, 0) = model_to_scene_rotation.transpose();
+    guesses[i].block<3, 1>(0, 3) = -model_to_scene_rotation.transpose() * model_to_scene_translation;
+  }
+
+  // Refine every hypothesis in parallel
+  PoseEstimateVector results(guesses.size());
+  boost::thread_group threads;
+  for (std::size_t i = 0; i < guesses.size(); ++i)
+  {
+    threads.create_thread(boost::bind(&refineHypothesis, model, pcl::PointCloud<pcl::PointXYZ>::ConstPtr(scene),
+                                      &guesses[i], max_correspondence_distance_, max_iterations_, &results[i]));
+  }
+  threads.join_all();
+
+  // Choose the best fit
+  estimate = PoseEstimate();
+  bool found = false;
+  for (std::size_t i = 0; i < results.size(); ++i)
+  {
+    ROS_DEBUG_STREAM_NAMED("pose_estimator","Hypothesis " << i << " for " << name << ": converged "
+                           << results[i].converged_ << ", fitness " << results[i].fitness_);
+    if (results[i].converged_ && results[i].fitness_ < estimate.fitness_)
+    {
+      estimate = results[i];
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+bool ProductPoseEstimator::finalizeModel(const ProductModelPtr& model) const
+{
+  pcl::PointCloud<pcl::PointXYZ>::Ptr downsampled(new pcl::PointCloud<pcl::PointXYZ>);
+  pcl::VoxelGrid<pcl::PointXYZ> voxel_grid;
+  voxel_grid.setInputCloud(model->cloud_);
+  voxel_grid.setLeafSize(model_leaf_size_, model_leaf_size_, model_leaf_size_);
+  voxel_grid.filter(*downsampled);
+
+  if (downsampled->size() < 3)
+  {
+    ROS_WARN_STREAM_NAMED("pose_estimator","Model of " << model->name_ << " is too small");
+    return false;
+  }
+  model->cloud_ = downsampled;
+
+  computePrincipalAxes(*model->cloud_, model->centroid_, model->axes_);
+
+  model->tree_.reset(new pcl::search::KdTree<pcl::PointXYZ>);
+  model->tree_->setInputCloud(model->cloud_);
+  return true;
+}
+
+void ProductPoseEstimator::computePrincipalAxes(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                                                Eigen::Vector3f& centroid, Eigen::Matrix3f& axes)
+{
+  Eigen::Vector4f centroid4;
+  pcl::compute3DCentroid(cloud, centroid4);
+  centroid = centroid4.head<3>();
+
+  Eigen::Matrix3f covariance;
+  pcl::computeCovarianceMatrixNormalized(cloud, centroid4, covariance);
+
+  // Eigen vectors sorted by decreasing eigen value
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance, Eigen::ComputeEigenvectors);
+  axes.col(0) = solver.eigenvectors().col(2);
+  axes.col(1) = solver.eigenvectors().col(1);
+  axes.col(2) = axes.col(0).cross(axes.col(1));
+}
+
+} // end namespace
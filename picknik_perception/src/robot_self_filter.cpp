@@ -0,0 +1,107 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Removes the robot's own links from camera clouds before the region of interest crop
+*/
+
+#include <picknik_perception/point_cloud_filter.h>
+
+// MoveIt
+#include <moveit/robot_model_loader/robot_model_loader.h>
+
+// ROS
+#include <tf/transform_listener.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+namespace picknik_perception
+{
+
+class RobotSelfFilter
+{
+public:
+  RobotSelfFilter()
+    : nh_("~")
+  {
+    // Load parameters
+    const std::string parent_name = "robot_self_filter"; // for namespacing logging messages
+    std::string map_frame = "/world";
+    double scale = 1.0;
+    double padding = 0.02;
+    ros_param_utilities::getStringParameter(parent_name, nh_, "map_frame", map_frame);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "link_scale", scale);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "link_padding", padding);
+
+    // Optional subset of links to filter, all links with collision geometry otherwise
+    std::vector<std::string> link_names;
+    nh_.getParam("links", link_names);
+
+    tf_.reset(new tf::TransformListener());
+    filter_.reset(new PointCloudFilter(tf_, map_frame));
+    filter_->initialize();
+
+    robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+    robot_model::RobotModelConstPtr robot_model = robot_model_loader.getModel();
+    if (!robot_model)
+    {
+      ROS_ERROR_STREAM_NAMED("robot_self_filter","Unable to load robot model, not filtering");
+      return;
+    }
+
+    filter_->excludeRobotLinks(robot_model, link_names, scale, padding);
+    filter_->start();
+  }
+
+private:
+  ros::NodeHandle nh_;
+  boost::shared_ptr<tf::TransformListener> tf_;
+  PointCloudFilterPtr filter_;
+}; // end class RobotSelfFilter
+
+} // end namespace picknik_perception
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "robot_self_filter");
+
+  // TF lookups block in the cloud callback, keep a second thread free for TF messages
+  ros::AsyncSpinner spinner(2);
+  spinner.start();
+
+  picknik_perception::RobotSelfFilter self_filter;
+
+  ros::waitForShutdown();
+}
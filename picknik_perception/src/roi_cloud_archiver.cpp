@@ -0,0 +1,301 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Archives region of interest point clouds to disk on a background thread
+*/
+
+#include <picknik_perception/roi_cloud_archiver.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+// ROS
+#include <ros/package.h>
+
+// PCL
+#include <pcl/filters/filter.h>
+#include <pcl/io/pcd_io.h>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+namespace picknik_perception
+{
+namespace fs = boost::filesystem;
+
+namespace
+{
+static const std::string FILE_PREFIX = "roi_pc_";
+
+struct FileByWriteTime
+{
+  bool operator()(const std::pair<std::time_t, std::string>& a,
+                  const std::pair<std::time_t, std::string>& b) const
+  {
+    return a.first < b.first;
+  }
+};
+} // namespace
+
+RoiCloudArchiver::RoiCloudArchiver(const std::string& save_directory, std::size_t quota_bytes,
+                                   std::size_t max_queue_size)
+  : save_directory_(save_directory)
+  , quota_bytes_(quota_bytes)
+  , max_queue_size_(std::max<std::size_t>(max_queue_size, 1))
+  , next_id_(0)
+  , archived_bytes_(0)
+  , writing_(false)
+  , shutdown_(false)
+{
+  scanSaveDirectory();
+
+  writer_thread_ = boost::thread(boost::bind(&RoiCloudArchiver::writeLoop, this));
+
+  ROS_DEBUG_STREAM_NAMED("roi_cloud_archiver","Archiving to " << save_directory_ << " starting at id "
+                         << next_id_ << ", " << archived_bytes_ << " bytes already on disk");
+}
+
+RoiCloudArchiver::~RoiCloudArchiver()
+{
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    shutdown_ = true;
+  }
+  queue_changed_.notify_all();
+  writer_thread_.join();
+}
+
+RoiCloudArchiverPtr RoiCloudArchiver::createDefault(std::size_t quota_bytes, std::size_t max_queue_size)
+{
+  // Save files in picknik_perception/data/roi_pcds
+  const std::string package_path = ros::package::getPath("picknik_perception");
+  return RoiCloudArchiverPtr(new RoiCloudArchiver(package_path + "/data/roi_pcds", quota_bytes, max_queue_size));
+}
+
+bool RoiCloudArchiver::archive(const Cloud& cloud)
+{
+  // Copy outside of the lock, the caller keeps ownership of its cloud
+  QueuedCloud queued;
+  queued.cloud_.reset(new Cloud(cloud));
+  queued.stamp_ = ros::WallTime::now();
+
+  bool dropped = false;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    queued.id_ = next_id_++;
+
+    if (queue_.size() >= max_queue_size_)
+    {
+      ROS_WARN_STREAM_NAMED("roi_cloud_archiver","Writer is behind, dropping queued cloud " << queue_.front().id_);
+      queue_.pop_front();
+      dropped = true;
+    }
+    queue_.push_back(queued);
+  }
+  queue_changed_.notify_all();
+
+  return !dropped;
+}
+
+void RoiCloudArchiver::waitUntilEmpty()
+{
+  boost::mutex::scoped_lock lock(queue_mutex_);
+  while (!queue_.empty() || writing_)
+    queue_changed_.wait(lock);
+}
+
+void RoiCloudArchiver::scanSaveDirectory()
+{
+  // Use the error code overloads throughout, an unreadable archive must not abort startup
+  fs::path save_path(save_directory_);
+  boost::system::error_code ec;
+  if (!fs::exists(save_path, ec))
+    fs::create_directories(save_path, ec);
+  if (ec)
+  {
+    ROS_ERROR_STREAM_NAMED("roi_cloud_archiver","Unable to create " << save_directory_ << ": " << ec.message());
+    return;
+  }
+
+  std::vector<std::pair<std::time_t, std::string> > files;
+  fs::directory_iterator iter(save_path, ec);
+  if (ec)
+  {
+    ROS_ERROR_STREAM_NAMED("roi_cloud_archiver","Unable to read " << save_directory_ << ": " << ec.message());
+    return;
+  }
+  for (fs::directory_iterator end_iter; iter != end_iter; iter.increment(ec))
+  {
+    if (ec)
+    {
+      ROS_ERROR_STREAM_NAMED("roi_cloud_archiver","Unable to read " << save_directory_ << ": " << ec.message());
+      break;
+    }
+    if (iter->path().extension() != ".pcd")
+      continue;
+
+    const std::string name = iter->path().filename().string();
+    const std::time_t write_time = fs::last_write_time(iter->path(), ec);
+    if (ec)
+    {
+      ROS_WARN_STREAM_NAMED("roi_cloud_archiver","Skipping " << iter->path().string() << ": " << ec.message());
+      continue;
+    }
+    files.push_back(std::make_pair(write_time, iter->path().string()));
+
+    // Continue numbering after the highest existing id (roi_pc_<id>.pcd or roi_pc_<id>_<stamp>.pcd)
+    if (name.compare(0, FILE_PREFIX.size(), FILE_PREFIX) == 0)
+    {
+      const std::size_t id = std::strtoul(name.c_str() + FILE_PREFIX.size(), NULL, 10);
+      next_id_ = std::max(next_id_, id + 1);
+    }
+  }
+
+  // Oldest first so that the quota removes them first
+  std::sort(files.begin(), files.end(), FileByWriteTime());
+  for (std::size_t i = 0; i < files.size(); ++i)
+  {
+    ArchivedFile file;
+    file.path_ = files[i].second;
+    file.size_ = fs::file_size(file.path_, ec);
+    if (ec)
+    {
+      ROS_WARN_STREAM_NAMED("roi_cloud_archiver","Not counting " << file.path_ << ": " << ec.message());
+      continue;
+    }
+    archived_files_.push_back(file);
+    archived_bytes_ += file.size_;
+  }
+
+  enforceQuota();
+}
+
+void RoiCloudArchiver::enforceQuota()
+{
+  if (quota_bytes_ == 0)
+    return;
+
+  while (archived_bytes_ > quota_bytes_ && !archived_files_.empty())
+  {
+    const ArchivedFile& oldest = archived_files_.front();
+    ROS_DEBUG_STREAM_NAMED("roi_cloud_archiver","Over quota, removing " << oldest.path_);
+
+    boost::system::error_code ec;
+    fs::remove(oldest.path_, ec);
+    if (ec)
+      ROS_WARN_STREAM_NAMED("roi_cloud_archiver","Unable to remove " << oldest.path_ << ": " << ec.message());
+
+    archived_bytes_ -= std::min(archived_bytes_, oldest.size_);
+    archived_files_.pop_front();
+  }
+}
+
+void RoiCloudArchiver::writeLoop()
+{
+  while (true)
+  {
+    QueuedCloud queued;
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      while (queue_.empty() && !shutdown_)
+        queue_changed_.wait(lock);
+
+      // Flush everything before shutting down
+      if (queue_.empty())
+        return;
+
+      queued = queue_.front();
+      queue_.pop_front();
+      writing_ = true;
+    }
+
+    writeCloud(*queued.cloud_, queued.id_, queued.stamp_);
+
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      writing_ = false;
+    }
+    queue_changed_.notify_all();
+  }
+}
+
+void RoiCloudArchiver::writeCloud(const Cloud& cloud, std::size_t id, const ros::WallTime& stamp)
+{
+  std::stringstream file_name;
+  file_name << save_directory_ << "/" << FILE_PREFIX << std::setw(6) << std::setfill('0') << id << "_"
+            << stamp.sec << "." << std::setw(9) << std::setfill('0') << stamp.nsec << ".pcd";
+  const std::string full_path = file_name.str();
+
+  // remove nan's
+  Cloud new_cloud;
+  std::vector<int> indices;
+  pcl::removeNaNFromPointCloud(cloud, new_cloud, indices);
+  new_cloud.sensor_origin_ = cloud.sensor_origin_;  // saved as the VIEWPOINT for replay
+
+  if (new_cloud.empty())
+  {
+    ROS_WARN_STREAM_NAMED("roi_cloud_archiver","Not saving empty cloud " << id);
+    return;
+  }
+
+  ROS_DEBUG_STREAM_NAMED("roi_cloud_archiver","saving " << new_cloud.size() << " points to: " << full_path);
+
+  // save to file
+  if (pcl::io::savePCDFileBinaryCompressed(full_path, new_cloud) != 0)
+  {
+    ROS_ERROR_STREAM_NAMED("roi_cloud_archiver","Unable to save " << full_path);
+    return;
+  }
+
+  // Throwing here would terminate the writer thread, and with it the process
+  boost::system::error_code ec;
+  ArchivedFile file;
+  file.path_ = full_path;
+  file.size_ = fs::file_size(full_path, ec);
+  if (ec)
+  {
+    ROS_WARN_STREAM_NAMED("roi_cloud_archiver","Not counting " << full_path << ": " << ec.message());
+    return;
+  }
+  archived_files_.push_back(file);
+  archived_bytes_ += file.size_;
+
+  enforceQuota();
+}
+
+} // end namespace
@@ -0,0 +1,260 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Voxel occupancy model of the empty shelf, used to remove shelf points from product clouds
+*/
+
+#include <picknik_perception/shelf_background_model.h>
+#include <picknik_perception/mesh_sampling.h>
+
+#include <algorithm>
+#include <cmath>
+
+// ROS
+#include <ros/package.h>
+
+// PCL
+#include <pcl/io/pcd_io.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+namespace picknik_perception
+{
+
+ShelfBackgroundModel::ShelfBackgroundModel(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner,
+                                           double resolution, int inflation)
+  : min_corner_(min_corner)
+  , resolution_(resolution)
+  , inflation_(std::max(0, inflation))
+{
+  const Eigen::Vector3d extent = max_corner - min_corner;
+  size_x_ = std::max(1, static_cast<int>(std::ceil(extent.x() / resolution_)));
+  size_y_ = std::max(1, static_cast<int>(std::ceil(extent.y() / resolution_)));
+  size_z_ = std::max(1, static_cast<int>(std::ceil(extent.z() / resolution_)));
+
+  occupied_.assign(static_cast<std::size_t>(size_x_) * size_y_ * size_z_, 0);
+
+  ROS_DEBUG_STREAM_NAMED("shelf_background","Background grid of " << size_x_ << " x " << size_y_ << " x "
+                         << size_z_ << " voxels at " << resolution_ << " m");
+}
+
+boost::shared_ptr<ShelfBackgroundModel> ShelfBackgroundModel::loadFromParameters(ros::NodeHandle nh,
+                                                                                const Eigen::Vector3d& min_corner,
+                                                                                const Eigen::Vector3d& max_corner)
+{
+  const std::string parent_name = "shelf_background"; // for namespacing logging messages
+  ShelfBackgroundModelPtr empty;
+
+  std::string background_source;
+  double background_resolution;
+  int background_inflation;
+  if (!ros_param_utilities::getStringParameter(parent_name, nh, "background_source", background_source) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "background_resolution", background_resolution) ||
+      !ros_param_utilities::getIntParameter(parent_name, nh, "background_inflation", background_inflation))
+    return empty;
+
+  ShelfBackgroundModelPtr background_model(new ShelfBackgroundModel(min_corner, max_corner, background_resolution,
+                                                                    background_inflation));
+
+  ros::WallTime start_time = ros::WallTime::now();
+  if (background_source == "mesh")
+  {
+    std::vector<double> collision_shelf_transform;
+    double collision_shelf_transform_x_offset;
+    if (!ros_param_utilities::getDoubleParameters(parent_name, nh, "collision_shelf_transform", collision_shelf_transform) ||
+        !ros_param_utilities::getDoubleParameter(parent_name, nh, "collision_shelf_transform_x_offset",
+                                                 collision_shelf_transform_x_offset))
+      return empty;
+
+    const std::string mesh_path = "file://" + ros::package::getPath("picknik_main") + "/meshes/computer_vision/shelf.stl";
+    if (!background_model->addMesh(mesh_path, convertCollisionShelfTransform(collision_shelf_transform,
+                                                                             collision_shelf_transform_x_offset)))
+      return empty;
+  }
+  else if (background_source == "scan")
+  {
+    std::string background_scan_file;
+    if (!ros_param_utilities::getStringParameter(parent_name, nh, "background_scan_file", background_scan_file))
+      return empty;
+
+    // Relative paths are inside picknik_perception/data
+    if (!background_scan_file.empty() && background_scan_file[0] != '/')
+      background_scan_file = ros::package::getPath("picknik_perception") + "/data/" + background_scan_file;
+
+    if (!background_model->addPCDFile(background_scan_file))
+      return empty;
+  }
+  else
+  {
+    ROS_ERROR_STREAM_NAMED("shelf_background","Unknown background_source '" << background_source
+                           << "', expected 'mesh' or 'scan'");
+    return empty;
+  }
+
+  ROS_INFO_STREAM_NAMED("shelf_background","Background model built in "
+                        << (ros::WallTime::now() - start_time).toSec() << " seconds");
+  return background_model;
+}
+
+bool ShelfBackgroundModel::addMesh(const std::string& resource, const Eigen::Affine3d& pose)
+{
+  // Sample finer than the voxel size so that no surface voxel is skipped
+  pcl::PointCloud<pcl::PointXYZ> surface;
+  if (!sampleMeshSurface(resource, pose, resolution_ / 2.0, surface))
+    return false;
+
+  for (std::size_t i = 0; i < surface.size(); ++i)
+    markPoint(Eigen::Vector3d(surface.points[i].x, surface.points[i].y, surface.points[i].z));
+
+  ROS_INFO_STREAM_NAMED("shelf_background","Loaded " << resource << ", " << getOccupiedCount()
+                        << " background voxels");
+  return true;
+}
+
+void ShelfBackgroundModel::addCloud(const Cloud& cloud)
+{
+  for (std::size_t i = 0; i < cloud.size(); ++i)
+  {
+    const pcl::PointXYZRGB& point = cloud.points[i];
+    if (!pcl_isfinite(point.x) || !pcl_isfinite(point.y) || !pcl_isfinite(point.z))
+      continue;
+    markPoint(Eigen::Vector3d(point.x, point.y, point.z));
+  }
+}
+
+bool ShelfBackgroundModel::addPCDFile(const std::string& file_path)
+{
+  Cloud cloud;
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(file_path, cloud) == -1)
+  {
+    ROS_ERROR_STREAM_NAMED("shelf_background","Unable to load background scan " << file_path);
+    return false;
+  }
+  addCloud(cloud);
+
+  ROS_INFO_STREAM_NAMED("shelf_background","Loaded " << cloud.size() << " points from " << file_path
+                        << ", " << getOccupiedCount() << " background voxels");
+  return true;
+}
+
+void ShelfBackgroundModel::removeBackground(const Cloud& input, Cloud& output) const
+{
+  Cloud foreground;
+  foreground.header = input.header;
+  foreground.points.reserve(input.size());
+
+  for (std::size_t i = 0; i < input.size(); ++i)
+  {
+    const pcl::PointXYZRGB& point = input.points[i];
+    if (!pcl_isfinite(point.x) || !pcl_isfinite(point.y) || !pcl_isfinite(point.z))
+      continue;
+    if (!isBackground(point.x, point.y, point.z))
+      foreground.points.push_back(point);
+  }
+
+  foreground.width = foreground.points.size();
+  foreground.height = 1;
+  foreground.is_dense = true;
+
+  // Allows input and output to be the same cloud
+  output.swap(foreground);
+}
+
+bool ShelfBackgroundModel::isBackground(double x, double y, double z) const
+{
+  int ix, iy, iz;
+  if (!getCell(x, y, z, ix, iy, iz))
+    return false;
+  return occupied_[getIndex(ix, iy, iz)] != 0;
+}
+
+std::size_t ShelfBackgroundModel::getOccupiedCount() const
+{
+  return occupied_.size() - std::count(occupied_.begin(), occupied_.end(), 0);
+}
+
+Eigen::Affine3d ShelfBackgroundModel::convertCollisionShelfTransform(const std::vector<double>& transform,
+                                                                     double x_offset)
+{
+  if (transform.size() != 6)
+  {
+    ROS_ERROR_STREAM_NAMED("shelf_background","collision_shelf_transform needs 6 values, got " << transform.size());
+    return Eigen::Affine3d::Identity();
+  }
+
+  // Same convention as ShelfObject::loadComputerVisionShelf() in picknik_main
+  Eigen::Affine3d computer_vision_shelf_pose = Eigen::Affine3d::Identity();
+  computer_vision_shelf_pose *= Eigen::AngleAxisd(transform[5], Eigen::Vector3d::UnitZ()) *
+                                Eigen::AngleAxisd(transform[4], Eigen::Vector3d::UnitY()) *
+                                Eigen::AngleAxisd(transform[3], Eigen::Vector3d::UnitX());
+  computer_vision_shelf_pose.translation() = Eigen::Vector3d(transform[0], transform[1], transform[2]);
+
+  // convert to ros frame (mesh is saved in computer vision frame)
+  Eigen::Affine3d shelf_pose = computer_vision_shelf_pose *
+                               Eigen::AngleAxisd(-M_PI / 2.0, Eigen::Vector3d::UnitX()) *
+                               Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitY());
+  shelf_pose.translation().x() -= x_offset;
+  return shelf_pose;
+}
+
+void ShelfBackgroundModel::markPoint(const Eigen::Vector3d& point)
+{
+  int ix, iy, iz;
+  if (!getCell(point.x(), point.y(), point.z(), ix, iy, iz))
+    return;
+
+  for (int x = std::max(0, ix - inflation_); x <= std::min(size_x_ - 1, ix + inflation_); ++x)
+    for (int y = std::max(0, iy - inflation_); y <= std::min(size_y_ - 1, iy + inflation_); ++y)
+      for (int z = std::max(0, iz - inflation_); z <= std::min(size_z_ - 1, iz + inflation_); ++z)
+        occupied_[getIndex(x, y, z)] = 1;
+}
+
+bool ShelfBackgroundModel::getCell(double x, double y, double z, int& ix, int& iy, int& iz) const
+{
+  const double fx = std::floor((x - min_corner_.x()) / resolution_);
+  const double fy = std::floor((y - min_corner_.y()) / resolution_);
+  const double fz = std::floor((z - min_corner_.z()) / resolution_);
+
+  if (fx < 0 || fy < 0 || fz < 0 || fx >= size_x_ || fy >= size_y_ || fz >= size_z_)
+    return false;
+
+  ix = static_cast<int>(fx);
+  iy = static_cast<int>(fy);
+  iz = static_cast<int>(fz);
+  return true;
+}
+
+} // end namespace
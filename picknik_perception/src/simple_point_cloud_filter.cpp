@@ -65,9 +65,9 @@ SimplePointCloudFilter::SimplePointCloudFilter(rviz_visual_tools::RvizVisualTool
   : visual_tools_(visual_tools)
   , nh_("~")
   , has_roi_(false)
+  , publish_roi_cloud_(true)
+  , archive_roi_(true)
 {
-  processing_ = false;
-
   // set regoin of interest
   roi_depth_ = 1.0;
   roi_width_ = 1.0;
@@ -77,6 +77,7 @@ SimplePointCloudFilter::SimplePointCloudFilter(rviz_visual_tools::RvizVisualTool
   // initialize cloud pointers
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr roi_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
   roi_cloud_ = roi_cloud;
+  object_cloud_.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
 
   // publish bin point cloud
   roi_cloud_pub_ = nh_.advertise<pcl::PointCloud<pcl::PointXYZRGB> >("roi_cloud",1);
@@ -87,6 +88,14 @@ SimplePointCloudFilter::SimplePointCloudFilter(rviz_visual_tools::RvizVisualTool
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "min_number_of_neighbors", min_number_of_neighbors_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "mean_k", mean_k_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "std_dev_thresh", std_dev_thresh_);
+  double roi_archive_quota_mb = 0; // unlimited
+  int roi_archive_queue_size = 4;
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "roi_archive_quota_mb", roi_archive_quota_mb);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "roi_archive_queue_size", roi_archive_queue_size);
+
+  // Background writer for saved regions of interest
+  roi_archiver_ = RoiCloudArchiver::createDefault(std::max(0.0, roi_archive_quota_mb) * 1024 * 1024,
+                                                  std::max(1, roi_archive_queue_size));
 
   ROS_DEBUG_STREAM_NAMED("point_cloud_filter","Simple point cloud filter ready.");
 }
@@ -105,15 +114,14 @@ bool SimplePointCloudFilter::publishRegionOfInterest()
 
 void SimplePointCloudFilter::pointCloudCallback(const sensor_msgs::PointCloud2ConstPtr& msg)
 {
-  if (processing_)
+  boost::mutex::scoped_lock lock(processing_mutex_, boost::try_to_lock);
+  if (!lock.owns_lock())
   {
     ROS_INFO_STREAM_THROTTLE_NAMED(2.0, "point_cloud_filter","Skipped point cloud because currently busy");
     return;
   }
 
-  processing_ = true;
   processPointCloud(msg);
-  processing_ = false;
 }
 
 void SimplePointCloudFilter::processPointCloud(const sensor_msgs::PointCloud2ConstPtr& msg)
@@ -126,52 +134,124 @@ void SimplePointCloudFilter::processPointCloud(const sensor_msgs::PointCloud2Con
   //ROS_DEBUG_STREAM_NAMED("perception","Waiting for transform from " << BASE_LINK << " to " << cloud->header.frame_id);
   tf_listener_.waitForTransform(BASE_LINK, cloud->header.frame_id, msg->header.stamp, ros::Duration(2.0));
 
-  if (!pcl_ros::transformPointCloud(BASE_LINK, *cloud, *roi_cloud_, tf_listener_))
+  // Always fill a new cloud so that clouds already handed out are never modified
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr world_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (!pcl_ros::transformPointCloud(BASE_LINK, *cloud, *world_cloud, tf_listener_))
   {
     ROS_ERROR_STREAM_NAMED("point_cloud_filter.process","Error converting to desired frame");
   }
 
+  // Remember where the camera was, descriptors depend on the viewpoint
+  try
+  {
+    tf::StampedTransform camera_transform;
+    tf_listener_.lookupTransform(BASE_LINK, cloud->header.frame_id, msg->header.stamp, camera_transform);
+    const tf::Vector3& origin = camera_transform.getOrigin();
+    world_cloud->sensor_origin_ = Eigen::Vector4f(origin.x(), origin.y(), origin.z(), 0.0f);
+  }
+  catch (const tf::TransformException& e)
+  {
+    ROS_WARN_STREAM_NAMED("point_cloud_filter.process","No camera origin for " << cloud->header.frame_id << ": "
+                          << e.what());
+  }
+
+  cropWorldCloud(world_cloud);
+}
+
+void SimplePointCloudFilter::processWorldCloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr& world_cloud)
+{
+  boost::mutex::scoped_lock lock(processing_mutex_);
+  cropWorldCloud(world_cloud);
+}
+
+void SimplePointCloudFilter::cropWorldCloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr& world_cloud)
+{
+  // The caller's cloud is never modified, the first crop writes into a new cloud
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr roi_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+
   if (!has_roi_)
   {
     ROS_DEBUG_STREAM_THROTTLE_NAMED(2, "point_cloud_filter","No region of interest specified yet, showing all points");
+    *roi_cloud = *world_cloud;
   }
   else
   {
 
     // Filter based on bin location
     pcl::PassThrough<pcl::PointXYZRGB> pass_x;
-    pass_x.setInputCloud(roi_cloud_);
+    pass_x.setInputCloud(world_cloud);
     pass_x.setFilterFieldName("x");
     pass_x.setFilterLimits(roi_pose_.translation()[0]-roi_depth_ / 2.0, roi_pose_.translation()[0] + roi_depth_ / 2.0);
-    pass_x.filter(*roi_cloud_);
+    pass_x.filter(*roi_cloud);
 
     pcl::PassThrough<pcl::PointXYZRGB> pass_y;
-    pass_y.setInputCloud(roi_cloud_);
+    pass_y.setInputCloud(roi_cloud);
     pass_y.setFilterFieldName("y");
     pass_y.setFilterLimits(roi_pose_.translation()[1] - roi_width_ / 2.0, roi_pose_.translation()[1] + roi_width_ / 2.0);
-    pass_y.filter(*roi_cloud_);
+    pass_y.filter(*roi_cloud);
 
     pcl::PassThrough<pcl::PointXYZRGB> pass_z;
-    pass_z.setInputCloud(roi_cloud_);
+    pass_z.setInputCloud(roi_cloud);
     pass_z.setFilterFieldName("z");
     pass_z.setFilterLimits(roi_pose_.translation()[2] - roi_height_ / 2.0, roi_pose_.translation()[2] + roi_height_ / 2.0);
-    pass_z.filter(*roi_cloud_);
+    pass_z.filter(*roi_cloud);
+  }
+
+  // Remove shelf walls, lips and floor
+  if (background_model_)
+  {
+    const std::size_t cropped_size = roi_cloud->size();
+    background_model_->removeBackground(*roi_cloud, *roi_cloud);
+    ROS_DEBUG_STREAM_THROTTLE_NAMED(2, "point_cloud_filter","Background subtraction kept " << roi_cloud->size()
+                                    << " of " << cropped_size << " points");
   }
 
+  // Crops and background removal do not all keep the sensor origin
+  roi_cloud->sensor_origin_ = world_cloud->sensor_origin_;
+  roi_cloud_ = roi_cloud;
+
   // publish point clouds for rviz
-  roi_cloud_pub_.publish(roi_cloud_);
-  ROS_DEBUG_STREAM_THROTTLE_NAMED(2, "point_cloud_filter","Publishing filtered point cloud");
+  if (publish_roi_cloud_)
+  {
+    roi_cloud_pub_.publish(roi_cloud_);
+    ROS_DEBUG_STREAM_THROTTLE_NAMED(2, "point_cloud_filter","Publishing filtered point cloud");
+  }
+
+  if (processed_cloud_callback_)
+    processed_cloud_callback_(roi_cloud_);
+}
+
+void SimplePointCloudFilter::setProcessedCloudCallback(const ProcessedCloudCallback& callback)
+{
+  boost::mutex::scoped_lock lock(processing_mutex_);
+  processed_cloud_callback_ = callback;
+}
+
+void SimplePointCloudFilter::setBackgroundModel(const ShelfBackgroundModelConstPtr& model)
+{
+  boost::mutex::scoped_lock lock(processing_mutex_);
+  background_model_ = model;
+}
+
+void SimplePointCloudFilter::enableRoiCloudPublishing(bool enable)
+{
+  boost::mutex::scoped_lock lock(processing_mutex_);
+  publish_roi_cloud_ = enable;
+}
+
+void SimplePointCloudFilter::enableRoiArchiving(bool enable)
+{
+  boost::mutex::scoped_lock lock(processing_mutex_);
+  archive_roi_ = enable;
 }
 
 bool SimplePointCloudFilter::detectObjects(bool remove_outliers)
 {
   // wait until other loop is done processing, then block that loop
-  while (processing_)
-  {
-    ros::Duration(0.1).sleep();
-    ROS_INFO_STREAM_THROTTLE_NAMED(1,"point_cloud_filter","Waiting for main point cloud callback to finish processing");
-  }
-  processing_ = true;
+  boost::mutex::scoped_lock lock(processing_mutex_);
+
+  // Filter into a new cloud, roi_cloud_ may still be held by a subscriber
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_cloud(new pcl::PointCloud<pcl::PointXYZRGB>(*roi_cloud_));
 
   if (remove_outliers)
   {
@@ -181,40 +261,38 @@ bool SimplePointCloudFilter::detectObjects(bool remove_outliers)
     rad.setInputCloud(roi_cloud_);
     rad.setRadiusSearch(radius_of_outlier_removal_);
     rad.setMinNeighborsInRadius(min_number_of_neighbors_);
-    rad.filter(*roi_cloud_);
+    rad.filter(*object_cloud);
 
     pcl::StatisticalOutlierRemoval<pcl::PointXYZRGB> sor;
-    sor.setInputCloud(roi_cloud_);
+    sor.setInputCloud(object_cloud);
     sor.setMeanK(mean_k_);
     sor.setStddevMulThresh(std_dev_thresh_);
-    sor.filter(*roi_cloud_);
+    sor.filter(*object_cloud);
   }
+  object_cloud->sensor_origin_ = roi_cloud_->sensor_origin_;
+  object_cloud_ = object_cloud;
 
   // publish point clouds for rviz
-  roi_cloud_pub_.publish(roi_cloud_);
-  ros::Duration(5).sleep();
+  roi_cloud_pub_.publish(object_cloud_);
 
-  if (roi_cloud_->points.size() == 0)
+  if (object_cloud_->points.size() == 0)
   {
     ROS_WARN_STREAM_THROTTLE_NAMED(2, "point_cloud_filter.process","0 points in region of interest");
-    processing_ = false;
     return false;
   }
 
   // get the bounding box of the point cloud
-  // bounding_box_.getBodyAlignedBoundingBox(roi_cloud_, Eigen::Affine3d::Identity(), bbox_pose_, bbox_depth_, bbox_width_, bbox_height_);
+  // bounding_box_.getBodyAlignedBoundingBox(object_cloud_, Eigen::Affine3d::Identity(), bbox_pose_, bbox_depth_, bbox_width_, bbox_height_);
 
-  ROS_DEBUG_STREAM_NAMED("simple_point_cloud_filter.detectObjects","roi_cloud_->header.frame_id = " << roi_cloud_->header.frame_id);
+  ROS_DEBUG_STREAM_NAMED("simple_point_cloud_filter.detectObjects","object_cloud_->header.frame_id = " << object_cloud_->header.frame_id);
 
   // save bounding_box_ point cloud for debugging
   // ROS_DEBUG_STREAM_NAMED("simple_point_cloud_filter.detectObjects","saving bbox_.cloud with " << bounding_box_.cloud_->size() << " points");
   // bounding_box_.cloud_->width = 1;
   // bounding_box_.cloud_->height = bounding_box_.cloud_->size();
-  saveRegionOfInterest(roi_cloud_);
-  
-  // Allow main loop to work again
-  processing_ = false;
-  
+  if (archive_roi_)
+    saveRegionOfInterest(object_cloud_);
+
   return true;
 }
 
@@ -250,41 +328,8 @@ void SimplePointCloudFilter::setRegionOfInterest(Eigen::Affine3d bottom_right_fr
 
 void SimplePointCloudFilter::saveRegionOfInterest(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud)
 {
-
-  // Save files in picknik_perception/data/roi_pcds
-  std::string package_path = ros::package::getPath("picknik_perception");
-
-  // from: http://www.cplusplus.com/forum/beginner/70854/
-  namespace fs = boost::filesystem;
-  fs::path save_path(package_path + "/data/roi_pcds");
-  fs::directory_iterator end_iter;
-
-  // get unique identifier for file (count number of pcd files in folder)
-  std::size_t file_count = 0;
-
-  for (fs::directory_iterator iter(save_path); iter != end_iter; ++iter)
-  {
-    if (iter->path().extension() == ".pcd")
-    {
-      file_count++;
-    }
-  }
-  
-  ROS_DEBUG_STREAM_NAMED("point_cloud_filter.save","number of files in directory: " << file_count);
-
-  std::stringstream file_name;
-  file_name << save_path.string() << "/roi_pc_" <<(int)file_count << ".pcd";
-  std::string full_path = file_name.str();
-
-  ROS_DEBUG_STREAM_NAMED("point_cloud_filter.save","saving file to: " << full_path);
-
-  // remove nan's
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr new_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-  std::vector<int> indices;
-  pcl::removeNaNFromPointCloud(*cloud, *new_cloud, indices);
-
-  // save to file
-  pcl::io::savePCDFileASCII(full_path, *new_cloud);
+  // Copies the cloud and returns, NaN removal and writing happen on the archiver thread
+  roi_archiver_->archive(*cloud);
 }
 
 void SimplePointCloudFilter::resetRegionOfInterst()
@@ -75,6 +75,8 @@ private:
 
   bounding_box::BoundingBox bbox_;
 
+  RoiCloudArchiverPtr roi_archiver_;
+
   std::size_t id_;
   bool is_done_;
 
@@ -104,6 +106,8 @@ public:
 
     id_ = 0;
 
+    roi_archiver_ = RoiCloudArchiver::createDefault();
+
     // subscribe to point clouds
     merged_sub_ = nh_.subscribe("/merge_point_clouds/points", 1, 
                             &PicknikPerceptionTester::mergedPointCloudCallback, this);
@@ -138,7 +142,8 @@ public:
       return;
     }
 
-    SimplePointCloudFilter::saveRegionOfInterest(roi_cloud_);
+    roi_archiver_->archive(*roi_cloud_);
+    roi_archiver_->waitUntilEmpty();
 
   }
 
@@ -0,0 +1,51 @@
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc  : Offline computation of the product descriptor library loaded by pcl_perception_server
+
+  Usage: rosrun picknik_perception build_descriptor_library [output_file]
+  Defaults to picknik_perception/data/product_descriptors.pkdl
+*/
+#include <picknik_perception/product_descriptor_library.h>
+#include <picknik_perception/mesh_sampling.h>
+
+#include <ros/package.h>
+
+#include <boost/filesystem.hpp>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "build_descriptor_library");
+  ROS_INFO_STREAM_NAMED("build_descriptor_library","Building product descriptor library");
+
+  namespace fs = boost::filesystem;
+  const std::string products_path = ros::package::getPath("picknik_main") + "/meshes/products";
+  const std::string output_file = argc > 1 ? std::string(argv[1]) :
+    ros::package::getPath("picknik_perception") + "/data/product_descriptors.pkdl";
+
+  picknik_perception::ProductDescriptorLibrary library;
+  const picknik_perception::DescriptorSettings& settings = library.getSettings();
+
+  ros::WallTime start_time = ros::WallTime::now();
+  for (fs::directory_iterator iter(products_path), end_iter; iter != end_iter; ++iter)
+  {
+    if (!fs::is_directory(iter->path()))
+      continue;
+    const std::string name = iter->path().filename().string();
+
+    picknik_perception::ProductDescriptorLibrary::Cloud::Ptr cloud(new picknik_perception::ProductDescriptorLibrary::Cloud);
+    if (!picknik_perception::loadProductModelCloud(iter->path().string(), settings.leaf_size_ / 2.0, *cloud))
+      continue;
+
+    if (library.addProduct(name, cloud))
+      ROS_INFO_STREAM_NAMED("build_descriptor_library","Computed descriptors for " << name);
+  }
+
+  ROS_INFO_STREAM_NAMED("build_descriptor_library","Computed " << library.size() << " products in "
+                        << (ros::WallTime::now() - start_time).toSec() << " seconds");
+
+  fs::create_directories(fs::path(output_file).parent_path());
+  if (!library.save(output_file))
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,413 @@
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc  : Replays recorded clouds through the perception chain of pcl_perception_server as fast as
+          possible and reports the latency of every stage. Optionally checks the resulting meshes
+          against golden results
+
+  Usage: roslaunch picknik_perception perception_benchmark.launch input_directory:=<dir>
+  Every pcd in input_directory is one frame. A subdirectory is one frame too, its pcds (one per
+  camera) are merged. Clouds must be in the world frame, as saved in data/roi_pcds
+*/
+#include <picknik_perception/simple_point_cloud_filter.h>
+#include <picknik_perception/product_perception.h>
+
+#include <ros_param_utilities/ros_param_utilities.h>
+
+#include <eigen_conversions/eigen_msg.h>
+
+#include <pcl/io/pcd_io.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+namespace picknik_perception
+{
+
+namespace fs = boost::filesystem;
+typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+enum BenchmarkStage
+{
+  STAGE_MERGE,
+  STAGE_CROP,
+  STAGE_DETECTION,
+  STAGE_LABELING,
+  STAGE_MESH,
+  STAGE_POSE,
+  NUM_STAGES
+};
+
+static const char* STAGE_NAMES[NUM_STAGES] = { "merge", "crop+background", "outlier removal", "labeling", "mesh",
+                                               "pose estimation" };
+
+/**
+ * \brief Summary of one product mesh in the bin frame, compared against golden results
+ */
+struct MeshSummary
+{
+  std::string frame_;
+  std::size_t points_;
+  std::size_t vertices_;
+  std::size_t triangles_;
+  Eigen::Vector3d min_;
+  Eigen::Vector3d max_;
+};
+
+/**
+ * \brief Recorded frame, the clouds of every camera at one instant
+ */
+struct Frame
+{
+  std::string name_;
+  std::vector<Cloud::Ptr> clouds_;
+};
+
+class PerceptionBenchmark
+{
+public:
+  PerceptionBenchmark()
+    : nh_("~")
+    , iterations_(1)
+    , write_golden_(false)
+    , golden_tolerance_(0.005)
+    , total_points_(0)
+  {
+    visual_tools_.reset(new rviz_visual_tools::RvizVisualTools("base", "/perception_benchmark/markers"));
+    filter_.reset(new SimplePointCloudFilter(visual_tools_));
+    filter_->enableRoiCloudPublishing(false);
+    filter_->enableRoiArchiving(false);
+
+    // Same background model, outlier removal, labeling, pose estimation and meshes as pcl_perception_server
+    product_perception_.reset(new ProductPerception(filter_, "perception_benchmark"));
+    if (!product_perception_->loadFromParameters(nh_))
+      ROS_WARN_STREAM_NAMED("perception_benchmark","Not every enabled part of the perception chain could be loaded");
+
+    // Load parameters
+    const std::string parent_name = "perception_benchmark"; // for namespacing logging messages
+    std::vector<double> roi_min_corner;
+    std::vector<double> roi_max_corner;
+    goal_.bin_name = "BIN_BENCHMARK";
+    ros_param_utilities::getStringParameter(parent_name, nh_, "input_directory", input_directory_);
+    ros_param_utilities::getIntParameter(parent_name, nh_, "iterations", iterations_);
+    ros_param_utilities::getDoubleParameters(parent_name, nh_, "roi_min_corner", roi_min_corner);
+    ros_param_utilities::getDoubleParameters(parent_name, nh_, "roi_max_corner", roi_max_corner);
+    ros_param_utilities::getStringParameter(parent_name, nh_, "bin_name", goal_.bin_name);
+    ros_param_utilities::getStringParameters(parent_name, nh_, "expected_objects_names", goal_.expected_objects_names);
+    ros_param_utilities::getStringParameter(parent_name, nh_, "golden_file", golden_file_);
+    ros_param_utilities::getBoolParameter(parent_name, nh_, "write_golden", write_golden_);
+    ros_param_utilities::getDoubleParameter(parent_name, nh_, "golden_tolerance", golden_tolerance_);
+
+    if (goal_.expected_objects_names.empty())
+      ROS_WARN_STREAM_NAMED("perception_benchmark","No expected_objects_names, no product meshes will be created");
+
+    // Region of interest, the whole shelf by default. Sent as the bin of a perception request
+    Eigen::Vector3d min_corner = SHELF_BOTTOM_RIGHT_FRONT;
+    Eigen::Vector3d max_corner = SHELF_TOP_LEFT_BACK;
+    if (roi_min_corner.size() == 3 && roi_max_corner.size() == 3)
+    {
+      min_corner = Eigen::Vector3d(roi_min_corner[0], roi_min_corner[1], roi_min_corner[2]);
+      max_corner = Eigen::Vector3d(roi_max_corner[0], roi_max_corner[1], roi_max_corner[2]);
+    }
+    else
+      ROS_WARN_STREAM_NAMED("perception_benchmark","No region of interest, using the whole shelf");
+
+    Eigen::Affine3d bin_centroid = Eigen::Affine3d::Identity();
+    bin_centroid.translation() = (min_corner + max_corner) / 2.0;
+    tf::poseEigenToMsg(bin_centroid, goal_.bin_centroid);
+    const Eigen::Vector3d bin_size = max_corner - min_corner;
+    goal_.bin_dimensions.type = shape_msgs::SolidPrimitive::BOX;
+    goal_.bin_dimensions.dimensions.resize(3);
+    goal_.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_X] = bin_size.x();
+    goal_.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Y] = bin_size.y();
+    goal_.bin_dimensions.dimensions[shape_msgs::SolidPrimitive::BOX_Z] = bin_size.z();
+    product_perception_->setBin(goal_);
+
+    for (std::size_t i = 0; i < NUM_STAGES; ++i)
+    {
+      stage_total_[i] = 0;
+      stage_max_[i] = 0;
+    }
+  }
+
+  /**
+   * \brief Load every frame into memory, so disk speed is not part of the benchmark
+   * \return true if at least one frame was loaded
+   */
+  bool loadFrames()
+  {
+    if (!fs::is_directory(input_directory_))
+    {
+      ROS_ERROR_STREAM_NAMED("perception_benchmark","Input directory " << input_directory_ << " does not exist");
+      return false;
+    }
+
+    std::vector<fs::path> paths;
+    std::copy(fs::directory_iterator(input_directory_), fs::directory_iterator(), std::back_inserter(paths));
+    std::sort(paths.begin(), paths.end());
+
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+      Frame frame;
+      frame.name_ = paths[i].filename().string();
+      if (fs::is_directory(paths[i]))
+      {
+        std::vector<fs::path> camera_paths;
+        std::copy(fs::directory_iterator(paths[i]), fs::directory_iterator(), std::back_inserter(camera_paths));
+        std::sort(camera_paths.begin(), camera_paths.end());
+        for (std::size_t j = 0; j < camera_paths.size(); ++j)
+          loadCloud(camera_paths[j], frame);
+      }
+      else
+        loadCloud(paths[i], frame);
+
+      if (!frame.clouds_.empty())
+        frames_.push_back(frame);
+    }
+
+    ROS_INFO_STREAM_NAMED("perception_benchmark","Loaded " << frames_.size() << " frames from " << input_directory_);
+    return !frames_.empty();
+  }
+
+  /**
+   * \brief Run every frame through the chain
+   * \return true if all golden results match
+   */
+  bool run()
+  {
+    std::vector<MeshSummary> results;
+    ros::WallTime start_time = ros::WallTime::now();
+
+    for (int iteration = 0; iteration < iterations_ && ros::ok(); ++iteration)
+    {
+      for (std::size_t i = 0; i < frames_.size() && ros::ok(); ++i)
+      {
+        // Only the first pass is compared, later passes give the same result
+        processFrame(frames_[i], iteration == 0 ? &results : NULL);
+      }
+    }
+
+    const double total_time = (ros::WallTime::now() - start_time).toSec();
+    printStatistics(total_time);
+
+    if (write_golden_)
+      return writeGolden(results);
+    if (!golden_file_.empty())
+      return checkGolden(results);
+    return true;
+  }
+
+private:
+  void loadCloud(const fs::path& path, Frame& frame)
+  {
+    if (path.extension() != ".pcd")
+      return;
+
+    Cloud::Ptr cloud(new Cloud);
+    if (pcl::io::loadPCDFile(path.string(), *cloud) != 0)
+    {
+      ROS_WARN_STREAM_NAMED("perception_benchmark","Unable to load " << path.string());
+      return;
+    }
+    frame.clouds_.push_back(cloud);
+  }
+
+  void processFrame(const Frame& frame, std::vector<MeshSummary>* results)
+  {
+    // Merge cameras
+    ros::WallTime stage_start = ros::WallTime::now();
+    Cloud::Ptr merged(new Cloud(*frame.clouds_.front()));
+    for (std::size_t i = 1; i < frame.clouds_.size(); ++i)
+      *merged += *frame.clouds_[i];
+    merged->header.frame_id = "/world";
+    stageDone(STAGE_MERGE, stage_start);
+    total_points_ += merged->size();
+
+    // Crop to the region of interest and remove the background
+    filter_->processWorldCloud(merged);
+    stageDone(STAGE_CROP, stage_start);
+
+    // Outlier removal, labeling, meshes and poses, exactly as for a perception request
+    ProductPerceptionTimes times;
+    picknik_msgs::FindObjectsResult result;
+    const bool found = product_perception_->findObjects(goal_, result, &times);
+    addStageTime(STAGE_DETECTION, times.detection_);
+    addStageTime(STAGE_LABELING, times.labeling_);
+    addStageTime(STAGE_MESH, times.mesh_);
+    addStageTime(STAGE_POSE, times.pose_);
+    if (!found)
+    {
+      ROS_WARN_STREAM_NAMED("perception_benchmark","No points left in frame " << frame.name_);
+      return;
+    }
+
+    if (!results)
+      return;
+    for (std::size_t i = 0; i < result.found_objects.size(); ++i)
+    {
+      // Meshes are relative to the product pose, compare them in the bin frame
+      const picknik_msgs::FoundObject& product = result.found_objects[i];
+      Eigen::Affine3d bin_to_product;
+      tf::poseMsgToEigen(product.object_pose.pose, bin_to_product);
+      results->push_back(summarize(frame.name_, product_perception_->product_clouds_[i]->size(),
+                                   product.bounding_mesh, bin_to_product));
+    }
+  }
+
+  /**
+   * \brief Record the time since stage_start and restart it for the next stage
+   */
+  void stageDone(BenchmarkStage stage, ros::WallTime& stage_start)
+  {
+    const ros::WallTime now = ros::WallTime::now();
+    addStageTime(stage, (now - stage_start).toSec());
+    stage_start = now;
+  }
+
+  void addStageTime(BenchmarkStage stage, double duration)
+  {
+    stage_total_[stage] += duration;
+    stage_max_[stage] = std::max(stage_max_[stage], duration);
+  }
+
+  MeshSummary summarize(const std::string& frame, std::size_t points, const shape_msgs::Mesh& mesh,
+                        const Eigen::Affine3d& bin_to_mesh) const
+  {
+    MeshSummary summary;
+    summary.frame_ = frame;
+    summary.points_ = points;
+    summary.vertices_ = mesh.vertices.size();
+    summary.triangles_ = mesh.triangles.size();
+    summary.min_ = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+    summary.max_ = -summary.min_;
+    for (std::size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+      const Eigen::Vector3d vertex = bin_to_mesh * Eigen::Vector3d(mesh.vertices[i].x, mesh.vertices[i].y,
+                                                                   mesh.vertices[i].z);
+      summary.min_ = summary.min_.cwiseMin(vertex);
+      summary.max_ = summary.max_.cwiseMax(vertex);
+    }
+    return summary;
+  }
+
+  void printStatistics(double total_time) const
+  {
+    const std::size_t num_frames = frames_.size() * iterations_;
+    std::cout << std::endl;
+    std::cout << "-------------------------------------------------------" << std::endl;
+    std::cout << "Perception benchmark: " << num_frames << " frames, " << total_points_ << " points in "
+              << total_time << " s" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (std::size_t i = 0; i < NUM_STAGES; ++i)
+    {
+      std::cout << std::setw(16) << STAGE_NAMES[i] << ": mean " << std::setw(8)
+                << stage_total_[i] / num_frames * 1000.0 << " ms, max " << std::setw(8)
+                << stage_max_[i] * 1000.0 << " ms" << std::endl;
+    }
+    std::cout << std::setw(16) << "throughput" << ": " << num_frames / total_time << " frames/s, "
+              << total_points_ / total_time << " points/s" << std::endl;
+    std::cout << "-------------------------------------------------------" << std::endl;
+  }
+
+  bool writeGolden(const std::vector<MeshSummary>& results) const
+  {
+    std::ofstream output(golden_file_.c_str());
+    if (!output)
+    {
+      ROS_ERROR_STREAM_NAMED("perception_benchmark","Unable to write " << golden_file_);
+      return false;
+    }
+
+    output << std::setprecision(9);
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      const MeshSummary& r = results[i];
+      output << r.frame_ << " " << r.points_ << " " << r.vertices_ << " " << r.triangles_ << " "
+             << r.min_.x() << " " << r.min_.y() << " " << r.min_.z() << " "
+             << r.max_.x() << " " << r.max_.y() << " " << r.max_.z() << std::endl;
+    }
+    ROS_INFO_STREAM_NAMED("perception_benchmark","Wrote " << results.size() << " golden meshes to " << golden_file_);
+    return true;
+  }
+
+  bool checkGolden(const std::vector<MeshSummary>& results) const
+  {
+    std::ifstream input(golden_file_.c_str());
+    if (!input)
+    {
+      ROS_ERROR_STREAM_NAMED("perception_benchmark","Unable to read " << golden_file_);
+      return false;
+    }
+
+    std::vector<MeshSummary> golden;
+    MeshSummary g;
+    while (input >> g.frame_ >> g.points_ >> g.vertices_ >> g.triangles_ >> g.min_.x() >> g.min_.y() >> g.min_.z()
+           >> g.max_.x() >> g.max_.y() >> g.max_.z())
+      golden.push_back(g);
+
+    if (golden.size() != results.size())
+    {
+      ROS_ERROR_STREAM_NAMED("perception_benchmark","Expected " << golden.size() << " meshes, found " << results.size());
+      return false;
+    }
+
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      const MeshSummary& r = results[i];
+      const MeshSummary& e = golden[i];
+      const double bounds_error = std::max((r.min_ - e.min_).cwiseAbs().maxCoeff(),
+                                           (r.max_ - e.max_).cwiseAbs().maxCoeff());
+      if (r.frame_ != e.frame_ || r.points_ != e.points_ || r.triangles_ != e.triangles_ ||
+          bounds_error > golden_tolerance_)
+      {
+        ROS_ERROR_STREAM_NAMED("perception_benchmark","Mesh " << i << " of frame " << r.frame_ << " differs: "
+                               << r.points_ << " points, " << r.triangles_ << " triangles, expected "
+                               << e.points_ << " points, " << e.triangles_ << " triangles, bounds off by "
+                               << bounds_error << " m");
+        ++mismatches;
+      }
+    }
+
+    if (mismatches)
+      return false;
+    ROS_INFO_STREAM_NAMED("perception_benchmark","All " << results.size() << " meshes match " << golden_file_);
+    return true;
+  }
+
+  ros::NodeHandle nh_;
+  rviz_visual_tools::RvizVisualToolsPtr visual_tools_;
+  SimplePointCloudFilterPtr filter_;
+  ProductPerceptionPtr product_perception_;
+
+  std::vector<Frame> frames_;
+
+  // Settings
+  std::string input_directory_;
+  int iterations_;
+  picknik_msgs::FindObjectsGoal goal_; // the region of interest and products of every frame
+  std::string golden_file_;
+  bool write_golden_;
+  double golden_tolerance_;
+
+  // Statistics
+  double stage_total_[NUM_STAGES];
+  double stage_max_[NUM_STAGES];
+  std::size_t total_points_;
+}; // end class PerceptionBenchmark
+
+} // end namespace picknik_perception
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "perception_benchmark");
+
+  picknik_perception::PerceptionBenchmark benchmark;
+  if (!benchmark.loadFrames())
+    return 1;
+
+  return benchmark.run() ? 0 : 1;
+}